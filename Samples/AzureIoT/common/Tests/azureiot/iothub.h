@@ -0,0 +1,10 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure IoT C SDK iothub.h when the sample is built on a Linux PC. The headers in
+// this directory declare the subset of the SDK which azure_iot.c uses; cloud_test.c implements it
+// as a stub IoT Hub client.
+
+#pragma once
+
+#include "iothub_device_client_ll.h"
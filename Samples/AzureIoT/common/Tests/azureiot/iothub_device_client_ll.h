@@ -0,0 +1,102 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure IoT C SDK iothub_device_client_ll.h when the sample is built on a Linux
+// PC.
+
+#pragma once
+
+#include <stddef.h>
+
+#include "iothub_message.h"
+
+typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *IOTHUB_DEVICE_CLIENT_LL_HANDLE;
+
+typedef enum {
+    IOTHUB_CLIENT_OK,
+    IOTHUB_CLIENT_INVALID_ARG,
+    IOTHUB_CLIENT_ERROR
+} IOTHUB_CLIENT_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR
+} IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED
+} IOTHUB_CLIENT_CONNECTION_STATUS;
+
+#define IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES                                              \
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN, IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,          \
+        IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL, IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,           \
+        IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,         \
+        IOTHUB_CLIENT_CONNECTION_OK
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES
+} IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+// The SDK generates a function which returns the name of each value.
+#define MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(enumName, ...)                                      \
+    static const char *enumName##Strings(enumName value)                                           \
+    {                                                                                              \
+        return #enumName;                                                                          \
+    }
+
+typedef enum {
+    IOTHUB_CLIENT_SEND_STATUS_IDLE,
+    IOTHUB_CLIENT_SEND_STATUS_BUSY
+} IOTHUB_CLIENT_STATUS;
+
+typedef enum { DEVICE_TWIN_UPDATE_COMPLETE, DEVICE_TWIN_UPDATE_PARTIAL } DEVICE_TWIN_UPDATE_STATE;
+
+typedef enum {
+    IOTHUBMESSAGE_ACCEPTED,
+    IOTHUBMESSAGE_REJECTED,
+    IOTHUBMESSAGE_ABANDONED
+} IOTHUBMESSAGE_DISPOSITION_RESULT;
+
+typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result,
+                                                          void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(
+    IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+    void *userContextCallback);
+typedef IOTHUBMESSAGE_DISPOSITION_RESULT (*IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)(
+    IOTHUB_MESSAGE_HANDLE message, void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(DEVICE_TWIN_UPDATE_STATE updateState,
+                                                   const unsigned char *payLoad, size_t size,
+                                                   void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_REPORTED_STATE_CALLBACK)(int status_code, void *userContextCallback);
+typedef int (*IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC)(const char *method_name,
+                                                          const unsigned char *payload, size_t size,
+                                                          unsigned char **response,
+                                                          size_t *response_size,
+                                                          void *userContextCallback);
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle);
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetSendStatus(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, const unsigned char *reportedState,
+    size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetMessageCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void *userContextCallback);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback, void *userContextCallback);
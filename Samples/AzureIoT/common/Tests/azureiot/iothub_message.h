@@ -0,0 +1,20 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure IoT C SDK iothub_message.h when the sample is built on a Linux PC.
+
+#pragma once
+
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+typedef enum {
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR
+} IOTHUB_MESSAGE_RESULT;
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value);
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
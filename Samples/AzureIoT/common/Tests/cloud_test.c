@@ -0,0 +1,418 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for cloud.c, azure_iot.c and telemetry_queue.c together, which run on a Linux PC. This
+// file implements a stub IoT Hub client in place of the Azure IoT C SDK, and a stub connection in
+// place of connection_iot_hub.c: when the network is up, the connection completes at once, the
+// client authenticates on its first DoWork, and each telemetry message which the client is given
+// is recorded. The timers run on the epoll event loop in eventloop_epoll.c, and the mutable
+// storage file is an ordinary file.
+//
+// Each run of the application is a child process, so that its RAM is lost when it exits, as when
+// the application restarts; only the mutable file is kept between runs.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/networking.h>
+#include <applibs/storage.h>
+
+#include "iothub.h"
+#include "iothub_message.h"
+
+#include "cloud.h"
+#include "connection.h"
+#include "parson.h"
+
+#define MAX_HUB_MESSAGES 16
+#define MAX_HUB_MESSAGE_SIZE 1024
+
+static const char storagePath[] = "cloud_test.bin";
+
+// The time of the first reading in each test: 2026-01-01T00:00:00Z.
+static const time_t firstReadingTime = 1767225600;
+
+static EventLoop *eventLoop = NULL;
+
+// State of the stub network, connection and IoT Hub client.
+static bool networkReady = false;
+static Connection_StatusCallbackType connectionStatusCallback = NULL;
+static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK clientStatusCallback = NULL;
+static void *clientStatusContext = NULL;
+static bool clientAuthenticated = false;
+
+// A message which has been passed to the stub IoT Hub client.
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    char text[MAX_HUB_MESSAGE_SIZE];
+    char creationTime[32];
+};
+
+static struct IOTHUB_MESSAGE_HANDLE_DATA_TAG hubMessages[MAX_HUB_MESSAGES];
+static size_t hubMessageCount = 0;
+
+// Confirmation callbacks for the messages which have been sent, but not yet confirmed.
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK pendingCallbacks[MAX_HUB_MESSAGES];
+static void *pendingContexts[MAX_HUB_MESSAGES];
+static size_t pendingCount = 0;
+
+// A non-NULL handle for the stub client.
+static struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *const clientHandle =
+    (struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *)&clientAuthenticated;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Storage_OpenMutableFile(void)
+{
+    return open(storagePath, O_RDWR | O_CREAT, 0600);
+}
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady)
+{
+    *outIsNetworkingReady = networkReady;
+    return 0;
+}
+
+ExitCode Connection_Initialise(EventLoop *el, Connection_StatusCallbackType statusCallBack,
+                               ExitCode_CallbackType failureCallback, const char *modelId,
+                               void *context)
+{
+    connectionStatusCallback = statusCallBack;
+    return ExitCode_Success;
+}
+
+void Connection_Start(void)
+{
+    connectionStatusCallback(Connection_Complete, clientHandle);
+}
+
+void Connection_Cleanup(void) {}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+    IOTHUB_MESSAGE_HANDLE message = calloc(1, sizeof(*message));
+    if (message != NULL) {
+        snprintf(message->text, sizeof(message->text), "%s", source);
+    }
+    return message;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value)
+{
+    if (strcmp(key, "iothub-creation-time-utc") == 0) {
+        snprintf(iotHubMessageHandle->creationTime, sizeof(iotHubMessageHandle->creationTime),
+                 "%s", value);
+    }
+    return IOTHUB_MESSAGE_OK;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    free(iotHubMessageHandle);
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle) {}
+
+// Authenticate on the first call, and confirm every message which has been sent.
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    if (!clientAuthenticated && clientStatusCallback != NULL) {
+        clientAuthenticated = true;
+        clientStatusCallback(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK,
+                             clientStatusContext);
+    }
+
+    size_t count = pendingCount;
+    pendingCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        pendingCallbacks[i](IOTHUB_CLIENT_CONFIRMATION_OK, pendingContexts[i]);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetSendStatus(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
+{
+    *iotHubClientStatus =
+        pendingCount > 0 ? IOTHUB_CLIENT_SEND_STATUS_BUSY : IOTHUB_CLIENT_SEND_STATUS_IDLE;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void *userContextCallback)
+{
+    if (!clientAuthenticated || hubMessageCount == MAX_HUB_MESSAGES) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // The SDK copies the message, so the caller can destroy it straight away.
+    hubMessages[hubMessageCount++] = *eventMessageHandle;
+    pendingCallbacks[pendingCount] = eventConfirmationCallback;
+    pendingContexts[pendingCount] = userContextCallback;
+    ++pendingCount;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, const unsigned char *reportedState,
+    size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback)
+{
+    // The tests do not report device twin state.
+    return IOTHUB_CLIENT_ERROR;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void *userContextCallback)
+{
+    clientStatusCallback = connectionStatusCallback;
+    clientStatusContext = userContextCallback;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetMessageCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+static void FailureCallback(ExitCode exitCode)
+{
+    Fail("FailureCallback", "application failed", exitCode);
+}
+
+static void StartCloud(void)
+{
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL || Cloud_Initialize(eventLoop, NULL, FailureCallback, NULL, NULL, NULL) !=
+                                 ExitCode_Success) {
+        printf("FAIL: could not initialize cloud\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void StopCloud(void)
+{
+    Cloud_Cleanup();
+    EventLoop_Close(eventLoop);
+    eventLoop = NULL;
+}
+
+// Run the event loop until the hub has received the given number of messages, or until the
+// timeout, in milliseconds, has passed.
+static void RunUntilReceived(size_t count, int timeout)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (hubMessageCount >= count || elapsed >= timeout) {
+            return;
+        }
+        EventLoop_Run(eventLoop, 10, false);
+    }
+}
+
+// Run the application once, in a child process. Returns false if the run failed.
+static bool RunApplication(const char *test, void (*run)(const char *test))
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        failures = 0;
+        run(test);
+        fflush(stdout);
+        _exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+        Fail(test, "run failed", (long)pid);
+        return false;
+    }
+    return true;
+}
+
+static void GetTimestamp(int reading, char *buffer, size_t size)
+{
+    time_t t = firstReadingTime + reading * 10;
+    strftime(buffer, size, "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+}
+
+// Send three readings to be batched while the network is down, and exit before the batch is
+// full or its maximum delay has passed.
+static void RunOfflineWithBatch(const char *test)
+{
+    networkReady = false;
+    StartCloud();
+    Cloud_SetTelemetryBatching(10, 60);
+    for (int i = 0; i < 3; ++i) {
+        Cloud_Telemetry telemetry = {.temperature = 20.5f + (float)i};
+        if (Cloud_SendTelemetry(&telemetry, firstReadingTime + i * 10) != Cloud_Result_OK) {
+            Fail(test, "could not send telemetry", i);
+        }
+    }
+
+    RunUntilReceived(1, 100);
+    if (hubMessageCount != 0) {
+        Fail(test, "message sent while offline", (long)hubMessageCount);
+    }
+    StopCloud();
+}
+
+// Start with the network up, and check that the batch from the previous run is sent as one
+// message, which holds each reading with its timestamp.
+static void RunOnlineAfterBatch(const char *test)
+{
+    networkReady = true;
+    StartCloud();
+    RunUntilReceived(1, 5000);
+
+    if (hubMessageCount != 1) {
+        Fail(test, "wrong number of messages received", (long)hubMessageCount);
+        StopCloud();
+        return;
+    }
+
+    char timestamp[32];
+    GetTimestamp(0, timestamp, sizeof(timestamp));
+    if (strcmp(hubMessages[0].creationTime, timestamp) != 0) {
+        Fail(test, "wrong creation time", 0);
+    }
+
+    JSON_Value *value = json_parse_string(hubMessages[0].text);
+    JSON_Array *readings = json_value_get_array(value);
+    if (readings == NULL || json_array_get_count(readings) != 3) {
+        Fail(test, "message is not an array of three readings", 0);
+    } else {
+        for (int i = 0; i < 3; ++i) {
+            JSON_Object *reading = json_array_get_object(readings, (size_t)i);
+            GetTimestamp(i, timestamp, sizeof(timestamp));
+            const char *readingTimestamp = json_object_get_string(reading, "timestamp");
+            if (json_object_get_number(reading, "temperature") != 20.5 + i ||
+                readingTimestamp == NULL || strcmp(readingTimestamp, timestamp) != 0) {
+                Fail(test, "wrong reading", i);
+            }
+        }
+    }
+    json_value_free(value);
+    StopCloud();
+}
+
+// Send three readings without batching while the network is down, and exit.
+static void RunOfflineWithoutBatch(const char *test)
+{
+    networkReady = false;
+    StartCloud();
+    for (int i = 0; i < 3; ++i) {
+        Cloud_Telemetry telemetry = {.temperature = 20.5f + (float)i};
+        if (Cloud_SendTelemetry(&telemetry, firstReadingTime + i * 10) != Cloud_Result_OK) {
+            Fail(test, "could not send telemetry", i);
+        }
+    }
+    StopCloud();
+}
+
+// Start with the network up, and check that the readings from the previous run are sent in order.
+static void RunOnlineAfterReadings(const char *test)
+{
+    networkReady = true;
+    StartCloud();
+    RunUntilReceived(3, 5000);
+
+    if (hubMessageCount != 3) {
+        Fail(test, "wrong number of messages received", (long)hubMessageCount);
+    }
+    for (size_t i = 0; i < hubMessageCount && i < 3; ++i) {
+        char timestamp[32];
+        GetTimestamp((int)i, timestamp, sizeof(timestamp));
+        JSON_Value *value = json_parse_string(hubMessages[i].text);
+        if (json_object_get_number(json_value_get_object(value), "temperature") != 20.5 + i ||
+            strcmp(hubMessages[i].creationTime, timestamp) != 0) {
+            Fail(test, "wrong message", (long)i);
+        }
+        json_value_free(value);
+    }
+    StopCloud();
+}
+
+// A batch of readings collected while offline is flushed when the application exits, and must
+// reach mutable storage so that the next run sends it.
+static void TestOfflineBatchKeptAtExit(void)
+{
+    const char *test = "TestOfflineBatchKeptAtExit";
+
+    unlink(storagePath);
+    if (RunApplication(test, RunOfflineWithBatch)) {
+        RunApplication(test, RunOnlineAfterBatch);
+    }
+}
+
+// Readings queued while offline, which are still in RAM when the application exits, are sent by
+// the next run.
+static void TestOfflineReadingsKeptAtExit(void)
+{
+    const char *test = "TestOfflineReadingsKeptAtExit";
+
+    unlink(storagePath);
+    if (RunApplication(test, RunOfflineWithoutBatch)) {
+        RunApplication(test, RunOnlineAfterReadings);
+    }
+}
+
+int main(void)
+{
+    TestOfflineBatchKeptAtExit();
+    TestOfflineReadingsKeptAtExit();
+
+    unlink(storagePath);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
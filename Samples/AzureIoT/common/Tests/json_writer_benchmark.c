@@ -0,0 +1,348 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Benchmark and test for json_writer.c against parson, which run on a Linux PC. For each payload
+// which cloud.c and log_azure.c send, the benchmark builds the payload with JsonWriter, and with
+// parson as those files did before they used JsonWriter: build a tree of values, serialize it to
+// a string, and free both. It checks that the two produce the same text, and reports the time and
+// the number of heap allocations which each takes. Random strings and numbers are also checked
+// against parson, so that JsonWriter escapes and formats them identically.
+//
+// malloc and free are wrapped at link time (-Wl,--wrap), so every allocation which parson makes
+// is counted, with its size.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_writer.h"
+#include "parson.h"
+
+#define BUFFER_SIZE 2048
+#define ITERATIONS 100000
+#define RANDOM_CASES 10000
+#define BATCH_READINGS 10
+
+// Heap allocations made while counting is true.
+static bool counting = false;
+static unsigned long allocations = 0;
+static size_t heapBytes = 0;
+static size_t peakHeapBytes = 0;
+
+static char writerBuffer[BUFFER_SIZE];
+
+// The string and number which the random cases use.
+static char randomString[64];
+static double randomNumber;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    if (counting && ptr != NULL) {
+        ++allocations;
+        heapBytes += malloc_usable_size(ptr);
+        if (heapBytes > peakHeapBytes) {
+            peakHeapBytes = heapBytes;
+        }
+    }
+    return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (counting && ptr != NULL) {
+        heapBytes -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+// Each payload is built by a function which uses JsonWriter, and a function which builds the
+// same parson tree.
+typedef struct {
+    const char *name;
+    bool (*write)(JsonWriter *writer);
+    JSON_Value *(*build)(void);
+} Payload;
+
+// cloud.c: Cloud_SendTelemetry.
+static bool WriteTelemetry(JsonWriter *writer)
+{
+    JsonWriter_BeginObject(writer, NULL);
+    JsonWriter_AppendNumber(writer, "temperature", 21.5f);
+    return JsonWriter_EndObject(writer);
+}
+
+static JSON_Value *BuildTelemetry(void)
+{
+    JSON_Value *value = json_value_init_object();
+    json_object_dotset_number(json_value_get_object(value), "temperature", 21.5f);
+    return value;
+}
+
+// cloud.c: FlushTelemetryBatch, with a batch of readings.
+static bool WriteTelemetryBatch(JsonWriter *writer)
+{
+    char timestamp[32];
+    JsonWriter_BeginArray(writer, NULL);
+    for (int i = 0; i < BATCH_READINGS; ++i) {
+        snprintf(timestamp, sizeof(timestamp), "2026-01-01T00:00:%02dZ", i);
+        JsonWriter_BeginObject(writer, NULL);
+        JsonWriter_AppendNumber(writer, "temperature", 20.0f + 0.1f * (float)i);
+        JsonWriter_AppendString(writer, "timestamp", timestamp);
+        JsonWriter_EndObject(writer);
+    }
+    return JsonWriter_EndArray(writer);
+}
+
+static JSON_Value *BuildTelemetryBatch(void)
+{
+    char timestamp[32];
+    JSON_Value *value = json_value_init_array();
+    for (int i = 0; i < BATCH_READINGS; ++i) {
+        snprintf(timestamp, sizeof(timestamp), "2026-01-01T00:00:%02dZ", i);
+        JSON_Value *reading = json_value_init_object();
+        json_object_set_number(json_value_get_object(reading), "temperature",
+                               20.0f + 0.1f * (float)i);
+        json_object_set_string(json_value_get_object(reading), "timestamp", timestamp);
+        json_array_append_value(json_value_get_array(value), reading);
+    }
+    return value;
+}
+
+// cloud.c: Cloud_SendThermometerTelemetryUploadEnabledChangedEvent.
+static bool WriteUploadEnabled(JsonWriter *writer)
+{
+    JsonWriter_BeginObject(writer, NULL);
+    JsonWriter_BeginObject(writer, "thermometerTelemetryUploadEnabled");
+    JsonWriter_AppendBool(writer, "value", true);
+    JsonWriter_AppendNumber(writer, "ac", 200);
+    JsonWriter_AppendNumber(writer, "av", 12);
+    JsonWriter_AppendString(writer, "ad", "Updated from Device Twin's desired value.");
+    JsonWriter_EndObject(writer);
+    return JsonWriter_EndObject(writer);
+}
+
+static JSON_Value *BuildUploadEnabled(void)
+{
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *root = json_value_get_object(value);
+    json_object_dotset_boolean(root, "thermometerTelemetryUploadEnabled.value", true);
+    json_object_dotset_number(root, "thermometerTelemetryUploadEnabled.ac", 200);
+    json_object_dotset_number(root, "thermometerTelemetryUploadEnabled.av", 12);
+    json_object_dotset_string(root, "thermometerTelemetryUploadEnabled.ad",
+                              "Updated from Device Twin's desired value.");
+    return value;
+}
+
+// cloud.c: Cloud_SendDeviceDetails.
+static bool WriteDeviceDetails(JsonWriter *writer)
+{
+    JsonWriter_BeginObject(writer, NULL);
+    JsonWriter_AppendString(writer, "serialNumber", "TEMPMON-01234");
+    return JsonWriter_EndObject(writer);
+}
+
+static JSON_Value *BuildDeviceDetails(void)
+{
+    JSON_Value *value = json_value_init_object();
+    json_object_dotset_string(json_value_get_object(value), "serialNumber", "TEMPMON-01234");
+    return value;
+}
+
+// log_azure.c: a batch of log records, which contains line breaks and slashes.
+static const char logBatch[] =
+    "[INFO] OS Version: 23.05\n[INFO] Network interface status:\n\twlan0: 192.168.1.10/24\n"
+    "[WARNING] 2 log records were dropped.\n[ERROR] read /mnt/config failed: \"busy\"";
+
+static bool WriteLogBatch(JsonWriter *writer)
+{
+    JsonWriter_BeginObject(writer, NULL);
+    JsonWriter_AppendString(writer, "debugMessage", logBatch);
+    return JsonWriter_EndObject(writer);
+}
+
+static JSON_Value *BuildLogBatch(void)
+{
+    JSON_Value *value = json_value_init_object();
+    json_object_dotset_string(json_value_get_object(value), "debugMessage", logBatch);
+    return value;
+}
+
+// A random string and number.
+static bool WriteRandom(JsonWriter *writer)
+{
+    JsonWriter_BeginObject(writer, NULL);
+    JsonWriter_AppendString(writer, "s", randomString);
+    JsonWriter_AppendNumber(writer, "n", randomNumber);
+    return JsonWriter_EndObject(writer);
+}
+
+static JSON_Value *BuildRandom(void)
+{
+    JSON_Value *value = json_value_init_object();
+    json_object_set_string(json_value_get_object(value), "s", randomString);
+    json_object_set_number(json_value_get_object(value), "n", randomNumber);
+    return value;
+}
+
+static const Payload payloads[] = {
+    {"telemetry", WriteTelemetry, BuildTelemetry},
+    {"telemetry batch", WriteTelemetryBatch, BuildTelemetryBatch},
+    {"upload enabled", WriteUploadEnabled, BuildUploadEnabled},
+    {"device details", WriteDeviceDetails, BuildDeviceDetails},
+    {"log batch", WriteLogBatch, BuildLogBatch},
+};
+
+static const char *Write(const Payload *payload)
+{
+    JsonWriter writer;
+    JsonWriter_Init(&writer, writerBuffer, sizeof(writerBuffer));
+    payload->write(&writer);
+    return JsonWriter_GetString(&writer);
+}
+
+// Checks that JsonWriter writes the same text as parson serializes.
+static void CheckSameAsParson(const char *test, const Payload *payload, long detail)
+{
+    const char *written = Write(payload);
+    JSON_Value *value = payload->build();
+    char *serialized = json_serialize_to_string(value);
+
+    if (written == NULL || serialized == NULL || strcmp(written, serialized) != 0) {
+        Fail(test, payload->name, detail);
+        printf("  JsonWriter: %s\n  parson:     %s\n", written ? written : "(null)",
+               serialized ? serialized : "(null)");
+    }
+
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+}
+
+static long GetNowNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Each payload which the application sends is the same as parson's.
+static void TestPayloads(void)
+{
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); ++i) {
+        CheckSameAsParson("TestPayloads", &payloads[i], (long)i);
+    }
+}
+
+// Random strings, which contain every ASCII character, including control characters, quotes,
+// backslashes and slashes, and some UTF-8, and random numbers, are the same as parson's.
+static void TestRandomValues(void)
+{
+    static const Payload random = {"random", WriteRandom, BuildRandom};
+    static const char *const utf8[] = {"\xc2\xb0", "\xe2\x82\xac", "\xf0\x9f\x8c\xa1"};
+
+    srand(1);
+    for (int i = 0; i < RANDOM_CASES; ++i) {
+        size_t length = 0;
+        size_t target = (size_t)(rand() % 32);
+        while (length < target) {
+            if (rand() % 8 == 0) {
+                const char *c = utf8[rand() % 3];
+                memcpy(&randomString[length], c, strlen(c));
+                length += strlen(c);
+            } else {
+                randomString[length++] = (char)(1 + rand() % 127);
+            }
+        }
+        randomString[length] = '\0';
+
+        switch (rand() % 3) {
+        case 0:
+            randomNumber = (double)(rand() % 2001 - 1000);
+            break;
+        case 1:
+            randomNumber = (float)rand() / (float)RAND_MAX * 100.0f - 50.0f;
+            break;
+        default:
+            randomNumber = ((double)rand() - RAND_MAX / 2) * 1e-9 * (double)rand();
+            break;
+        }
+
+        CheckSameAsParson("TestRandomValues", &random, i);
+    }
+}
+
+// Report the time and heap allocations which each payload takes, and check that JsonWriter
+// makes no allocations.
+static void BenchmarkPayloads(void)
+{
+    printf("%-16s %14s %14s %16s %16s\n", "payload", "writer ns", "parson ns",
+           "parson allocs", "parson peak B");
+
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); ++i) {
+        const Payload *payload = &payloads[i];
+
+        allocations = 0;
+        counting = true;
+        long start = GetNowNanoseconds();
+        for (int j = 0; j < ITERATIONS; ++j) {
+            if (Write(payload) == NULL) {
+                Fail("BenchmarkPayloads", "could not write payload", (long)i);
+                break;
+            }
+        }
+        long writerNs = (GetNowNanoseconds() - start) / ITERATIONS;
+        counting = false;
+        if (allocations != 0) {
+            Fail("BenchmarkPayloads", "JsonWriter allocated memory", (long)allocations);
+        }
+
+        allocations = 0;
+        heapBytes = 0;
+        peakHeapBytes = 0;
+        counting = true;
+        start = GetNowNanoseconds();
+        for (int j = 0; j < ITERATIONS; ++j) {
+            JSON_Value *value = payload->build();
+            char *serialized = json_serialize_to_string(value);
+            json_free_serialized_string(serialized);
+            json_value_free(value);
+        }
+        long parsonNs = (GetNowNanoseconds() - start) / ITERATIONS;
+        counting = false;
+
+        printf("%-16s %14ld %14ld %16lu %16zu\n", payload->name, writerNs, parsonNs,
+               allocations / ITERATIONS, peakHeapBytes);
+    }
+}
+
+int main(void)
+{
+    TestPayloads();
+    TestRandomValues();
+    BenchmarkPayloads();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for telemetry_queue.c, which run on a Linux PC against an ordinary file in place of the
+// mutable storage file. The drain timer runs on the epoll event loop in eventloop_epoll.c.
+//
+// Each test queues messages in a child process, which cleans up the queue as the application does
+// when it exits. The test then initializes the queue again, as the next run of the application
+// would, and checks which messages are replayed, and in which order.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include <applibs/storage.h>
+
+#include "eventloop_timer_utilities.h"
+#include "telemetry_queue.h"
+
+// As in telemetry_queue.c.
+#define RAM_QUEUE_CAPACITY 8
+#define STORAGE_QUEUE_CAPACITY 24
+
+#define MAX_MESSAGES 64
+
+static const char storagePath[] = "telemetry_queue_test.bin";
+
+// If true, Storage_OpenMutableFile fails, as it does if the application has no mutable storage.
+static bool storageUnavailable = false;
+
+static EventLoop *eventLoop = NULL;
+
+// The messages which the send callback has accepted.
+static char replayedMessages[MAX_MESSAGES][TELEMETRY_QUEUE_MAX_MESSAGE_SIZE];
+static char replayedTimestamps[MAX_MESSAGES][TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE];
+static size_t replayedCount = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Storage_OpenMutableFile(void)
+{
+    if (storageUnavailable) {
+        return -1;
+    }
+    return open(storagePath, O_RDWR | O_CREAT, 0600);
+}
+
+static void FailureCallback(ExitCode exitCode)
+{
+    Fail("FailureCallback", "queue failed", exitCode);
+}
+
+static bool SendCallback(const char *jsonMessage, const char *iso8601DateTimeString, void *context)
+{
+    if (replayedCount == MAX_MESSAGES) {
+        return false;
+    }
+    strcpy(replayedMessages[replayedCount], jsonMessage);
+    strcpy(replayedTimestamps[replayedCount],
+           iso8601DateTimeString != NULL ? iso8601DateTimeString : "");
+    ++replayedCount;
+    return true;
+}
+
+static void Enqueue(const char *test, int id)
+{
+    char message[64];
+    char timestamp[TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE];
+    snprintf(message, sizeof(message), "{\"id\":%d}", id);
+    snprintf(timestamp, sizeof(timestamp), "2026-01-01T00:00:%02dZ", id % 60);
+    if (!TelemetryQueue_Enqueue(message, timestamp, NULL)) {
+        Fail(test, "could not queue message", id);
+    }
+}
+
+static void Initialize(void)
+{
+    if (TelemetryQueue_Initialize(eventLoop, FailureCallback, SendCallback, 1, 4) !=
+        ExitCode_Success) {
+        printf("FAIL: could not initialize telemetry queue\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Run the application once, in a child process: queue the messages with IDs from 1 to messages,
+// and exit. The child's event loop is separate,
+// and its RAM is lost when it exits, as when the application restarts.
+static void RunFirstRun(const char *test, int messages)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        failures = 0;
+        eventLoop = EventLoop_Create();
+        Initialize();
+
+        TelemetryQueue_Counters before;
+        TelemetryQueue_GetCounters(&before);
+        for (int id = 1; id <= messages; ++id) {
+            Enqueue(test, id);
+        }
+        TelemetryQueue_Cleanup();
+
+        // Without mutable storage, the messages in RAM are counted as dropped.
+        TelemetryQueue_Counters after;
+        TelemetryQueue_GetCounters(&after);
+        if (storageUnavailable && after.dropped - before.dropped != (unsigned int)messages) {
+            Fail(test, "wrong number of messages dropped", (long)(after.dropped - before.dropped));
+        }
+        EventLoop_Close(eventLoop);
+        fflush(stdout);
+        _exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+        Fail(test, "first run failed", (long)pid);
+    }
+}
+
+// Start the second run of the application, which picks up the queue from the mutable file.
+static void StartSecondRun(void)
+{
+    storageUnavailable = false;
+    replayedCount = 0;
+    eventLoop = EventLoop_Create();
+    Initialize();
+}
+
+static void StopSecondRun(void)
+{
+    TelemetryQueue_Cleanup();
+    EventLoop_Close(eventLoop);
+    eventLoop = NULL;
+}
+
+// Let the queue replay every message it holds.
+static void Drain(void)
+{
+    TelemetryQueue_SetDrainEnabled(true);
+    for (int i = 0; i < 1000 && TelemetryQueue_GetLength() > 0; ++i) {
+        EventLoop_Run(eventLoop, 10, false);
+    }
+    TelemetryQueue_SetDrainEnabled(false);
+}
+
+// Check that the messages with IDs from first to last were replayed, in order, with their
+// timestamps.
+static void CheckReplayed(const char *test, int first, int last)
+{
+    if (replayedCount != (size_t)(last - first + 1)) {
+        Fail(test, "wrong number of messages replayed", (long)replayedCount);
+        return;
+    }
+
+    for (int id = first; id <= last; ++id) {
+        char message[64];
+        char timestamp[TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE];
+        snprintf(message, sizeof(message), "{\"id\":%d}", id);
+        snprintf(timestamp, sizeof(timestamp), "2026-01-01T00:00:%02dZ", id % 60);
+        if (strcmp(replayedMessages[id - first], message) != 0 ||
+            strcmp(replayedTimestamps[id - first], timestamp) != 0) {
+            Fail(test, "wrong message replayed", id);
+            return;
+        }
+    }
+}
+
+// Messages which are still in the RAM ring when the application exits are replayed by the next
+// run.
+static void TestCleanupKeepsRamMessages(void)
+{
+    const char *test = "TestCleanupKeepsRamMessages";
+    const int messages = RAM_QUEUE_CAPACITY - 3;
+
+    unlink(storagePath);
+    RunFirstRun(test, messages);
+
+    StartSecondRun();
+    if (TelemetryQueue_GetLength() != (size_t)messages) {
+        Fail(test, "wrong number of messages kept", (long)TelemetryQueue_GetLength());
+    }
+    Drain();
+    CheckReplayed(test, 1, messages);
+    StopSecondRun();
+}
+
+// When some messages have already been spilled, the messages in RAM are kept after them.
+static void TestCleanupAfterSpill(void)
+{
+    const char *test = "TestCleanupAfterSpill";
+    const int messages = RAM_QUEUE_CAPACITY + 12;
+
+    unlink(storagePath);
+    RunFirstRun(test, messages);
+
+    StartSecondRun();
+    Drain();
+    CheckReplayed(test, 1, messages);
+    StopSecondRun();
+
+    // The queue is empty once it has been replayed, so nothing is replayed again.
+    StartSecondRun();
+    if (TelemetryQueue_GetLength() != 0) {
+        Fail(test, "replayed messages were kept", (long)TelemetryQueue_GetLength());
+    }
+    StopSecondRun();
+}
+
+// When there is more in the queue than mutable storage can hold, the newest messages are kept.
+static void TestCleanupWhenStorageFull(void)
+{
+    const char *test = "TestCleanupWhenStorageFull";
+    const int messages = RAM_QUEUE_CAPACITY + STORAGE_QUEUE_CAPACITY + 10;
+
+    unlink(storagePath);
+    RunFirstRun(test, messages);
+
+    StartSecondRun();
+    Drain();
+    CheckReplayed(test, messages - STORAGE_QUEUE_CAPACITY + 1, messages);
+    StopSecondRun();
+}
+
+// Without mutable storage, messages in RAM are counted as dropped when the queue is cleaned up,
+// and a later run which has mutable storage finds nothing to replay.
+static void TestCleanupWithoutStorage(void)
+{
+    const char *test = "TestCleanupWithoutStorage";
+
+    unlink(storagePath);
+    storageUnavailable = true;
+    RunFirstRun(test, RAM_QUEUE_CAPACITY - 1);
+
+    StartSecondRun();
+    if (TelemetryQueue_GetLength() != 0) {
+        Fail(test, "messages were kept", (long)TelemetryQueue_GetLength());
+    }
+    StopSecondRun();
+}
+
+int main(void)
+{
+    TestCleanupKeepsRamMessages();
+    TestCleanupAfterSpill();
+    TestCleanupWhenStorageFull();
+    TestCleanupWithoutStorage();
+
+    unlink(storagePath);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,11 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 
 #include <applibs/eventloop.h>
 #include <applibs/log.h>
@@ -15,6 +18,7 @@
 #include "eventloop_timer_utilities.h"
 #include "exitcodes.h"
 #include "connection.h"
+#include "telemetry_queue.h"
 
 static void AzureIoTConnectTimerEventHandler(EventLoopTimer *timer);
 static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer);
@@ -23,9 +27,11 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
                                      IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
                                      void *userContextCallback);
 static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context);
+static void SendEventUntrackedCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context);
 static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
                                size_t payloadSize, void *userContextCallback);
 static void ReportedStateCallback(int result, void *context);
+static void ReportedStateUntrackedCallback(int result, void *context);
 static int DeviceMethodCallback(const char *methodName, const unsigned char *payload,
                                 size_t payloadSize, unsigned char **response, size_t *responseSize,
                                 void *userContextCallback);
@@ -35,6 +41,12 @@ static IOTHUBMESSAGE_DISPOSITION_RESULT CloudToDeviceCallback(IOTHUB_MESSAGE_HAN
 static void ConnectionCallbackHandler(Connection_Status status,
                                       IOTHUB_DEVICE_CLIENT_LL_HANDLE clientHandle);
 static bool IsConnectionReadyToSendTelemetry(void);
+static void ScheduleDoWork(int delayMilliseconds);
+static void RequestDoWork(void);
+static AzureIoT_Result SendTelemetryMessage(const char *jsonMessage,
+                                            const char *iso8601DateTimeString, void *context);
+static bool SendQueuedTelemetryCallback(const char *jsonMessage,
+                                        const char *iso8601DateTimeString, void *context);
 
 /// <summary>
 /// Authentication state of the client with respect to the Azure IoT Hub.
@@ -57,13 +69,24 @@ static const int AzureIoTDefaultConnectPeriodSeconds =
     1; // check if device is connected to the internet and Azure client is setup every second
 static const int AzureIoTMinReconnectPeriodSeconds = 10;      // back off when reconnecting
 static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60; // back off limit
-static const int AzureIoTDoWorkIntervalMilliseconds =
-    100; // Call IoTHubDeviceClient_LL_DoWork() every 100 ms
+// IoTHubDeviceClient_LL_DoWork() is called every AzureIoTDoWorkMinIntervalMilliseconds while
+// requests are outstanding. Once the client is idle, the interval doubles on each call up to
+// AzureIoTDoWorkMaxIntervalMilliseconds, which bounds the latency of incoming device twin
+// updates, direct methods and cloud-to-device messages. Enqueuing a send or device twin report
+// runs DoWork straight away.
+static const int AzureIoTDoWorkMinIntervalMilliseconds = 100;
+static const int AzureIoTDoWorkMaxIntervalMilliseconds = 1600;
 static const int NanosecondsPerMillisecond = 1000000;
+static const int MillisecondsPerSecond = 1000;
+// Rate at which telemetry queued while offline is replayed once the connection is restored. This
+// is paced so that the backlog does not flood IoTHubDeviceClient_LL_DoWork().
+static const unsigned int TelemetryQueueDrainIntervalMilliseconds = 500;
+static const unsigned int TelemetryQueueMessagesPerDrainInterval = 2;
 static int azureIoTConnectPeriodSeconds = -1;
 static bool azureIoTInitialized = false;
 static EventLoopTimer *azureIoTConnectionTimer = NULL;
 static EventLoopTimer *azureIoTDoWorkTimer = NULL;
+static int azureIoTDoWorkIntervalMilliseconds = -1;
 
 static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
 static ExitCode_CallbackType failureCallbackFunction = NULL;
@@ -73,6 +96,27 @@ static Connection_Status connectionStatus = Connection_NotStarted;
 
 // Constants
 #define MAX_DEVICE_TWIN_PAYLOAD_SIZE 512
+#define MAX_TRACKED_REQUESTS 16
+
+/// <summary>
+/// A send or device twin report request which has been passed to the IoT Hub client and is
+/// awaiting its callback. Used to measure enqueue-to-callback latency.
+/// </summary>
+typedef struct {
+    bool inUse;
+    struct timespec enqueueTime;
+    void *context;
+} TrackedRequest;
+
+// Statically allocated for more predictable memory use patterns. If every entry is in use,
+// further requests are sent untracked.
+static TrackedRequest trackedRequests[MAX_TRACKED_REQUESTS];
+static unsigned int trackedRequestCount = 0;
+static AzureIoT_DoWorkStatistics doWorkStatistics = {0};
+
+static TrackedRequest *StartTrackedRequest(void *context);
+static void *CompleteTrackedRequest(TrackedRequest *request);
+static void CancelTrackedRequest(TrackedRequest *request);
 
 MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(IOTHUB_CLIENT_CONNECTION_STATUS_REASON,
                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES);
@@ -100,15 +144,20 @@ ExitCode AzureIoT_Initialize(EventLoop *eventLoop, ExitCode_CallbackType failure
         return ExitCode_Init_AzureIoTConnectionTimer;
     }
 
-    int azureIoTDoWorkIntervalNanoseconds =
-        AzureIoTDoWorkIntervalMilliseconds * NanosecondsPerMillisecond;
-    struct timespec azureIoTDoWorkPollPeriod = {.tv_sec = 0,
-                                                .tv_nsec = azureIoTDoWorkIntervalNanoseconds};
-    azureIoTDoWorkTimer = CreateEventLoopPeriodicTimer(eventLoop, &AzureIoTDoWorkTimerEventHandler,
-                                                       &azureIoTDoWorkPollPeriod);
+    azureIoTDoWorkTimer =
+        CreateEventLoopDisarmedTimer(eventLoop, &AzureIoTDoWorkTimerEventHandler);
     if (azureIoTDoWorkTimer == NULL) {
         return ExitCode_Init_AzureIoTDoWorkTimer;
     }
+    azureIoTDoWorkIntervalMilliseconds = AzureIoTDoWorkMaxIntervalMilliseconds;
+    ScheduleDoWork(azureIoTDoWorkIntervalMilliseconds);
+
+    ExitCode telemetryQueueErrorCode = TelemetryQueue_Initialize(
+        eventLoop, failureCallback, SendQueuedTelemetryCallback,
+        TelemetryQueueDrainIntervalMilliseconds, TelemetryQueueMessagesPerDrainInterval);
+    if (telemetryQueueErrorCode != ExitCode_Success) {
+        return telemetryQueueErrorCode;
+    }
 
     azureIoTInitialized = true;
 
@@ -119,6 +168,7 @@ void AzureIoT_Cleanup(void)
 {
     DisposeEventLoopTimer(azureIoTConnectionTimer);
     DisposeEventLoopTimer(azureIoTDoWorkTimer);
+    TelemetryQueue_Cleanup();
 }
 
 /// <summary>
@@ -162,6 +212,9 @@ static void ConnectionCallbackHandler(Connection_Status status,
                                                       NULL);
         IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
                                                           ConnectionStatusCallback, NULL);
+
+        // Drive the authentication handshake without waiting for the idle interval.
+        RequestDoWork();
         break;
     }
 
@@ -215,7 +268,9 @@ static void AzureIoTConnectTimerEventHandler(EventLoopTimer *timer)
 }
 
 /// <summary>
-///     azureIoTDoWorkTimer timer event:  Call IoTHubDeviceClient_LL_DoWork()
+///     azureIoTDoWorkTimer timer event:  Call IoTHubDeviceClient_LL_DoWork(), then schedule the
+///     next call - soon if the client still has work in progress, otherwise after a longer
+///     interval.
 /// </summary>
 static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer)
 {
@@ -224,9 +279,63 @@ static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer)
         return;
     }
 
+    if (iothubClientHandle == NULL) {
+        ScheduleDoWork(AzureIoTDoWorkMaxIntervalMilliseconds);
+        return;
+    }
+
+    IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+    ++doWorkStatistics.doWorkCount;
+
+    // The client may have been destroyed by a callback invoked from DoWork.
+    IOTHUB_CLIENT_STATUS sendStatus = IOTHUB_CLIENT_SEND_STATUS_IDLE;
     if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        IoTHubDeviceClient_LL_GetSendStatus(iothubClientHandle, &sendStatus);
     }
+
+    bool busy = sendStatus == IOTHUB_CLIENT_SEND_STATUS_BUSY || trackedRequestCount > 0 ||
+                iotHubClientAuthenticationState ==
+                    IoTHubClientAuthenticationState_AuthenticationInitiated;
+
+    if (busy) {
+        azureIoTDoWorkIntervalMilliseconds = AzureIoTDoWorkMinIntervalMilliseconds;
+    } else {
+        ++doWorkStatistics.idleDoWorkCount;
+        azureIoTDoWorkIntervalMilliseconds *= 2;
+        if (azureIoTDoWorkIntervalMilliseconds > AzureIoTDoWorkMaxIntervalMilliseconds) {
+            azureIoTDoWorkIntervalMilliseconds = AzureIoTDoWorkMaxIntervalMilliseconds;
+        }
+    }
+
+    ScheduleDoWork(azureIoTDoWorkIntervalMilliseconds);
+}
+
+/// <summary>
+///     Arm the DoWork timer to fire once after the given delay.
+/// </summary>
+static void ScheduleDoWork(int delayMilliseconds)
+{
+    struct timespec delay = {.tv_sec = delayMilliseconds / MillisecondsPerSecond,
+                             .tv_nsec = (delayMilliseconds % MillisecondsPerSecond) *
+                                        NanosecondsPerMillisecond};
+
+    // A zero delay would disarm the timer, so use the shortest non-zero delay instead.
+    if (delay.tv_sec == 0 && delay.tv_nsec == 0) {
+        delay.tv_nsec = 1;
+    }
+
+    SetEventLoopTimerOneShot(azureIoTDoWorkTimer, &delay);
+}
+
+/// <summary>
+///     Run DoWork on the next pass of the event loop, and poll at the fastest rate until the
+///     client is idle again. DoWork is deferred rather than called here because this may be
+///     called from within an IoT Hub client callback.
+/// </summary>
+static void RequestDoWork(void)
+{
+    azureIoTDoWorkIntervalMilliseconds = AzureIoTDoWorkMinIntervalMilliseconds;
+    ScheduleDoWork(0);
 }
 
 /// <summary>
@@ -258,6 +367,17 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
     Log_Debug("Azure IoT connection status: %s\n",
               IOTHUB_CLIENT_CONNECTION_STATUS_REASONStrings(reason));
 
+    unsigned int averageLatencyMilliseconds =
+        doWorkStatistics.completedRequestCount == 0
+            ? 0
+            : (unsigned int)(doWorkStatistics.totalLatencyMilliseconds /
+                             doWorkStatistics.completedRequestCount);
+    Log_Debug("INFO: DoWork called %u times (%u idle); %u requests completed, latency avg %u ms, "
+              "max %u ms.\n",
+              doWorkStatistics.doWorkCount, doWorkStatistics.idleDoWorkCount,
+              doWorkStatistics.completedRequestCount, averageLatencyMilliseconds,
+              doWorkStatistics.maxLatencyMilliseconds);
+
     iotHubClientAuthenticationState = result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED
                                           ? IoTHubClientAuthenticationState_Authenticated
                                           : IoTHubClientAuthenticationState_NotAuthenticated;
@@ -266,6 +386,10 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
         ConnectionCallbackHandler(Connection_NotStarted, NULL);
     }
 
+    // Replay any telemetry that was queued while the client was not authenticated.
+    TelemetryQueue_SetDrainEnabled(iotHubClientAuthenticationState ==
+                                   IoTHubClientAuthenticationState_Authenticated);
+
     if (callbacks.connectionStatusCallbackFunction != NULL) {
         callbacks.connectionStatusCallbackFunction(result ==
                                                    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
@@ -350,17 +474,39 @@ AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8
 {
     Log_Debug("Sending Azure IoT Hub telemetry: %s.\n", jsonMessage);
 
-    // Check whether the device is connected to the internet.
-    if (IsConnectionReadyToSendTelemetry() == false) {
-        return AzureIoT_Result_NoNetwork;
+    // If the device is offline, or earlier telemetry is still waiting to be replayed, queue the
+    // message so that it is sent, in order, once the connection is available.
+    if (IsConnectionReadyToSendTelemetry() == false ||
+        iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated ||
+        TelemetryQueue_GetLength() > 0) {
+        return TelemetryQueue_Enqueue(jsonMessage, iso8601DateTimeString, context)
+                   ? AzureIoT_Result_OK
+                   : AzureIoT_Result_OtherFailure;
     }
 
+    return SendTelemetryMessage(jsonMessage, iso8601DateTimeString, context);
+}
+
+/// <summary>
+///     Called by the telemetry queue to replay a queued message.
+/// </summary>
+static bool SendQueuedTelemetryCallback(const char *jsonMessage,
+                                        const char *iso8601DateTimeString, void *context)
+{
     if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
-        // AzureIoT client is not authenticated. Log a warning and return.
-        Log_Debug("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
-        return AzureIoT_Result_OtherFailure;
+        return false;
     }
 
+    Log_Debug("Replaying queued Azure IoT Hub telemetry: %s.\n", jsonMessage);
+    return SendTelemetryMessage(jsonMessage, iso8601DateTimeString, context) == AzureIoT_Result_OK;
+}
+
+/// <summary>
+///     Create an IoT Hub message and pass it to the IoT Hub client for delivery.
+/// </summary>
+static AzureIoT_Result SendTelemetryMessage(const char *jsonMessage,
+                                            const char *iso8601DateTimeString, void *context)
+{
     IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(jsonMessage);
 
     if (messageHandle == 0) {
@@ -374,12 +520,21 @@ AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8
 
     AzureIoT_Result result = AzureIoT_Result_OK;
 
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendEventCallback,
-                                             context) != IOTHUB_CLIENT_OK) {
+    TrackedRequest *request = StartTrackedRequest(context);
+    IOTHUB_CLIENT_RESULT sendResult =
+        request != NULL
+            ? IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle,
+                                                   SendEventCallback, request)
+            : IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle,
+                                                   SendEventUntrackedCallback, context);
+
+    if (sendResult != IOTHUB_CLIENT_OK) {
         Log_Debug("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+        CancelTrackedRequest(request);
         result = AzureIoT_Result_OtherFailure;
     } else {
         Log_Debug("INFO: IoTHubClient accepted the telemetry event for delivery.\n");
+        RequestDoWork();
     }
 
     IoTHubMessage_Destroy(messageHandle);
@@ -387,9 +542,17 @@ AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8
 }
 
 /// <summary>
-///     Callback invoked when the Azure IoT Hub send event request is processed.
+///     Callback invoked when a tracked Azure IoT Hub send event request is processed.
 /// </summary>
 static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
+{
+    SendEventUntrackedCallback(result, CompleteTrackedRequest((TrackedRequest *)context));
+}
+
+/// <summary>
+///     Callback invoked when the Azure IoT Hub send event request is processed.
+/// </summary>
+static void SendEventUntrackedCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
 {
     Log_Debug("INFO: Azure IoT Hub send telemetry event callback: status code %d.\n", result);
 
@@ -414,14 +577,25 @@ AzureIoT_Result AzureIoT_DeviceTwinReportState(const char *jsonState, void *cont
         return AzureIoT_Result_OtherFailure;
     }
 
-    if (IoTHubDeviceClient_LL_SendReportedState(
-            iothubClientHandle, (const unsigned char *)jsonState, strlen(jsonState),
-            ReportedStateCallback, context) != IOTHUB_CLIENT_OK) {
+    TrackedRequest *request = StartTrackedRequest(context);
+    IOTHUB_CLIENT_RESULT reportResult =
+        request != NULL
+            ? IoTHubDeviceClient_LL_SendReportedState(iothubClientHandle,
+                                                      (const unsigned char *)jsonState,
+                                                      strlen(jsonState), ReportedStateCallback,
+                                                      request)
+            : IoTHubDeviceClient_LL_SendReportedState(
+                  iothubClientHandle, (const unsigned char *)jsonState, strlen(jsonState),
+                  ReportedStateUntrackedCallback, context);
+
+    if (reportResult != IOTHUB_CLIENT_OK) {
         Log_Debug("ERROR: Azure IoT Hub client error when reporting state '%s'.\n", jsonState);
+        CancelTrackedRequest(request);
         return AzureIoT_Result_OtherFailure;
     }
 
     Log_Debug("INFO: Azure IoT Hub client accepted request to report state '%s'.\n", jsonState);
+    RequestDoWork();
     return AzureIoT_Result_OK;
 }
 
@@ -430,11 +604,20 @@ bool AzureIoT_IsInitialized(void)
     return azureIoTInitialized;
 }
 
+/// <summary>
+///     Callback invoked when a tracked Device Twin report state request is processed by Azure IoT
+///     Hub client.
+/// </summary>
+static void ReportedStateCallback(int result, void *context)
+{
+    ReportedStateUntrackedCallback(result, CompleteTrackedRequest((TrackedRequest *)context));
+}
+
 /// <summary>
 ///     Callback invoked when the Device Twin report state request is processed by Azure IoT Hub
 ///     client.
 /// </summary>
-static void ReportedStateCallback(int result, void *context)
+static void ReportedStateUntrackedCallback(int result, void *context)
 {
     Log_Debug("INFO: Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
 
@@ -483,4 +666,68 @@ static bool IsConnectionReadyToSendTelemetry(void)
 bool AzureIoT_IsConnected(void)
 {
     return iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated;
-}
\ No newline at end of file
+}
+
+void AzureIoT_GetDoWorkStatistics(AzureIoT_DoWorkStatistics *statistics)
+{
+    *statistics = doWorkStatistics;
+}
+
+/// <summary>
+///     Record the time at which a request is passed to the IoT Hub client.
+/// </summary>
+/// <returns>The tracking entry to pass as the IoT Hub client callback context, or NULL if there
+/// is no free entry.</returns>
+static TrackedRequest *StartTrackedRequest(void *context)
+{
+    for (size_t i = 0; i < MAX_TRACKED_REQUESTS; ++i) {
+        if (!trackedRequests[i].inUse) {
+            trackedRequests[i].inUse = true;
+            trackedRequests[i].context = context;
+            clock_gettime(CLOCK_MONOTONIC, &trackedRequests[i].enqueueTime);
+            ++trackedRequestCount;
+            return &trackedRequests[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+///     Record the enqueue-to-callback latency of a request and release its tracking entry.
+/// </summary>
+/// <returns>The user context supplied with the request.</returns>
+static void *CompleteTrackedRequest(TrackedRequest *request)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    unsigned int latencyMilliseconds =
+        (unsigned int)((now.tv_sec - request->enqueueTime.tv_sec) * MillisecondsPerSecond +
+                       (now.tv_nsec - request->enqueueTime.tv_nsec) / NanosecondsPerMillisecond);
+
+    ++doWorkStatistics.completedRequestCount;
+    doWorkStatistics.totalLatencyMilliseconds += latencyMilliseconds;
+    if (latencyMilliseconds > doWorkStatistics.maxLatencyMilliseconds) {
+        doWorkStatistics.maxLatencyMilliseconds = latencyMilliseconds;
+    }
+
+    void *context = request->context;
+    CancelTrackedRequest(request);
+    return context;
+}
+
+/// <summary>
+///     Release a tracking entry without recording its latency. It is safe to call this function
+///     with a NULL pointer.
+/// </summary>
+static void CancelTrackedRequest(TrackedRequest *request)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    request->inUse = false;
+    request->context = NULL;
+    --trackedRequestCount;
+}
@@ -89,6 +89,25 @@ typedef struct {
     AzureIoT_CloudToDeviceCallbackType cloudToDeviceCallbackFunction;
 } AzureIoT_Callbacks;
 
+/// <summary>
+/// Counters describing how IoTHubDeviceClient_LL_DoWork() has been scheduled.
+/// </summary>
+typedef struct {
+    /// <summary>Number of calls to IoTHubDeviceClient_LL_DoWork().</summary>
+    unsigned int doWorkCount;
+    /// <summary>Number of those calls after which the client had no work in progress. The idle
+    /// ratio is idleDoWorkCount / doWorkCount.</summary>
+    unsigned int idleDoWorkCount;
+    /// <summary>Number of telemetry and device twin requests whose callback has been
+    /// invoked.</summary>
+    unsigned int completedRequestCount;
+    /// <summary>Sum of the enqueue-to-callback latencies of those requests, in milliseconds.
+    /// </summary>
+    unsigned long long totalLatencyMilliseconds;
+    /// <summary>Largest enqueue-to-callback latency seen, in milliseconds.</summary>
+    unsigned int maxLatencyMilliseconds;
+} AzureIoT_DoWorkStatistics;
+
 /// <summary>
 /// An enum indicating possible result codes when performing Azure IoT-related operations
 /// </summary>
@@ -132,6 +151,8 @@ void AzureIoT_Cleanup(void);
 ///     function will return immediately, and then call the
 ///     <see cref="AzureIoT_SendTelemetryCallbackType" /> (passed to
 ///     <see cref="AzureIoT_Initialize" />) to indicate success or failure.
+///     If the device is not connected, the telemetry is held in a store-and-forward queue (see
+///     telemetry_queue.h) and sent once the connection is restored.
 /// </summary>
 /// <param name="jsonMessage">The telemetry to send, as a JSON string.</param>
 /// <param name="iso8601DateTimeString">
@@ -181,3 +202,10 @@ bool AzureIoT_IsInitialized(void);
 /// </summary>
 /// <returns>A boolean indicating connection state.</returns>
 bool AzureIoT_IsConnected(void);
+
+/// <summary>
+///     Get counters describing IoTHubDeviceClient_LL_DoWork() scheduling and the
+///     enqueue-to-callback latency of telemetry and device twin requests.
+/// </summary>
+/// <param name="statistics">(out) Receives the current counter values.</param>
+void AzureIoT_GetDoWorkStatistics(AzureIoT_DoWorkStatistics *statistics);
@@ -9,10 +9,12 @@
 #include <applibs/eventloop.h>
 #include <applibs/log.h>
 
+#include "json_writer.h"
 #include "parson.h"
 
 #include "azure_iot.h"
 #include "cloud.h"
+#include "eventloop_timer_utilities.h"
 #include "exitcodes.h"
 
 // This file implements the interface described in cloud.h in terms of an Azure IoT Hub.
@@ -46,14 +48,40 @@ static Cloud_ConnectionChangedCallbackType connectionChangedCallbackFunction =
 // Utility functions
 static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result);
 static bool BuildUtcDateTimeString(char *outputBuffer, size_t outputBufferSize, time_t t);
+static Cloud_Result SendTelemetryPayload(const char *serializedTelemetry, const char *utcDateTime);
+
+// Telemetry batching
+static void TelemetryBatchTimerEventHandler(EventLoopTimer *timer);
+static Cloud_Result FlushTelemetryBatch(void);
 
 // Constants
 #define MAX_PAYLOAD_SIZE 512
 #define DATETIME_BUFFER_SIZE 128
+#define MAX_SERIALIZED_PAYLOAD_SIZE 1024
 
 // State
 static unsigned int lastAckedVersion = 0;
 static char dateTimeBuffer[DATETIME_BUFFER_SIZE];
+// Outgoing payloads are serialized here rather than on the heap. Each Cloud_Send* function hands
+// the payload to the Azure IoT layer, which copies it, before returning.
+static char payloadBuffer[MAX_SERIALIZED_PAYLOAD_SIZE];
+static ExitCode_CallbackType failureCallbackFunction = NULL;
+static Cloud_TelemetryStatistics telemetryStatistics = {0};
+
+/// <summary>
+/// A reading held for a telemetry batch.
+/// </summary>
+typedef struct {
+    Cloud_Telemetry telemetry;
+    time_t timestamp;
+} BatchedTelemetry;
+
+// Telemetry batch. A batch size of 1 means batching is disabled.
+static unsigned int telemetryBatchSize = 1;
+static struct timespec telemetryBatchMaxDelay = {.tv_sec = 0, .tv_nsec = 0};
+static BatchedTelemetry telemetryBatch[CLOUD_MAX_TELEMETRY_BATCH_SIZE];
+static unsigned int telemetryBatchCount = 0;
+static EventLoopTimer *telemetryBatchTimer = NULL;
 
 ExitCode Cloud_Initialize(EventLoop *el, void *backendContext,
                           ExitCode_CallbackType failureCallback,
@@ -75,6 +103,13 @@ ExitCode Cloud_Initialize(EventLoop *el, void *backendContext,
         connectionChangedCallbackFunction = connectionChangedCallback;
     }
 
+    failureCallbackFunction = failureCallback;
+
+    telemetryBatchTimer = CreateEventLoopDisarmedTimer(el, &TelemetryBatchTimerEventHandler);
+    if (telemetryBatchTimer == NULL) {
+        return ExitCode_Init_TelemetryBatchTimer;
+    }
+
     AzureIoT_Callbacks callbacks = {
         .connectionStatusCallbackFunction = ConnectionChangedCallbackHandler,
         .deviceTwinReceivedCallbackFunction = DeviceTwinCallbackHandler,
@@ -87,6 +122,14 @@ ExitCode Cloud_Initialize(EventLoop *el, void *backendContext,
 
 void Cloud_Cleanup(void)
 {
+    // Hand any readings still held in the batch to the Azure IoT library before it is cleaned up.
+    Cloud_Result result = FlushTelemetryBatch();
+    if (result != Cloud_Result_OK) {
+        Log_Debug("WARNING: Could not send telemetry batch to cloud (%d).\n", result);
+    }
+
+    DisposeEventLoopTimer(telemetryBatchTimer);
+    telemetryBatchTimer = NULL;
     AzureIoT_Cleanup();
 }
 
@@ -105,25 +148,141 @@ static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result)
 
 Cloud_Result Cloud_SendTelemetry(const Cloud_Telemetry *telemetry, time_t timestamp)
 {
+    ++telemetryStatistics.readings;
+
+    if (telemetryBatchSize > 1) {
+        telemetryBatch[telemetryBatchCount].telemetry = *telemetry;
+        telemetryBatch[telemetryBatchCount].timestamp = timestamp;
+        ++telemetryBatchCount;
+
+        if (telemetryBatchCount >= telemetryBatchSize) {
+            return FlushTelemetryBatch();
+        }
+
+        // Start the maximum delay from the first reading in the batch.
+        if (telemetryBatchCount == 1) {
+            SetEventLoopTimerOneShot(telemetryBatchTimer, &telemetryBatchMaxDelay);
+        }
+
+        return Cloud_Result_OK;
+    }
+
     char *utcDateTime = NULL;
     if (timestamp != -1) {
         BuildUtcDateTimeString(dateTimeBuffer, sizeof(dateTimeBuffer), timestamp);
         utcDateTime = dateTimeBuffer;
     }
 
-    JSON_Value *telemetryValue = json_value_init_object();
-    JSON_Object *telemetryRoot = json_value_get_object(telemetryValue);
-    json_object_dotset_number(telemetryRoot, "temperature", telemetry->temperature);
-    char *serializedTelemetry = json_serialize_to_string(telemetryValue);
-    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedTelemetry, utcDateTime, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
+    JsonWriter writer;
+    JsonWriter_Init(&writer, payloadBuffer, sizeof(payloadBuffer));
+    JsonWriter_BeginObject(&writer, NULL);
+    JsonWriter_AppendNumber(&writer, "temperature", telemetry->temperature);
+    JsonWriter_EndObject(&writer);
+
+    return SendTelemetryPayload(JsonWriter_GetString(&writer), utcDateTime);
+}
+
+Cloud_Result Cloud_SetTelemetryBatching(unsigned int maxReadings, unsigned int maxDelaySeconds)
+{
+    if (maxReadings > CLOUD_MAX_TELEMETRY_BATCH_SIZE) {
+        Log_Debug("ERROR: Telemetry batch size %u exceeds maximum (%u).\n", maxReadings,
+                  CLOUD_MAX_TELEMETRY_BATCH_SIZE);
+        return Cloud_Result_OtherFailure;
+    }
+
+    // Send anything collected under the previous settings.
+    Cloud_Result result = FlushTelemetryBatch();
+
+    telemetryBatchSize = maxReadings > 1 ? maxReadings : 1;
+    telemetryBatchMaxDelay.tv_sec = maxDelaySeconds;
+    telemetryBatchMaxDelay.tv_nsec = 0;
+
+    return result;
+}
+
+void Cloud_GetTelemetryStatistics(Cloud_TelemetryStatistics *statistics)
+{
+    *statistics = telemetryStatistics;
+}
+
+/// <summary>
+///     Send the readings collected in the current batch, if any, as a single message holding a
+///     JSON array of {"temperature", "timestamp"} objects.
+/// </summary>
+static Cloud_Result FlushTelemetryBatch(void)
+{
+    if (telemetryBatchCount == 0) {
+        return Cloud_Result_OK;
+    }
+
+    if (telemetryBatchTimer != NULL) {
+        DisarmEventLoopTimer(telemetryBatchTimer);
+    }
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, payloadBuffer, sizeof(payloadBuffer));
+    JsonWriter_BeginArray(&writer, NULL);
+    for (unsigned int i = 0; i < telemetryBatchCount; ++i) {
+        JsonWriter_BeginObject(&writer, NULL);
+        JsonWriter_AppendNumber(&writer, "temperature", telemetryBatch[i].telemetry.temperature);
+        if (telemetryBatch[i].timestamp != -1 &&
+            BuildUtcDateTimeString(dateTimeBuffer, sizeof(dateTimeBuffer),
+                                   telemetryBatch[i].timestamp)) {
+            JsonWriter_AppendString(&writer, "timestamp", dateTimeBuffer);
+        }
+        JsonWriter_EndObject(&writer);
+    }
+    JsonWriter_EndArray(&writer);
+
+    // The message itself carries the creation time of the oldest reading.
+    char *utcDateTime = NULL;
+    if (telemetryBatch[0].timestamp != -1) {
+        BuildUtcDateTimeString(dateTimeBuffer, sizeof(dateTimeBuffer), telemetryBatch[0].timestamp);
+        utcDateTime = dateTimeBuffer;
+    }
 
-    json_free_serialized_string(serializedTelemetry);
-    json_value_free(telemetryValue);
+    Cloud_Result result = SendTelemetryPayload(JsonWriter_GetString(&writer), utcDateTime);
 
+    telemetryBatchCount = 0;
     return result;
 }
 
+/// <summary>
+///     Telemetry batch timer event: the oldest reading in the batch has been held for the maximum
+///     delay, so send the batch.
+/// </summary>
+static void TelemetryBatchTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureCallbackFunction(ExitCode_TelemetryBatchTimer_Consume);
+        return;
+    }
+
+    Cloud_Result result = FlushTelemetryBatch();
+    if (result != Cloud_Result_OK) {
+        Log_Debug("WARNING: Could not send telemetry batch to cloud (%d).\n", result);
+    }
+}
+
+/// <summary>
+///     Send a serialized telemetry payload and update the telemetry statistics.
+/// </summary>
+static Cloud_Result SendTelemetryPayload(const char *serializedTelemetry, const char *utcDateTime)
+{
+    if (serializedTelemetry == NULL) {
+        Log_Debug("ERROR: Could not serialize telemetry.\n");
+        return Cloud_Result_OtherFailure;
+    }
+
+    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedTelemetry, utcDateTime, NULL);
+    if (aziotResult == AzureIoT_Result_OK) {
+        ++telemetryStatistics.messages;
+        telemetryStatistics.payloadBytes += (unsigned int)strlen(serializedTelemetry);
+    }
+
+    return AzureIoTToCloudResult(aziotResult);
+}
+
 Cloud_Result Cloud_SendThermometerMovedEvent(time_t timestamp)
 {
     char *utcDateTime = NULL;
@@ -132,75 +291,81 @@ Cloud_Result Cloud_SendThermometerMovedEvent(time_t timestamp)
         utcDateTime = dateTimeBuffer;
     }
 
-    JSON_Value *thermometerMovedValue = json_value_init_object();
-    JSON_Object *thermometerMovedRoot = json_value_get_object(thermometerMovedValue);
-    json_object_dotset_boolean(thermometerMovedRoot, "thermometerMoved", 1);
-    char *serializedDeviceMoved = json_serialize_to_string(thermometerMovedValue);
-    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedDeviceMoved, utcDateTime, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
+    JsonWriter writer;
+    JsonWriter_Init(&writer, payloadBuffer, sizeof(payloadBuffer));
+    JsonWriter_BeginObject(&writer, NULL);
+    JsonWriter_AppendBool(&writer, "thermometerMoved", true);
+    JsonWriter_EndObject(&writer);
 
-    json_free_serialized_string(serializedDeviceMoved);
-    json_value_free(thermometerMovedValue);
+    const char *serializedDeviceMoved = JsonWriter_GetString(&writer);
+    if (serializedDeviceMoved == NULL) {
+        Log_Debug("ERROR: Could not serialize thermometer moved event.\n");
+        return Cloud_Result_OtherFailure;
+    }
 
-    return result;
+    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedDeviceMoved, utcDateTime, NULL);
+    return AzureIoTToCloudResult(aziotResult);
 }
 
 Cloud_Result Cloud_SendThermometerTelemetryUploadEnabledChangedEvent(bool uploadEnabled,
                                                                      bool fromCloud)
 {
-    JSON_Value *thermometerTelemetryUploadValue = json_value_init_object();
-    JSON_Object *thermometerTelemetryUploadRoot =
-        json_value_get_object(thermometerTelemetryUploadValue);
+    JsonWriter writer;
+    JsonWriter_Init(&writer, payloadBuffer, sizeof(payloadBuffer));
+    JsonWriter_BeginObject(&writer, NULL);
+    JsonWriter_BeginObject(&writer, "thermometerTelemetryUploadEnabled");
 
     // Update the property value.
-    json_object_dotset_boolean(thermometerTelemetryUploadRoot,
-                               "thermometerTelemetryUploadEnabled.value", uploadEnabled ? 1 : 0);
+    JsonWriter_AppendBool(&writer, "value", uploadEnabled);
 
     // Ref.:
     // https://learn.microsoft.com/azure/iot-develop/concepts-convention#acknowledgment-responses
     // If the property value is modified locally on the device, the ackCode must be set to 203,
     // otherwise if it was modified when syncing with the Device Twin, it must be set to 200.
-    json_object_dotset_number(thermometerTelemetryUploadRoot,
-                              "thermometerTelemetryUploadEnabled.ac", // ackCode
-                              fromCloud ? 200 : 203);
+    JsonWriter_AppendNumber(&writer, "ac", // ackCode
+                            fromCloud ? 200 : 203);
 
     // If a property is changed locally (i.e. from a button press) the device must report 0 as the
     // ackVersion, otherwise it should report the version provided from the Device Twin (i.e. from
     // the desired version).
-    json_object_dotset_number(thermometerTelemetryUploadRoot,
-                              "thermometerTelemetryUploadEnabled.av", // ackVersion
-                              fromCloud ? lastAckedVersion : 0);
+    JsonWriter_AppendNumber(&writer, "av", // ackVersion
+                            fromCloud ? lastAckedVersion : 0);
 
     // Optional free-form description.
-    json_object_dotset_string(
-        thermometerTelemetryUploadRoot,
-        "thermometerTelemetryUploadEnabled.ad", // ackDescription
+    JsonWriter_AppendString(
+        &writer, "ad", // ackDescription
         fromCloud ? "Updated from Device Twin's desired value." : "Updated locally on the device.");
 
-    char *serializedTelemetryUpload = json_serialize_to_string(thermometerTelemetryUploadValue);
-    AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedTelemetryUpload, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
 
-    json_free_serialized_string(serializedTelemetryUpload);
-    json_value_free(thermometerTelemetryUploadValue);
+    const char *serializedTelemetryUpload = JsonWriter_GetString(&writer);
+    if (serializedTelemetryUpload == NULL) {
+        Log_Debug("ERROR: Could not serialize telemetry upload enabled state.\n");
+        return Cloud_Result_OtherFailure;
+    }
 
-    return result;
+    AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedTelemetryUpload, NULL);
+    return AzureIoTToCloudResult(aziotResult);
 }
 
 Cloud_Result Cloud_SendDeviceDetails(const char *serialNumber)
 {
     // Send static device twin properties when connection is established.
-    JSON_Value *deviceDetailsValue = json_value_init_object();
-    JSON_Object *deviceDetailsRoot = json_value_get_object(deviceDetailsValue);
-    json_object_dotset_string(deviceDetailsRoot, "serialNumber", serialNumber);
-    char *serializedDeviceDetails = json_serialize_to_string(deviceDetailsValue);
-    AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedDeviceDetails, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
-
-    json_free_serialized_string(serializedDeviceDetails);
-    json_value_free(deviceDetailsValue);
+    JsonWriter writer;
+    JsonWriter_Init(&writer, payloadBuffer, sizeof(payloadBuffer));
+    JsonWriter_BeginObject(&writer, NULL);
+    JsonWriter_AppendString(&writer, "serialNumber", serialNumber);
+    JsonWriter_EndObject(&writer);
+
+    const char *serializedDeviceDetails = JsonWriter_GetString(&writer);
+    if (serializedDeviceDetails == NULL) {
+        Log_Debug("ERROR: Could not serialize device details.\n");
+        return Cloud_Result_OtherFailure;
+    }
 
-    return result;
+    AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedDeviceDetails, NULL);
+    return AzureIoTToCloudResult(aziotResult);
 }
 
 static bool BuildUtcDateTimeString(char *outputBuffer, size_t outputBufferSize, time_t t)
@@ -245,6 +410,12 @@ static void DefaultConnectionChangedHandler(bool connected)
 
 static void ConnectionChangedCallbackHandler(bool connected)
 {
+    // Don't hold readings across a connection change: send them now, or queue them while offline.
+    Cloud_Result result = FlushTelemetryBatch();
+    if (result != Cloud_Result_OK) {
+        Log_Debug("WARNING: Could not send telemetry batch to cloud (%d).\n", result);
+    }
+
     connectionChangedCallbackFunction(connected);
 }
 
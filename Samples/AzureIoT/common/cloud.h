@@ -34,6 +34,11 @@ typedef void (*Cloud_DisplayAlertCallbackType)(const char *alertMessage);
 /// <param name="connected">A boolean indicating whether the cloud connection is available.</param>
 typedef void (*Cloud_ConnectionChangedCallbackType)(bool connected);
 
+/// <summary>
+/// The maximum number of readings that can be combined into one telemetry message.
+/// </summary>
+#define CLOUD_MAX_TELEMETRY_BATCH_SIZE 12
+
 /// <summary>
 /// Telemetry to send to the cloud.
 /// </summary>
@@ -92,7 +97,9 @@ ExitCode Cloud_Initialize(
 void Cloud_Cleanup(void);
 
 /// <summary>
-/// Queue sending telemtry to the cloud backend.
+/// Queue sending telemtry to the cloud backend. If batching is enabled (see
+/// <see cref="Cloud_SetTelemetryBatching" />), the reading may be held and sent later as part of
+/// a batch.
 /// </summary>
 /// <param name="telemetry">A pointer to a <see cref="Cloud_Telemetry" /> structure to send.</param>
 /// <param name="timestamp">
@@ -101,6 +108,41 @@ void Cloud_Cleanup(void);
 /// <returns>A <see cref="Cloud_Result" /> indicating success or failure.</returns>
 Cloud_Result Cloud_SendTelemetry(const Cloud_Telemetry *telemetry, time_t timestamp);
 
+/// <summary>
+/// Counters describing the telemetry messages sent by <see cref="Cloud_SendTelemetry" />.
+/// </summary>
+typedef struct {
+    /// <summary>Number of readings passed to <see cref="Cloud_SendTelemetry" />.</summary>
+    unsigned int readings;
+    /// <summary>Number of telemetry messages handed to the cloud backend.</summary>
+    unsigned int messages;
+    /// <summary>Total size in bytes of the telemetry message payloads.</summary>
+    unsigned int payloadBytes;
+} Cloud_TelemetryStatistics;
+
+/// <summary>
+/// Configure telemetry batching. When batching is enabled, readings passed to
+/// <see cref="Cloud_SendTelemetry" /> are collected and sent as a single message holding a JSON
+/// array, with a timestamp for each reading. A batch is sent when it holds
+/// <paramref name="maxReadings" /> readings, when its oldest reading has been held for
+/// <paramref name="maxDelaySeconds" />, or when the cloud connection status changes.
+/// </summary>
+/// <param name="maxReadings">
+///     Maximum number of readings in a batch, up to <see cref="CLOUD_MAX_TELEMETRY_BATCH_SIZE" />.
+///     A value of 0 or 1 disables batching, so that each reading is sent as its own message.
+/// </param>
+/// <param name="maxDelaySeconds">
+///     Maximum time a reading is held before its batch is sent, or 0 for no time limit.
+/// </param>
+/// <returns>A <see cref="Cloud_Result" /> indicating success or failure.</returns>
+Cloud_Result Cloud_SetTelemetryBatching(unsigned int maxReadings, unsigned int maxDelaySeconds);
+
+/// <summary>
+/// Get counters for the telemetry sent so far, to compare batched and unbatched modes.
+/// </summary>
+/// <param name="statistics">(out) Receives the current counter values.</param>
+void Cloud_GetTelemetryStatistics(Cloud_TelemetryStatistics *statistics);
+
 /// <summary>
 /// Queue sending an event to the cloud indicating that the device location has changed.
 /// </summary>
@@ -55,6 +55,12 @@ typedef enum {
 
     ExitCode_Init_AzureIoTDoWorkTimer = 30,
     ExitCode_AzureIoTDoWorkTimer_Consume = 31,
+
+    ExitCode_Init_TelemetryQueueDrainTimer = 32,
+    ExitCode_TelemetryQueueDrainTimer_Consume = 33,
+
+    ExitCode_Init_TelemetryBatchTimer = 34,
+    ExitCode_TelemetryBatchTimer_Consume = 35,
 } ExitCode;
 
 /// <summary>
@@ -0,0 +1,176 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/log.h>
+
+#include "eventloop_timer_utilities.h"
+#include "input_service.h"
+
+typedef struct {
+    int fd;
+    GPIO_Value_Type pressedValue;
+    InputService_EventHandler handler;
+    void *context;
+    // Debounced state of the input.
+    bool isPressed;
+    bool isLongPressReported;
+    uint64_t pressedTimeMs;
+    // Set while the input differs from its debounced state.
+    bool isChanging;
+    uint64_t changeStartTimeMs;
+} Input;
+
+static void PollTimerEventHandler(EventLoopTimer *timer);
+static bool UpdateInput(Input *input, bool isPressed, uint64_t nowMs);
+static uint64_t GetTimeMs(void);
+
+static Input inputs[INPUT_SERVICE_MAX_INPUTS];
+static size_t inputCount = 0;
+
+static EventLoopTimer *pollTimer = NULL;
+static bool isActivePolling = false;
+static InputService_FailureHandler failureHandlerFunction = NULL;
+
+static const struct timespec idlePollPeriod = {.tv_sec = 0,
+                                               .tv_nsec = INPUT_SERVICE_IDLE_POLL_MS * 1000 * 1000};
+static const struct timespec activePollPeriod = {
+    .tv_sec = 0, .tv_nsec = INPUT_SERVICE_ACTIVE_POLL_MS * 1000 * 1000};
+
+/// <summary>
+///     Gets the time from the monotonic clock, in milliseconds.
+/// </summary>
+static uint64_t GetTimeMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / (1000 * 1000);
+}
+
+/// <summary>
+///     Runs the debounce state machine of an input, and reports its events.
+/// </summary>
+/// <param name="input">The input.</param>
+/// <param name="isPressed">Whether the input reads as pressed.</param>
+/// <param name="nowMs">Time at which the input was read.</param>
+/// <returns>true if the input is changing, and should be read at the active rate.</returns>
+static bool UpdateInput(Input *input, bool isPressed, uint64_t nowMs)
+{
+    if (isPressed == input->isPressed) {
+        // The input has bounced back, or not changed at all.
+        input->isChanging = false;
+    } else if (!input->isChanging) {
+        input->isChanging = true;
+        input->changeStartTimeMs = nowMs;
+    } else if (nowMs - input->changeStartTimeMs >= INPUT_SERVICE_DEBOUNCE_MS) {
+        input->isChanging = false;
+        input->isPressed = isPressed;
+        if (isPressed) {
+            input->pressedTimeMs = nowMs;
+            input->isLongPressReported = false;
+            input->handler(InputService_Event_Pressed, input->context);
+        } else {
+            input->handler(InputService_Event_Released, input->context);
+        }
+    }
+
+    if (input->isPressed && !input->isLongPressReported &&
+        nowMs - input->pressedTimeMs >= INPUT_SERVICE_LONG_PRESS_MS) {
+        input->isLongPressReported = true;
+        input->handler(InputService_Event_LongPress, input->context);
+    }
+
+    return input->isChanging;
+}
+
+/// <summary>
+///     Poll timer event: read every input, and switch between the idle and active rates.
+/// </summary>
+static void PollTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureHandlerFunction();
+        return;
+    }
+
+    uint64_t nowMs = GetTimeMs();
+    bool isAnyInputChanging = false;
+
+    for (size_t i = 0; i < inputCount; ++i) {
+        GPIO_Value_Type value;
+        if (GPIO_GetValue(inputs[i].fd, &value) != 0) {
+            Log_Debug("ERROR: Could not read input GPIO: %s (%d).\n", strerror(errno), errno);
+            failureHandlerFunction();
+            return;
+        }
+
+        if (UpdateInput(&inputs[i], value == inputs[i].pressedValue, nowMs)) {
+            isAnyInputChanging = true;
+        }
+    }
+
+    if (isAnyInputChanging != isActivePolling) {
+        const struct timespec *period = isAnyInputChanging ? &activePollPeriod : &idlePollPeriod;
+        if (SetEventLoopTimerPeriod(pollTimer, period) != 0) {
+            failureHandlerFunction();
+            return;
+        }
+        isActivePolling = isAnyInputChanging;
+    }
+}
+
+int InputService_Init(EventLoop *el, InputService_FailureHandler failureHandler)
+{
+    failureHandlerFunction = failureHandler;
+    inputCount = 0;
+    isActivePolling = false;
+
+    pollTimer = CreateEventLoopPeriodicTimer(el, &PollTimerEventHandler, &idlePollPeriod);
+    if (pollTimer == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int InputService_AddInput(GPIO_Id gpioId, GPIO_Value_Type pressedValue,
+                          InputService_EventHandler handler, void *context)
+{
+    if (inputCount == INPUT_SERVICE_MAX_INPUTS) {
+        Log_Debug("ERROR: Too many inputs; the maximum is %d.\n", INPUT_SERVICE_MAX_INPUTS);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    int fd = GPIO_OpenAsInput(gpioId);
+    if (fd == -1) {
+        Log_Debug("ERROR: Could not open input GPIO %d: %s (%d).\n", gpioId, strerror(errno),
+                  errno);
+        return -1;
+    }
+
+    inputs[inputCount] = (Input){
+        .fd = fd, .pressedValue = pressedValue, .handler = handler, .context = context};
+    ++inputCount;
+    return 0;
+}
+
+void InputService_Cleanup(void)
+{
+    DisposeEventLoopTimer(pollTimer);
+    pollTimer = NULL;
+
+    for (size_t i = 0; i < inputCount; ++i) {
+        if (close(inputs[i].fd) != 0) {
+            Log_Debug("ERROR: Could not close input GPIO: %s (%d).\n", strerror(errno), errno);
+        }
+    }
+    inputCount = 0;
+}
@@ -0,0 +1,108 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// This header describes a small streaming JSON writer which serializes directly into a
+// caller-provided buffer, without any heap allocation. It is intended for building the small
+// telemetry and device twin payloads sent by this application; use parson to parse JSON.
+//
+// Each value is appended in order. Values inside an object must be given a name; values inside an
+// array, and the root value, must not. If the buffer is too small or the calls are unbalanced, the
+// writer enters an error state and <see cref="JsonWriter_GetString" /> returns NULL.
+
+/// <summary>
+/// The maximum nesting depth of objects and arrays.
+/// </summary>
+#define JSON_WRITER_MAX_DEPTH 8
+
+/// <summary>
+/// State of a JSON writer. Initialize with <see cref="JsonWriter_Init" />; the fields should not
+/// be accessed directly.
+/// </summary>
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+    unsigned int depth;
+    // Bit n is set if the container at depth n already holds a value.
+    uint32_t hasValue;
+    bool failed;
+} JsonWriter;
+
+/// <summary>
+/// Initialize a JSON writer to write into the supplied buffer.
+/// </summary>
+/// <param name="writer">The writer to initialize.</param>
+/// <param name="buffer">Buffer to write into; must remain valid while the writer is used.</param>
+/// <param name="size">Size of the buffer, including space for the NULL terminator.</param>
+void JsonWriter_Init(JsonWriter *writer, char *buffer, size_t size);
+
+/// <summary>
+/// Begin a nested object.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <param name="name">Name of the object within its parent object, or NULL.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_BeginObject(JsonWriter *writer, const char *name);
+
+/// <summary>
+/// End the object started by the matching <see cref="JsonWriter_BeginObject" />.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_EndObject(JsonWriter *writer);
+
+/// <summary>
+/// Begin a nested array.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <param name="name">Name of the array within its parent object, or NULL.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_BeginArray(JsonWriter *writer, const char *name);
+
+/// <summary>
+/// End the array started by the matching <see cref="JsonWriter_BeginArray" />.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_EndArray(JsonWriter *writer);
+
+/// <summary>
+/// Append a number.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <param name="name">Name of the value within its parent object, or NULL.</param>
+/// <param name="value">The value; must be finite.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_AppendNumber(JsonWriter *writer, const char *name, double value);
+
+/// <summary>
+/// Append a boolean.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <param name="name">Name of the value within its parent object, or NULL.</param>
+/// <param name="value">The value.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_AppendBool(JsonWriter *writer, const char *name, bool value);
+
+/// <summary>
+/// Append a string, escaped as parson escapes it.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <param name="name">Name of the value within its parent object, or NULL.</param>
+/// <param name="value">The value, as a NULL-terminated UTF-8 string.</param>
+/// <returns>true on success; false if the writer is in an error state.</returns>
+bool JsonWriter_AppendString(JsonWriter *writer, const char *name, const char *value);
+
+/// <summary>
+/// Get the serialized JSON.
+/// </summary>
+/// <param name="writer">The writer.</param>
+/// <returns>The NULL-terminated JSON, which is held in the writer's buffer; or NULL if the
+/// writer is in an error state or an object or array has not been ended.</returns>
+const char *JsonWriter_GetString(const JsonWriter *writer);
@@ -46,6 +46,7 @@
 #include "cloud.h"
 #include "options.h"
 #include "connection.h"
+#include "telemetry_queue.h"
 
 static volatile sig_atomic_t exitCode = ExitCode_Success;
 
@@ -77,6 +78,13 @@ static bool telemetryUploadEnabled = false; // False by default - do not send te
 
 static const char *serialNumber = "TEMPMON-01234";
 
+// Telemetry batching: up to telemetryBatchSize readings are combined into each telemetry message,
+// and no reading is held for longer than telemetryBatchMaxDelaySeconds. Batching is disabled by
+// default, because a batched message holds a JSON array, which does not conform to the thermometer
+// model; set telemetryBatchSize to more than 1 to enable it.
+static const unsigned int telemetryBatchSize = 1;
+static const unsigned int telemetryBatchMaxDelaySeconds = 30;
+
 /// <summary>
 ///     Signal handler for termination requests. This handler must be async-signal-safe.
 /// </summary>
@@ -198,6 +206,16 @@ static void ConnectionChangedCallbackHandler(bool connected)
 {
     isConnected = connected;
 
+    TelemetryQueue_Counters counters;
+    TelemetryQueue_GetCounters(&counters);
+    Log_Debug("INFO: Telemetry queue: %u queued, %u dropped, %u spilled, %u replayed.\n",
+              counters.queued, counters.dropped, counters.spilled, counters.replayed);
+
+    Cloud_TelemetryStatistics statistics;
+    Cloud_GetTelemetryStatistics(&statistics);
+    Log_Debug("INFO: Telemetry sent: %u readings in %u messages, %u payload bytes.\n",
+              statistics.readings, statistics.messages, statistics.payloadBytes);
+
     if (isConnected) {
         Cloud_Result result = Cloud_SendDeviceDetails(serialNumber);
         if (result != Cloud_Result_OK) {
@@ -219,20 +237,20 @@ static void TelemetryTimerCallbackHandler(EventLoopTimer *timer)
     time_t now;
     time(&now);
 
-    if (isConnected) {
-        if (telemetryUploadEnabled) {
-            // Generate a simulated temperature.
-            float delta = ((float)(rand() % 41)) / 20.0f - 1.0f; // between -1.0 and +1.0
-            telemetry.temperature += delta;
-
-            Cloud_Result result = Cloud_SendTelemetry(&telemetry, now);
-            if (result != Cloud_Result_OK) {
-                Log_Debug("WARNING: Could not send thermometer telemetry to cloud: %s\n",
-                          CloudResultToString(result));
-            }
-        } else {
-            Log_Debug("INFO: Telemetry upload disabled; not sending telemetry.\n");
+    // Telemetry is sent even while disconnected; it is queued and replayed once the connection
+    // is restored.
+    if (telemetryUploadEnabled) {
+        // Generate a simulated temperature.
+        float delta = ((float)(rand() % 41)) / 20.0f - 1.0f; // between -1.0 and +1.0
+        telemetry.temperature += delta;
+
+        Cloud_Result result = Cloud_SendTelemetry(&telemetry, now);
+        if (result != Cloud_Result_OK) {
+            Log_Debug("WARNING: Could not send thermometer telemetry to cloud: %s\n",
+                      CloudResultToString(result));
         }
+    } else {
+        Log_Debug("INFO: Telemetry upload disabled; not sending telemetry.\n");
     }
 }
 
@@ -274,9 +292,17 @@ static ExitCode InitPeripheralsAndHandlers(void)
 
     void *connectionContext = Options_GetConnectionContext();
 
-    return Cloud_Initialize(eventLoop, connectionContext, ExitCodeCallbackHandler,
-                            CloudTelemetryUploadEnabledChangedCallbackHandler,
-                            DisplayAlertCallbackHandler, ConnectionChangedCallbackHandler);
+    ExitCode cloudExitCode =
+        Cloud_Initialize(eventLoop, connectionContext, ExitCodeCallbackHandler,
+                         CloudTelemetryUploadEnabledChangedCallbackHandler,
+                         DisplayAlertCallbackHandler, ConnectionChangedCallbackHandler);
+    if (cloudExitCode != ExitCode_Success) {
+        return cloudExitCode;
+    }
+
+    Cloud_SetTelemetryBatching(telemetryBatchSize, telemetryBatchMaxDelaySeconds);
+
+    return ExitCode_Success;
 }
 
 /// <summary>
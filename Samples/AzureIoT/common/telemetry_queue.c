@@ -0,0 +1,378 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "eventloop_timer_utilities.h"
+#include "exitcodes.h"
+#include "telemetry_queue.h"
+
+// Number of messages held in RAM before the oldest is spilled to mutable storage.
+#define RAM_QUEUE_CAPACITY 8
+
+// Number of messages held in mutable storage. Each record is
+// TELEMETRY_QUEUE_MAX_MESSAGE_SIZE + TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE bytes; the total must fit
+// in the MutableStorage SizeKB set in app_manifest.json.
+#define STORAGE_QUEUE_CAPACITY 24
+
+// Identifies a mutable file written by this module ("TQ" v1).
+#define STORAGE_HEADER_MAGIC 0x31305154u
+
+/// <summary>
+/// A message held in the RAM ring.
+/// </summary>
+typedef struct {
+    char message[TELEMETRY_QUEUE_MAX_MESSAGE_SIZE];
+    // An empty string indicates that the message has no timestamp.
+    char timestamp[TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE];
+    void *context;
+} RamQueueEntry;
+
+/// <summary>
+/// A message held in mutable storage. The context pointer is not persisted.
+/// </summary>
+typedef struct {
+    char message[TELEMETRY_QUEUE_MAX_MESSAGE_SIZE];
+    char timestamp[TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE];
+} StorageQueueRecord;
+
+/// <summary>
+/// Header at the start of the mutable file. Records follow it, as a ring of
+/// STORAGE_QUEUE_CAPACITY entries starting at index "head".
+/// </summary>
+typedef struct {
+    uint32_t magic;
+    uint32_t head;
+    uint32_t count;
+} StorageQueueHeader;
+
+static void DrainTimerEventHandler(EventLoopTimer *timer);
+static void UpdateDrainTimer(void);
+static void OpenStorage(void);
+static bool SpillOldestRamEntry(void);
+static bool ReadStorageRecord(uint32_t index, StorageQueueRecord *record);
+static bool WriteStorageRecord(uint32_t index, const StorageQueueRecord *record);
+static bool WriteStorageHeader(void);
+static bool ReadAt(off_t offset, void *buffer, size_t size);
+static bool WriteAt(off_t offset, const void *buffer, size_t size);
+
+static ExitCode_CallbackType failureCallbackFunction = NULL;
+static TelemetryQueue_SendCallbackType sendCallbackFunction = NULL;
+static EventLoopTimer *drainTimer = NULL;
+static struct timespec drainPeriod = {.tv_sec = 0, .tv_nsec = 0};
+static unsigned int messagesPerDrain = 1;
+static bool drainEnabled = false;
+static bool drainTimerArmed = false;
+
+// RAM ring. Statically allocated for more predictable memory use patterns.
+static RamQueueEntry ramQueue[RAM_QUEUE_CAPACITY];
+static size_t ramHead = 0;
+static size_t ramCount = 0;
+
+// Mutable storage ring. storageFd is -1 if mutable storage is not available, in which case
+// messages are dropped rather than spilled when the RAM ring is full.
+static int storageFd = -1;
+static StorageQueueHeader storageHeader = {.magic = STORAGE_HEADER_MAGIC, .head = 0, .count = 0};
+
+static TelemetryQueue_Counters counters = {0};
+
+static const long NanosecondsPerMillisecond = 1000000;
+static const long MillisecondsPerSecond = 1000;
+
+ExitCode TelemetryQueue_Initialize(EventLoop *el, ExitCode_CallbackType failureCallback,
+                                   TelemetryQueue_SendCallbackType sendCallback,
+                                   unsigned int drainIntervalMilliseconds,
+                                   unsigned int messagesPerDrainInterval)
+{
+    failureCallbackFunction = failureCallback;
+    sendCallbackFunction = sendCallback;
+    messagesPerDrain = messagesPerDrainInterval > 0 ? messagesPerDrainInterval : 1;
+    drainPeriod.tv_sec = (time_t)(drainIntervalMilliseconds / MillisecondsPerSecond);
+    drainPeriod.tv_nsec =
+        (long)(drainIntervalMilliseconds % MillisecondsPerSecond) * NanosecondsPerMillisecond;
+    if (drainPeriod.tv_sec == 0 && drainPeriod.tv_nsec == 0) {
+        drainPeriod.tv_nsec = NanosecondsPerMillisecond;
+    }
+
+    drainTimer = CreateEventLoopDisarmedTimer(el, &DrainTimerEventHandler);
+    if (drainTimer == NULL) {
+        return ExitCode_Init_TelemetryQueueDrainTimer;
+    }
+
+    OpenStorage();
+
+    return ExitCode_Success;
+}
+
+void TelemetryQueue_Cleanup(void)
+{
+    DisposeEventLoopTimer(drainTimer);
+    drainTimer = NULL;
+    drainTimerArmed = false;
+
+    // Keep the messages which are still in RAM for the next run, oldest first, so that they are
+    // replayed in the order in which they were queued.
+    while (ramCount > 0 && SpillOldestRamEntry()) {
+    }
+    if (ramCount > 0) {
+        Log_Debug("WARNING: %u queued telemetry messages could not be saved.\n",
+                  (unsigned int)ramCount);
+        counters.dropped += (unsigned int)ramCount;
+        ramHead = 0;
+        ramCount = 0;
+    }
+
+    if (storageFd != -1) {
+        close(storageFd);
+        storageFd = -1;
+    }
+}
+
+bool TelemetryQueue_Enqueue(const char *jsonMessage, const char *iso8601DateTimeString,
+                            void *context)
+{
+    if (strlen(jsonMessage) >= TELEMETRY_QUEUE_MAX_MESSAGE_SIZE ||
+        (iso8601DateTimeString != NULL &&
+         strlen(iso8601DateTimeString) >= TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE)) {
+        Log_Debug("WARNING: Telemetry message too large to queue; dropping it.\n");
+        ++counters.dropped;
+        return false;
+    }
+
+    if (ramCount == RAM_QUEUE_CAPACITY && !SpillOldestRamEntry()) {
+        // No room in mutable storage either: discard the oldest message in RAM.
+        ramHead = (ramHead + 1) % RAM_QUEUE_CAPACITY;
+        --ramCount;
+        ++counters.dropped;
+    }
+
+    RamQueueEntry *entry = &ramQueue[(ramHead + ramCount) % RAM_QUEUE_CAPACITY];
+    strcpy(entry->message, jsonMessage);
+    strcpy(entry->timestamp, iso8601DateTimeString != NULL ? iso8601DateTimeString : "");
+    entry->context = context;
+    ++ramCount;
+    ++counters.queued;
+
+    Log_Debug("INFO: Telemetry queued (%u in RAM, %u in storage).\n", (unsigned int)ramCount,
+              (unsigned int)storageHeader.count);
+
+    UpdateDrainTimer();
+    return true;
+}
+
+void TelemetryQueue_SetDrainEnabled(bool enabled)
+{
+    drainEnabled = enabled;
+    UpdateDrainTimer();
+}
+
+size_t TelemetryQueue_GetLength(void)
+{
+    return ramCount + storageHeader.count;
+}
+
+void TelemetryQueue_GetCounters(TelemetryQueue_Counters *out)
+{
+    *out = counters;
+}
+
+/// <summary>
+///     Arm the drain timer if draining is enabled and there is something to send; disarm it
+///     otherwise, so that an idle queue causes no wakeups.
+/// </summary>
+static void UpdateDrainTimer(void)
+{
+    if (drainTimer == NULL) {
+        return;
+    }
+
+    bool shouldRun = drainEnabled && TelemetryQueue_GetLength() > 0;
+    if (shouldRun == drainTimerArmed) {
+        return;
+    }
+
+    if (shouldRun) {
+        SetEventLoopTimerPeriod(drainTimer, &drainPeriod);
+    } else {
+        DisarmEventLoopTimer(drainTimer);
+    }
+    drainTimerArmed = shouldRun;
+}
+
+/// <summary>
+///     Drain timer event: send up to messagesPerDrain queued messages, oldest first. Messages in
+///     mutable storage are always older than those in RAM, so they are sent first.
+/// </summary>
+static void DrainTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureCallbackFunction(ExitCode_TelemetryQueueDrainTimer_Consume);
+        return;
+    }
+
+    for (unsigned int i = 0; i < messagesPerDrain && drainEnabled; ++i) {
+        if (storageHeader.count > 0) {
+            static StorageQueueRecord record;
+            if (!ReadStorageRecord(storageHeader.head, &record)) {
+                // Skip an unreadable record rather than stalling the queue behind it.
+                storageHeader.head = (storageHeader.head + 1) % STORAGE_QUEUE_CAPACITY;
+                --storageHeader.count;
+                WriteStorageHeader();
+                ++counters.dropped;
+                continue;
+            }
+            if (!sendCallbackFunction(record.message,
+                                      record.timestamp[0] != '\0' ? record.timestamp : NULL,
+                                      NULL)) {
+                break;
+            }
+            storageHeader.head = (storageHeader.head + 1) % STORAGE_QUEUE_CAPACITY;
+            --storageHeader.count;
+            WriteStorageHeader();
+        } else if (ramCount > 0) {
+            RamQueueEntry *entry = &ramQueue[ramHead];
+            if (!sendCallbackFunction(entry->message,
+                                      entry->timestamp[0] != '\0' ? entry->timestamp : NULL,
+                                      entry->context)) {
+                break;
+            }
+            ramHead = (ramHead + 1) % RAM_QUEUE_CAPACITY;
+            --ramCount;
+        } else {
+            break;
+        }
+
+        ++counters.replayed;
+    }
+
+    UpdateDrainTimer();
+}
+
+/// <summary>
+///     Open the mutable file and load the queue header written by a previous run, if any.
+/// </summary>
+static void OpenStorage(void)
+{
+    storageFd = Storage_OpenMutableFile();
+    if (storageFd == -1) {
+        Log_Debug("WARNING: Could not open mutable file: %s (%d). Telemetry will not be spilled.\n",
+                  strerror(errno), errno);
+        return;
+    }
+
+    StorageQueueHeader header;
+    if (ReadAt(0, &header, sizeof(header)) && header.magic == STORAGE_HEADER_MAGIC &&
+        header.head < STORAGE_QUEUE_CAPACITY && header.count <= STORAGE_QUEUE_CAPACITY) {
+        storageHeader = header;
+        if (storageHeader.count > 0) {
+            Log_Debug("INFO: %u queued telemetry messages recovered from mutable storage.\n",
+                      storageHeader.count);
+        }
+    } else {
+        storageHeader.head = 0;
+        storageHeader.count = 0;
+        WriteStorageHeader();
+    }
+}
+
+/// <summary>
+///     Move the oldest message in the RAM ring to the back of the mutable storage ring. If the
+///     storage ring is full, its oldest record is overwritten.
+/// </summary>
+/// <returns>true if the message was spilled; false if mutable storage is unavailable.</returns>
+static bool SpillOldestRamEntry(void)
+{
+    if (storageFd == -1) {
+        return false;
+    }
+
+    static StorageQueueRecord record;
+    const RamQueueEntry *entry = &ramQueue[ramHead];
+    memset(&record, 0, sizeof(record));
+    strcpy(record.message, entry->message);
+    strcpy(record.timestamp, entry->timestamp);
+
+    uint32_t tail = (storageHeader.head + storageHeader.count) % STORAGE_QUEUE_CAPACITY;
+    if (!WriteStorageRecord(tail, &record)) {
+        return false;
+    }
+
+    if (storageHeader.count == STORAGE_QUEUE_CAPACITY) {
+        storageHeader.head = (storageHeader.head + 1) % STORAGE_QUEUE_CAPACITY;
+        ++counters.dropped;
+    } else {
+        ++storageHeader.count;
+    }
+
+    // The record is written before the header, so an interrupted spill leaves the previous queue
+    // contents intact.
+    WriteStorageHeader();
+
+    ramHead = (ramHead + 1) % RAM_QUEUE_CAPACITY;
+    --ramCount;
+    ++counters.spilled;
+    return true;
+}
+
+static bool ReadStorageRecord(uint32_t index, StorageQueueRecord *record)
+{
+    off_t offset = (off_t)(sizeof(StorageQueueHeader) + index * sizeof(StorageQueueRecord));
+    if (!ReadAt(offset, record, sizeof(*record))) {
+        return false;
+    }
+
+    // Guard against a corrupted record.
+    record->message[sizeof(record->message) - 1] = '\0';
+    record->timestamp[sizeof(record->timestamp) - 1] = '\0';
+    return true;
+}
+
+static bool WriteStorageRecord(uint32_t index, const StorageQueueRecord *record)
+{
+    off_t offset = (off_t)(sizeof(StorageQueueHeader) + index * sizeof(StorageQueueRecord));
+    return WriteAt(offset, record, sizeof(*record));
+}
+
+static bool WriteStorageHeader(void)
+{
+    return WriteAt(0, &storageHeader, sizeof(storageHeader));
+}
+
+static bool ReadAt(off_t offset, void *buffer, size_t size)
+{
+    if (storageFd == -1 || lseek(storageFd, offset, SEEK_SET) == -1) {
+        return false;
+    }
+
+    ssize_t ret = read(storageFd, buffer, size);
+    if (ret == -1) {
+        Log_Debug("ERROR: Could not read mutable file: %s (%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    return (size_t)ret == size;
+}
+
+static bool WriteAt(off_t offset, const void *buffer, size_t size)
+{
+    if (storageFd == -1 || lseek(storageFd, offset, SEEK_SET) == -1) {
+        return false;
+    }
+
+    ssize_t ret = write(storageFd, buffer, size);
+    if (ret == -1) {
+        // If the file has reached the maximum size specified in the application manifest,
+        // then -1 will be returned with errno EDQUOT (122)
+        Log_Debug("ERROR: Could not write mutable file: %s (%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    return (size_t)ret == size;
+}
@@ -0,0 +1,110 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <applibs/eventloop.h>
+#include "exitcodes.h"
+
+// This header describes a bounded store-and-forward queue for telemetry messages which could not
+// be sent immediately (for example, because the network is down). Messages are held in a
+// fixed-size RAM ring; when the ring is full, the oldest message is spilled to this application's
+// mutable storage. When draining is enabled, queued messages are handed to a send callback at a
+// configurable rate, oldest first.
+//
+// The queue does not depend on the Azure IoT C SDK; the send callback decides how a message is
+// delivered.
+
+/// <summary>
+/// Maximum size of a queued telemetry message, including the NULL terminator.
+/// </summary>
+#define TELEMETRY_QUEUE_MAX_MESSAGE_SIZE 1024
+
+/// <summary>
+/// Maximum size of a queued ISO 8601 timestamp, including the NULL terminator.
+/// </summary>
+#define TELEMETRY_QUEUE_MAX_TIMESTAMP_SIZE 32
+
+/// <summary>
+/// Callback type for a function to be invoked when a queued message should be sent.
+/// </summary>
+/// <param name="jsonMessage">The telemetry to send, as a NULL-terminated JSON string.</param>
+/// <param name="iso8601DateTimeString">The timestamp supplied when the message was queued, or
+/// NULL if there was none.</param>
+/// <param name="context">The context supplied when the message was queued. Messages that were
+/// spilled to mutable storage are always replayed with a NULL context.</param>
+/// <returns>true if the message was accepted for delivery; false if it should stay
+/// queued.</returns>
+typedef bool (*TelemetryQueue_SendCallbackType)(const char *jsonMessage,
+                                                const char *iso8601DateTimeString, void *context);
+
+/// <summary>
+/// Counters describing the activity of the telemetry queue.
+/// </summary>
+typedef struct {
+    /// <summary>Number of messages added to the queue.</summary>
+    unsigned int queued;
+    /// <summary>Number of messages discarded because the queue was full or they were too
+    /// large.</summary>
+    unsigned int dropped;
+    /// <summary>Number of messages moved from the RAM ring to mutable storage.</summary>
+    unsigned int spilled;
+    /// <summary>Number of queued messages accepted by the send callback.</summary>
+    unsigned int replayed;
+} TelemetryQueue_Counters;
+
+/// <summary>
+/// Initialize the telemetry queue. Messages spilled to mutable storage by a previous run of the
+/// application are picked up and will be replayed.
+/// </summary>
+/// <param name="el">EventLoop to register the drain timer to.</param>
+/// <param name="failureCallback">Function called on unrecoverable failure.</param>
+/// <param name="sendCallback">Function called to send each queued message.</param>
+/// <param name="drainIntervalMilliseconds">Interval between drain passes.</param>
+/// <param name="messagesPerDrainInterval">Maximum number of messages sent on each pass.</param>
+/// <returns>An <see cref="ExitCode" /> indicating success or failure.</returns>
+ExitCode TelemetryQueue_Initialize(EventLoop *el, ExitCode_CallbackType failureCallback,
+                                   TelemetryQueue_SendCallbackType sendCallback,
+                                   unsigned int drainIntervalMilliseconds,
+                                   unsigned int messagesPerDrainInterval);
+
+/// <summary>
+/// Dispose of the drain timer and close the mutable storage file. Messages that are still in the
+/// RAM ring are spilled to mutable storage, so that all queued messages are kept for the next
+/// run; they are lost only if mutable storage is unavailable. If the storage ring fills up, its
+/// oldest messages are overwritten, as when the queue is full.
+/// </summary>
+void TelemetryQueue_Cleanup(void);
+
+/// <summary>
+/// Add a message to the back of the queue. If the queue is full, the oldest message is dropped.
+/// </summary>
+/// <param name="jsonMessage">The telemetry to queue, as a NULL-terminated JSON string.</param>
+/// <param name="iso8601DateTimeString">Timestamp for the message, or NULL.</param>
+/// <param name="context">An optional context, passed to the send callback if the message is
+/// replayed from RAM.</param>
+/// <returns>true if the message was queued; false if it is too large to be queued.</returns>
+bool TelemetryQueue_Enqueue(const char *jsonMessage, const char *iso8601DateTimeString,
+                            void *context);
+
+/// <summary>
+/// Start or stop draining the queue. While draining is enabled and the queue is not empty, up to
+/// messagesPerDrainInterval messages are passed to the send callback on each drain interval.
+/// </summary>
+/// <param name="enabled">true to start draining; false to stop.</param>
+void TelemetryQueue_SetDrainEnabled(bool enabled);
+
+/// <summary>
+/// Get the number of messages currently queued, in RAM and in mutable storage.
+/// </summary>
+/// <returns>The number of queued messages.</returns>
+size_t TelemetryQueue_GetLength(void);
+
+/// <summary>
+/// Get the telemetry queue counters.
+/// </summary>
+/// <param name="counters">(out) Receives the current counter values.</param>
+void TelemetryQueue_GetCounters(TelemetryQueue_Counters *counters);
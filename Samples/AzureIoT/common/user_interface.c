@@ -3,6 +3,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <applibs/gpio.h>
 #include <applibs/log.h>
@@ -22,66 +23,38 @@
 // See https://aka.ms/azsphere-samples-hardwaredefinitions for further details on this feature.
 #include <hw/sample_appliance.h>
 
-#include "eventloop_timer_utilities.h"
+#include "input_service.h"
 
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer);
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState);
+static void ButtonEventHandler(InputService_Event event, void *context);
+static void InputFailureHandler(void);
 static void CloseFdAndPrintError(int fd, const char *fdName);
 
 // File descriptors - initialized to invalid value
-static int buttonAGpioFd = -1;
-static int buttonBGpioFd = -1;
 static int statusLedGpioFd = -1;
 
-static EventLoopTimer *buttonPollTimer = NULL;
-
 static ExitCode_CallbackType failureCallbackFunction = NULL;
 static UserInterface_ButtonPressedCallbackType buttonPressedCallbackFunction = NULL;
 
-// State variables
-static GPIO_Value_Type buttonAState = GPIO_Value_High;
-static GPIO_Value_Type buttonBState = GPIO_Value_High;
+// Passed to the input service as the context of each button.
+static const UserInterface_Button buttonA = UserInterface_Button_A;
+static const UserInterface_Button buttonB = UserInterface_Button_B;
 
 /// <summary>
-///     Check whether a given button has just been pressed.
+///     Button event: report a button press.
 /// </summary>
-/// <param name="fd">The button file descriptor</param>
-/// <param name="oldState">Old state of the button (pressed or released)</param>
-/// <returns>true if pressed, false otherwise</returns>
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState)
+static void ButtonEventHandler(InputService_Event event, void *context)
 {
-    bool isButtonPressed = false;
-    GPIO_Value_Type newState;
-    int result = GPIO_GetValue(fd, &newState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        failureCallbackFunction(ExitCode_IsButtonPressed_GetValue);
-    } else {
-        // Button is pressed if it is low and different than last known state.
-        isButtonPressed = (newState != *oldState) && (newState == GPIO_Value_Low);
-        *oldState = newState;
+    if (event == InputService_Event_Pressed && NULL != buttonPressedCallbackFunction) {
+        buttonPressedCallbackFunction(*(const UserInterface_Button *)context);
     }
-
-    return isButtonPressed;
 }
 
 /// <summary>
-///     Button timer event:  Check the status of the button
+///     Handle a failure to read the buttons.
 /// </summary>
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer)
+static void InputFailureHandler(void)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        failureCallbackFunction(ExitCode_ButtonTimer_Consume);
-        return;
-    }
-
-    if (IsButtonPressed(buttonAGpioFd, &buttonAState) && NULL != buttonPressedCallbackFunction) {
-        buttonPressedCallbackFunction(UserInterface_Button_A);
-    }
-
-    if (IsButtonPressed(buttonBGpioFd, &buttonBState) && NULL != buttonPressedCallbackFunction) {
-        buttonPressedCallbackFunction(UserInterface_Button_B);
-    }
+    failureCallbackFunction(ExitCode_IsButtonPressed_GetValue);
 }
 
 /// <summary>
@@ -106,19 +79,22 @@ ExitCode UserInterface_Initialise(EventLoop *el,
     failureCallbackFunction = failureCallback;
     buttonPressedCallbackFunction = buttonPressedCallback;
 
-    // Open SAMPLE_BUTTON_1 GPIO as input
+    // Start the input service, which reads the buttons.
+    if (InputService_Init(el, InputFailureHandler) != 0) {
+        return ExitCode_Init_ButtonPollTimer;
+    }
+
+    // Open SAMPLE_BUTTON_1 and SAMPLE_BUTTON_2 GPIOs as inputs. The buttons have GPIO_Value_Low
+    // when pressed and GPIO_Value_High when released.
     Log_Debug("Opening SAMPLE_BUTTON_1 as input.\n");
-    buttonAGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
-    if (buttonAGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_BUTTON_1: %s (%d).\n", strerror(errno), errno);
+    if (InputService_AddInput(SAMPLE_BUTTON_1, GPIO_Value_Low, ButtonEventHandler,
+                              (void *)&buttonA) != 0) {
         return ExitCode_Init_Button;
     }
 
-    // Open SAMPLE_BUTTON_2 GPIO as input
     Log_Debug("Opening SAMPLE_BUTTON_2 as input.\n");
-    buttonBGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_2);
-    if (buttonBGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_BUTTON_2: %s (%d).\n", strerror(errno), errno);
+    if (InputService_AddInput(SAMPLE_BUTTON_2, GPIO_Value_Low, ButtonEventHandler,
+                              (void *)&buttonB) != 0) {
         return ExitCode_Init_Button;
     }
 
@@ -130,28 +106,18 @@ ExitCode UserInterface_Initialise(EventLoop *el,
         return ExitCode_Init_Led;
     }
 
-    // Set up a timer to poll for button events.
-    static const struct timespec buttonPressCheckPeriod = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer =
-        CreateEventLoopPeriodicTimer(el, &ButtonPollTimerEventHandler, &buttonPressCheckPeriod);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
-    }
-
     return ExitCode_Success;
 }
 
 void UserInterface_Cleanup(void)
 {
-    DisposeEventLoopTimer(buttonPollTimer);
+    InputService_Cleanup();
 
     // Leave the LEDs off
     if (statusLedGpioFd >= 0) {
         GPIO_SetValue(statusLedGpioFd, GPIO_Value_High);
     }
 
-    CloseFdAndPrintError(buttonAGpioFd, "ButtonA");
-    CloseFdAndPrintError(buttonBGpioFd, "ButtonB");
     CloseFdAndPrintError(statusLedGpioFd, "StatusLed");
 }
 
@@ -0,0 +1,9 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/log.h when the sample is built on a PC. The test program
+// defines Log_Debug.
+
+#pragma once
+
+int Log_Debug(const char *fmt, ...);
@@ -0,0 +1,435 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for dns-sd-cache.c and dns-sd.c, which runs on a Linux PC. A UDP responder on the loopback
+// interface stands in for the mDNS proxy, and answers queries with canned records for two service
+// instances on one host. The test wraps sendto at link time, to send the queries to the responder
+// rather than to port 53, and clock_gettime, so an hour of the cache's time passes in well under
+// a second.
+//
+// The responder answers an ANY query with the SRV and TXT records of an instance, but not its A
+// record, so each instance must also query the address of the host. After 30 minutes the second
+// instance stops answering, and after 40 minutes the responder sends a goodbye for the first. The
+// test reports the queries of each type which the responder received, and checks that:
+//   - both instances are added, with the details from their records;
+//   - the address query which both instances need is sent once;
+//   - no query is sent again less than a second after an identical one;
+//   - the second instance is removed when its records expire, and the first one second after its
+//     goodbye.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <applibs/log.h>
+
+#include "dns-sd-cache.h"
+
+#define SERVICE_NAME "_sample-service._tcp.local"
+#define INSTANCE_1 "inst1." SERVICE_NAME
+#define INSTANCE_2 "inst2." SERVICE_NAME
+#define HOST_NAME "host1.local"
+#define HOST_ADDRESS "192.168.1.7"
+#define SERVICE_PORT 8080
+#define TXT_DATA "a=1"
+
+// TTLs which RFC 6762 recommends, in seconds.
+#define PTR_TTL 4500
+#define HOST_RECORD_TTL 120
+
+// Both instances are resolved within this time. The cache waits a second before it queries for
+// records which a response did not include.
+#define RESOLVE_MS (5 * 1000)
+#define INSTANCE_2_OFFLINE_MS (30 * 60 * 1000)
+#define GOODBYE_MS (40 * 60 * 1000)
+#define END_MS (60 * 60 * 1000)
+
+#define MAX_MESSAGE_SIZE 512
+#define MAX_QUERY_HISTORY 16
+
+typedef struct {
+    const char *name;
+    int64_t addedAt;
+    int64_t removedAt;
+    ServiceInstanceDetails details;
+} InstanceEvents;
+
+typedef struct {
+    char name[NS_MAXDNAME];
+    int type;
+    int64_t receivedAt;
+} ReceivedQuery;
+
+// Simulated CLOCK_MONOTONIC time, in milliseconds.
+static int64_t nowMs = 1000;
+static int64_t nextRefreshMs = 0;
+
+static int cacheFd = -1;
+static int responderFd = -1;
+static struct sockaddr_in responderAddress;
+
+static bool instance2Online = true;
+static unsigned queriesByType[ns_t_any + 1];
+static ReceivedQuery recentQueries[MAX_QUERY_HISTORY];
+static size_t nextRecentQuery = 0;
+static unsigned repeatedQueries = 0;
+
+static InstanceEvents instances[] = {{.name = INSTANCE_1}, {.name = INSTANCE_2}};
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int __wrap_clock_gettime(clockid_t clock, struct timespec *now)
+{
+    now->tv_sec = (time_t)(nowMs / 1000);
+    now->tv_nsec = (long)(nowMs % 1000) * 1000000;
+    return 0;
+}
+
+// Sends the cache's queries to the responder rather than to port 53.
+ssize_t __real_sendto(int fd, const void *buf, size_t len, int flags,
+                      const struct sockaddr *address, socklen_t addressLength);
+ssize_t __wrap_sendto(int fd, const void *buf, size_t len, int flags,
+                      const struct sockaddr *address, socklen_t addressLength)
+{
+    if (fd == cacheFd) {
+        address = (const struct sockaddr *)&responderAddress;
+        addressLength = sizeof(responderAddress);
+    }
+    return __real_sendto(fd, buf, len, flags, address, addressLength);
+}
+
+static void HandleInstanceChange(DnsSdCacheChange change, const ServiceInstanceDetails *instance,
+                                 void *context)
+{
+    for (size_t i = 0; i < sizeof(instances) / sizeof(instances[0]); ++i) {
+        if (strcasecmp(instances[i].name, instance->name) != 0) {
+            continue;
+        }
+        if (change == DnsSdCacheChange_Added) {
+            instances[i].addedAt = nowMs;
+            instances[i].details = *instance;
+            // The strings are only valid during the callback.
+            instances[i].details.name = NULL;
+            instances[i].details.txtData = NULL;
+            instances[i].details.host =
+                (strcasecmp(instance->host, HOST_NAME) == 0) ? HOST_NAME : NULL;
+            if (instance->txtDataLength != strlen(TXT_DATA) + 1 ||
+                memcmp(instance->txtData + 1, TXT_DATA, strlen(TXT_DATA)) != 0) {
+                Fail("HandleInstanceChange", "wrong TXT data", (long)i);
+            }
+        } else {
+            instances[i].removedAt = nowMs;
+        }
+    }
+}
+
+static uint8_t *PutName(uint8_t *out, const char *name)
+{
+    while (*name != '\0') {
+        const char *dot = strchr(name, '.');
+        size_t length = (dot == NULL) ? strlen(name) : (size_t)(dot - name);
+        *out++ = (uint8_t)length;
+        memcpy(out, name, length);
+        out += length;
+        name += length + (dot == NULL ? 0 : 1);
+    }
+    *out++ = 0;
+    return out;
+}
+
+static uint8_t *Put16(uint8_t *out, uint16_t value)
+{
+    *out++ = (uint8_t)(value >> 8);
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// Appends a resource record, whose data is written by the caller after the returned pointer.
+static uint8_t *PutRecordHeader(uint8_t *out, const char *name, int type, uint32_t ttl)
+{
+    out = PutName(out, name);
+    out = Put16(out, (uint16_t)type);
+    out = Put16(out, ns_c_in);
+    out = Put16(out, (uint16_t)(ttl >> 16));
+    out = Put16(out, (uint16_t)ttl);
+    return out;
+}
+
+static uint8_t *PutPtrRecord(uint8_t *out, const char *instanceName, uint32_t ttl)
+{
+    out = PutRecordHeader(out, SERVICE_NAME, ns_t_ptr, ttl);
+    uint8_t *data = out + 2;
+    uint8_t *end = PutName(data, instanceName);
+    Put16(out, (uint16_t)(end - data));
+    return end;
+}
+
+static uint8_t *PutSrvRecord(uint8_t *out, const char *instanceName)
+{
+    out = PutRecordHeader(out, instanceName, ns_t_srv, HOST_RECORD_TTL);
+    uint8_t *data = out + 2;
+    uint8_t *end = Put16(Put16(Put16(data, 0), 0), SERVICE_PORT);
+    end = PutName(end, HOST_NAME);
+    Put16(out, (uint16_t)(end - data));
+    return end;
+}
+
+static uint8_t *PutTxtRecord(uint8_t *out, const char *instanceName)
+{
+    out = PutRecordHeader(out, instanceName, ns_t_txt, HOST_RECORD_TTL);
+    out = Put16(out, (uint16_t)(strlen(TXT_DATA) + 1));
+    *out++ = (uint8_t)strlen(TXT_DATA);
+    memcpy(out, TXT_DATA, strlen(TXT_DATA));
+    return out + strlen(TXT_DATA);
+}
+
+static uint8_t *PutARecord(uint8_t *out)
+{
+    out = PutRecordHeader(out, HOST_NAME, ns_t_a, HOST_RECORD_TTL);
+    out = Put16(out, sizeof(struct in_addr));
+    inet_pton(AF_INET, HOST_ADDRESS, out);
+    return out + sizeof(struct in_addr);
+}
+
+static void SendResponse(const uint8_t *id, uint8_t *message, uint8_t *end, uint16_t answers,
+                         const struct sockaddr_in *to)
+{
+    memcpy(message, id, 2);
+    uint8_t *header = Put16(message + 2, 0x8400);
+    header = Put16(header, 0);
+    header = Put16(header, answers);
+    header = Put16(header, 0);
+    Put16(header, 0);
+    sendto(responderFd, message, (size_t)(end - message), 0, (const struct sockaddr *)to,
+           sizeof(*to));
+}
+
+// Records a query, and counts it if an identical query was received less than a second ago.
+static void RecordQuery(const char *name, int type)
+{
+    if (type <= ns_t_any) {
+        ++queriesByType[type];
+    }
+    for (size_t i = 0; i < MAX_QUERY_HISTORY; ++i) {
+        const ReceivedQuery *query = &recentQueries[i];
+        if (query->type == type && nowMs - query->receivedAt < 1000 &&
+            strcasecmp(query->name, name) == 0) {
+            ++repeatedQueries;
+        }
+    }
+
+    ReceivedQuery *query = &recentQueries[nextRecentQuery];
+    nextRecentQuery = (nextRecentQuery + 1) % MAX_QUERY_HISTORY;
+    snprintf(query->name, sizeof(query->name), "%s", name);
+    query->type = type;
+    query->receivedAt = nowMs;
+}
+
+// Answers the queries which the cache has sent. Returns the number of queries answered.
+static unsigned AnswerQueries(void)
+{
+    unsigned count = 0;
+    uint8_t query[MAX_MESSAGE_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    ssize_t length;
+    while ((length = recvfrom(responderFd, query, sizeof(query), MSG_DONTWAIT,
+                              (struct sockaddr *)&from, &fromLength)) > 0) {
+        ++count;
+        ns_msg message;
+        ns_rr question;
+        if (ns_initparse(query, (int)length, &message) != 0 ||
+            ns_parserr(&message, ns_s_qd, 0, &question) != 0) {
+            Fail("AnswerQueries", "malformed query", (long)length);
+            continue;
+        }
+        const char *name = ns_rr_name(question);
+        int type = ns_rr_type(question);
+        RecordQuery(name, type);
+
+        uint8_t response[MAX_MESSAGE_SIZE];
+        uint8_t *end = response + NS_HFIXEDSZ;
+        uint16_t answers = 0;
+        if (type == ns_t_ptr && strcasecmp(name, SERVICE_NAME) == 0) {
+            end = PutPtrRecord(end, INSTANCE_1, PTR_TTL);
+            ++answers;
+            if (instance2Online) {
+                end = PutPtrRecord(end, INSTANCE_2, PTR_TTL);
+                ++answers;
+            }
+        } else if (type == ns_t_any && (strcasecmp(name, INSTANCE_1) == 0 ||
+                                        (instance2Online && strcasecmp(name, INSTANCE_2) == 0))) {
+            end = PutTxtRecord(PutSrvRecord(end, name), name);
+            answers = 2;
+        } else if (type == ns_t_a && strcasecmp(name, HOST_NAME) == 0) {
+            end = PutARecord(end);
+            answers = 1;
+        } else {
+            continue;
+        }
+        SendResponse(query, response, end, answers, &from);
+    }
+    return count;
+}
+
+static void RefreshCache(void)
+{
+    struct timespec nextRefresh;
+    DnsSdCache_Refresh(&nextRefresh);
+    nextRefreshMs = nowMs + nextRefresh.tv_sec * 1000 + nextRefresh.tv_nsec / 1000000;
+}
+
+// Exchanges queries and responses until the cache sends no more queries, as main.c does when
+// the socket is readable. Loopback datagrams arrive as soon as they are sent.
+static void ExchangeMessages(void)
+{
+    unsigned answered;
+    do {
+        answered = AnswerQueries();
+        struct pollfd pfd = {.fd = cacheFd, .events = POLLIN};
+        while (poll(&pfd, 1, 0) == 1) {
+            if (DnsSdCache_ProcessResponse() != 0) {
+                Fail("ExchangeMessages", "could not process response", errno);
+                return;
+            }
+            RefreshCache();
+        }
+    } while (answered != 0);
+}
+
+// Runs the cache's timer, as main.c does, until the simulated time reaches endMs.
+static void RunUntil(int64_t endMs)
+{
+    while (nowMs < endMs) {
+        RefreshCache();
+        ExchangeMessages();
+        nowMs = (nextRefreshMs < endMs) ? nextRefreshMs : endMs;
+    }
+}
+
+static bool OpenSockets(void)
+{
+    cacheFd = socket(AF_INET, SOCK_DGRAM, 0);
+    responderFd = socket(AF_INET, SOCK_DGRAM, 0);
+    responderAddress.sin_family = AF_INET;
+    responderAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(responderAddress);
+    return cacheFd != -1 && responderFd != -1 &&
+           bind(responderFd, (struct sockaddr *)&responderAddress, sizeof(responderAddress)) == 0 &&
+           getsockname(responderFd, (struct sockaddr *)&responderAddress, &addressLength) == 0;
+}
+
+// Sends an unsolicited goodbye for the first instance, as a responder does when a service stops.
+static void SendGoodbye(void)
+{
+    struct sockaddr_in cacheAddress;
+    socklen_t addressLength = sizeof(cacheAddress);
+    getsockname(cacheFd, (struct sockaddr *)&cacheAddress, &addressLength);
+
+    uint8_t response[MAX_MESSAGE_SIZE];
+    uint8_t *end = PutPtrRecord(response + NS_HFIXEDSZ, INSTANCE_1, 0);
+    const uint8_t id[2] = {0, 0};
+    SendResponse(id, response, end, 1, &cacheAddress);
+    ExchangeMessages();
+}
+
+static void PrintQueries(const char *phase)
+{
+    printf("%-28s %6u %6u %6u %6u\n", phase, queriesByType[ns_t_ptr], queriesByType[ns_t_any],
+           queriesByType[ns_t_a],
+           queriesByType[ns_t_ptr] + queriesByType[ns_t_any] + queriesByType[ns_t_a]);
+    memset(queriesByType, 0, sizeof(queriesByType));
+}
+
+int main(void)
+{
+    if (!OpenSockets()) {
+        printf("ERROR: Could not open the sockets: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    DnsSdCache_Init(SERVICE_NAME, cacheFd, HandleInstanceChange, NULL);
+
+    printf("%-28s %6s %6s %6s %6s\n", "phase", "PTR", "ANY", "A", "total");
+    const int64_t startMs = nowMs;
+    RunUntil(startMs + RESOLVE_MS);
+    PrintQueries("first 5 s");
+    for (size_t i = 0; i < sizeof(instances) / sizeof(instances[0]); ++i) {
+        const ServiceInstanceDetails *details = &instances[i].details;
+        if (instances[i].addedAt == 0 || details->host == NULL || details->port != SERVICE_PORT ||
+            details->ipv4Address.s_addr != inet_addr(HOST_ADDRESS)) {
+            Fail("main", "instance was not resolved", (long)i);
+        }
+    }
+    DnsSdCacheCounters counters;
+    DnsSdCache_GetCounters(&counters);
+    if (counters.queriesCoalesced == 0) {
+        Fail("main", "address query was not coalesced", 0);
+    }
+
+    RunUntil(startMs + INSTANCE_2_OFFLINE_MS);
+    PrintQueries("until 30 min");
+    instance2Online = false;
+    RunUntil(startMs + GOODBYE_MS);
+    PrintQueries("until 40 min, one offline");
+    SendGoodbye();
+    RunUntil(startMs + END_MS);
+    PrintQueries("until 60 min, after goodbye");
+
+    DnsSdCache_GetCounters(&counters);
+    printf("%u queries sent, %u coalesced, %u records received\n", counters.queriesSent,
+           counters.queriesCoalesced, counters.recordsReceived);
+    printf("instance 2 removed %.1f s after going offline, instance 1 %.1f s after its goodbye\n",
+           (double)(instances[1].removedAt - startMs - INSTANCE_2_OFFLINE_MS) / 1000.0,
+           (double)(instances[0].removedAt - startMs - GOODBYE_MS) / 1000.0);
+
+    if (repeatedQueries != 0) {
+        Fail("main", "identical queries within a second", (long)repeatedQueries);
+    }
+    if (instances[1].removedAt <= startMs + INSTANCE_2_OFFLINE_MS ||
+        instances[1].removedAt > startMs + INSTANCE_2_OFFLINE_MS + HOST_RECORD_TTL * 1000) {
+        Fail("main", "instance 2 was not removed when its records expired",
+             (long)instances[1].removedAt);
+    }
+    if (instances[0].removedAt < startMs + GOODBYE_MS + 1000 ||
+        instances[0].removedAt > startMs + GOODBYE_MS + 1100) {
+        Fail("main", "instance 1 was not removed after its goodbye", (long)instances[0].removedAt);
+    }
+
+    DnsSdCache_Fini();
+    close(cacheFd);
+    close(responderFd);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,494 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "dns-sd-cache.h"
+#include <applibs/log.h>
+#include <errno.h>
+#include <resolv.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define MAX_NAME_LENGTH 256u
+#define SENT_QUERY_HISTORY_SIZE 16u
+
+/// <summary>
+/// When a record expires, and when it should next be queried, in milliseconds on the
+/// CLOCK_MONOTONIC clock. A record which has not been received has an expiry of zero.
+/// </summary>
+typedef struct {
+    int64_t expiry;
+    int64_t nextRefresh;
+    int64_t refreshInterval;
+} RecordLifetime;
+
+/// <summary>
+/// A service instance in the cache.
+/// </summary>
+typedef struct {
+    bool inUse;
+    /// <summary>Whether the instance has been reported as added</summary>
+    bool isAnnounced;
+    ServiceInstanceDetails details;
+    RecordLifetime ptr;
+    RecordLifetime srv;
+    RecordLifetime txt;
+    RecordLifetime a;
+    /// <summary>When to query again for records which the instance is missing</summary>
+    int64_t nextResolve;
+    int64_t resolveInterval;
+} CacheEntry;
+
+/// <summary>
+/// A query which was sent recently, so it can be coalesced with identical queries.
+/// </summary>
+typedef struct {
+    char name[MAX_NAME_LENGTH];
+    int type;
+    int64_t sentAt;
+} SentQuery;
+
+static const char *cacheServiceName = NULL;
+static int cacheFd = -1;
+static DnsSdCacheChangeHandler changeHandler = NULL;
+static void *changeContext = NULL;
+
+static CacheEntry entries[DNS_SD_CACHE_MAX_INSTANCES];
+static SentQuery sentQueries[SENT_QUERY_HISTORY_SIZE];
+static size_t nextSentQuery = 0;
+static int64_t nextBrowse = 0;
+static int64_t browseInterval = 0;
+static DnsSdCacheCounters cacheCounters;
+
+// An identical query which was sent more recently than this is not sent again.
+static const int64_t queryHoldOffMs = 1000;
+// Browse queries find new instances. The interval doubles after each query, up to the maximum.
+static const int64_t initialBrowseIntervalMs = 10 * 1000;
+static const int64_t maxBrowseIntervalMs = 15 * 60 * 1000;
+// Queries for the missing records of an instance back off in the same way.
+static const int64_t initialResolveIntervalMs = 1000;
+static const int64_t maxResolveIntervalMs = 60 * 1000;
+// A record which is withdrawn with a TTL of zero is kept for one second (RFC 6762, section 10.1).
+static const int64_t goodbyeDelayMs = 1000;
+// The shortest delay which is returned by DnsSdCache_Refresh.
+static const int64_t minRefreshDelayMs = 10;
+
+static int64_t GetNowMilliseconds(void);
+static void SetRecordLifetime(RecordLifetime *lifetime, uint32_t ttl, int64_t now);
+static bool IsRecordLive(const RecordLifetime *lifetime, int64_t now);
+static bool RefreshRecordIfDue(RecordLifetime *lifetime, int64_t now);
+static void SendQuery(const char *name, int type, int64_t now);
+static CacheEntry *FindEntry(const char *instanceName);
+static CacheEntry *AddEntry(const char *instanceName, int64_t now);
+static void ClearEntry(CacheEntry *entry);
+static void WithdrawEntry(CacheEntry *entry);
+static int ReplaceString(char **field, const char *value);
+static void HandleRecord(const DnsRecord *record, void *context);
+static int64_t RefreshEntry(CacheEntry *entry, int64_t now);
+
+/// <summary>
+/// Get the current time of the CLOCK_MONOTONIC clock in milliseconds.
+/// </summary>
+static int64_t GetNowMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/// <summary>
+/// Set the lifetime of a record which has just been received.
+/// </summary>
+static void SetRecordLifetime(RecordLifetime *lifetime, uint32_t ttl, int64_t now)
+{
+    if (ttl == 0) {
+        lifetime->expiry = now + goodbyeDelayMs;
+        lifetime->nextRefresh = lifetime->expiry;
+        lifetime->refreshInterval = 0;
+        return;
+    }
+
+    int64_t ttlMs = (int64_t)ttl * 1000;
+    lifetime->expiry = now + ttlMs;
+    lifetime->nextRefresh = now + ttlMs * 80 / 100;
+    lifetime->refreshInterval = ttlMs * 5 / 100;
+}
+
+static bool IsRecordLive(const RecordLifetime *lifetime, int64_t now)
+{
+    return lifetime->expiry > now;
+}
+
+/// <summary>
+/// Check whether a record should be queried again, and if so, schedule the following refresh.
+/// </summary>
+/// <returns>true if the record should be queried now; false otherwise.</returns>
+static bool RefreshRecordIfDue(RecordLifetime *lifetime, int64_t now)
+{
+    if (!IsRecordLive(lifetime, now) || now < lifetime->nextRefresh) {
+        return false;
+    }
+
+    if (lifetime->refreshInterval == 0) {
+        lifetime->nextRefresh = lifetime->expiry;
+    } else {
+        while (lifetime->nextRefresh <= now) {
+            lifetime->nextRefresh += lifetime->refreshInterval;
+        }
+    }
+    return true;
+}
+
+/// <summary>
+/// Send a query, unless an identical query was sent within <see cref="queryHoldOffMs"/>.
+/// </summary>
+/// <param name="name">The name to query</param>
+/// <param name="type">ns_t_ptr, ns_t_any or ns_t_a</param>
+/// <param name="now">The current time</param>
+static void SendQuery(const char *name, int type, int64_t now)
+{
+    for (size_t i = 0; i < SENT_QUERY_HISTORY_SIZE; ++i) {
+        const SentQuery *sent = &sentQueries[i];
+        if (sent->type == type && now - sent->sentAt < queryHoldOffMs &&
+            strcasecmp(sent->name, name) == 0) {
+            ++cacheCounters.queriesCoalesced;
+            return;
+        }
+    }
+
+    int result;
+    switch (type) {
+    case ns_t_ptr:
+        result = SendServiceDiscoveryQuery(name, cacheFd);
+        break;
+    case ns_t_any:
+        result = SendServiceInstanceDetailsQuery(name, cacheFd);
+        break;
+    default:
+        result = SendHostAddressQuery(name, cacheFd);
+        break;
+    }
+    if (result != 0) {
+        return;
+    }
+
+    ++cacheCounters.queriesSent;
+
+    // Replace the oldest entry in the history.
+    SentQuery *sent = &sentQueries[nextSentQuery];
+    nextSentQuery = (nextSentQuery + 1) % SENT_QUERY_HISTORY_SIZE;
+    strncpy(sent->name, name, sizeof(sent->name) - 1);
+    sent->name[sizeof(sent->name) - 1] = '\0';
+    sent->type = type;
+    sent->sentAt = now;
+}
+
+static CacheEntry *FindEntry(const char *instanceName)
+{
+    for (size_t i = 0; i < DNS_SD_CACHE_MAX_INSTANCES; ++i) {
+        if (entries[i].inUse && strcasecmp(entries[i].details.name, instanceName) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static CacheEntry *AddEntry(const char *instanceName, int64_t now)
+{
+    for (size_t i = 0; i < DNS_SD_CACHE_MAX_INSTANCES; ++i) {
+        CacheEntry *entry = &entries[i];
+        if (entry->inUse) {
+            continue;
+        }
+
+        entry->details.name = strdup(instanceName);
+        if (!entry->details.name) {
+            Log_Debug("ERROR: strdup for instance name failed: %d (%s)\n", errno, strerror(errno));
+            return NULL;
+        }
+        entry->inUse = true;
+        entry->details.ipv4Address.s_addr = INADDR_NONE;
+        entry->nextResolve = now;
+        entry->resolveInterval = initialResolveIntervalMs;
+        return entry;
+    }
+
+    Log_Debug("WARNING: The DNS-SD cache is full; ignoring instance %s.\n", instanceName);
+    return NULL;
+}
+
+static void ClearEntry(CacheEntry *entry)
+{
+    free(entry->details.name);
+    free(entry->details.host);
+    free(entry->details.txtData);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/// <summary>
+/// Report that an instance has been removed, if it was reported as added.
+/// </summary>
+static void WithdrawEntry(CacheEntry *entry)
+{
+    if (entry->isAnnounced) {
+        entry->isAnnounced = false;
+        changeHandler(DnsSdCacheChange_Removed, &entry->details, changeContext);
+    }
+}
+
+/// <summary>
+/// Replace a string in the instance details with a copy of a new value.
+/// </summary>
+/// <returns>0 if succeeded, -1 if an error occurred.</returns>
+static int ReplaceString(char **field, const char *value)
+{
+    char *copy = strdup(value);
+    if (!copy) {
+        Log_Debug("ERROR: strdup: %d (%s)\n", errno, strerror(errno));
+        return -1;
+    }
+    free(*field);
+    *field = copy;
+    return 0;
+}
+
+/// <summary>
+/// Update the cache from a received record.
+/// This function follows the <see cref="DnsRecordHandler"/> signature.
+/// </summary>
+static void HandleRecord(const DnsRecord *record, void *context)
+{
+    int64_t now = *(const int64_t *)context;
+    ++cacheCounters.recordsReceived;
+
+    switch (record->type) {
+    case ns_t_ptr: {
+        if (strcasecmp(record->name, cacheServiceName) != 0) {
+            break;
+        }
+        CacheEntry *entry = FindEntry(record->target);
+        if (!entry) {
+            if (record->ttl == 0) {
+                break;
+            }
+            entry = AddEntry(record->target, now);
+            if (!entry) {
+                break;
+            }
+        }
+        SetRecordLifetime(&entry->ptr, record->ttl, now);
+        break;
+    }
+    case ns_t_srv: {
+        CacheEntry *entry = FindEntry(record->name);
+        if (!entry) {
+            break;
+        }
+
+        // The instance has moved, so its address has to be resolved again.
+        bool hostChanged = !entry->details.host || strcasecmp(entry->details.host, record->target);
+        if (hostChanged || entry->details.port != record->port) {
+            WithdrawEntry(entry);
+        }
+        if (hostChanged) {
+            if (ReplaceString(&entry->details.host, record->target) != 0) {
+                break;
+            }
+            entry->details.ipv4Address.s_addr = INADDR_NONE;
+            memset(&entry->a, 0, sizeof(entry->a));
+        }
+        entry->details.port = record->port;
+        SetRecordLifetime(&entry->srv, record->ttl, now);
+        break;
+    }
+    case ns_t_txt: {
+        CacheEntry *entry = FindEntry(record->name);
+        if (!entry) {
+            break;
+        }
+
+        char *txtData = malloc(record->txtDataLength + 1u);
+        if (!txtData) {
+            Log_Debug("ERROR: malloc: %d (%s)\n", errno, strerror(errno));
+            break;
+        }
+        memcpy(txtData, record->txtData, record->txtDataLength);
+        free(entry->details.txtData);
+        entry->details.txtData = txtData;
+        entry->details.txtDataLength = record->txtDataLength;
+        SetRecordLifetime(&entry->txt, record->ttl, now);
+        break;
+    }
+    case ns_t_a: {
+        // Several instances may share a host.
+        for (size_t i = 0; i < DNS_SD_CACHE_MAX_INSTANCES; ++i) {
+            CacheEntry *entry = &entries[i];
+            if (!entry->inUse || !entry->details.host ||
+                strcasecmp(entry->details.host, record->name) != 0) {
+                continue;
+            }
+            if (entry->details.ipv4Address.s_addr != record->ipv4Address.s_addr) {
+                WithdrawEntry(entry);
+                entry->details.ipv4Address = record->ipv4Address;
+            }
+            SetRecordLifetime(&entry->a, record->ttl, now);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/// <summary>
+/// Expire the records of an instance, send the queries which it needs, and report changes.
+/// </summary>
+/// <returns>The time at which the instance next needs attention.</returns>
+static int64_t RefreshEntry(CacheEntry *entry, int64_t now)
+{
+    if (!IsRecordLive(&entry->ptr, now)) {
+        WithdrawEntry(entry);
+        ClearEntry(entry);
+        return INT64_MAX;
+    }
+
+    // Forget the records which have expired.
+    if (entry->srv.expiry != 0 && !IsRecordLive(&entry->srv, now)) {
+        WithdrawEntry(entry);
+        free(entry->details.host);
+        entry->details.host = NULL;
+        entry->details.port = 0;
+        memset(&entry->srv, 0, sizeof(entry->srv));
+        memset(&entry->a, 0, sizeof(entry->a));
+        entry->details.ipv4Address.s_addr = INADDR_NONE;
+    }
+    if (entry->txt.expiry != 0 && !IsRecordLive(&entry->txt, now)) {
+        free(entry->details.txtData);
+        entry->details.txtData = NULL;
+        entry->details.txtDataLength = 0;
+        memset(&entry->txt, 0, sizeof(entry->txt));
+    }
+    if (entry->a.expiry != 0 && !IsRecordLive(&entry->a, now)) {
+        WithdrawEntry(entry);
+        entry->details.ipv4Address.s_addr = INADDR_NONE;
+        memset(&entry->a, 0, sizeof(entry->a));
+    }
+
+    // Refresh the records which are about to expire. One PTR query refreshes every instance,
+    // and one ANY query refreshes both the SRV and TXT records.
+    if (RefreshRecordIfDue(&entry->ptr, now)) {
+        SendQuery(cacheServiceName, ns_t_ptr, now);
+    }
+    bool srvDue = RefreshRecordIfDue(&entry->srv, now);
+    bool txtDue = RefreshRecordIfDue(&entry->txt, now);
+    if (srvDue || txtDue) {
+        SendQuery(entry->details.name, ns_t_any, now);
+    }
+    if (RefreshRecordIfDue(&entry->a, now)) {
+        SendQuery(entry->details.host, ns_t_a, now);
+    }
+
+    // Query for the records which are missing.
+    bool isResolved = IsRecordLive(&entry->srv, now) && IsRecordLive(&entry->a, now);
+    bool isComplete = isResolved && IsRecordLive(&entry->txt, now);
+    if (isComplete) {
+        entry->resolveInterval = initialResolveIntervalMs;
+    } else if (now >= entry->nextResolve) {
+        if (!IsRecordLive(&entry->srv, now) || !IsRecordLive(&entry->txt, now)) {
+            SendQuery(entry->details.name, ns_t_any, now);
+        } else {
+            SendQuery(entry->details.host, ns_t_a, now);
+        }
+        entry->nextResolve = now + entry->resolveInterval;
+        if (entry->resolveInterval < maxResolveIntervalMs) {
+            entry->resolveInterval *= 2;
+        }
+    }
+
+    if (isResolved && !entry->isAnnounced) {
+        entry->isAnnounced = true;
+        changeHandler(DnsSdCacheChange_Added, &entry->details, changeContext);
+    }
+
+    // Find the next refresh or expiry of the records which the instance has.
+    int64_t next = isComplete ? INT64_MAX : entry->nextResolve;
+    const RecordLifetime *lifetimes[] = {&entry->ptr, &entry->srv, &entry->txt, &entry->a};
+    for (size_t i = 0; i < sizeof(lifetimes) / sizeof(lifetimes[0]); ++i) {
+        if (lifetimes[i]->expiry == 0) {
+            continue;
+        }
+        int64_t recordNext = lifetimes[i]->nextRefresh < lifetimes[i]->expiry
+                                 ? lifetimes[i]->nextRefresh
+                                 : lifetimes[i]->expiry;
+        if (recordNext < next) {
+            next = recordNext;
+        }
+    }
+    return next;
+}
+
+void DnsSdCache_Init(const char *serviceName, int fd, DnsSdCacheChangeHandler handler,
+                     void *context)
+{
+    cacheServiceName = serviceName;
+    cacheFd = fd;
+    changeHandler = handler;
+    changeContext = context;
+
+    memset(entries, 0, sizeof(entries));
+    memset(sentQueries, 0, sizeof(sentQueries));
+    memset(&cacheCounters, 0, sizeof(cacheCounters));
+    nextSentQuery = 0;
+    nextBrowse = 0;
+    browseInterval = initialBrowseIntervalMs;
+}
+
+int DnsSdCache_ProcessResponse(void)
+{
+    int64_t now = GetNowMilliseconds();
+    return ReceiveDnsRecords(cacheFd, HandleRecord, &now);
+}
+
+void DnsSdCache_Refresh(struct timespec *nextRefresh)
+{
+    int64_t now = GetNowMilliseconds();
+
+    if (now >= nextBrowse) {
+        SendQuery(cacheServiceName, ns_t_ptr, now);
+        nextBrowse = now + browseInterval;
+        if (browseInterval < maxBrowseIntervalMs) {
+            browseInterval *= 2;
+        }
+    }
+
+    int64_t next = nextBrowse;
+    for (size_t i = 0; i < DNS_SD_CACHE_MAX_INSTANCES; ++i) {
+        if (entries[i].inUse) {
+            int64_t entryNext = RefreshEntry(&entries[i], now);
+            if (entryNext < next) {
+                next = entryNext;
+            }
+        }
+    }
+
+    int64_t delay = next - now;
+    if (delay < minRefreshDelayMs) {
+        delay = minRefreshDelayMs;
+    }
+    nextRefresh->tv_sec = (time_t)(delay / 1000);
+    nextRefresh->tv_nsec = (long)(delay % 1000) * 1000000;
+}
+
+void DnsSdCache_GetCounters(DnsSdCacheCounters *counters)
+{
+    *counters = cacheCounters;
+}
+
+void DnsSdCache_Fini(void)
+{
+    for (size_t i = 0; i < DNS_SD_CACHE_MAX_INSTANCES; ++i) {
+        if (entries[i].inUse) {
+            ClearEntry(&entries[i]);
+        }
+    }
+}
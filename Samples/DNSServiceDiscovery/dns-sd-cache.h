@@ -0,0 +1,85 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "dns-sd.h"
+
+// The service discovery cache keeps the details of each service instance, keyed by instance
+// name, for as long as the TTLs of its records allow. It queries a record again when 80% of its
+// TTL has passed, and then at intervals of 5% of the TTL until the record expires (RFC 6762,
+// section 5.2). A query which was sent less than a second ago is not sent again, so instances
+// which share a host, or records which need refreshing at the same time, cause a single query.
+//
+// An instance is added when its PTR, SRV and A records are all known, and removed when any of
+// them expires or is withdrawn.
+
+/// <summary>Maximum number of service instances which the cache holds.</summary>
+#define DNS_SD_CACHE_MAX_INSTANCES 8
+
+/// <summary>Change which the cache reports for a service instance.</summary>
+typedef enum {
+    /// <summary>The instance has been resolved, and can be connected to.</summary>
+    DnsSdCacheChange_Added,
+    /// <summary>The instance is no longer available.</summary>
+    DnsSdCacheChange_Removed
+} DnsSdCacheChange;
+
+/// <summary>
+/// Callback which is invoked when a service instance is added to or removed from the cache.
+/// </summary>
+/// <param name="change">Whether the instance was added or removed</param>
+/// <param name="instance">The instance, which is only valid during the callback</param>
+/// <param name="context">The context which was passed to <see cref="DnsSdCache_Init"/></param>
+typedef void (*DnsSdCacheChangeHandler)(DnsSdCacheChange change,
+                                        const ServiceInstanceDetails *instance, void *context);
+
+/// <summary>Counters which describe the queries that the cache has made.</summary>
+typedef struct {
+    /// <summary>Number of queries sent</summary>
+    uint32_t queriesSent;
+    /// <summary>Number of queries not sent because the same query was just sent</summary>
+    uint32_t queriesCoalesced;
+    /// <summary>Number of records received</summary>
+    uint32_t recordsReceived;
+} DnsSdCacheCounters;
+
+/// <summary>
+/// Initialize the service discovery cache. No queries are sent until
+/// <see cref="DnsSdCache_Refresh"/> is called.
+/// </summary>
+/// <param name="serviceName">Fully-qualified domain name of the service to discover</param>
+/// <param name="fd">The socket file descriptor to send DNS queries to</param>
+/// <param name="handler">Callback which receives add and remove notifications</param>
+/// <param name="context">Passed to the handler</param>
+void DnsSdCache_Init(const char *serviceName, int fd, DnsSdCacheChangeHandler handler,
+                     void *context);
+
+/// <summary>
+/// Process a pending DNS response, and update the cache from its records.
+/// Call <see cref="DnsSdCache_Refresh"/> afterwards to send any queries which the new records
+/// need, and to deliver change notifications.
+/// </summary>
+/// <returns>0 if succeeded, -1 if an error occurred.</returns>
+int DnsSdCache_ProcessResponse(void);
+
+/// <summary>
+/// Expire old records, send the queries which are due, and deliver change notifications.
+/// </summary>
+/// <param name="nextRefresh">
+/// Set to the time after which this function should be called again.
+/// </param>
+void DnsSdCache_Refresh(struct timespec *nextRefresh);
+
+/// <summary>Get the cache counters.</summary>
+/// <param name="counters">Populated with the current counter values</param>
+void DnsSdCache_GetCounters(DnsSdCacheCounters *counters);
+
+/// <summary>
+/// Remove every instance from the cache, without delivering notifications, and free its memory.
+/// </summary>
+void DnsSdCache_Fini(void);
@@ -14,9 +14,12 @@
 #define ANSWER_BUF_SIZE 2048u
 #define DISPLAY_BUF_SIZE 256u
 
+// The resolver state only needs to be initialized once, rather than for every query.
+static bool isResolverInitialized = false;
+
 int SendDnsQuery(const char *dName, int class, int type, int fd)
 {
-    char queryBuf[QUERY_BUF_SIZE];
+    unsigned char queryBuf[QUERY_BUF_SIZE];
     if (!dName) {
         Log_Debug("ERROR: Can't send DNS query as the domain name is null.\n");
         errno = EINVAL;
@@ -25,10 +28,14 @@ int SendDnsQuery(const char *dName, int class, int type, int fd)
 
     // Construct the DNS query to send
     Log_Debug("INFO: Sending DNS query to resolve domain name [%s]...\n", dName);
-    int ret = res_init();
-    if (ret) {
-        Log_Debug("ERROR: res_init: %d (%s)\n", errno, strerror(errno));
-        return -1;
+    int ret;
+    if (!isResolverInitialized) {
+        ret = res_init();
+        if (ret) {
+            Log_Debug("ERROR: res_init: %d (%s)\n", errno, strerror(errno));
+            return -1;
+        }
+        isResolverInitialized = true;
     }
     int messageSize =
         res_mkquery(ns_o_query, dName, class, type, NULL, 0, NULL, queryBuf, QUERY_BUF_SIZE);
@@ -65,111 +72,91 @@ int SendServiceInstanceDetailsQuery(const char *instanceName, int fd)
     return SendDnsQuery(instanceName, ns_c_in, ns_t_any, fd);
 }
 
-int ProcessMessageBySection(char *buf, ssize_t len, ns_msg msg, ns_sect section,
-                            ServiceInstanceDetails **instanceDetails)
+int SendHostAddressQuery(const char *hostName, int fd)
+{
+    return SendDnsQuery(hostName, ns_c_in, ns_t_a, fd);
+}
+
+int ProcessMessageBySection(const unsigned char *buf, ssize_t len, ns_msg msg, ns_sect section,
+                            DnsRecordHandler handler, void *context)
 {
     char displayBuf[DISPLAY_BUF_SIZE];
     ns_rr rr;
     int messageCount = ns_msg_count(msg, section);
 
-    if (!(*instanceDetails)) {
-        // Allocate for ServiceInstanceDetails and initialize its members.
-        *instanceDetails = malloc(sizeof(ServiceInstanceDetails));
-        if (!(*instanceDetails)) {
-            Log_Debug("ERROR: recvfrom: %d (%s)\n", errno, strerror(errno));
-            return -1;
-        }
-        (*instanceDetails)->name = NULL;
-        (*instanceDetails)->host = NULL;
-        (*instanceDetails)->ipv4Address.s_addr = INADDR_NONE;
-        (*instanceDetails)->port = 0;
-        (*instanceDetails)->txtData = NULL;
-        (*instanceDetails)->txtDataLength = 0;
-    }
-
     // Parse each message
     for (int i = 0; i < messageCount; ++i) {
         if (ns_parserr(&msg, section, i, &rr)) {
             Log_Debug("ERROR: ns_parserr: %d (%s)\n", errno, strerror(errno));
             return -1;
         }
+
+        DnsRecord record;
+        memset(&record, 0, sizeof(record));
+        record.name = ns_rr_name(rr);
+        record.type = ns_rr_type(rr);
+        record.ttl = ns_rr_ttl(rr);
+        record.ipv4Address.s_addr = INADDR_NONE;
+
         switch (ns_rr_type(rr)) {
         case ns_t_ptr: {
             int compressedNameLength =
                 dn_expand(buf, buf + len, ns_rr_rdata(rr), displayBuf, sizeof(displayBuf));
-            if (compressedNameLength > 0 && !(*instanceDetails)->name) {
-                (*instanceDetails)->name = strdup(displayBuf);
-                if (!(*instanceDetails)->name) {
-                    Log_Debug("ERROR: strdup for instance name failed: %d (%s)\n", errno,
-                              strerror(errno));
-                    return -1;
-                }
+            if (compressedNameLength <= 0) {
+                Log_Debug("ERROR: Invalid DNS PTR record.\n");
+                continue;
             }
+            record.target = displayBuf;
             break;
         }
         case ns_t_srv: {
-            // Parse the SRV record and populate the port and host fields in instance details as per
+            // Parse the SRV record and populate the port and host fields in the record as per
             // DNS SRV record specification: https://tools.ietf.org/rfc/rfc2782.txt
             // SRV record format: Priority|  Weight |   Port  |     Target
             //                   (2 Bytes)|(2 Bytes)|(2 Bytes)|(Remaining Bytes)
-            const char *data = ns_rr_rdata(rr);
+            const unsigned char *data = ns_rr_rdata(rr);
+            if (ns_rr_rdlen(rr) <= sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t)) {
+                Log_Debug("ERROR: Invalid DNS SRV record length: %d\n", ns_rr_rdlen(rr));
+                continue;
+            }
             int compressedTargetDomainNameLength = dn_expand(
                 buf, buf + len, data + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t),
                 displayBuf, sizeof(displayBuf));
-            if ((*instanceDetails)->port == 0 && compressedTargetDomainNameLength > 0 &&
-                !(*instanceDetails)->host) {
-                (*instanceDetails)->port =
-                    (uint16_t)ns_get16(data + sizeof(uint16_t) + sizeof(uint16_t));
-                (*instanceDetails)->host = strdup(displayBuf);
-                if (!(*instanceDetails)->host) {
-                    Log_Debug("ERROR: strdup: %d (%s)\n", errno, strerror(errno));
-                    return -1;
-                }
+            if (compressedTargetDomainNameLength <= 0) {
+                Log_Debug("ERROR: Invalid DNS SRV record target.\n");
+                continue;
             }
+            record.port = (uint16_t)ns_get16(data + sizeof(uint16_t) + sizeof(uint16_t));
+            record.target = displayBuf;
             break;
         }
         case ns_t_txt: {
-            // Populate name field in instance details if it hasn't been set
-            if (!(*instanceDetails)->name) {
-                (*instanceDetails)->name = strdup(ns_rr_name(rr));
-                if (!(*instanceDetails)->name) {
-                    Log_Debug("ERROR: strdup(ns_rr_name(rr)): %d (%s)\n", errno, strerror(errno));
-                    return -1;
-                }
-            }
-
-            // Get TXT record, populate txtData and txtDataLength fields in instance details
-            if (!(*instanceDetails)->txtData) {
-                (*instanceDetails)->txtData =
-                    malloc(sizeof(unsigned char) * (size_t)(ns_rr_rdlen(rr)));
-                if (!(*instanceDetails)->txtData) {
-                    Log_Debug("ERROR: malloc: %d (%s)\n", errno, strerror(errno));
-                    return -1;
-                }
-                memcpy((*instanceDetails)->txtData, ns_rr_rdata(rr), ns_rr_rdlen(rr));
-                (*instanceDetails)->txtDataLength = ns_rr_rdlen(rr);
-            }
+            // Pass the TXT data as it is. It points into the received response.
+            record.txtData = (const char *)ns_rr_rdata(rr);
+            record.txtDataLength = ns_rr_rdlen(rr);
             break;
         }
         case ns_t_a: {
-            // Get A record (host address), populate ipv4Address field in instance details
-            if (ns_rr_rdlen(rr) == sizeof((*instanceDetails)->ipv4Address)) {
-                memcpy(&(*instanceDetails)->ipv4Address.s_addr, ns_rr_rdata(rr), ns_rr_rdlen(rr));
-            } else {
+            // Get A record (host address), populate ipv4Address field in the record
+            if (ns_rr_rdlen(rr) != sizeof(record.ipv4Address)) {
                 Log_Debug("ERROR: Invalid DNS A record length: %d\n", ns_rr_rdlen(rr));
+                continue;
             }
+            memcpy(&record.ipv4Address.s_addr, ns_rr_rdata(rr), ns_rr_rdlen(rr));
             break;
         }
         default:
-            break;
+            continue;
         }
+
+        handler(&record, context);
     }
     return 0;
 }
 
-int ProcessDnsResponse(int fd, ServiceInstanceDetails **instanceDetails)
+int ReceiveDnsRecords(int fd, DnsRecordHandler handler, void *context)
 {
-    char answerBuf[ANSWER_BUF_SIZE];
+    unsigned char answerBuf[ANSWER_BUF_SIZE];
     ns_msg msg;
     struct sockaddr_in socketAddress;
     socklen_t addrLength = sizeof(socketAddress);
@@ -189,28 +176,13 @@ int ProcessDnsResponse(int fd, ServiceInstanceDetails **instanceDetails)
     // Decode received response
     if (ns_initparse(answerBuf, len, &msg) != 0) {
         Log_Debug("ERROR: ns_initparse: %d (%s)\n", errno, strerror(errno));
-        goto fail;
+        return -1;
     }
-    if (ProcessMessageBySection(answerBuf, len, msg, ns_s_an, instanceDetails) != 0) {
-        goto fail;
+    if (ProcessMessageBySection(answerBuf, len, msg, ns_s_an, handler, context) != 0) {
+        return -1;
     }
-    if (ProcessMessageBySection(answerBuf, len, msg, ns_s_ar, instanceDetails) != 0) {
-        goto fail;
+    if (ProcessMessageBySection(answerBuf, len, msg, ns_s_ar, handler, context) != 0) {
+        return -1;
     }
     return 0;
-
-fail:
-    FreeServiceInstanceDetails(*instanceDetails);
-    *instanceDetails = NULL;
-    return -1;
 }
-
-void FreeServiceInstanceDetails(const ServiceInstanceDetails *details)
-{
-    if (details) {
-        free(details->name);
-        free(details->host);
-        free(details->txtData);
-        free((void *)details);
-    }
-}
\ No newline at end of file
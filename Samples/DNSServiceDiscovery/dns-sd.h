@@ -8,8 +8,7 @@
 
 /// <summary>
 /// Data structure for a DNS instance details.
-/// This should be created with <see cref="ProcessServiceInstanceDetailsResponse"/> and freed with
-/// <see cref="FreeServiceInstanceDetails"/>.
+/// Instances are kept by the service discovery cache, which is declared in dns-sd-cache.h.
 /// </summary>
 typedef struct {
     /// <summary>Service instance name</summary>
@@ -26,6 +25,36 @@ typedef struct {
     uint16_t txtDataLength;
 } ServiceInstanceDetails;
 
+/// <summary>
+/// Data structure for a resource record which was received in a DNS response.
+/// The pointers are only valid during the <see cref="DnsRecordHandler"/> callback.
+/// </summary>
+typedef struct {
+    /// <summary>Owner name of the record</summary>
+    const char *name;
+    /// <summary>Record type: ns_t_ptr, ns_t_srv, ns_t_txt or ns_t_a</summary>
+    int type;
+    /// <summary>Time to live in seconds. Zero means the record has been withdrawn.</summary>
+    uint32_t ttl;
+    /// <summary>PTR record: the instance name. SRV record: the target host name.</summary>
+    const char *target;
+    /// <summary>SRV record: the network port</summary>
+    uint16_t port;
+    /// <summary>A record: the IPv4 address</summary>
+    struct in_addr ipv4Address;
+    /// <summary>TXT record: the TXT data</summary>
+    const char *txtData;
+    /// <summary>TXT record: the TXT data length</summary>
+    uint16_t txtDataLength;
+} DnsRecord;
+
+/// <summary>
+/// Callback which receives each PTR, SRV, TXT and A record of a DNS response.
+/// </summary>
+/// <param name="record">The record</param>
+/// <param name="context">The context which was passed to <see cref="ReceiveDnsRecords"/></param>
+typedef void (*DnsRecordHandler)(const DnsRecord *record, void *context);
+
 /// <summary>
 /// Send a service discovery query
 /// </summary>
@@ -43,15 +72,18 @@ int SendServiceDiscoveryQuery(const char *svcName, int fd);
 int SendServiceInstanceDetailsQuery(const char *instanceName, int fd);
 
 /// <summary>
-/// Process pending data from a service discovery request
+/// Send a host address query
 /// </summary>
-/// <param name="fd">The socket file descriptor to receive the DNS response from</param>
-/// <param name="instanceDetails">The instance details if it is available in the response</param>
+/// <param name="hostName">The host name to query the IPv4 address for</param>
+/// <param name="fd">The socket file descriptor to send the DNS query to</param>
 /// <returns>0 if succeeded, -1 if an error occurred.</returns>
-int ProcessDnsResponse(int fd, ServiceInstanceDetails **instanceDetails);
+int SendHostAddressQuery(const char *hostName, int fd);
 
 /// <summary>
-/// Free memory used by a ServiceInstanceDetails
+/// Receive a pending DNS response, and pass each of its records to a handler
 /// </summary>
-/// <param name="instance">The ServiceInstanceDetails struct to free</param>
-void FreeServiceInstanceDetails(const ServiceInstanceDetails *instance);
\ No newline at end of file
+/// <param name="fd">The socket file descriptor to receive the DNS response from</param>
+/// <param name="handler">The handler which receives each record</param>
+/// <param name="context">Passed to the handler</param>
+/// <returns>0 if succeeded, -1 if an error occurred.</returns>
+int ReceiveDnsRecords(int fd, DnsRecordHandler handler, void *context);
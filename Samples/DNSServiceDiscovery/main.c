@@ -18,6 +18,7 @@
 #include <applibs/networking.h>
 
 #include "dns-sd.h"
+#include "dns-sd-cache.h"
 #include "eventloop_timer_utilities.h"
 
 /// <summary>
@@ -40,15 +41,20 @@ typedef enum {
     ExitCode_Init_ConnectionTimer = 7,
     ExitCode_Init_DnsResponseHandler = 8,
 
-    ExitCode_Main_EventLoopFail = 9
+    ExitCode_Main_EventLoopFail = 9,
+
+    ExitCode_Init_CacheTimer = 10,
+    ExitCode_CacheTimer_Consume = 11
 } ExitCode;
 
 // File descriptors - initialized to invalid value
 static int dnsSocketFd = -1;
 static bool isNetworkStackReady = false;
+static bool isDiscoveryStarted = false;
 
 static EventLoop *eventLoop = NULL;
 static EventLoopTimer *connectionTimer = NULL;
+static EventLoopTimer *cacheTimer = NULL;
 static EventRegistration *dnsEventReg = NULL;
 
 // If using DNS in an internet-connected network, consider setting the desired status to be
@@ -65,6 +71,10 @@ static void TerminationHandler(int signalNumber);
 static void HandleReceivedDnsDiscoveryResponse(EventLoop *el, int fd, EventLoop_IoEvents events,
                                                void *context);
 static void ConnectionTimerEventHandler(EventLoopTimer *timer);
+static void CacheTimerEventHandler(EventLoopTimer *timer);
+static void RefreshDnsSdCache(void);
+static void HandleServiceInstanceChange(DnsSdCacheChange change,
+                                        const ServiceInstanceDetails *instance, void *context);
 static ExitCode InitializeAndStartDnsServiceDiscovery(void);
 static void CloseFdAndPrintError(int fd, const char *fdName);
 static void Cleanup(void);
@@ -89,31 +99,63 @@ static void TerminationHandler(int signalNumber)
 static void HandleReceivedDnsDiscoveryResponse(EventLoop *el, int fd, EventLoop_IoEvents events,
                                                void *context)
 {
-    // Read received DNS response over socket.
-    // Process received response, if it contains PRT message, but no SRV or TXT message, send
-    // instance details request for each PTR instance. Otherwise, get the instance details.
-    ServiceInstanceDetails *details = NULL;
-    int result = ProcessDnsResponse(dnsSocketFd, &details);
-    if (result != 0) {
-        goto fail;
+    // Read received DNS response over socket and update the cache from its records. The cache
+    // then queries for any details which the response did not include, such as the SRV and TXT
+    // records of a newly found instance, and reports instances which are now resolved.
+    if (DnsSdCache_ProcessResponse() != 0) {
+        return;
     }
 
-    if (details && details->name) {
-        Log_Debug("INFO: DNS Service Discovery has found an instance: %s.\n", details->name);
-        if (!details->host) {
-            Log_Debug("INFO: Requesting SRV and TXT details for the instance.\n");
-            SendServiceInstanceDetailsQuery(details->name, dnsSocketFd);
-        } else {
-            // NOTE: The TXT data is simply treated as a string and isn't parsed here. You should
-            // replace this with your own production logic.
-            Log_Debug("\tName: %s\n\tHost: %s\n\tIPv4 Address: %s\n\tPort: %hd\n\tTXT Data: %.*s\n",
-                      details->name, details->host, inet_ntoa(details->ipv4Address), details->port,
-                      details->txtDataLength, details->txtData);
-        }
+    RefreshDnsSdCache();
+}
+
+/// <summary>
+///     Report a service instance which has been added to or removed from the DNS-SD cache.
+///     This function follows the <see cref="DnsSdCacheChangeHandler" /> signature.
+/// </summary>
+static void HandleServiceInstanceChange(DnsSdCacheChange change,
+                                        const ServiceInstanceDetails *instance, void *context)
+{
+    if (change == DnsSdCacheChange_Removed) {
+        Log_Debug("INFO: DNS Service Discovery has lost an instance: %s.\n", instance->name);
+        return;
     }
 
-fail:
-    FreeServiceInstanceDetails(details);
+    // NOTE: The TXT data is simply treated as a string and isn't parsed here. You should
+    // replace this with your own production logic.
+    Log_Debug("INFO: DNS Service Discovery has found an instance: %s.\n", instance->name);
+    Log_Debug("\tName: %s\n\tHost: %s\n\tIPv4 Address: %s\n\tPort: %hd\n\tTXT Data: %.*s\n",
+              instance->name, instance->host, inet_ntoa(instance->ipv4Address), instance->port,
+              instance->txtDataLength, instance->txtData ? instance->txtData : "");
+}
+
+/// <summary>
+///     Let the DNS-SD cache send the queries which are due, and arm the cache timer for the
+///     next time it needs to do so.
+/// </summary>
+static void RefreshDnsSdCache(void)
+{
+    struct timespec nextRefresh;
+    DnsSdCache_Refresh(&nextRefresh);
+    SetEventLoopTimerOneShot(cacheTimer, &nextRefresh);
+
+    DnsSdCacheCounters counters;
+    DnsSdCache_GetCounters(&counters);
+    Log_Debug("INFO: DNS-SD cache: %u queries sent, %u coalesced, %u records received.\n",
+              counters.queriesSent, counters.queriesCoalesced, counters.recordsReceived);
+}
+
+/// <summary>
+///     The timer event handler to refresh the DNS-SD cache.
+/// </summary>
+static void CacheTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        exitCode = ExitCode_CacheTimer_Consume;
+        return;
+    }
+
+    RefreshDnsSdCache();
 }
 
 /// <summary>
@@ -143,8 +185,8 @@ int IsConnectionReady(const char *interface, bool *ipAddressAvailable)
 }
 
 /// <summary>
-///     The timer event handler to check whether network connection is ready and send DNS service
-///     discovery queries.
+///     The timer event handler to check whether network connection is ready and start DNS service
+///     discovery.
 /// </summary>
 static void ConnectionTimerEventHandler(EventLoopTimer *timer)
 {
@@ -157,9 +199,11 @@ static void ConnectionTimerEventHandler(EventLoopTimer *timer)
     bool isConnectionReady = false;
     if (IsConnectionReady(NetworkInterface, &isConnectionReady) != 0) {
         exitCode = ExitCode_ConnectionTimer_ConnectionReady;
-    } else if (isConnectionReady) {
-        // Connection is ready, send a DNS service discovery query.
-        SendServiceDiscoveryQuery(DnsServiceDiscoveryServer, dnsSocketFd);
+    } else if (isConnectionReady && !isDiscoveryStarted) {
+        // Connection is ready, send the first DNS service discovery query. After this, the cache
+        // decides when to query again.
+        isDiscoveryStarted = true;
+        RefreshDnsSdCache();
     }
 }
 
@@ -189,8 +233,10 @@ static ExitCode InitializeAndStartDnsServiceDiscovery(void)
         return ExitCode_Init_Socket;
     }
 
+    DnsSdCache_Init(DnsServiceDiscoveryServer, dnsSocketFd, &HandleServiceInstanceChange,
+                    /* context */ NULL);
+
     // Check network interface status at the specified period until it is ready.
-    // This also defines the frequency at which the sample sends out DNS-SD queries.
     static const struct timespec checkInterval = {.tv_sec = 10, .tv_nsec = 0};
     connectionTimer =
         CreateEventLoopPeriodicTimer(eventLoop, &ConnectionTimerEventHandler, &checkInterval);
@@ -198,6 +244,12 @@ static ExitCode InitializeAndStartDnsServiceDiscovery(void)
         return ExitCode_Init_ConnectionTimer;
     }
 
+    // The DNS-SD cache arms this timer when it next needs to send queries or expire records.
+    cacheTimer = CreateEventLoopDisarmedTimer(eventLoop, &CacheTimerEventHandler);
+    if (cacheTimer == NULL) {
+        return ExitCode_Init_CacheTimer;
+    }
+
     // Register DNS response handler, for handling responses from DNS-SD queries.
     dnsEventReg = EventLoop_RegisterIo(eventLoop, dnsSocketFd, EventLoop_Input,
                                        &HandleReceivedDnsDiscoveryResponse, /* context */ NULL);
@@ -229,11 +281,13 @@ static void CloseFdAndPrintError(int fd, const char *fdName)
 static void Cleanup(void)
 {
     DisposeEventLoopTimer(connectionTimer);
+    DisposeEventLoopTimer(cacheTimer);
     EventLoop_UnregisterIo(eventLoop, dnsEventReg);
     EventLoop_Close(eventLoop);
 
     Log_Debug("INFO: Closing file descriptors\n");
     CloseFdAndPrintError(dnsSocketFd, "DNS Socket");
+    DnsSdCache_Fini();
 }
 
 int main(void)
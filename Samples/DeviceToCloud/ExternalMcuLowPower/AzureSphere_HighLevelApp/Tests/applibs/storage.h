@@ -0,0 +1,21 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/storage.h when kv_store.c is built on a PC. Each test
+// program defines Storage_OpenMutableFile to open an ordinary file.
+
+#pragma once
+
+#include <sys/types.h>
+
+int Storage_OpenMutableFile(void);
+
+#ifdef KV_STORE_FAULT_INJECTION
+// kv_store.c includes this header after <unistd.h>, so these macros replace its calls to
+// pwrite and fsync with ones which kv_store_test.c can interrupt.
+ssize_t Test_Pwrite(int fd, const void *buf, size_t count, off_t offset);
+int Test_Fsync(int fd);
+
+#define pwrite Test_Pwrite
+#define fsync Test_Fsync
+#endif
@@ -0,0 +1,34 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/uart.h when uart_transport.c is built on a Linux PC. Each
+// test program defines UART_InitConfig and UART_Open, which can return one end of a socketpair.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int UART_Id;
+typedef uint32_t UART_BaudRate_Type;
+typedef uint8_t UART_BlockingMode_Type;
+typedef uint8_t UART_DataBits_Type;
+typedef uint8_t UART_Parity_Type;
+typedef uint8_t UART_StopBits_Type;
+typedef uint8_t UART_FlowControl_Type;
+
+enum { UART_Parity_None = 0, UART_Parity_Even = 1, UART_Parity_Odd = 2 };
+
+enum { UART_FlowControl_None = 0, UART_FlowControl_RTSCTS = 1, UART_FlowControl_XONXOFF = 2 };
+
+typedef struct {
+    uint32_t z__magicAndVersion;
+    UART_BaudRate_Type baudRate;
+    UART_BlockingMode_Type blockingMode;
+    UART_DataBits_Type dataBits;
+    UART_Parity_Type parity;
+    UART_StopBits_Type stopBits;
+    UART_FlowControl_Type flowControl;
+} UART_Config;
+
+void UART_InitConfig(UART_Config *uartConfig);
+int UART_Open(UART_Id uartId, const UART_Config *uartConfig);
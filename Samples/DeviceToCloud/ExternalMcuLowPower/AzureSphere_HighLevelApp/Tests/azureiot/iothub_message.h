@@ -0,0 +1,9 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure IoT C SDK iothub_message.h when the sample is built on a Linux PC.
+// azure_iot.h only needs the message handle type.
+
+#pragma once
+
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
@@ -0,0 +1,145 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Benchmark for kv_store.c, which runs on a Linux PC against an ordinary file in place of the
+// mutable storage file. It measures:
+// - updates per second, against rewriting a struct at the start of the file as the sample did
+//   before it used the store;
+// - the time to open the store, against the number of records in the log.
+//
+// The results depend on the file system and disk which hold the file; by default, the file is
+// created in the current directory. Usage: kv_store_benchmark [file]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+#include "kv_store.h"
+
+// A value of the size that persistent_storage.c stores for the telemetry.
+typedef struct {
+    uint32_t version;
+    uint32_t counters[7];
+} Value;
+
+static const char *storagePath = "kv_store_benchmark.bin";
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Storage_OpenMutableFile(void)
+{
+    return open(storagePath, O_RDWR | O_CREAT, 0600);
+}
+
+static double GetSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void Check(int result, const char *operation)
+{
+    if (result != 0) {
+        printf("ERROR: %s failed: %s (%d)\n", operation, strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Create a store whose log holds the given number of records, and leave it open.
+static void CreateStore(size_t capacity, int records)
+{
+    Value value = {.version = 1};
+
+    unlink(storagePath);
+    Check(KvStore_Open(capacity), "KvStore_Open");
+    for (int i = 0; i < records; ++i) {
+        value.counters[0] = (uint32_t)i;
+        Check(KvStore_Set("telemetry", &value, sizeof(value)), "KvStore_Set");
+    }
+}
+
+static void MeasureUpdates(void)
+{
+    const int updates = 2000;
+    Value value = {.version = 1};
+
+    CreateStore(8 * 1024, 0);
+    double start = GetSeconds();
+    for (int i = 0; i < updates; ++i) {
+        value.counters[0] = (uint32_t)i;
+        Check(KvStore_Set("telemetry", &value, sizeof(value)), "KvStore_Set");
+    }
+    double storeRate = updates / (GetSeconds() - start);
+    KvStore_Close();
+
+    // Open the file, rewrite the struct, flush it and close the file, for each update.
+    unlink(storagePath);
+    start = GetSeconds();
+    for (int i = 0; i < updates; ++i) {
+        value.counters[0] = (uint32_t)i;
+        int fd = Storage_OpenMutableFile();
+        Check(fd == -1 || pwrite(fd, &value, sizeof(value), 0) != sizeof(value), "pwrite");
+        Check(fsync(fd), "fsync");
+        close(fd);
+    }
+    double rewriteRate = updates / (GetSeconds() - start);
+
+    printf("Updates per second, each flushed to the file:\n");
+    printf("    key-value store: %.0f\n", storeRate);
+    printf("    rewrite struct:  %.0f\n", rewriteRate);
+}
+
+static void MeasureOpen(void)
+{
+    // 8KB is the capacity which persistent_storage.c uses. A larger capacity allows a longer
+    // log before the store is compacted.
+    static const struct {
+        size_t capacity;
+        int records;
+    } cases[] = {{8 * 1024, 0},     {8 * 1024, 10},     {8 * 1024, 70},     {2048 * 1024, 100},
+                 {2048 * 1024, 1000}, {2048 * 1024, 10000}};
+    const double minSeconds = 0.2;
+
+    printf("Time to open the store:\n");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        CreateStore(cases[c].capacity, cases[c].records);
+        KvStore_Close();
+
+        int opens = 0;
+        double start = GetSeconds();
+        double elapsed;
+        do {
+            Check(KvStore_Open(cases[c].capacity), "KvStore_Open");
+            KvStore_Close();
+            ++opens;
+            elapsed = GetSeconds() - start;
+        } while (elapsed < minSeconds);
+
+        printf("    %5d records, capacity %7zu bytes: %8.1f us\n", cases[c].records,
+               cases[c].capacity, elapsed / opens * 1e6);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        storagePath = argv[1];
+    }
+
+    MeasureUpdates();
+    MeasureOpen();
+
+    unlink(storagePath);
+    return EXIT_SUCCESS;
+}
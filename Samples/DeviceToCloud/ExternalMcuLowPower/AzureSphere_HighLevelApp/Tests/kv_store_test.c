@@ -0,0 +1,548 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for kv_store.c, which run on a Linux PC against an ordinary file in place of the
+// mutable storage file.
+//
+// The test checks the store against a model of the values which it should hold. Faults are
+// injected through Test_Pwrite, which kv_store.c calls in place of pwrite: a write can be cut
+// short after any number of bytes, either by cutting the power, after which the test reopens
+// the store as the application would when it restarts, or by failing with EIO. Writes reach
+// the file in the order in which they are made, so Test_Fsync has nothing to do.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+#include "kv_store.h"
+
+// Only kv_store.c calls the fault injection functions; this file writes the file directly.
+#undef pwrite
+#undef fsync
+
+// As used by persistent_storage.c.
+#define CAPACITY (8 * 1024)
+
+typedef struct {
+    bool isSet;
+    size_t size;
+    uint8_t data[KV_STORE_MAX_VALUE_SIZE];
+} ModelValue;
+
+// The values which the store should hold, indexed in the same way as keys.
+typedef struct {
+    ModelValue values[KV_STORE_MAX_KEYS];
+} Model;
+
+static const char *const keys[KV_STORE_MAX_KEYS] = {
+    "telemetry", "baseline", "a", "b", "c", "d", "e", "key-of-15-chars"};
+
+static const char storagePath[] = "kv_store_test.bin";
+
+// Number of bytes which are written before the write is cut short, or -1 if writes are not
+// cut short. If failWrites is true, the write which is cut short fails with EIO; otherwise
+// the power is cut.
+static long bytesBeforeFault = -1;
+static bool failWrites = false;
+static jmp_buf powerCut;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Storage_OpenMutableFile(void)
+{
+    return open(storagePath, O_RDWR | O_CREAT, 0600);
+}
+
+ssize_t Test_Pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    if (bytesBeforeFault < 0 || (long)count <= bytesBeforeFault) {
+        if (bytesBeforeFault >= 0) {
+            bytesBeforeFault -= (long)count;
+        }
+        return pwrite(fd, buf, count, offset);
+    }
+
+    // Only the start of the data reaches the file.
+    size_t written = (size_t)bytesBeforeFault;
+    bytesBeforeFault = -1;
+    if (written > 0 && pwrite(fd, buf, written, offset) != (ssize_t)written) {
+        printf("FAIL: could not write test file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (failWrites) {
+        errno = EIO;
+        return -1;
+    }
+    longjmp(powerCut, 1);
+}
+
+int Test_Fsync(int fd)
+{
+    return 0;
+}
+
+static off_t GetFileSize(void)
+{
+    struct stat st;
+    if (stat(storagePath, &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+static size_t ReadFileImage(uint8_t *image)
+{
+    int fd = open(storagePath, O_RDONLY);
+    ssize_t size = fd == -1 ? 0 : read(fd, image, CAPACITY);
+    if (fd != -1) {
+        close(fd);
+    }
+    return size > 0 ? (size_t)size : 0;
+}
+
+// Replace the file with the first size bytes of an image.
+static void WriteFileImage(const uint8_t *image, size_t size)
+{
+    int fd = open(storagePath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1 || write(fd, image, size) != (ssize_t)size) {
+        printf("FAIL: could not write test file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void OpenStore(const char *test)
+{
+    if (KvStore_Open(CAPACITY) != 0) {
+        Fail(test, "could not open store", errno);
+    }
+}
+
+// Forget the index in RAM and read it from the file again, as the application does when it
+// starts.
+static void Reopen(const char *test)
+{
+    KvStore_Close();
+    OpenStore(test);
+}
+
+// Start with a new store.
+static void CreateStore(const char *test, Model *model)
+{
+    KvStore_Close();
+    unlink(storagePath);
+    memset(model, 0, sizeof(*model));
+    OpenStore(test);
+}
+
+// The value which step i of a run of writes sets. Half of the writes are to the first key, as
+// the telemetry is written more often than anything else, and the sizes cover every size
+// from 0 to KV_STORE_MAX_VALUE_SIZE.
+static size_t GetStepValue(int i, ModelValue *value)
+{
+    size_t key = (i % 2 == 0) ? 0 : (size_t)(i / 2) % KV_STORE_MAX_KEYS;
+    value->isSet = true;
+    value->size = (size_t)(i * 7 + (int)key) % (KV_STORE_MAX_VALUE_SIZE + 1);
+    for (size_t j = 0; j < value->size; ++j) {
+        value->data[j] = (uint8_t)(i * 31 + (int)j);
+    }
+    return key;
+}
+
+// Apply step i to a model, and return the key which it sets.
+static size_t ApplyStep(int i, Model *model)
+{
+    ModelValue value;
+    size_t key = GetStepValue(i, &value);
+    model->values[key] = value;
+    return key;
+}
+
+static int WriteStep(int i)
+{
+    ModelValue value;
+    size_t key = GetStepValue(i, &value);
+    return KvStore_Set(keys[key], value.data, value.size);
+}
+
+// Returns true if the store holds exactly the values in the model.
+static bool StoreMatches(const Model *model)
+{
+    for (size_t key = 0; key < KV_STORE_MAX_KEYS; ++key) {
+        uint8_t data[KV_STORE_MAX_VALUE_SIZE];
+        ssize_t size = KvStore_Get(keys[key], data, sizeof(data));
+        const ModelValue *expected = &model->values[key];
+
+        if (!expected->isSet) {
+            if (size != -1 || errno != ENOENT) {
+                return false;
+            }
+        } else if (size != (ssize_t)expected->size ||
+                   memcmp(data, expected->data, expected->size) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// After a fault, check that the store can still be written, and that the write is kept when
+// the store is reopened.
+static void CheckWritable(const char *test, long detail)
+{
+    static const char marker[] = "written after fault";
+    uint8_t data[sizeof(marker)];
+
+    if (KvStore_Set(keys[0], marker, sizeof(marker)) != 0) {
+        Fail(test, "could not write after fault", detail);
+        return;
+    }
+    Reopen(test);
+    if (KvStore_Get(keys[0], data, sizeof(data)) != sizeof(marker) ||
+        memcmp(data, marker, sizeof(marker)) != 0) {
+        Fail(test, "write after fault was lost", detail);
+    }
+}
+
+static void TestSetAndGet(void)
+{
+    const char *test = "TestSetAndGet";
+    Model model;
+    uint8_t data[KV_STORE_MAX_VALUE_SIZE + 1] = {0};
+
+    CreateStore(test, &model);
+    if (KvStore_Get(keys[0], data, sizeof(data)) != -1 || errno != ENOENT) {
+        Fail(test, "new store has a value", 0);
+    }
+
+    // Invalid keys and values.
+    if (KvStore_Set("", data, 1) != -1 || errno != EINVAL) {
+        Fail(test, "accepted empty key", 0);
+    }
+    if (KvStore_Set("key-of-16-chars!", data, 1) != -1 || errno != EINVAL) {
+        Fail(test, "accepted overlong key", 0);
+    }
+    if (KvStore_Set(keys[0], data, KV_STORE_MAX_VALUE_SIZE + 1) != -1 || errno != EINVAL) {
+        Fail(test, "accepted overlong value", 0);
+    }
+
+    // Fill every key, and then check that no more keys can be added.
+    for (int i = 1; i <= 2 * KV_STORE_MAX_KEYS; ++i) {
+        if (WriteStep(i) != 0) {
+            Fail(test, "could not set value", i);
+        }
+        ApplyStep(i, &model);
+    }
+    if (!StoreMatches(&model)) {
+        Fail(test, "wrong values", 0);
+    }
+    if (KvStore_Set("ninth-key", data, 1) != -1 || errno != ENOSPC) {
+        Fail(test, "accepted too many keys", 0);
+    }
+
+    // A buffer one byte smaller than the value is too small.
+    ModelValue value;
+    GetStepValue(2, &value);
+    if (KvStore_Set(keys[0], value.data, value.size) != 0 ||
+        KvStore_Get(keys[0], data, value.size - 1) != -1 || errno != ERANGE) {
+        Fail(test, "read value into small buffer", (long)value.size);
+    }
+    model.values[0] = value;
+
+    Reopen(test);
+    if (!StoreMatches(&model)) {
+        Fail(test, "wrong values after reopening", 0);
+    }
+
+    KvStore_Close();
+    if (KvStore_Open(256) != -1 || errno != EINVAL) {
+        Fail(test, "accepted too small a capacity", 0);
+    }
+}
+
+// Write a long run of values, reopening the store every N writes, and check that each reopen
+// restores the latest values, and that the file never grows beyond its capacity.
+static void TestReopenEveryN(void)
+{
+    const char *test = "TestReopenEveryN";
+    static const int reopenIntervals[] = {1, 2, 7, 50, 1000};
+    const int writes = 1000;
+    Model model;
+
+    for (size_t n = 0; n < sizeof(reopenIntervals) / sizeof(reopenIntervals[0]); ++n) {
+        CreateStore(test, &model);
+
+        for (int i = 1; i <= writes; ++i) {
+            if (WriteStep(i) != 0) {
+                Fail(test, "could not set value", i);
+                break;
+            }
+            ApplyStep(i, &model);
+
+            if (GetFileSize() > CAPACITY) {
+                Fail(test, "file grew beyond capacity", (long)GetFileSize());
+                break;
+            }
+            if (i % reopenIntervals[n] == 0) {
+                Reopen(test);
+                if (!StoreMatches(&model)) {
+                    Fail(test, "wrong values after reopening", reopenIntervals[n]);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Truncate the file at every length, and check what the store holds when it is reopened.
+//
+// While the log is in the first half of the file, each write extends the file, so a
+// truncated file is what a power cut during a write could leave: it must hold the values
+// after some prefix of the writes, and a longer file must not hold an earlier prefix. Once
+// the file has grown to its capacity, truncation is not a failure which can happen, but the
+// store must still open, and only return values which were written.
+static void TestTruncation(void)
+{
+    const char *test = "TestTruncation";
+    static uint8_t image[CAPACITY];
+    static Model history[501];
+    const int growingWrites = 40;
+    const int writes = 500;
+    long truncations = 0;
+
+    CreateStore(test, &history[0]);
+    for (int i = 1; i <= writes; ++i) {
+        if (WriteStep(i) != 0) {
+            Fail(test, "could not set value", i);
+        }
+        history[i] = history[i - 1];
+        ApplyStep(i, &history[i]);
+
+        if (i != growingWrites && i != writes) {
+            continue;
+        }
+
+        KvStore_Close();
+        size_t size = ReadFileImage(image);
+        if (i == growingWrites && size > CAPACITY / 2) {
+            Fail(test, "log left the first half of the file", (long)size);
+        }
+
+        int lastPrefix = 0;
+        for (size_t length = 0; length <= size; ++length) {
+            WriteFileImage(image, length);
+            OpenStore(test);
+            ++truncations;
+
+            if (i == growingWrites) {
+                int prefix = lastPrefix;
+                while (prefix <= i && !StoreMatches(&history[prefix])) {
+                    ++prefix;
+                }
+                if (prefix > i) {
+                    Fail(test, "truncated log holds values of no prefix", (long)length);
+                } else {
+                    lastPrefix = prefix;
+                }
+            } else {
+                for (size_t key = 0; key < KV_STORE_MAX_KEYS; ++key) {
+                    uint8_t data[KV_STORE_MAX_VALUE_SIZE];
+                    ssize_t valueSize = KvStore_Get(keys[key], data, sizeof(data));
+                    if (valueSize == -1) {
+                        continue;
+                    }
+
+                    bool wasWritten = false;
+                    for (int step = 1; step <= i && !wasWritten; ++step) {
+                        const ModelValue *value = &history[step].values[key];
+                        wasWritten = value->isSet && value->size == (size_t)valueSize &&
+                                     memcmp(value->data, data, (size_t)valueSize) == 0;
+                    }
+                    if (!wasWritten) {
+                        Fail(test, "truncated file returned a value never written", (long)length);
+                    }
+                }
+            }
+
+            CheckWritable(test, (long)length);
+            KvStore_Close();
+        }
+        if (i == growingWrites && lastPrefix != i) {
+            Fail(test, "complete log lost writes", lastPrefix);
+        }
+
+        // Carry on from the complete file.
+        WriteFileImage(image, size);
+        OpenStore(test);
+    }
+
+    printf("%s: %ld truncations\n", test, truncations);
+}
+
+// Write the value for step i with a fault after the given number of bytes. Returns true if the
+// write completed before the fault.
+static bool WriteStepWithFault(int i, long bytes, bool fail)
+{
+    bytesBeforeFault = bytes;
+    failWrites = fail;
+
+    if (setjmp(powerCut) != 0) {
+        return false;
+    }
+    int result = WriteStep(i);
+    bool faulted = bytesBeforeFault == -1;
+    bytesBeforeFault = -1;
+    return result == 0 && !faulted;
+}
+
+// For each write in a run with several compactions, cut the power after each byte of the write
+// in turn, and check that reopening the store restores either the values before the write or
+// the values after it. Then check that the store can still be written.
+static void TestPowerCutAtEachByte(void)
+{
+    const char *test = "TestPowerCutAtEachByte";
+    static uint8_t image[CAPACITY];
+    const int writes = 180;
+    long trials = 0;
+    long compactions = 0;
+    Model before;
+
+    CreateStore(test, &before);
+    for (int i = 1; i <= writes; ++i) {
+        Model after = before;
+        ApplyStep(i, &after);
+
+        long cut;
+        for (cut = 0;; ++cut) {
+            size_t size = ReadFileImage(image);
+            bool completed = WriteStepWithFault(i, cut, false);
+            ++trials;
+
+            Reopen(test);
+            if (completed ? !StoreMatches(&after)
+                          : !StoreMatches(&before) && !StoreMatches(&after)) {
+                Fail(test, "wrong values after power cut", i);
+            }
+            CheckWritable(test, i);
+
+            // Put the file back as it was before the write.
+            KvStore_Close();
+            WriteFileImage(image, size);
+            OpenStore(test);
+            if (!StoreMatches(&before)) {
+                Fail(test, "could not go back to the previous values", i);
+            }
+            if (completed) {
+                break;
+            }
+        }
+
+        // A write which took more than half of the file must have compacted the store.
+        if (cut > CAPACITY / 2) {
+            ++compactions;
+        }
+
+        // Carry on from the completed write.
+        if (WriteStep(i) != 0) {
+            Fail(test, "could not set value", i);
+        }
+        before = after;
+    }
+
+    if (compactions < 2) {
+        Fail(test, "too few compactions", compactions);
+    }
+    printf("%s: %ld power cuts, over %ld compactions\n", test, trials, compactions);
+}
+
+// For each write in a run with several compactions, fail the write after each byte in turn,
+// and check that the store keeps the values from before the write, both in RAM and when it is
+// reopened. Then check that the write succeeds when it is retried.
+static void TestWriteErrorAtEachByte(void)
+{
+    const char *test = "TestWriteErrorAtEachByte";
+    static uint8_t image[CAPACITY];
+    const int writes = 180;
+    long trials = 0;
+    Model before;
+
+    CreateStore(test, &before);
+    for (int i = 1; i <= writes; ++i) {
+        Model after = before;
+        ApplyStep(i, &after);
+
+        for (long cut = 0;; ++cut) {
+            size_t size = ReadFileImage(image);
+            bool completed = WriteStepWithFault(i, cut, true);
+            ++trials;
+
+            if (!StoreMatches(completed ? &after : &before)) {
+                Fail(test, "wrong values after write error", i);
+            }
+            if (completed) {
+                break;
+            }
+
+            if (WriteStep(i) != 0 || !StoreMatches(&after)) {
+                Fail(test, "retry after write error failed", i);
+            }
+            Reopen(test);
+            if (!StoreMatches(&after)) {
+                Fail(test, "retried write was lost", i);
+            }
+
+            // Put the file back as it was before the write.
+            KvStore_Close();
+            WriteFileImage(image, size);
+            OpenStore(test);
+        }
+
+        before = after;
+    }
+
+    printf("%s: %ld write errors\n", test, trials);
+}
+
+int main(void)
+{
+    TestSetAndGet();
+    TestReopenEveryN();
+    TestTruncation();
+    TestPowerCutAtEachByte();
+    TestWriteErrorAtEachByte();
+
+    KvStore_Close();
+    unlink(storagePath);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Fuzz test and benchmark for the receive path of message_protocol.c, which run on a Linux PC.
+// The transport is replaced by functions which record each request, and which return a prepared
+// stream of received data in pieces of a chosen size.
+//
+// The fuzz test sends up to a window of requests, then builds a stream of their responses and of
+// events, in random order. Between messages, it puts noise which does not contain a preamble but
+// may contain part of one, messages of an unknown type, and responses with unknown sequence
+// numbers. The stream is received in random pieces, from 1 to 300 bytes. Every response and event
+// must be handled once, in the order in which it was received, with the right data, and the
+// corrupt messages must not be handled. A message which is too long to fit in the receive buffer
+// must be discarded, and the messages which follow it must still be handled.
+//
+// The benchmark receives a stream of events in pieces of several sizes, and reports the time for
+// each message, and the number of bytes which are moved within the receive buffer for each byte
+// which is received. memmove is wrapped at link time (-Wl,--wrap) to count them.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+#include "message_protocol.h"
+#include "message_protocol_private.h"
+
+#define FUZZ_ROUNDS 20000
+#define MAX_CHUNK 300
+#define MAX_NOISE 8
+#define MAX_EVENTS 3
+#define BENCHMARK_EVENTS 100000
+
+#define CATEGORY 0x1
+#define EVENT_COUNT 4
+
+// A response or event which was handled, or which is expected to be handled.
+typedef struct {
+    bool isEvent;
+    uint16_t id;
+} Handled;
+
+static EventLoop *eventLoop = NULL;
+
+// The stream which the transport returns, and how much of it has been read.
+static uint8_t stream[2 * 1024 * 1024];
+static size_t streamLength = 0;
+static size_t streamOffset = 0;
+
+// Each read returns at most this many bytes, or a random number up to MAX_CHUNK if it is zero.
+static size_t chunkSize = 0;
+
+// The requests which have been sent, and which have not been answered in a stream yet.
+static MessageProtocol_RequestId sentRequestIds[MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
+static MessageProtocol_SequenceNumber
+    sentSequenceNumbers[MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
+static size_t sentCount = 0;
+
+static Handled expected[MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS + MAX_EVENTS];
+static size_t expectedCount = 0;
+static Handled handled[2 * (MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS + MAX_EVENTS)];
+static size_t handledCount = 0;
+static unsigned long eventsHandled = 0;
+static bool wrongResponseData = false;
+
+static size_t bytesMoved = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+void *__real_memmove(void *dest, const void *src, size_t n);
+
+void *__wrap_memmove(void *dest, const void *src, size_t n)
+{
+    bytesMoved += n;
+    return __real_memmove(dest, src, n);
+}
+
+static ssize_t ReadStream(char *buffer, size_t amount)
+{
+    size_t length = chunkSize != 0 ? chunkSize : 1 + (size_t)rand() % MAX_CHUNK;
+    if (length > amount) {
+        length = amount;
+    }
+    if (length > streamLength - streamOffset) {
+        length = streamLength - streamOffset;
+    }
+    memcpy(buffer, &stream[streamOffset], length);
+    streamOffset += length;
+    return (ssize_t)length;
+}
+
+static ssize_t RecordRequest(const char *buffer, size_t amount)
+{
+    const MessageProtocol_RequestMessage *request = (const MessageProtocol_RequestMessage *)buffer;
+    sentRequestIds[sentCount] = request->requestHeader.requestId;
+    sentSequenceNumbers[sentCount] = request->requestHeader.sequenceNumber;
+    ++sentCount;
+    return (ssize_t)amount;
+}
+
+// The data in each response depends on its request ID.
+static size_t GetResponseData(MessageProtocol_RequestId requestId, uint8_t *data)
+{
+    size_t length = ((size_t)requestId * 29u) % (MAX_RESPONSE_DATA_SIZE + 1);
+    for (size_t i = 0; i < length; ++i) {
+        data[i] = (uint8_t)(requestId * 7u + i);
+    }
+    return length;
+}
+
+static void ResponseHandler(MessageProtocol_CategoryId categoryId,
+                            MessageProtocol_RequestId requestId, const uint8_t *data,
+                            size_t dataSize, MessageProtocol_ResponseResult result, bool timedOut)
+{
+    uint8_t expectedData[MAX_RESPONSE_DATA_SIZE];
+    size_t expectedSize = GetResponseData(requestId, expectedData);
+    if (timedOut || dataSize != expectedSize || memcmp(data, expectedData, dataSize) != 0) {
+        wrongResponseData = true;
+    }
+
+    if (handledCount < sizeof(handled) / sizeof(handled[0])) {
+        handled[handledCount++] = (Handled){.isEvent = false, .id = requestId};
+    }
+}
+
+static void EventHandler(MessageProtocol_CategoryId categoryId, MessageProtocol_EventId eventId)
+{
+    ++eventsHandled;
+    if (handledCount < sizeof(handled) / sizeof(handled[0])) {
+        handled[handledCount++] = (Handled){.isEvent = true, .id = eventId};
+    }
+}
+
+static void AppendBytes(const void *data, size_t length)
+{
+    memcpy(&stream[streamLength], data, length);
+    streamLength += length;
+}
+
+static void AppendHeader(MessageProtocol_MessageHeaderWithType *header, size_t messageLength,
+                         MessageProtocol_MessageType type)
+{
+    memcpy(header->messageHeader.preamble, MessageProtocol_MessagePreamble,
+           sizeof(MessageProtocol_MessagePreamble));
+    header->messageHeader.length =
+        (uint16_t)(messageLength - sizeof(MessageProtocol_MessageHeader));
+    header->type = type;
+    header->reserved = 0;
+}
+
+static void AppendEvent(MessageProtocol_EventId eventId, MessageProtocol_MessageType type)
+{
+    MessageProtocol_EventMessage event;
+    AppendHeader(&event.messageHeaderWithType, sizeof(event), type);
+    event.eventInfo.categoryId = CATEGORY;
+    event.eventInfo.eventId = eventId;
+    AppendBytes(&event, sizeof(event));
+}
+
+static void AppendResponse(MessageProtocol_RequestId requestId,
+                           MessageProtocol_SequenceNumber sequenceNumber)
+{
+    MessageProtocol_ResponseMessage response;
+    size_t dataLength = GetResponseData(requestId, response.data);
+    size_t length = sizeof(MessageProtocol_ResponseHeader) + dataLength;
+    AppendHeader(&response.responseHeader.messageHeaderWithType, length,
+                 MessageProtocol_ResponseMessageType);
+    response.responseHeader.categoryId = CATEGORY;
+    response.responseHeader.requestId = requestId;
+    response.responseHeader.sequenceNumber = sequenceNumber;
+    response.responseHeader.responseResult = 0;
+    response.responseHeader.reserved = 0;
+    AppendBytes(&response, length);
+}
+
+// Appends random bytes, which often contain the start of a preamble, but never all of one.
+static void AppendNoise(void)
+{
+    size_t length = (size_t)rand() % (MAX_NOISE + 1);
+    size_t start = streamLength;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t b =
+            (rand() % 2 == 0) ? MessageProtocol_MessagePreamble[rand() % 3] : (uint8_t)rand();
+        AppendBytes(&b, 1);
+        if (streamLength - start >= sizeof(MessageProtocol_MessagePreamble) &&
+            memcmp(&stream[streamLength - sizeof(MessageProtocol_MessagePreamble)],
+                   MessageProtocol_MessagePreamble, sizeof(MessageProtocol_MessagePreamble)) == 0) {
+            --streamLength;
+        }
+    }
+
+    // The noise must not end with part of a preamble which the next message completes.
+    while (streamLength > start && stream[streamLength - 1] == MessageProtocol_MessagePreamble[0]) {
+        --streamLength;
+    }
+}
+
+// Receives the whole stream, as the transport would return it, until the receive path stops
+// reading it.
+static void ReceiveStream(void)
+{
+    streamOffset = 0;
+    while (streamOffset < streamLength) {
+        size_t offset = streamOffset;
+        MessageProtocol_HandleReceivedMessage();
+        if (streamOffset == offset) {
+            break;
+        }
+    }
+}
+
+static void SetUp(void)
+{
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL ||
+        MessageProtocol_Initialize(eventLoop, ReadStream, RecordRequest) != ExitCode_Success) {
+        printf("FAIL: could not initialize\n");
+        exit(EXIT_FAILURE);
+    }
+    for (MessageProtocol_EventId eventId = 0; eventId < EVENT_COUNT; ++eventId) {
+        MessageProtocol_RegisterEventHandler(CATEGORY, eventId, EventHandler);
+    }
+}
+
+static void TearDown(void)
+{
+    MessageProtocol_Cleanup();
+    EventLoop_Close(eventLoop);
+    eventLoop = NULL;
+}
+
+static void TestFragmentedCorruptStreams(void)
+{
+    const char *test = "TestFragmentedCorruptStreams";
+    SetUp();
+    chunkSize = 0;
+    srand(1);
+
+    for (int round = 0; round < FUZZ_ROUNDS; ++round) {
+        sentCount = 0;
+        size_t requests = 1 + (size_t)rand() % MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS;
+        for (size_t i = 0; i < requests; ++i) {
+            const uint8_t body[] = {0};
+            MessageProtocol_SendRequest(CATEGORY, (MessageProtocol_RequestId)rand(), body,
+                                        sizeof(body), ResponseHandler);
+        }
+
+        // Shuffle the responses and some events together, with noise and corrupt messages
+        // between them.
+        size_t eventsLeft = (size_t)rand() % (MAX_EVENTS + 1);
+        size_t responsesLeft = sentCount;
+        expectedCount = 0;
+        streamLength = 0;
+        while (responsesLeft + eventsLeft > 0) {
+            AppendNoise();
+            switch (rand() % 8) {
+            case 0:
+                // A well-formed message of an unknown type.
+                AppendEvent(0, 0x7F);
+                break;
+            case 1:
+                // A response to a request which was never sent.
+                AppendResponse(1, (MessageProtocol_SequenceNumber)(sentSequenceNumbers[0] + 100));
+                break;
+            default:
+                break;
+            }
+
+            Handled *next = &expected[expectedCount++];
+            if (eventsLeft > 0 && (responsesLeft == 0 || rand() % 2 == 0)) {
+                *next = (Handled){.isEvent = true, .id = (uint16_t)(rand() % EVENT_COUNT)};
+                AppendEvent(next->id, MessageProtocol_EventMessageType);
+                --eventsLeft;
+            } else {
+                // Answer a random request, and move the last unanswered request into its place.
+                size_t index = (size_t)rand() % responsesLeft;
+                *next = (Handled){.isEvent = false, .id = sentRequestIds[index]};
+                AppendResponse(sentRequestIds[index], sentSequenceNumbers[index]);
+                --responsesLeft;
+                sentRequestIds[index] = sentRequestIds[responsesLeft];
+                sentSequenceNumbers[index] = sentSequenceNumbers[responsesLeft];
+            }
+        }
+        AppendNoise();
+
+        handledCount = 0;
+        wrongResponseData = false;
+        ReceiveStream();
+
+        bool matches = handledCount == expectedCount && !wrongResponseData;
+        for (size_t i = 0; matches && i < expectedCount; ++i) {
+            matches = handled[i].isEvent == expected[i].isEvent && handled[i].id == expected[i].id;
+        }
+        if (!matches || !MessageProtocol_IsIdle()) {
+            Fail(test, "stream was not handled as expected", round);
+            break;
+        }
+    }
+
+    TearDown();
+}
+
+// A message which is too long for the receive buffer is discarded, and the event after it is
+// still handled.
+static void TestOverlongMessage(void)
+{
+    const char *test = "TestOverlongMessage";
+    SetUp();
+    chunkSize = 0;
+
+    streamLength = 0;
+    MessageProtocol_MessageHeaderWithType header;
+    AppendHeader(&header, 2000, MessageProtocol_EventMessageType);
+    AppendBytes(&header, sizeof(header));
+    for (size_t i = 0; i < 1500; ++i) {
+        uint8_t filler = (uint8_t)(i & 0x1F);
+        AppendBytes(&filler, 1);
+    }
+    AppendEvent(2, MessageProtocol_EventMessageType);
+
+    handledCount = 0;
+    ReceiveStream();
+
+    if (handledCount != 1 || !handled[0].isEvent || handled[0].id != 2) {
+        Fail(test, "event after overlong message was not handled", (long)handledCount);
+    }
+
+    TearDown();
+}
+
+static long GetNowNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static void BenchmarkReadSizes(void)
+{
+    static const size_t readSizes[] = {sizeof(MessageProtocol_EventMessage), 64, 256, 1024};
+
+    SetUp();
+    streamLength = 0;
+    for (int i = 0; i < BENCHMARK_EVENTS; ++i) {
+        AppendEvent((MessageProtocol_EventId)(i % EVENT_COUNT), MessageProtocol_EventMessageType);
+    }
+
+    printf("%-12s %16s %24s\n", "read bytes", "ns per message", "bytes moved per byte");
+    for (size_t i = 0; i < sizeof(readSizes) / sizeof(readSizes[0]); ++i) {
+        chunkSize = readSizes[i];
+        bytesMoved = 0;
+        eventsHandled = 0;
+        handledCount = 0;
+
+        long start = GetNowNanoseconds();
+        ReceiveStream();
+        long elapsed = GetNowNanoseconds() - start;
+
+        if (eventsHandled != BENCHMARK_EVENTS) {
+            Fail("BenchmarkReadSizes", "not every event was handled", (long)eventsHandled);
+        }
+        printf("%-12zu %16.1f %24.3f\n", readSizes[i], (double)elapsed / BENCHMARK_EVENTS,
+               (double)bytesMoved / (double)streamLength);
+    }
+
+    TearDown();
+}
+
+int main(void)
+{
+    TestFragmentedCorruptStreams();
+    TestOverlongMessage();
+    BenchmarkReadSizes();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,422 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for message_protocol.c and uart_transport.c, which run on a Linux PC. The UART is one end
+// of a socketpair, and the test plays the part of the MCU at the other end: it reads the request
+// messages, checks that each arrived intact, and writes response messages back. The event loop in
+// eventloop_epoll.c drives the sample's code, between the test's steps.
+//
+// uart_transport.c is included rather than linked, so its calls to write can be replaced with
+// Test_Write, which can refuse data with EAGAIN or accept only part of it, as a UART whose
+// transmit buffer is full would.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+static ssize_t Test_Write(int fd, const void *buf, size_t count);
+
+#define write Test_Write
+#include "uart_transport.c"
+#undef write
+
+#include "message_protocol.h"
+#include "message_protocol_private.h"
+
+// If true, Test_Write fails with EAGAIN. Otherwise, if randomWriteLimits is true, it writes a
+// random number of bytes, up to 7, and sometimes fails with EAGAIN.
+static bool writeBlocked = false;
+static bool randomWriteLimits = false;
+
+// A request as the MCU received it.
+typedef struct {
+    MessageProtocol_RequestId requestId;
+    MessageProtocol_SequenceNumber sequenceNumber;
+    size_t bodyLength;
+    uint8_t body[MAX_REQUEST_DATA_SIZE];
+} ReceivedRequest;
+
+// A call to the response handler.
+typedef struct {
+    MessageProtocol_RequestId requestId;
+    size_t dataSize;
+    uint8_t data[MAX_RESPONSE_DATA_SIZE];
+    bool timedOut;
+} HandledResponse;
+
+#define MAX_REQUESTS 1000
+
+// As in message_protocol.c.
+#define REQUEST_TIMEOUT 5
+
+static EventLoop *eventLoop = NULL;
+static int mcuFd = -1;
+
+// Data which the MCU has read, but which does not hold a complete request yet.
+static uint8_t _Alignas(MessageProtocol_RequestMessage)
+    mcuBuffer[2 * sizeof(MessageProtocol_RequestMessage)];
+static size_t mcuBufferLength = 0;
+
+static ReceivedRequest receivedRequests[MAX_REQUESTS];
+static size_t receivedCount = 0;
+
+static HandledResponse handledResponses[MAX_REQUESTS];
+static size_t handledCount = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+void UART_InitConfig(UART_Config *uartConfig)
+{
+    memset(uartConfig, 0, sizeof(*uartConfig));
+}
+
+// The sample's end of the socketpair, which UART_Open returns.
+static int uartFd = -1;
+
+int UART_Open(UART_Id uartId, const UART_Config *uartConfig)
+{
+    return uartFd;
+}
+
+static ssize_t Test_Write(int fd, const void *buf, size_t count)
+{
+    if (writeBlocked || (randomWriteLimits && rand() % 3 == 0)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (randomWriteLimits && count > 1) {
+        count = 1 + (size_t)rand() % (count < 7 ? count : 7);
+    }
+    return write(fd, buf, count);
+}
+
+// The body of each request is filled with a pattern which depends on its ID, so that the MCU can
+// check that the body arrived intact.
+static size_t GetRequestBody(MessageProtocol_RequestId requestId, uint8_t *body)
+{
+    size_t length = ((size_t)requestId * 37u) % (MAX_REQUEST_DATA_SIZE + 1);
+    for (size_t i = 0; i < length; ++i) {
+        body[i] = (uint8_t)(requestId * 13u + i);
+    }
+    return length;
+}
+
+static void ResponseHandler(MessageProtocol_CategoryId categoryId,
+                            MessageProtocol_RequestId requestId, const uint8_t *data,
+                            size_t dataSize, MessageProtocol_ResponseResult result, bool timedOut)
+{
+    HandledResponse *response = &handledResponses[handledCount++];
+    response->requestId = requestId;
+    response->dataSize = dataSize;
+    memcpy(response->data, data, dataSize);
+    response->timedOut = timedOut;
+}
+
+static void SendRequest(MessageProtocol_RequestId requestId)
+{
+    uint8_t body[MAX_REQUEST_DATA_SIZE];
+    size_t length = GetRequestBody(requestId, body);
+    MessageProtocol_SendRequest(0x1, requestId, body, length, ResponseHandler);
+}
+
+// Read what the sample has written to the UART, and record each complete request. Any byte which
+// does not belong to a well-formed request is a failure.
+static void ReadRequests(const char *test)
+{
+    for (;;) {
+        ssize_t bytesRead =
+            read(mcuFd, mcuBuffer + mcuBufferLength, sizeof(mcuBuffer) - mcuBufferLength);
+        if (bytesRead <= 0) {
+            break;
+        }
+        mcuBufferLength += (size_t)bytesRead;
+
+        const MessageProtocol_RequestMessage *request =
+            (const MessageProtocol_RequestMessage *)mcuBuffer;
+        const MessageProtocol_MessageHeader *header =
+            &request->requestHeader.messageHeaderWithType.messageHeader;
+        while (mcuBufferLength >= sizeof(MessageProtocol_MessageHeader) &&
+               mcuBufferLength >= sizeof(MessageProtocol_MessageHeader) + header->length) {
+            size_t messageLength = sizeof(MessageProtocol_MessageHeader) + header->length;
+            size_t bodyLength = messageLength - sizeof(MessageProtocol_RequestHeader);
+            if (memcmp(header->preamble, MessageProtocol_MessagePreamble,
+                       sizeof(MessageProtocol_MessagePreamble)) != 0 ||
+                request->requestHeader.messageHeaderWithType.type !=
+                    MessageProtocol_RequestMessageType ||
+                messageLength < sizeof(MessageProtocol_RequestHeader) ||
+                bodyLength > MAX_REQUEST_DATA_SIZE || receivedCount == MAX_REQUESTS) {
+                Fail(test, "MCU received a corrupt request", (long)receivedCount);
+                mcuBufferLength = 0;
+                return;
+            }
+
+            ReceivedRequest *received = &receivedRequests[receivedCount++];
+            received->requestId = request->requestHeader.requestId;
+            received->sequenceNumber = request->requestHeader.sequenceNumber;
+            received->bodyLength = bodyLength;
+            memcpy(received->body, request->data, bodyLength);
+
+            uint8_t expected[MAX_REQUEST_DATA_SIZE];
+            if (GetRequestBody(received->requestId, expected) != bodyLength ||
+                memcmp(expected, received->body, bodyLength) != 0) {
+                Fail(test, "MCU received a request with a corrupt body", received->requestId);
+            }
+
+            mcuBufferLength -= messageLength;
+            memmove(mcuBuffer, mcuBuffer + messageLength, mcuBufferLength);
+        }
+    }
+}
+
+// Write the response to a request which the MCU received. The response data is the request
+// body, reversed.
+static void SendResponse(const ReceivedRequest *request)
+{
+    MessageProtocol_ResponseMessage response;
+    size_t length = sizeof(MessageProtocol_ResponseHeader) + request->bodyLength;
+    memcpy(response.responseHeader.messageHeaderWithType.messageHeader.preamble,
+           MessageProtocol_MessagePreamble, sizeof(MessageProtocol_MessagePreamble));
+    response.responseHeader.messageHeaderWithType.messageHeader.length =
+        (uint16_t)(length - sizeof(MessageProtocol_MessageHeader));
+    response.responseHeader.messageHeaderWithType.type = MessageProtocol_ResponseMessageType;
+    response.responseHeader.messageHeaderWithType.reserved = 0;
+    response.responseHeader.categoryId = 0x1;
+    response.responseHeader.requestId = request->requestId;
+    response.responseHeader.sequenceNumber = request->sequenceNumber;
+    response.responseHeader.responseResult = 0;
+    response.responseHeader.reserved = 0;
+    for (size_t i = 0; i < request->bodyLength; ++i) {
+        response.data[i] = request->body[request->bodyLength - 1 - i];
+    }
+
+    if (write(mcuFd, &response, length) != (ssize_t)length) {
+        printf("FAIL: could not write response: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Check that the response handler was called with the response to a request.
+static void CheckResponse(const char *test, const HandledResponse *response)
+{
+    uint8_t body[MAX_REQUEST_DATA_SIZE];
+    size_t length = GetRequestBody(response->requestId, body);
+
+    bool matches = !response->timedOut && response->dataSize == length;
+    for (size_t i = 0; matches && i < length; ++i) {
+        matches = response->data[i] == body[length - 1 - i];
+    }
+    if (!matches) {
+        Fail(test, "wrong response", response->requestId);
+    }
+}
+
+// Run the event loop and read requests until the MCU has received the given number of requests,
+// or until the event loop has run the given number of times.
+static void RunUntilReceived(const char *test, size_t count, int runs)
+{
+    for (int i = 0; i < runs && receivedCount < count; ++i) {
+        EventLoop_Run(eventLoop, 1, false);
+        ReadRequests(test);
+    }
+}
+
+// Run the event loop until the response handler has been called the given number of times, or
+// until the timeout, in milliseconds, has passed.
+static void RunUntilHandled(size_t count, int timeout)
+{
+    for (int i = 0; i < timeout && handledCount < count; ++i) {
+        EventLoop_Run(eventLoop, 1, false);
+    }
+}
+
+static void SetUp(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0) {
+        printf("FAIL: could not create socketpair: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    uartFd = fds[0];
+    mcuFd = fds[1];
+
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL ||
+        MessageProtocol_Initialize(eventLoop, UartTransport_Read, UartTransport_Send) !=
+            ExitCode_Success ||
+        UartTransport_Initialize(eventLoop, 0, MessageProtocol_HandleReceivedMessage) !=
+            ExitCode_Success) {
+        printf("FAIL: could not initialize\n");
+        exit(EXIT_FAILURE);
+    }
+
+    writeBlocked = false;
+    randomWriteLimits = false;
+    mcuBufferLength = 0;
+    receivedCount = 0;
+    handledCount = 0;
+}
+
+static void TearDown(void)
+{
+    UartTransport_Cleanup();
+    MessageProtocol_Cleanup();
+    EventLoop_Close(eventLoop);
+    close(mcuFd);
+    eventLoop = NULL;
+    mcuFd = -1;
+}
+
+// Send a full window of requests back to back while the UART cannot accept any data, so that they
+// all queue behind the first, and then let them go out with partial writes. The MCU must receive
+// every request intact and in order; a fifth request must be refused; and responses in reverse
+// order must each reach the handler of their own request.
+static void TestBackToBackRequests(void)
+{
+    const char *test = "TestBackToBackRequests";
+    const size_t window = MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS;
+
+    SetUp();
+    writeBlocked = true;
+    for (MessageProtocol_RequestId id = 1; id <= window + 1; ++id) {
+        SendRequest(id);
+    }
+    if (MessageProtocol_IsIdle()) {
+        Fail(test, "no request is outstanding", 0);
+    }
+
+    writeBlocked = false;
+    randomWriteLimits = true;
+    RunUntilReceived(test, window + 1, 1000);
+    if (receivedCount != window) {
+        Fail(test, "MCU received the wrong number of requests", (long)receivedCount);
+    }
+    for (size_t i = 0; i < receivedCount; ++i) {
+        if (receivedRequests[i].requestId != i + 1) {
+            Fail(test, "MCU received requests out of order", receivedRequests[i].requestId);
+        }
+    }
+
+    for (size_t i = receivedCount; i > 0; --i) {
+        SendResponse(&receivedRequests[i - 1]);
+    }
+    RunUntilHandled(window, 1000);
+    if (handledCount != receivedCount) {
+        Fail(test, "wrong number of responses handled", (long)handledCount);
+    }
+    for (size_t i = 0; i < handledCount; ++i) {
+        if (handledResponses[i].requestId != receivedCount - i) {
+            Fail(test, "responses handled out of order", handledResponses[i].requestId);
+        }
+        CheckResponse(test, &handledResponses[i]);
+    }
+    if (!MessageProtocol_IsIdle()) {
+        Fail(test, "requests still outstanding", 0);
+    }
+    TearDown();
+}
+
+// Keep the window full for a long run of requests, with partial writes throughout, while the MCU
+// answers the requests which it has received in batches, in reverse order. Every request must
+// arrive intact and be answered.
+static void TestSustainedWindow(void)
+{
+    const char *test = "TestSustainedWindow";
+    const MessageProtocol_RequestId requests = MAX_REQUESTS;
+    MessageProtocol_RequestId sent = 0;
+    size_t answered = 0;
+
+    SetUp();
+    randomWriteLimits = true;
+    for (int runs = 0; runs < 100000 && handledCount < requests; ++runs) {
+        while (sent < requests && sent - handledCount < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS) {
+            SendRequest(++sent);
+        }
+
+        EventLoop_Run(eventLoop, 0, false);
+        ReadRequests(test);
+
+        for (size_t i = receivedCount; i > answered; --i) {
+            SendResponse(&receivedRequests[i - 1]);
+        }
+        answered = receivedCount;
+    }
+
+    if (receivedCount != requests || handledCount != requests) {
+        Fail(test, "not every request was answered", (long)handledCount);
+    }
+    for (size_t i = 0; i < handledCount; ++i) {
+        CheckResponse(test, &handledResponses[i]);
+    }
+    for (size_t i = 0; i < receivedCount; ++i) {
+        if (receivedRequests[i].requestId != i + 1) {
+            Fail(test, "MCU received requests out of order", receivedRequests[i].requestId);
+            break;
+        }
+    }
+    TearDown();
+}
+
+// If the MCU does not answer one request, only that request times out.
+static void TestTimeout(void)
+{
+    const char *test = "TestTimeout";
+
+    SetUp();
+    SendRequest(1);
+    SendRequest(2);
+    RunUntilReceived(test, 2, 1000);
+    if (receivedCount != 2) {
+        Fail(test, "MCU received the wrong number of requests", (long)receivedCount);
+        TearDown();
+        return;
+    }
+
+    SendResponse(&receivedRequests[1]);
+    RunUntilHandled(1, 1000);
+    RunUntilHandled(2, (REQUEST_TIMEOUT + 1) * 1000);
+    if (handledCount != 2 || handledResponses[0].requestId != 2 ||
+        handledResponses[1].requestId != 1 || !handledResponses[1].timedOut) {
+        Fail(test, "wrong request timed out", (long)handledCount);
+    } else {
+        CheckResponse(test, &handledResponses[0]);
+    }
+    if (!MessageProtocol_IsIdle()) {
+        Fail(test, "requests still outstanding", 0);
+    }
+    TearDown();
+}
+
+int main(void)
+{
+    TestBackToBackRequests();
+    TestSustainedWindow();
+    TestTimeout();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
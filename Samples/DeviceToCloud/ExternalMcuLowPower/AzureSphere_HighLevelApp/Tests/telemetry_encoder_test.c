@@ -0,0 +1,283 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Replay test for telemetry_encoder.c, which runs on a Linux PC with cloud.c and parson.c. The
+// Azure IoT connection is replaced by functions which record each telemetry message, and which
+// acknowledge it after Cloud_SendTelemetry returns.
+//
+// The trace is a week of wake cycles, one every 2 minutes as the sample sleeps. A machine with 5
+// slots is used in bursts during the day, and is refilled some time after it is empty. The
+// battery runs down slowly, and its readings are noisy. On the third night it gets cold, and the
+// battery level falls by more than the deadband, in steps smaller than it. Each cycle chooses the
+// fields to send and updates the baseline as business_logic.c does. A cloud view, which applies
+// the fields of each message, must:
+//   - match the dispense counts and low soda flag after every cycle;
+//   - be within the deadband of the battery level after every cycle;
+//   - add up the dispenses since the last update to the lifetime total;
+//   - receive all the fields at least every TELEMETRY_KEYFRAME_INTERVAL cycles.
+// It reports the bytes and messages sent, against a full snapshot every cycle, which is what the
+// sample sent before the encoder was added.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "azure_iot.h"
+#include "cloud.h"
+#include "parson.h"
+#include "telemetry.h"
+#include "telemetry_encoder.h"
+
+#define CYCLES_PER_HOUR 30
+#define CYCLES (7 * 24 * CYCLES_PER_HOUR)
+#define SLOTS 5
+// The battery level falls by this much each cycle in the first cold hour, and rises again in the
+// second.
+#define COLD_HOUR 50
+#define COLD_STEP_VOLTS 0.006f
+// From business_logic.c.
+#define LOW_DISPENSE_ALERT_THRESHOLD 2
+
+typedef struct {
+    CloudTelemetry telemetry;
+    uint64_t dispensesReceived;
+    unsigned cyclesSinceAllFields;
+    unsigned maxCyclesBetweenAllFields;
+} CloudView;
+
+static AzureIoT_Callbacks azureIoTCallbacks;
+static void *pendingAckContext = NULL;
+static bool pendingAck = false;
+static bool measuringOnly = false;
+
+static size_t fullBytes = 0;
+static size_t sentBytes = 0;
+static unsigned sentMessages = 0;
+static bool acknowledged = false;
+static CloudView cloudView;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+ExitCode AzureIoT_Initialize(EventLoop *el, ExitCode_CallbackType failureCallback,
+                             const char *modelId, void *connectionContext,
+                             AzureIoT_Callbacks callbacks)
+{
+    azureIoTCallbacks = callbacks;
+    return ExitCode_Success;
+}
+
+void AzureIoT_Cleanup(void) {}
+
+AzureIoT_Result AzureIoT_DeviceTwinReportState(const char *jsonState, void *context)
+{
+    return AzureIoT_Result_OtherFailure;
+}
+
+// Applies the fields in a telemetry message to the cloud view.
+static void ReceiveTelemetry(const char *jsonMessage)
+{
+    JSON_Value *rootValue = json_parse_string(jsonMessage);
+    JSON_Object *root = json_value_get_object(rootValue);
+    if (root == NULL) {
+        Fail("ReceiveTelemetry", "message is not a JSON object", 0);
+        json_value_free(rootValue);
+        return;
+    }
+
+    CloudTelemetry *telemetry = &cloudView.telemetry;
+    if (json_object_has_value(root, "DispensesSinceLastUpdate")) {
+        telemetry->dispensesSinceLastSync =
+            (uint32_t)json_object_get_number(root, "DispensesSinceLastUpdate");
+        cloudView.dispensesReceived += telemetry->dispensesSinceLastSync;
+    }
+    if (json_object_has_value(root, "RemainingDispenses")) {
+        telemetry->remainingDispenses =
+            (uint32_t)json_object_get_number(root, "RemainingDispenses");
+    }
+    if (json_object_has_value(root, "LowSoda")) {
+        telemetry->lowSoda = json_object_get_boolean(root, "LowSoda") == 1;
+    }
+    if (json_object_has_value(root, "LifetimeTotalDispenses")) {
+        telemetry->lifetimeTotalDispenses =
+            (uint32_t)json_object_get_number(root, "LifetimeTotalDispenses");
+    }
+    if (json_object_has_value(root, "BatteryLevel")) {
+        telemetry->batteryLevel = (float)json_object_get_number(root, "BatteryLevel");
+    }
+    if (json_object_get_count(root) == 5) {
+        cloudView.cyclesSinceAllFields = 0;
+    }
+    json_value_free(rootValue);
+}
+
+AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8601DateTimeString,
+                                       void *context)
+{
+    if (measuringOnly) {
+        fullBytes += strlen(jsonMessage);
+    } else {
+        sentBytes += strlen(jsonMessage);
+        ++sentMessages;
+        ReceiveTelemetry(jsonMessage);
+    }
+    pendingAck = true;
+    pendingAckContext = context;
+    return AzureIoT_Result_OK;
+}
+
+static void DeliverAck(void)
+{
+    if (pendingAck) {
+        pendingAck = false;
+        azureIoTCallbacks.sendTelemetryCallbackFunction(true, pendingAckContext);
+    }
+}
+
+static void HandleSendTelemetryAck(bool success)
+{
+    acknowledged = success;
+}
+
+static void HandleMeasuringAck(bool success) {}
+
+static void CheckCloudView(const CloudTelemetry *telemetry, int cycle)
+{
+    const CloudTelemetry *received = &cloudView.telemetry;
+    if (received->lifetimeTotalDispenses != telemetry->lifetimeTotalDispenses ||
+        received->remainingDispenses != telemetry->remainingDispenses ||
+        received->lowSoda != telemetry->lowSoda) {
+        Fail("CheckCloudView", "cloud has the wrong dispense counts", cycle);
+    }
+    // Allow for the battery level being serialized as a double.
+    if (fabsf(received->batteryLevel - telemetry->batteryLevel) >
+        TELEMETRY_BATTERY_LEVEL_DEADBAND + 1e-5f) {
+        Fail("CheckCloudView", "cloud battery level is outside the deadband", cycle);
+    }
+    if (cloudView.dispensesReceived != telemetry->lifetimeTotalDispenses) {
+        Fail("CheckCloudView", "dispenses since last update do not add up", cycle);
+    }
+}
+
+// Replays a week of wake cycles, choosing the fields to send as business_logic.c does.
+static void ReplayWeek(void)
+{
+    srand(42);
+    uint32_t lifetimeTotalDispenses = 0;
+    uint32_t lifetimeTotalStockedDispenses = SLOTS;
+    uint32_t persistedLifetimeTotalDispenses = 0;
+    float battery = 3.30f;
+    float coldOffset = 0.0f;
+    TelemetryBaseline baseline;
+    bool haveBaseline = false;
+    unsigned skippedCycles = 0;
+
+    for (int cycle = 0; cycle < CYCLES; ++cycle) {
+        int hour = (cycle / CYCLES_PER_HOUR) % 24;
+        uint32_t remaining = lifetimeTotalStockedDispenses - lifetimeTotalDispenses;
+        if (hour >= 8 && hour < 20 && rand() % 100 < 15 && remaining > 0) {
+            ++lifetimeTotalDispenses;
+        }
+        if (lifetimeTotalStockedDispenses == lifetimeTotalDispenses && rand() % 100 < 10) {
+            lifetimeTotalStockedDispenses += SLOTS;
+        }
+        battery -= 0.00002f;
+        if (cycle / CYCLES_PER_HOUR == COLD_HOUR) {
+            coldOffset -= COLD_STEP_VOLTS;
+        } else if (cycle / CYCLES_PER_HOUR == COLD_HOUR + 1) {
+            coldOffset += COLD_STEP_VOLTS;
+        }
+
+        CloudTelemetry telemetry;
+        telemetry.lifetimeTotalDispenses = lifetimeTotalDispenses;
+        telemetry.dispensesSinceLastSync = lifetimeTotalDispenses - persistedLifetimeTotalDispenses;
+        telemetry.remainingDispenses = lifetimeTotalStockedDispenses - lifetimeTotalDispenses;
+        telemetry.lowSoda = telemetry.remainingDispenses <= LOW_DISPENSE_ALERT_THRESHOLD;
+        telemetry.batteryLevel = battery + coldOffset + (float)(rand() % 21 - 10) * 0.001f;
+
+        measuringOnly = true;
+        Cloud_SendTelemetry(&telemetry, CloudTelemetryField_All, HandleMeasuringAck);
+        DeliverAck();
+        measuringOnly = false;
+
+        uint32_t fields =
+            TelemetryEncoder_SelectFields(haveBaseline ? &baseline : NULL, &telemetry);
+        acknowledged = false;
+        if (fields == 0) {
+            ++skippedCycles;
+            acknowledged = true;
+        } else if (!Cloud_SendTelemetry(&telemetry, fields, HandleSendTelemetryAck)) {
+            Fail("ReplayWeek", "could not send telemetry", cycle);
+        }
+        DeliverAck();
+        if (!acknowledged) {
+            Fail("ReplayWeek", "telemetry was not acknowledged", cycle);
+            continue;
+        }
+
+        TelemetryEncoder_UpdateBaseline(&baseline, &telemetry, fields);
+        haveBaseline = true;
+        persistedLifetimeTotalDispenses = lifetimeTotalDispenses;
+
+        CheckCloudView(&telemetry, cycle);
+        ++cloudView.cyclesSinceAllFields;
+        if (cloudView.cyclesSinceAllFields > cloudView.maxCyclesBetweenAllFields) {
+            cloudView.maxCyclesBetweenAllFields = cloudView.cyclesSinceAllFields;
+        }
+    }
+
+    printf("%d wake cycles, %u dispenses\n", CYCLES, lifetimeTotalDispenses);
+    printf("full snapshots:  %7zu bytes in %4d messages\n", fullBytes, CYCLES);
+    printf("selected fields: %7zu bytes in %4u messages (%.0f%% fewer bytes)\n", sentBytes,
+           sentMessages, 100.0 * (double)(fullBytes - sentBytes) / (double)fullBytes);
+    printf("%u cycles skipped the telemetry round trip; all fields sent at least every %u cycles\n",
+           skippedCycles, cloudView.maxCyclesBetweenAllFields);
+
+    if (cloudView.maxCyclesBetweenAllFields > TELEMETRY_KEYFRAME_INTERVAL) {
+        Fail("ReplayWeek", "fields were not all sent often enough",
+             (long)cloudView.maxCyclesBetweenAllFields);
+    }
+    if (sentBytes * 2 > fullBytes) {
+        Fail("ReplayWeek", "selected fields saved less than half the bytes", (long)sentBytes);
+    }
+}
+
+int main(void)
+{
+    char scopeId[] = "0ne00000000";
+    if (Cloud_Initialize(NULL, scopeId, NULL, NULL, NULL) != ExitCode_Success) {
+        printf("ERROR: Could not initialize the cloud interface.\n");
+        return EXIT_FAILURE;
+    }
+    azureIoTCallbacks.connectionStatusCallbackFunction(true);
+
+    ReplayWeek();
+
+    Cloud_Cleanup();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -20,6 +20,7 @@
 #include "power.h"
 #include "status.h"
 #include "telemetry.h"
+#include "telemetry_encoder.h"
 #include "update.h"
 
 static void Initialize(void);
@@ -62,6 +63,9 @@ static bool mcuReady;
 static bool cloudReady;
 static bool haveTelemetry;
 static DeviceTelemetry telemetry;
+static TelemetryBaseline telemetryBaseline;
+static CloudTelemetry sentTelemetry;
+static uint32_t sentTelemetryFields;
 static bool telemetryReceivedByCloud;
 static bool haveFlavor;
 static char *receivedFlavorName;
@@ -151,6 +155,9 @@ bool BusinessLogic_Run(ExitCode *ec)
             break;
         case State_PersistTelemetry:
             PersistentStorage_PersistTelemetry(&telemetry);
+            TelemetryEncoder_UpdateBaseline(&telemetryBaseline, &sentTelemetry,
+                                            sentTelemetryFields);
+            PersistentStorage_PersistTelemetryBaseline(&telemetryBaseline);
             applicationState = State_WaitForFlavor;
             finished = false;
             break;
@@ -298,7 +305,18 @@ static void CalculateAndSendTelemetry()
     cloudTelemetry.lowSoda = cloudTelemetry.remainingDispenses <= LowDispenseAlertThreshold;
     cloudTelemetry.batteryLevel = telemetry.batteryLevel;
 
-    Cloud_SendTelemetry(&cloudTelemetry, HandleCloudSendTelemetryAck);
+    // Only send the fields which have changed since the cloud last acknowledged them.
+    bool retrievedBaseline = PersistentStorage_RetrieveTelemetryBaseline(&telemetryBaseline);
+    sentTelemetry = cloudTelemetry;
+    sentTelemetryFields = TelemetryEncoder_SelectFields(
+        retrievedBaseline ? &telemetryBaseline : NULL, &cloudTelemetry);
+
+    if (sentTelemetryFields == 0) {
+        Log_Debug("INFO: Telemetry has not changed; not sending it.\n");
+        telemetryReceivedByCloud = true;
+    } else {
+        Cloud_SendTelemetry(&cloudTelemetry, sentTelemetryFields, HandleCloudSendTelemetryAck);
+    }
 }
 
 static void HandleMcuMessageFailure(void)
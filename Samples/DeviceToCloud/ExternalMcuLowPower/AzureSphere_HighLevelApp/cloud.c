@@ -66,7 +66,7 @@ void Cloud_Cleanup(void)
     AzureIoT_Cleanup();
 }
 
-bool Cloud_SendTelemetry(const CloudTelemetry *telemetry,
+bool Cloud_SendTelemetry(const CloudTelemetry *telemetry, uint32_t fields,
                          Cloud_SendTelemetryCallbackType sendTelemetryCallback)
 {
     if (!isConnected) {
@@ -83,14 +83,24 @@ bool Cloud_SendTelemetry(const CloudTelemetry *telemetry,
 
     JSON_Object *telemetryRootObject = json_value_get_object(telemetryRootValue);
 
-    json_object_dotset_number(telemetryRootObject, "DispensesSinceLastUpdate",
-                              telemetry->dispensesSinceLastSync);
-    json_object_dotset_number(telemetryRootObject, "RemainingDispenses",
-                              telemetry->remainingDispenses);
-    json_object_dotset_boolean(telemetryRootObject, "LowSoda", telemetry->lowSoda);
-    json_object_dotset_number(telemetryRootObject, "LifetimeTotalDispenses",
-                              telemetry->lifetimeTotalDispenses);
-    json_object_dotset_number(telemetryRootObject, "BatteryLevel", telemetry->batteryLevel);
+    if (fields & CloudTelemetryField_DispensesSinceLastSync) {
+        json_object_dotset_number(telemetryRootObject, "DispensesSinceLastUpdate",
+                                  telemetry->dispensesSinceLastSync);
+    }
+    if (fields & CloudTelemetryField_RemainingDispenses) {
+        json_object_dotset_number(telemetryRootObject, "RemainingDispenses",
+                                  telemetry->remainingDispenses);
+    }
+    if (fields & CloudTelemetryField_LowSoda) {
+        json_object_dotset_boolean(telemetryRootObject, "LowSoda", telemetry->lowSoda);
+    }
+    if (fields & CloudTelemetryField_LifetimeTotalDispenses) {
+        json_object_dotset_number(telemetryRootObject, "LifetimeTotalDispenses",
+                                  telemetry->lifetimeTotalDispenses);
+    }
+    if (fields & CloudTelemetryField_BatteryLevel) {
+        json_object_dotset_number(telemetryRootObject, "BatteryLevel", telemetry->batteryLevel);
+    }
 
     char *serializedTelemetry = json_serialize_to_string(telemetryRootValue);
     AzureIoT_SendTelemetry(serializedTelemetry, NULL, (void *)&sendTelemetryMessageIdentifier);
@@ -50,6 +50,10 @@ void Cloud_Cleanup(void);
 ///     (or otherwise) by the cloud.
 /// </summary>
 /// <param name="telemetry">Pointer to telemetry to send.</param>
+/// <param name="fields">
+///     Bitmask of the <see cref="CloudTelemetryField" /> values to send; other fields are left
+///     out of the message.
+/// </param>
 /// <param name="callback">
 ///     A <see cref="Cloud_SendTelemetryCallbackType" /> to be invoked, to indicate whether the
 ///     telemetry was successfully received by the cloud backend.
@@ -57,7 +61,8 @@ void Cloud_Cleanup(void);
 /// <returns>
 ///     A Boolean indicating whether the telemetry was successfuly queued for sending.
 /// </returns>
-bool Cloud_SendTelemetry(const CloudTelemetry *telemetry, Cloud_SendTelemetryCallbackType callback);
+bool Cloud_SendTelemetry(const CloudTelemetry *telemetry, uint32_t fields,
+                         Cloud_SendTelemetryCallbackType callback);
 
 /// <summary>
 ///     Queue a message to the cloud acknowledging the new flavor sent to the device. Should be
@@ -59,6 +59,8 @@ void DisposeEventLoopTimer(EventLoopTimer *timer);
 
 /// <summary>
 /// The timer callback should call this function to consume the timer event.
+/// The timers on an event loop share one timer event, which has already been consumed
+/// when the callback is called, so this function always succeeds.
 /// </summary>
 /// <param name="timer">Successfully allocated timer.</param>
 /// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
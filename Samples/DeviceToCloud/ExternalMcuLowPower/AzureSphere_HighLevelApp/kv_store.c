@@ -0,0 +1,455 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "kv_store.h"
+
+// Header at the start of each half of the file. It is written once the half has been filled
+// with the latest values, so the half whose header is valid and has the greater generation
+// holds the log.
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t crc;
+} RegionHeader;
+
+// Header of a record, which is followed by the key and then the value. The CRC covers the rest
+// of the record. Beyond the end of the log there may be a record whose write was interrupted, or
+// data from before the store was created, so the log ends at the first record which is invalid
+// or has a different generation.
+typedef struct {
+    uint32_t crc;
+    uint32_t generation;
+    uint8_t keyLength;
+    uint8_t reserved;
+    uint16_t valueSize;
+} RecordHeader;
+
+typedef struct {
+    char key[KV_STORE_MAX_KEY_LENGTH + 1];
+    off_t valueOffset;
+    size_t valueSize;
+} Entry;
+
+#define MAX_RECORD_SIZE \
+    (sizeof(RecordHeader) + KV_STORE_MAX_KEY_LENGTH + KV_STORE_MAX_VALUE_SIZE)
+
+static int ReadRegionHeader(int region, uint32_t *generation);
+static int WriteRegionHeader(int region, uint32_t generation);
+static int ReadLog(void);
+static int WriteRecord(off_t offset, uint32_t generation, const char *key, const void *value,
+                       size_t size);
+static int Compact(void);
+static Entry *FindEntry(const char *key);
+static size_t GetRecordSize(const char *key, size_t size);
+static off_t GetRegionStart(int region);
+static uint32_t ComputeCrc(const void *data, size_t size);
+
+static const uint32_t magicWord = ('K' << 24) | ('V' << 16) | ('S' << 8) | '1';
+
+static int storageFd = -1;
+static off_t regionSize = 0;
+
+// Half of the file which holds the log, its generation, and where the next record is written.
+static int activeRegion = 0;
+static uint32_t activeGeneration = 0;
+static off_t appendOffset = 0;
+
+// Location in the file of the latest value of each key.
+static Entry entries[KV_STORE_MAX_KEYS];
+static size_t entryCount = 0;
+
+/// <summary>
+///     Reads the header of a half of the file.
+/// </summary>
+/// <returns>
+///     1 if the header is valid; 0 if it is not, such as for a half which has not been
+///     written; -1 if the file cannot be read.
+/// </returns>
+static int ReadRegionHeader(int region, uint32_t *generation)
+{
+    RegionHeader header;
+    ssize_t bytesRead = pread(storageFd, &header, sizeof(header), GetRegionStart(region));
+    if (bytesRead == -1) {
+        Log_Debug("ERROR: Could not read key-value store header: %s (%d).\n", strerror(errno),
+                  errno);
+        return -1;
+    }
+
+    if (bytesRead < (ssize_t)sizeof(header) || header.magic != magicWord ||
+        header.crc != ComputeCrc(&header, offsetof(RegionHeader, crc))) {
+        return 0;
+    }
+
+    *generation = header.generation;
+    return 1;
+}
+
+static int WriteRegionHeader(int region, uint32_t generation)
+{
+    RegionHeader header = {.magic = magicWord, .generation = generation};
+    header.crc = ComputeCrc(&header, offsetof(RegionHeader, crc));
+
+    ssize_t bytesWritten = pwrite(storageFd, &header, sizeof(header), GetRegionStart(region));
+    if (bytesWritten < (ssize_t)sizeof(header)) {
+        if (bytesWritten != -1) {
+            errno = EIO;
+        }
+        Log_Debug("ERROR: Could not write key-value store header: %s (%d).\n", strerror(errno),
+                  errno);
+        return -1;
+    }
+
+    if (fsync(storageFd) != 0) {
+        Log_Debug("ERROR: Could not flush key-value store: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+///     Reads the log in the active half of the file, and records where the latest value of each
+///     key is.
+/// </summary>
+static int ReadLog(void)
+{
+    off_t offset = GetRegionStart(activeRegion) + (off_t)sizeof(RegionHeader);
+    off_t regionEnd = GetRegionStart(activeRegion) + regionSize;
+    entryCount = 0;
+
+    while (offset + (off_t)sizeof(RecordHeader) <= regionEnd) {
+        uint8_t record[MAX_RECORD_SIZE];
+        size_t maxSize = sizeof(record);
+        if (regionEnd - offset < (off_t)maxSize) {
+            maxSize = (size_t)(regionEnd - offset);
+        }
+
+        ssize_t bytesRead = pread(storageFd, record, maxSize, offset);
+        if (bytesRead == -1) {
+            Log_Debug("ERROR: Could not read key-value store: %s (%d).\n", strerror(errno), errno);
+            return -1;
+        }
+        if (bytesRead < (ssize_t)sizeof(RecordHeader)) {
+            break;
+        }
+
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        size_t recordSize = sizeof(header) + header.keyLength + header.valueSize;
+        if (header.generation != activeGeneration || header.keyLength == 0 ||
+            header.keyLength > KV_STORE_MAX_KEY_LENGTH ||
+            header.valueSize > KV_STORE_MAX_VALUE_SIZE || recordSize > (size_t)bytesRead) {
+            break;
+        }
+
+        // A record whose write was interrupted ends the log; the next record overwrites it.
+        uint32_t crc = ComputeCrc(record + sizeof(header.crc), recordSize - sizeof(header.crc));
+        if (header.crc != crc) {
+            break;
+        }
+
+        char key[KV_STORE_MAX_KEY_LENGTH + 1];
+        memcpy(key, record + sizeof(header), header.keyLength);
+        key[header.keyLength] = '\0';
+
+        Entry *entry = FindEntry(key);
+        if (entry == NULL) {
+            if (entryCount == KV_STORE_MAX_KEYS) {
+                break;
+            }
+            entry = &entries[entryCount++];
+            strcpy(entry->key, key);
+        }
+        entry->valueOffset = offset + (off_t)(sizeof(header) + header.keyLength);
+        entry->valueSize = header.valueSize;
+
+        offset += (off_t)recordSize;
+    }
+
+    appendOffset = offset;
+    return 0;
+}
+
+static int WriteRecord(off_t offset, uint32_t generation, const char *key, const void *value,
+                       size_t size)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t keyLength = strlen(key);
+    size_t recordSize = GetRecordSize(key, size);
+
+    RecordHeader header = {
+        .generation = generation, .keyLength = (uint8_t)keyLength, .valueSize = (uint16_t)size};
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), key, keyLength);
+    memcpy(record + sizeof(header) + keyLength, value, size);
+
+    header.crc = ComputeCrc(record + sizeof(header.crc), recordSize - sizeof(header.crc));
+    memcpy(record, &header.crc, sizeof(header.crc));
+
+    ssize_t bytesWritten = pwrite(storageFd, record, recordSize, offset);
+    if (bytesWritten < (ssize_t)recordSize) {
+        if (bytesWritten != -1) {
+            errno = EIO;
+        }
+        Log_Debug("ERROR: Could not write to key-value store: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+///     Copies the latest value of each key to the other half of the file, and makes that half
+///     hold the log. Until its header has been written, the log in the current half is used.
+/// </summary>
+static int Compact(void)
+{
+    int targetRegion = 1 - activeRegion;
+    uint32_t generation = activeGeneration + 1;
+    off_t offset = GetRegionStart(targetRegion) + (off_t)sizeof(RegionHeader);
+    off_t valueOffsets[KV_STORE_MAX_KEYS];
+
+    // Clear the other half first. An earlier compaction which was interrupted may have left
+    // records of the same generation there, which would otherwise be read as part of the log.
+    static const uint8_t zeros[256];
+    for (off_t cleared = 0; cleared < regionSize; cleared += (off_t)sizeof(zeros)) {
+        size_t size = sizeof(zeros);
+        if (regionSize - cleared < (off_t)size) {
+            size = (size_t)(regionSize - cleared);
+        }
+        ssize_t bytesWritten =
+            pwrite(storageFd, zeros, size, GetRegionStart(targetRegion) + cleared);
+        if (bytesWritten < (ssize_t)size) {
+            if (bytesWritten != -1) {
+                errno = EIO;
+            }
+            Log_Debug("ERROR: Could not write to key-value store: %s (%d).\n", strerror(errno),
+                      errno);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < entryCount; ++i) {
+        uint8_t value[KV_STORE_MAX_VALUE_SIZE];
+        ssize_t bytesRead = pread(storageFd, value, entries[i].valueSize, entries[i].valueOffset);
+        if (bytesRead < (ssize_t)entries[i].valueSize) {
+            if (bytesRead != -1) {
+                errno = EIO;
+            }
+            Log_Debug("ERROR: Could not read key-value store: %s (%d).\n", strerror(errno), errno);
+            return -1;
+        }
+
+        if (WriteRecord(offset, generation, entries[i].key, value, entries[i].valueSize) != 0) {
+            return -1;
+        }
+
+        valueOffsets[i] = offset + (off_t)(sizeof(RecordHeader) + strlen(entries[i].key));
+        offset += (off_t)GetRecordSize(entries[i].key, entries[i].valueSize);
+    }
+
+    // The records must reach storage before the header which makes them the log.
+    if (fsync(storageFd) != 0) {
+        Log_Debug("ERROR: Could not flush key-value store: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    if (WriteRegionHeader(targetRegion, generation) != 0) {
+        return -1;
+    }
+
+    activeRegion = targetRegion;
+    activeGeneration = generation;
+    appendOffset = offset;
+    for (size_t i = 0; i < entryCount; ++i) {
+        entries[i].valueOffset = valueOffsets[i];
+    }
+
+    Log_Debug("INFO: Compacted key-value store to %zu keys.\n", entryCount);
+    return 0;
+}
+
+static Entry *FindEntry(const char *key)
+{
+    for (size_t i = 0; i < entryCount; ++i) {
+        if (strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static size_t GetRecordSize(const char *key, size_t size)
+{
+    return sizeof(RecordHeader) + strlen(key) + size;
+}
+
+static off_t GetRegionStart(int region)
+{
+    return region * regionSize;
+}
+
+/// <summary>
+///     Computes the CRC-32 (IEEE 802.3) of a block of data.
+/// </summary>
+static uint32_t ComputeCrc(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+int KvStore_Open(size_t capacity)
+{
+    // Each half must be able to hold a value for every key, plus the record being written.
+    if (capacity / 2 < sizeof(RegionHeader) + (KV_STORE_MAX_KEYS + 1) * MAX_RECORD_SIZE) {
+        Log_Debug("ERROR: Key-value store capacity of %zu bytes is too small.\n", capacity);
+        errno = EINVAL;
+        return -1;
+    }
+
+    storageFd = Storage_OpenMutableFile();
+    if (storageFd == -1) {
+        Log_Debug("ERROR: Could not open mutable file: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    regionSize = (off_t)(capacity / 2);
+
+    uint32_t generations[2] = {0, 0};
+    int results[2];
+    for (int region = 0; region < 2; ++region) {
+        results[region] = ReadRegionHeader(region, &generations[region]);
+        if (results[region] == -1) {
+            goto fail;
+        }
+    }
+
+    if (results[0] == 0 && results[1] == 0) {
+        // The file is new, or does not hold a key-value store.
+        Log_Debug("INFO: Creating new key-value store.\n");
+        activeRegion = 0;
+        activeGeneration = 1;
+        if (WriteRegionHeader(activeRegion, activeGeneration) != 0) {
+            goto fail;
+        }
+    } else {
+        // Generations are compared so that they can wrap around.
+        if (results[0] == 1 &&
+            (results[1] == 0 || (int32_t)(generations[0] - generations[1]) > 0)) {
+            activeRegion = 0;
+        } else {
+            activeRegion = 1;
+        }
+        activeGeneration = generations[activeRegion];
+    }
+
+    if (ReadLog() != 0) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    KvStore_Close();
+    return -1;
+}
+
+ssize_t KvStore_Get(const char *key, void *value, size_t maxSize)
+{
+    Entry *entry = FindEntry(key);
+    if (entry == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (entry->valueSize > maxSize) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    ssize_t bytesRead = pread(storageFd, value, entry->valueSize, entry->valueOffset);
+    if (bytesRead < (ssize_t)entry->valueSize) {
+        if (bytesRead != -1) {
+            errno = EIO;
+        }
+        Log_Debug("ERROR: Could not read key-value store: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return bytesRead;
+}
+
+int KvStore_Set(const char *key, const void *value, size_t size)
+{
+    size_t keyLength = strlen(key);
+    if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY_LENGTH || size > KV_STORE_MAX_VALUE_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Entry *entry = FindEntry(key);
+    if (entry == NULL && entryCount == KV_STORE_MAX_KEYS) {
+        Log_Debug("ERROR: Too many keys in key-value store; the maximum is %d.\n",
+                  KV_STORE_MAX_KEYS);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    // If the record does not fit in this half of the file, move the log to the other half.
+    size_t recordSize = GetRecordSize(key, size);
+    if (appendOffset + (off_t)recordSize > GetRegionStart(activeRegion) + regionSize) {
+        if (Compact() != 0) {
+            return -1;
+        }
+    }
+
+    if (WriteRecord(appendOffset, activeGeneration, key, value, size) != 0) {
+        return -1;
+    }
+
+    if (fsync(storageFd) != 0) {
+        Log_Debug("ERROR: Could not flush key-value store: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    if (entry == NULL) {
+        entry = &entries[entryCount++];
+        strcpy(entry->key, key);
+    }
+    entry->valueOffset = appendOffset + (off_t)(sizeof(RecordHeader) + keyLength);
+    entry->valueSize = size;
+    appendOffset += (off_t)recordSize;
+
+    return 0;
+}
+
+void KvStore_Close(void)
+{
+    if (storageFd != -1) {
+        if (close(storageFd) != 0) {
+            Log_Debug("ERROR: Could not close mutable file: %s (%d).\n", strerror(errno), errno);
+        }
+        storageFd = -1;
+    }
+
+    entryCount = 0;
+}
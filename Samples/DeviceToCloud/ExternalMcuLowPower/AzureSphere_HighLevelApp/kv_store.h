@@ -0,0 +1,66 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// The key-value store keeps a small number of values in the application's mutable storage
+// file, as a log of records. Setting a value appends a record to the log, rather than
+// rewriting the file, and each record carries a CRC, so a record whose write was interrupted
+// is ignored and the previous value of its key is kept.
+//
+// The file is split into two halves, and the log is kept in one of them. When a record does
+// not fit in that half, the latest value of each key is copied to the other half, which then
+// holds the log. The file therefore never grows beyond the capacity given to KvStore_Open, so
+// writes do not fail with EDQUOT as long as the capacity is no greater than the size given
+// for MutableStorage in the application manifest.
+//
+// Tests/kv_store_test.c tests the store on a Linux PC, including after a power cut or a failed
+// write at each byte, and Tests/kv_store_benchmark.c measures it.
+
+/// <summary>Maximum number of keys which the store can hold.</summary>
+#define KV_STORE_MAX_KEYS 8
+
+/// <summary>Maximum length of a key, excluding the null terminator.</summary>
+#define KV_STORE_MAX_KEY_LENGTH 15
+
+/// <summary>Maximum size of a value, in bytes.</summary>
+#define KV_STORE_MAX_VALUE_SIZE 64
+
+/// <summary>
+/// Open the mutable storage file, and read the latest value of each key.
+/// </summary>
+/// <param name="capacity">
+/// Size of the file in bytes. This must not exceed the size given for MutableStorage in the
+/// application manifest, and must be the same each time the store is opened.
+/// </param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more information.</returns>
+int KvStore_Open(size_t capacity);
+
+/// <summary>
+/// Read the latest value of a key.
+/// </summary>
+/// <param name="key">The key.</param>
+/// <param name="value">Buffer which receives the value.</param>
+/// <param name="maxSize">Size of the buffer.</param>
+/// <returns>
+/// The size of the value on success; -1 on failure, in which case errno contains more
+/// information. errno is ENOENT if the key has no value, and ERANGE if the buffer is too small.
+/// </returns>
+ssize_t KvStore_Get(const char *key, void *value, size_t maxSize);
+
+/// <summary>
+/// Set the value of a key, and flush it to storage.
+/// </summary>
+/// <param name="key">The key.</param>
+/// <param name="value">The value.</param>
+/// <param name="size">Size of the value, up to KV_STORE_MAX_VALUE_SIZE.</param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more information.</returns>
+int KvStore_Set(const char *key, const void *value, size_t size);
+
+/// <summary>
+/// Close the mutable storage file.
+/// </summary>
+void KvStore_Close(void);
@@ -35,6 +35,7 @@
 #include "eventloop_timer_utilities.h"
 #include "exitcodes.h"
 #include "message_protocol.h"
+#include "persistent_storage.h"
 #include "power.h"
 #include "mcu_messaging.h"
 #include "uart_transport.h"
@@ -135,6 +136,7 @@ static void ClosePeripheralsAndHandlers(void)
     MessageProtocol_Cleanup();
     UartTransport_Cleanup();
     Cloud_Cleanup();
+    PersistentStorage_Cleanup();
 
     EventLoop_Close(eventLoop);
 }
@@ -1,6 +1,7 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
@@ -23,28 +24,36 @@
 
 static EventLoop *eventLoopRef = NULL;
 
-static EventLoopTimer *requestTimeoutTimer = NULL;
-
 static Transport_ReadFunctionType transportReadFunction = NULL;
 static Transport_WriteFunctionType transportWriteFunction = NULL;
 
-// Buffer for data received via transport and index at which to write future data.
-static uint8_t receiveBuffer[RECEIVED_BUFFER_SIZE];
-static uint16_t receiveBufferPos = 0;
+// Buffer for data received via transport. Data which has not been processed yet lies between
+// receiveBufferHead and receiveBufferTail; new data is written at receiveBufferTail. Complete
+// messages are handled in place, and the head moves past them without copying any data.
+static uint8_t _Alignas(MessageProtocol_ResponseMessage) receiveBuffer[RECEIVED_BUFFER_SIZE];
+static size_t receiveBufferHead = 0;
+static size_t receiveBufferTail = 0;
 
 // Buffer in which to assemble messages
 static uint8_t sendBuffer[SEND_BUFFER_SIZE];
 
-// Message protocol states.
-typedef enum {
-    MessageProtocolState_Idle,
-    MessageProtocolState_RequestOutstanding
-} MessageProtocolState;
+// A request which has been sent, and whose response has not been received yet. Responses are
+// matched to requests by sequence number, so they can arrive in any order.
+typedef struct {
+    bool inUse;
+    uint16_t sequenceNumber;
+    MessageProtocol_CategoryId categoryId;
+    MessageProtocol_RequestId requestId;
+    MessageProtocol_ResponseHandlerType responseHandler;
+    // Times out this request.
+    EventLoopTimer *timeoutTimer;
+} OutstandingRequest;
 
-// Current state of the message protocol.
-static MessageProtocolState protocolState;
+static OutstandingRequest outstandingRequests[MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
+static size_t outstandingRequestCount = 0;
 
-static MessageProtocol_ResponseHandlerType currentResponseHandler;
+// Maximum number of requests which can be outstanding at once.
+static size_t windowSize = MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS;
 
 // Request sequence number
 static uint16_t currentSequenceNumber = 0;
@@ -65,51 +74,89 @@ struct IdleHandlerNode {
 };
 static struct IdleHandlerNode *idleHandlerList;
 
-static void RemoveFirstCompleteMessage(void)
+static OutstandingRequest *FindOutstandingRequest(uint16_t sequenceNumber)
 {
-    MessageProtocol_MessageHeader *messageHeader = (MessageProtocol_MessageHeader *)receiveBuffer;
-    uint16_t topMessageLength =
-        (uint16_t)(messageHeader->length + sizeof(MessageProtocol_MessageHeader));
-    if (receiveBufferPos == topMessageLength) {
-        // There is only one complete message in the buffer: set receivedBufferIndex to 0.
-        receiveBufferPos = 0;
-    } else if (receiveBufferPos > topMessageLength) {
-        // There is more than one complete message in the buffer: remove the top message, move
-        // the rest forward and subtract the message length from receiveBufferPos.
-        receiveBufferPos = (uint16_t)(receiveBufferPos - topMessageLength);
-        memmove(receiveBuffer, receiveBuffer + topMessageLength, receiveBufferPos);
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (outstandingRequests[i].inUse &&
+            outstandingRequests[i].sequenceNumber == sequenceNumber) {
+            return &outstandingRequests[i];
+        }
     }
+    return NULL;
 }
 
-static void RemoveInvalidBytesBeforePreamble(void)
+static MessageProtocol_ResponseHandlerType CompleteOutstandingRequest(OutstandingRequest *request)
+{
+    // The slot is released before the response handler is called, so the handler can send
+    // another request.
+    DisarmEventLoopTimer(request->timeoutTimer);
+    request->inUse = false;
+    --outstandingRequestCount;
+
+    MessageProtocol_ResponseHandlerType handler = request->responseHandler;
+    request->responseHandler = NULL;
+    return handler;
+}
+
+static void DiscardInvalidBytesBeforePreamble(void)
 {
     size_t preambleSize = sizeof(MessageProtocol_MessagePreamble);
-    bool foundPreamble = false;
-    size_t pos = 0;
+    size_t pos = receiveBufferHead;
+
+    while (pos < receiveBufferTail) {
+        // Skip straight to the next byte which could start a preamble.
+        const uint8_t *candidate = memchr(receiveBuffer + pos, MessageProtocol_MessagePreamble[0],
+                                          receiveBufferTail - pos);
+        if (candidate == NULL) {
+            pos = receiveBufferTail;
+            break;
+        }
+        pos = (size_t)(candidate - receiveBuffer);
 
-    while (pos < receiveBufferPos) {
-        size_t remainingDataSize = receiveBufferPos - pos;
         // Check whether we can find a complete or partial preamble by the end of current data.
+        size_t remainingDataSize = receiveBufferTail - pos;
         size_t checkPreambleSize =
             (remainingDataSize >= preambleSize) ? preambleSize : remainingDataSize;
         if (memcmp(MessageProtocol_MessagePreamble, receiveBuffer + pos, checkPreambleSize) == 0) {
-            foundPreamble = true;
             break;
         }
         ++pos;
     }
-    uint16_t validMessageLength = (uint16_t)(receiveBufferPos - pos);
-    receiveBufferPos = validMessageLength;
-
-    // Found complete or partial preamble. If it's not at the beginning of the
-    // message, move everything between i and (pos - 1) to the front, otherwise
-    // doing nothing as receivedBufferIndex is set to 0 already.
-    if (pos > 0 && foundPreamble) {
-        memmove(receiveBuffer, receiveBuffer + pos, validMessageLength);
+
+    receiveBufferHead = pos;
+}
+
+static void CompactReceiveBuffer(void)
+{
+    // Move the unprocessed data to the start of the buffer. This is only required when there is
+    // no space left after it, or when it is not suitably aligned to be handled in place. Once all
+    // complete messages have been handled, this is at most one partial message.
+    size_t unprocessedLength = receiveBufferTail - receiveBufferHead;
+    if (receiveBufferHead > 0 && unprocessedLength > 0) {
+        memmove(receiveBuffer, receiveBuffer + receiveBufferHead, unprocessedLength);
+    }
+    receiveBufferHead = 0;
+    receiveBufferTail = unprocessedLength;
+}
+
+static size_t GetCompleteMessageLength(void)
+{
+    uint8_t *message = receiveBuffer + receiveBufferHead;
+    size_t available = receiveBufferTail - receiveBufferHead;
+
+    // Message lengths are limited to 8 bits.
+    if (!MessageProtocol_IsMessageComplete(
+            message, (uint8_t)((available > UINT8_MAX) ? UINT8_MAX : available))) {
+        return 0;
     }
+
+    // The message is only aligned once it is handled, so copy the length out of its header.
+    uint16_t length;
+    memcpy(&length, message + offsetof(MessageProtocol_MessageHeader, length), sizeof(length));
+    return length + sizeof(MessageProtocol_MessageHeader);
 }
 
-static MessageProtocol_EventInfo *GetEventInfo(uint8_t *message, uint16_t messageLength)
+static MessageProtocol_EventInfo *GetEventInfo(uint8_t *message, size_t messageLength)
 {
     MessageProtocol_MessageHeader *messageHeader = (MessageProtocol_MessageHeader *)message;
     if (messageLength <
@@ -125,17 +172,17 @@ static MessageProtocol_EventInfo *GetEventInfo(uint8_t *message, uint16_t messag
 
 static void CallIdleHandlers(void)
 {
-    // Call all registered idle handlers as long as protocol state is still idle.
+    // Call all registered idle handlers as long as no request has been sent by one of them.
     struct IdleHandlerNode *current = idleHandlerList;
-    while (current != NULL && protocolState == MessageProtocolState_Idle) {
+    while (current != NULL && outstandingRequestCount == 0) {
         current->handler();
         current = current->nextNode;
     }
 }
 
-static void CallEventHandler(void)
+static void CallEventHandler(uint8_t *message, size_t messageLength)
 {
-    MessageProtocol_EventInfo *eventInfo = GetEventInfo(receiveBuffer, receiveBufferPos);
+    MessageProtocol_EventInfo *eventInfo = GetEventInfo(message, messageLength);
     if (eventInfo == NULL) {
         Log_Debug("ERROR: Received malformed event message.\n");
         return;
@@ -154,12 +201,11 @@ static void CallEventHandler(void)
               eventInfo->categoryId, eventInfo->eventId);
 }
 
-static void CallResponseHandler(void)
+static void CallResponseHandler(uint8_t *message, size_t messageLength)
 {
-    MessageProtocol_ResponseMessage *responseMessage =
-        (MessageProtocol_ResponseMessage *)(receiveBuffer);
+    MessageProtocol_ResponseMessage *responseMessage = (MessageProtocol_ResponseMessage *)(message);
 
-    if (receiveBufferPos < sizeof(MessageProtocol_ResponseHeader) ||
+    if (messageLength < sizeof(MessageProtocol_ResponseHeader) ||
         responseMessage->responseHeader.messageHeaderWithType.messageHeader.length +
                 sizeof(MessageProtocol_MessageHeader) <
             sizeof(MessageProtocol_ResponseHeader)) {
@@ -167,21 +213,15 @@ static void CallResponseHandler(void)
         return;
     }
 
-    if (currentSequenceNumber != responseMessage->responseHeader.sequenceNumber) {
+    OutstandingRequest *request =
+        FindOutstandingRequest(responseMessage->responseHeader.sequenceNumber);
+    if (request == NULL) {
         Log_Debug("ERROR: Received a response with invalid sequence number: %x.\n",
                   responseMessage->responseHeader.sequenceNumber);
         return;
     }
 
-    if (protocolState != MessageProtocolState_RequestOutstanding) {
-        Log_Debug("ERROR: Received a response when not expecting one\n");
-        return;
-    }
-    protocolState = MessageProtocolState_Idle;
-    DisarmEventLoopTimer(requestTimeoutTimer);
-
-    MessageProtocol_ResponseHandlerType handler = currentResponseHandler;
-    currentResponseHandler = NULL;
+    MessageProtocol_ResponseHandlerType handler = CompleteOutstandingRequest(request);
 
     if (handler != NULL) {
         size_t dataLength =
@@ -192,61 +232,103 @@ static void CallResponseHandler(void)
                 responseMessage->responseHeader.responseResult, false);
     }
 
-    CallIdleHandlers();
+    if (outstandingRequestCount == 0) {
+        CallIdleHandlers();
+    }
 }
 
 void MessageProtocol_HandleReceivedMessage(void)
 {
+    if (receiveBufferTail == RECEIVED_BUFFER_SIZE) {
+        CompactReceiveBuffer();
+    }
+
     // Attempt to read message from UART.
-    ssize_t bytesRead = transportReadFunction(receiveBuffer + receiveBufferPos,
-                                              RECEIVED_BUFFER_SIZE - receiveBufferPos);
+    ssize_t bytesRead = transportReadFunction((char *)receiveBuffer + receiveBufferTail,
+                                              RECEIVED_BUFFER_SIZE - receiveBufferTail);
     if (bytesRead == -1) {
         Log_Debug("ERROR: Could not read from UART: %s (%d).\n", strerror(errno), errno);
         return;
     }
 
     if (bytesRead > 0) {
-        receiveBufferPos = (uint16_t)(receiveBufferPos + bytesRead);
-        // Messages in the receive buffer should always start with a preamble, so remove all invalid
-        // bytes before the preamble.
-        RemoveInvalidBytesBeforePreamble();
-        while (MessageProtocol_IsMessageComplete(receiveBuffer, (uint8_t)receiveBufferPos)) {
+        receiveBufferTail += (size_t)bytesRead;
+
+        for (;;) {
+            // Messages should always start with a preamble, so skip all invalid bytes before the
+            // preamble.
+            DiscardInvalidBytesBeforePreamble();
+
+            size_t messageLength = GetCompleteMessageLength();
+            if (messageLength == 0) {
+                break;
+            }
+
+            // Handlers access the message through its structure types, so it must be aligned.
+            if (receiveBufferHead % _Alignof(MessageProtocol_ResponseMessage) != 0) {
+                CompactReceiveBuffer();
+            }
+
             // We received a complete message, call its handler.
+            uint8_t *message = receiveBuffer + receiveBufferHead;
             MessageProtocol_MessageHeaderWithType *messageHeader =
-                (MessageProtocol_MessageHeaderWithType *)receiveBuffer;
+                (MessageProtocol_MessageHeaderWithType *)message;
             if (messageHeader->type == MessageProtocol_EventMessageType) {
-                CallEventHandler();
+                CallEventHandler(message, messageLength);
             } else if (messageHeader->type == MessageProtocol_ResponseMessageType) {
-                CallResponseHandler();
+                CallResponseHandler(message, messageLength);
             } else {
                 Log_Debug("ERROR: Skipping message: unknown or invalid message type.\n");
             }
-            // We have finished with this message now, so remove it from the receive buffer.
-            RemoveFirstCompleteMessage();
+
+            // We have finished with this message now, so move past it in the receive buffer.
+            receiveBufferHead += messageLength;
+        }
+
+        if (receiveBufferHead == receiveBufferTail) {
+            receiveBufferHead = 0;
+            receiveBufferTail = 0;
+        }
+
+        // If the buffer is full of an incomplete message which can never fit, discard it so that
+        // reception can continue.
+        if (receiveBufferHead == 0 && receiveBufferTail == RECEIVED_BUFFER_SIZE) {
+            Log_Debug("ERROR: Discarding received data: message too long.\n");
+            receiveBufferTail = 0;
         }
     }
 }
 
 static void RequestTimeoutEventHandler(EventLoopTimer *timer)
 {
-    if (ConsumeEventLoopTimerEvent(requestTimeoutTimer) != 0) {
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
         return;
     }
 
-    // Timed out waiting for response message: change back to Idle state and call the response
-    // handler to inform it that the request has timed out.
-    protocolState = MessageProtocolState_Idle;
-    MessageProtocol_ResponseHandlerType handler = currentResponseHandler;
-    currentResponseHandler = NULL;
+    OutstandingRequest *request = NULL;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (outstandingRequests[i].timeoutTimer == timer && outstandingRequests[i].inUse) {
+            request = &outstandingRequests[i];
+            break;
+        }
+    }
+    if (request == NULL) {
+        return;
+    }
+
+    // Timed out waiting for response message: release the request and call the response
+    // handler to inform it that the request has timed out. Other requests are unaffected.
+    MessageProtocol_CategoryId categoryId = request->categoryId;
+    MessageProtocol_RequestId requestId = request->requestId;
+    MessageProtocol_ResponseHandlerType handler = CompleteOutstandingRequest(request);
     if (handler != NULL) {
-        MessageProtocol_RequestMessage *requestMessage =
-            (MessageProtocol_RequestMessage *)sendBuffer;
-        handler(requestMessage->requestHeader.categoryId, requestMessage->requestHeader.requestId,
-                NULL, 0, 0, true);
+        handler(categoryId, requestId, NULL, 0, 0, true);
     }
 
-    // We are idle now, so call the idle handlers.
-    CallIdleHandlers();
+    // If we are idle now, call the idle handlers.
+    if (outstandingRequestCount == 0) {
+        CallIdleHandlers();
+    }
 }
 
 ExitCode MessageProtocol_Initialize(EventLoop *el, Transport_ReadFunctionType readFunction,
@@ -256,14 +338,16 @@ ExitCode MessageProtocol_Initialize(EventLoop *el, Transport_ReadFunctionType re
     transportReadFunction = readFunction;
     transportWriteFunction = writeFunction;
 
-    requestTimeoutTimer = CreateEventLoopDisarmedTimer(eventLoopRef, RequestTimeoutEventHandler);
-
-    if (requestTimeoutTimer == NULL) {
-        return ExitCode_MsgProtoInit_Timer;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        outstandingRequests[i] = (OutstandingRequest){.inUse = false};
+        outstandingRequests[i].timeoutTimer =
+            CreateEventLoopDisarmedTimer(eventLoopRef, RequestTimeoutEventHandler);
+        if (outstandingRequests[i].timeoutTimer == NULL) {
+            return ExitCode_MsgProtoInit_Timer;
+        }
     }
 
-    protocolState = MessageProtocolState_Idle;
-    currentResponseHandler = NULL;
+    outstandingRequestCount = 0;
     eventHandlerList = NULL;
     idleHandlerList = NULL;
     return ExitCode_Success;
@@ -271,7 +355,11 @@ ExitCode MessageProtocol_Initialize(EventLoop *el, Transport_ReadFunctionType re
 
 void MessageProtocol_Cleanup(void)
 {
-    DisposeEventLoopTimer(requestTimeoutTimer);
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        DisposeEventLoopTimer(outstandingRequests[i].timeoutTimer);
+        outstandingRequests[i] = (OutstandingRequest){.inUse = false};
+    }
+    outstandingRequestCount = 0;
     eventLoopRef = NULL;
     transportReadFunction = NULL;
     transportWriteFunction = NULL;
@@ -321,11 +409,19 @@ void MessageProtocol_SendRequest(MessageProtocol_CategoryId categoryId,
                                  size_t bodyLength,
                                  MessageProtocol_ResponseHandlerType responseHandler)
 {
-    if (protocolState != MessageProtocolState_Idle) {
+    if (outstandingRequestCount >= windowSize) {
         Log_Debug("INFO: Protocol busy, can't send request: %x, %x.\n", categoryId, requestId);
         return;
     }
 
+    OutstandingRequest *request = NULL;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (!outstandingRequests[i].inUse) {
+            request = &outstandingRequests[i];
+            break;
+        }
+    }
+
     // Set request message data in-place.
     MessageProtocol_RequestMessage *requestMessage = (MessageProtocol_RequestMessage *)sendBuffer;
     memcpy(requestMessage->requestHeader.messageHeaderWithType.messageHeader.preamble,
@@ -350,17 +446,34 @@ void MessageProtocol_SendRequest(MessageProtocol_CategoryId categoryId,
     }
     memcpy(requestMessage->data, body, bodyLength);
 
-    currentResponseHandler = responseHandler;
+    request->inUse = true;
+    request->sequenceNumber = requestMessage->requestHeader.sequenceNumber;
+    request->categoryId = categoryId;
+    request->requestId = requestId;
+    request->responseHandler = responseHandler;
+    ++outstandingRequestCount;
 
     // Start timer for response to this request.
     const struct timespec sendRequestMessageCheckPeriod = {REQUEST_TIMEOUT, 0};
-    SetEventLoopTimerOneShot(requestTimeoutTimer, &sendRequestMessageCheckPeriod);
-    protocolState = MessageProtocolState_RequestOutstanding;
+    SetEventLoopTimerOneShot(request->timeoutTimer, &sendRequestMessageCheckPeriod);
 
-    transportWriteFunction(sendBuffer, messageLength);
+    if (transportWriteFunction((const char *)sendBuffer, messageLength) <= 0) {
+        Log_Debug("ERROR: Could not send request: %x, %x.\n", categoryId, requestId);
+        CompleteOutstandingRequest(request);
+    }
+}
+
+void MessageProtocol_SetWindowSize(size_t size)
+{
+    if (size == 0 || size > MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS) {
+        Log_Debug("ERROR: Invalid window size %zu; it must be between 1 and %u.\n", size,
+                  MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS);
+        return;
+    }
+    windowSize = size;
 }
 
 bool MessageProtocol_IsIdle(void)
 {
-    return (protocolState == MessageProtocolState_Idle);
+    return (outstandingRequestCount == 0);
 }
\ No newline at end of file
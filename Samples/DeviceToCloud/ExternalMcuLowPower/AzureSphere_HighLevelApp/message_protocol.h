@@ -8,6 +8,12 @@
 #include "message_protocol_public.h"
 #include "exitcodes.h"
 
+/// <summary>
+///     Maximum number of requests which can be waiting for a response at once. Responses are
+///     matched to requests by sequence number, and each request times out separately.
+/// </summary>
+#define MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS 4u
+
 typedef ssize_t (*Transport_ReadFunctionType)(char *buffer, size_t amount);
 
 typedef ssize_t (*Transport_WriteFunctionType)(const char *buffer, size_t amount);
@@ -61,7 +67,8 @@ typedef void (*MessageProtocol_ResponseHandlerType)(MessageProtocol_CategoryId c
                                                     bool timedOut);
 
 /// <summary>
-///     Send a request using the message protocol.
+///     Send a request using the message protocol. The request is not sent if the window of
+///     outstanding requests is full.
 /// </summary>
 /// <param name="categoryId">The message protocol category ID.</param>
 /// <param name="requestId">The message protocol request ID.</param>
@@ -73,8 +80,16 @@ void MessageProtocol_SendRequest(MessageProtocol_CategoryId categoryId,
                                  size_t bodyLength,
                                  MessageProtocol_ResponseHandlerType responseHandler);
 
+/// <summary>
+///     Set the number of requests which can be waiting for a response at once. By default, this
+///     is MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS. Use 1 for a peer which cannot receive a
+///     request until it has responded to the previous one.
+/// </summary>
+/// <param name="size">The window size, from 1 to MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS.</param>
+void MessageProtocol_SetWindowSize(size_t size);
+
 /// <summary>
 ///     Query whether the message protocol is currently idle.
 /// </summary>
-/// <returns>True if the message protocol is currently idle; false if it is busy.</returns>
+/// <returns>True if no requests are outstanding; false otherwise.</returns>
 bool MessageProtocol_IsIdle(void);
@@ -7,136 +7,150 @@
 #include <unistd.h>
 #include <stdbool.h>
 
-#include <applibs/storage.h>
 #include <applibs/log.h>
 
 #include "telemetry.h"
+#include "kv_store.h"
 #include "persistent_storage.h"
 
-static const uint32_t magicWord0 = ('M' << 24) | ('S' << 16) | ('A' << 8) | 'S';
-static const uint32_t magicWord1 = ('S' << 24) | ('O' << 16) | ('D' << 8) | 'A';
+// Size of the mutable storage file; this must not exceed the MutableStorage SizeKB given in
+// app_manifest.json.
+#define MUTABLE_STORAGE_SIZE (8 * 1024)
 
-bool PersistentStorage_RetrieveTelemetry(DeviceTelemetry *telemetry)
-{
-    int storageFd = -1;
+static const char telemetryKey[] = "telemetry";
+static const char telemetryBaselineKey[] = "baseline";
 
-    if (telemetry == NULL) {
-        Log_Debug("ERROR: Telemetry pointer cannot be NULL\n");
-        goto fail;
-    }
+// Each value is stored after the telemetry struct version which it was written with.
+_Static_assert(sizeof(uint32_t) + sizeof(DeviceTelemetry) <= KV_STORE_MAX_VALUE_SIZE,
+               "DeviceTelemetry is too large for the key-value store.");
+_Static_assert(sizeof(uint32_t) + sizeof(TelemetryBaseline) <= KV_STORE_MAX_VALUE_SIZE,
+               "TelemetryBaseline is too large for the key-value store.");
 
-    memset(telemetry, 0, sizeof(DeviceTelemetry));
+static bool isStoreOpen = false;
 
-    storageFd = Storage_OpenMutableFile();
-    if (storageFd == -1) {
-        Log_Debug("ERROR: Failed to open mutable storage - %s (%d)\n", strerror(errno), errno);
-        goto fail;
-    }
+static bool OpenStore(void);
+static bool RetrieveValue(const char *key, void *value, size_t size, const char *description);
+static void PersistValue(const char *key, const void *value, size_t size, const char *description);
 
-    uint32_t header[3];
-    ssize_t bytesRead = read(storageFd, &header[0], sizeof(header));
-    if (bytesRead == -1) {
-        Log_Debug("ERROR: Failed to read telemetry header from mutable storage - %s (%d)\n",
-                  strerror(errno), errno);
-        goto fail;
+/// <summary>
+///     Open the key-value store, if it is not already open.
+/// </summary>
+/// <returns>true if the store is open; false if it could not be opened.</returns>
+static bool OpenStore(void)
+{
+    if (!isStoreOpen) {
+        if (KvStore_Open(MUTABLE_STORAGE_SIZE) != 0) {
+            Log_Debug("ERROR: Failed to open persistent storage - %s (%d)\n", strerror(errno),
+                      errno);
+            return false;
+        }
+        isStoreOpen = true;
     }
 
-    if (bytesRead < sizeof(header)) {
-        Log_Debug(
-            "Failed to read telemetry header from mutable storage: incomplete header (%d bytes "
-            "when %u were expected)\n",
-            bytesRead, sizeof(header));
-        goto fail;
-    }
+    return true;
+}
 
-    if (header[0] != magicWord0 || header[1] != magicWord1) {
-        Log_Debug(
-            "Mutable storage does not contain header bytes; no stored telemetry available.\n");
-        goto fail;
-    }
+/// <summary>
+///     Retrieve a value which was persisted with the current telemetry struct version. If there
+///     is no such value, returns false and sets the value to zero.
+/// </summary>
+static bool RetrieveValue(const char *key, void *value, size_t size, const char *description)
+{
+    memset(value, 0, size);
 
-    uint32_t persistedTelemetryVersion = header[2];
-    if (persistedTelemetryVersion != telemetryStructVersion) {
-        Log_Debug(
-            "Persisted telemetry struct version (%d) differs from expected version (%d); no stored "
-            "telemetry available",
-            persistedTelemetryVersion, telemetryStructVersion);
-        goto fail;
+    if (!OpenStore()) {
+        return false;
     }
 
-    bytesRead = read(storageFd, telemetry, sizeof(DeviceTelemetry));
-
+    uint8_t buffer[KV_STORE_MAX_VALUE_SIZE];
+    ssize_t bytesRead = KvStore_Get(key, buffer, sizeof(buffer));
     if (bytesRead == -1) {
-        Log_Debug("ERROR: Failed to read telemetry from mutable storage - %s (%d)", strerror(errno),
-                  errno);
-        goto fail;
+        if (errno == ENOENT) {
+            Log_Debug("No stored %s available.\n", description);
+        } else {
+            Log_Debug("ERROR: Failed to read %s from persistent storage - %s (%d)\n", description,
+                      strerror(errno), errno);
+        }
+        return false;
     }
 
-    if (bytesRead < sizeof(DeviceTelemetry)) {
-        Log_Debug(
-            "ERROR: Failed to read full telemetry struct from mutable storage; no stored telemetry "
-            "available");
-        goto fail;
+    uint32_t persistedVersion = 0;
+    if (bytesRead == (ssize_t)(sizeof(persistedVersion) + size)) {
+        memcpy(&persistedVersion, buffer, sizeof(persistedVersion));
+    }
+    if (persistedVersion != telemetryStructVersion) {
+        Log_Debug("Persisted %s differs from expected version (%d); no stored %s available\n",
+                  description, telemetryStructVersion, description);
+        return false;
     }
 
+    memcpy(value, buffer + sizeof(persistedVersion), size);
     return true;
+}
 
-fail:
+/// <summary>
+///     Persist a value, together with the current telemetry struct version.
+/// </summary>
+static void PersistValue(const char *key, const void *value, size_t size, const char *description)
+{
+    if (!OpenStore()) {
+        return;
+    }
 
-    if (storageFd != 0) {
-        close(storageFd);
+    uint8_t buffer[KV_STORE_MAX_VALUE_SIZE];
+    memcpy(buffer, &telemetryStructVersion, sizeof(telemetryStructVersion));
+    memcpy(buffer + sizeof(telemetryStructVersion), value, size);
+
+    if (KvStore_Set(key, buffer, sizeof(telemetryStructVersion) + size) != 0) {
+        Log_Debug("ERROR: Failed to write %s to persistent storage - %s (%d)\n", description,
+                  strerror(errno), errno);
     }
-    return false;
 }
 
-void PersistentStorage_PersistTelemetry(const DeviceTelemetry *telemetry)
+bool PersistentStorage_RetrieveTelemetry(DeviceTelemetry *telemetry)
 {
-    int storageFd = -1;
-
     if (telemetry == NULL) {
         Log_Debug("ERROR: Telemetry pointer cannot be NULL\n");
-        goto cleanup;
+        return false;
     }
 
-    storageFd = Storage_OpenMutableFile();
-    if (storageFd == -1) {
-        Log_Debug("ERROR: Failed to open mutable storage - %s (%d)\n", strerror(errno), errno);
-        goto cleanup;
-    }
+    return RetrieveValue(telemetryKey, telemetry, sizeof(*telemetry), "telemetry");
+}
 
-    uint32_t header[] = {magicWord0, magicWord1, telemetryStructVersion};
-    ssize_t bytesWritten = write(storageFd, &header, sizeof(header));
-    if (bytesWritten == -1) {
-        Log_Debug("ERROR: Failed to write telemetry header to persistent storage - %s (%d)\n",
-                  strerror(errno), errno);
-        goto cleanup;
+void PersistentStorage_PersistTelemetry(const DeviceTelemetry *telemetry)
+{
+    if (telemetry == NULL) {
+        Log_Debug("ERROR: Telemetry pointer cannot be NULL\n");
+        return;
     }
 
-    if (bytesWritten < sizeof(header)) {
-        Log_Debug(
-            "ERROR: Failed to write full telemetry header to persistent storage - only wrote %d of "
-            "%u bytes\n",
-            bytesWritten, sizeof(header));
-        goto cleanup;
-    }
+    PersistValue(telemetryKey, telemetry, sizeof(*telemetry), "telemetry");
+}
 
-    bytesWritten = write(storageFd, telemetry, sizeof(DeviceTelemetry));
-    if (bytesWritten == -1) {
-        Log_Debug("ERROR: Failed to write telemetry to persistent storage - %s (%d)\n",
-                  strerror(errno), errno);
-        goto cleanup;
+bool PersistentStorage_RetrieveTelemetryBaseline(TelemetryBaseline *baseline)
+{
+    if (baseline == NULL) {
+        Log_Debug("ERROR: Telemetry baseline pointer cannot be NULL\n");
+        return false;
     }
 
-    if (bytesWritten < sizeof(DeviceTelemetry)) {
-        Log_Debug(
-            "ERROR: Failed to write full telemetry to persistent storage - only wrote %d of %u "
-            "bytes\n",
-            bytesWritten, sizeof(DeviceTelemetry));
-        goto cleanup;
+    return RetrieveValue(telemetryBaselineKey, baseline, sizeof(*baseline), "telemetry baseline");
+}
+
+void PersistentStorage_PersistTelemetryBaseline(const TelemetryBaseline *baseline)
+{
+    if (baseline == NULL) {
+        Log_Debug("ERROR: Telemetry baseline pointer cannot be NULL\n");
+        return;
     }
 
-cleanup:
-    if (storageFd != 0) {
-        close(storageFd);
+    PersistValue(telemetryBaselineKey, baseline, sizeof(*baseline), "telemetry baseline");
+}
+
+void PersistentStorage_Cleanup(void)
+{
+    if (isStoreOpen) {
+        KvStore_Close();
+        isStoreOpen = false;
     }
 }
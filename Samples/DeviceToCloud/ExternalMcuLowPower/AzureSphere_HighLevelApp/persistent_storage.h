@@ -22,3 +22,23 @@ void PersistentStorage_PersistTelemetry(const DeviceTelemetry *telemetry);
 /// </param>
 /// <returns>true if previously-persisted telemetry is found; false if not.</returns>
 bool PersistentStorage_RetrieveTelemetry(DeviceTelemetry *telemetry);
+
+/// <summary>
+///     Persist the telemetry baseline, for retrieval on a future run.
+/// </summary>
+/// <param name="baseline">Pointer to the baseline to persist.</param>
+void PersistentStorage_PersistTelemetryBaseline(const TelemetryBaseline *baseline);
+
+/// <summary>
+///     Attempt to retrieve the previously persisted telemetry baseline from storage. If none can
+///     be found, returns false and sets all fields of the supplied baseline to zero; otherwise,
+///     returns true and populates the supplied baseline.
+/// </summary>
+/// <param name="baseline">Pointer to a baseline object to receive the persisted data.</param>
+/// <returns>true if a previously-persisted baseline is found; false if not.</returns>
+bool PersistentStorage_RetrieveTelemetryBaseline(TelemetryBaseline *baseline);
+
+/// <summary>
+///     Close the persistent storage.
+/// </summary>
+void PersistentStorage_Cleanup(void);
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /// <summary>
@@ -64,3 +65,30 @@ typedef struct {
     /// </summary>
     float batteryLevel;
 } CloudTelemetry;
+
+/// <summary>
+///     Fields of <see cref="CloudTelemetry" />, as a bitmask of the fields to send to the cloud.
+/// </summary>
+typedef enum {
+    CloudTelemetryField_LifetimeTotalDispenses = 1u << 0,
+    CloudTelemetryField_DispensesSinceLastSync = 1u << 1,
+    CloudTelemetryField_RemainingDispenses = 1u << 2,
+    CloudTelemetryField_LowSoda = 1u << 3,
+    CloudTelemetryField_BatteryLevel = 1u << 4,
+    CloudTelemetryField_All = (1u << 5) - 1
+} CloudTelemetryField;
+
+/// <summary>
+///     The telemetry last acknowledged by the cloud, against which changes are measured.
+/// </summary>
+typedef struct {
+    /// <summary>
+    /// The last value of each field which the cloud acknowledged
+    /// </summary>
+    CloudTelemetry telemetry;
+
+    /// <summary>
+    /// Number of wake cycles since all the fields were last sent
+    /// </summary>
+    uint32_t cyclesSinceKeyframe;
+} TelemetryBaseline;
@@ -0,0 +1,70 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "telemetry_encoder.h"
+
+uint32_t TelemetryEncoder_SelectFields(const TelemetryBaseline *baseline,
+                                       const CloudTelemetry *telemetry)
+{
+    if (baseline == NULL || baseline->cyclesSinceKeyframe + 1 >= TELEMETRY_KEYFRAME_INTERVAL) {
+        return CloudTelemetryField_All;
+    }
+
+    const CloudTelemetry *last = &baseline->telemetry;
+    uint32_t fields = 0;
+
+    // Dispenses are counted exactly, so any change is sent.
+    if (telemetry->lifetimeTotalDispenses != last->lifetimeTotalDispenses) {
+        fields |= CloudTelemetryField_LifetimeTotalDispenses;
+    }
+
+    if (telemetry->dispensesSinceLastSync != 0) {
+        fields |= CloudTelemetryField_DispensesSinceLastSync;
+    }
+
+    if (abs((int)(telemetry->remainingDispenses - last->remainingDispenses)) >
+        TELEMETRY_REMAINING_DISPENSES_DEADBAND) {
+        fields |= CloudTelemetryField_RemainingDispenses;
+    }
+
+    if (telemetry->lowSoda != last->lowSoda) {
+        fields |= CloudTelemetryField_LowSoda;
+    }
+
+    if (fabsf(telemetry->batteryLevel - last->batteryLevel) > TELEMETRY_BATTERY_LEVEL_DEADBAND) {
+        fields |= CloudTelemetryField_BatteryLevel;
+    }
+
+    return fields;
+}
+
+void TelemetryEncoder_UpdateBaseline(TelemetryBaseline *baseline, const CloudTelemetry *telemetry,
+                                     uint32_t fields)
+{
+    // Only the fields which were sent move the baseline, so that small changes which were not
+    // sent still add up to one which is.
+    if (fields & CloudTelemetryField_LifetimeTotalDispenses) {
+        baseline->telemetry.lifetimeTotalDispenses = telemetry->lifetimeTotalDispenses;
+    }
+    if (fields & CloudTelemetryField_DispensesSinceLastSync) {
+        baseline->telemetry.dispensesSinceLastSync = telemetry->dispensesSinceLastSync;
+    }
+    if (fields & CloudTelemetryField_RemainingDispenses) {
+        baseline->telemetry.remainingDispenses = telemetry->remainingDispenses;
+    }
+    if (fields & CloudTelemetryField_LowSoda) {
+        baseline->telemetry.lowSoda = telemetry->lowSoda;
+    }
+    if (fields & CloudTelemetryField_BatteryLevel) {
+        baseline->telemetry.batteryLevel = telemetry->batteryLevel;
+    }
+
+    if (fields == CloudTelemetryField_All) {
+        baseline->cyclesSinceKeyframe = 0;
+    } else {
+        ++baseline->cyclesSinceKeyframe;
+    }
+}
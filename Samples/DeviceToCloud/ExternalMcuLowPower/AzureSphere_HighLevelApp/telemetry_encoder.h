@@ -0,0 +1,46 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "telemetry.h"
+
+// The telemetry encoder chooses which fields of the telemetry to send on each wake cycle, so
+// that a field is only sent when it has changed since the cloud last acknowledged it. Small
+// changes to the remaining dispenses and battery level are not sent, and a cycle in which no
+// field has changed sends nothing. Every TELEMETRY_KEYFRAME_INTERVAL cycles, all the fields are
+// sent, so the cloud does not miss a value for long.
+
+/// <summary>Change in remaining dispenses which is too small to send.</summary>
+#define TELEMETRY_REMAINING_DISPENSES_DEADBAND 0
+
+/// <summary>Change in battery level, in volts, which is too small to send.</summary>
+#define TELEMETRY_BATTERY_LEVEL_DEADBAND 0.05f
+
+/// <summary>Number of wake cycles after which all the fields are sent.</summary>
+#define TELEMETRY_KEYFRAME_INTERVAL 12
+
+/// <summary>
+///     Choose the fields of the telemetry to send.
+/// </summary>
+/// <param name="baseline">
+///     The telemetry last acknowledged by the cloud, or NULL if there is none, in which case all
+///     the fields are sent.
+/// </param>
+/// <param name="telemetry">The telemetry for this wake cycle.</param>
+/// <returns>A bitmask of <see cref="CloudTelemetryField" />; 0 if nothing need be sent.</returns>
+uint32_t TelemetryEncoder_SelectFields(const TelemetryBaseline *baseline,
+                                       const CloudTelemetry *telemetry);
+
+/// <summary>
+///     Update the baseline once the cloud has acknowledged the telemetry for a wake cycle, or
+///     nothing was sent for that cycle.
+/// </summary>
+/// <param name="baseline">The baseline to update.</param>
+/// <param name="telemetry">The telemetry for the wake cycle.</param>
+/// <param name="fields">The fields which were sent, as returned by
+///     <see cref="TelemetryEncoder_SelectFields" />.</param>
+void TelemetryEncoder_UpdateBaseline(TelemetryBaseline *baseline, const CloudTelemetry *telemetry,
+                                     uint32_t fields);
@@ -15,6 +15,7 @@
 #include <applibs/log.h>
 
 #include "uart_transport.h"
+#include "message_protocol.h"
 #include "exitcodes.h"
 
 #define UART_SEND_BUFFER_SIZE 247u // This is the max MTU size of BLE GATT.
@@ -27,8 +28,10 @@ static UartTransport_DataReadyCallback dataReadyCallback = NULL;
 // True if the UART event is registered for EventLoop_Output; false if EventLoop_Input
 static bool uartEventOutputEnabled = false;
 
-// Buffer for data to be writtern via UART.
-static uint8_t sendBuffer[UART_SEND_BUFFER_SIZE];
+// Buffer for data to be written via UART. Each message is appended to it, so a message can be
+// queued while an earlier one is still being written; it holds one message for each request
+// which the message protocol can have outstanding.
+static uint8_t sendBuffer[UART_SEND_BUFFER_SIZE * MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
 
 // Total amount of data in sendBuffer.
 static size_t sendBufferDataLength = 0;
@@ -90,6 +93,10 @@ static void SendUartMessage(void)
         }
         sendBufferDataSent += (size_t)bytesSent;
     }
+
+    // Everything has been written, so the next message can go at the start of the buffer.
+    sendBufferDataLength = 0;
+    sendBufferDataSent = 0;
 }
 
 ssize_t UartTransport_Read(char *buffer, size_t amount)
@@ -107,11 +114,27 @@ ssize_t UartTransport_Send(const char *buffer, size_t length)
         return 0;
     }
 
-    memcpy(sendBuffer, buffer, length);
+    // If there is no space after the queued data, drop the data which has already been written
+    // from the start of the buffer.
+    if (sendBufferDataLength + length > sizeof(sendBuffer)) {
+        size_t unsentLength = sendBufferDataLength - sendBufferDataSent;
+        memmove(sendBuffer, sendBuffer + sendBufferDataSent, unsentLength);
+        sendBufferDataLength = unsentLength;
+        sendBufferDataSent = 0;
+
+        if (sendBufferDataLength + length > sizeof(sendBuffer)) {
+            Log_Debug("ERROR: UART send buffer is full.\n");
+            return 0;
+        }
+    }
 
-    sendBufferDataLength = length;
-    sendBufferDataSent = 0;
-    SendUartMessage();
+    memcpy(sendBuffer + sendBufferDataLength, buffer, length);
+    sendBufferDataLength += length;
+
+    // If an earlier message is waiting for EventLoop_Output, this one is written after it.
+    if (!uartEventOutputEnabled) {
+        SendUartMessage();
+    }
 
     return (ssize_t)length;
 }
@@ -166,5 +189,10 @@ void UartTransport_Cleanup(void)
     }
 
     eventLoopRef = NULL;
+    messageUartFd = -1;
+    uartEventRegistration = NULL;
+    uartEventOutputEnabled = false;
+    sendBufferDataLength = 0;
+    sendBufferDataSent = 0;
     dataReadyCallback = NULL;
 }
@@ -28,13 +28,14 @@ void UartTransport_Cleanup(void);
 
 /// <summary>
 ///     Queue data to be sent over the UART. This function will return immediately, but the
-///     transfer may occur asynchronously, completing after the function returns.
+///     transfer may occur asynchronously, completing after the function returns. Data is sent in
+///     the order in which it is queued.
 /// </summary>
 /// <param name="buffer">The data to be sent over the UART.</param>
 /// <param name="length">Length of the data to be sent - must not be zero.</param>
 /// <returns>
-///     0 if the UART is not initialized or if the data is too long to send; otherwise, the length
-///     of the queued data.
+///     0 if the UART is not initialized, if the data is too long to send, or if there is no space
+///     to queue it; otherwise, the length of the queued data.
 /// </returns>
 ssize_t UartTransport_Send(const char *buffer, size_t length);
 
@@ -0,0 +1,29 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#ifndef __FLASH_PORT_H
+#define __FLASH_PORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The flash operations which persist.c uses. flash_port.c implements them with the HAL.
+// Tests/persist_test.c links its own implementation instead, which simulates the flash
+// memory, so that the persistent storage can be tested on a PC.
+
+// Unlock the flash memory and the option bytes for programming.
+void UnlockFlash(void);
+
+// Whether any of the given write-protection sectors (OB_WRP_*) is write-protected.
+bool IsFlashWriteProtected(uint32_t sectors);
+
+uint32_t ReadFlashWord(uint32_t addr);
+
+// Program an erased word. If the word cannot be programmed, Error_Handler is called.
+void ProgramFlashWord(uint32_t addr, uint32_t value);
+
+// Erase whole pages, which sets every byte to 0x00. If the pages cannot be erased,
+// Error_Handler is called.
+void EraseFlashPages(uint32_t addr, uint32_t pageCount);
+
+#endif /* __FLASH_PORT_H */
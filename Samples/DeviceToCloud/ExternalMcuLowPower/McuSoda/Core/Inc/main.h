@@ -86,6 +86,7 @@ extern MachineState state;
 
 _Noreturn void RunSodaMachine(void);
 void ReadMessageAsync(void);
+void UartRxIdleCallback(void);
 
 void HandleWakeupFromMT3620(void);
 void HandleButtonPress(void);
@@ -0,0 +1,45 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "main.h"
+#include "flash_port.h"
+
+void UnlockFlash(void)
+{
+	HAL_FLASH_Unlock();
+	HAL_FLASH_OB_Unlock();
+}
+
+bool IsFlashWriteProtected(uint32_t sectors)
+{
+	FLASH_OBProgramInitTypeDef ob = { };
+	HAL_FLASHEx_OBGetConfig(&ob);
+
+	return (ob.WRPSector & sectors) != 0;
+}
+
+uint32_t ReadFlashWord(uint32_t addr)
+{
+	return *(__IO uint32_t*) addr;
+}
+
+void ProgramFlashWord(uint32_t addr, uint32_t value)
+{
+	if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, value) != HAL_OK) {
+		Error_Handler();
+	}
+}
+
+void EraseFlashPages(uint32_t addr, uint32_t pageCount)
+{
+	FLASH_EraseInitTypeDef ei = { };
+	ei.TypeErase = FLASH_TYPEERASE_PAGES;
+	ei.PageAddress = addr;
+	ei.NbPages = pageCount;
+
+	uint32_t pageError;
+
+	if (HAL_FLASHEx_Erase(&ei, &pageError) != HAL_OK) {
+		Error_Handler();
+	}
+}
@@ -7,7 +7,9 @@
 #include "messages.h"
 #include "message_protocol_utilities.h"
 
-static void ReadMessageNextByteAsync(void);
+static uint32_t GetRingBytesWritten(void);
+static bool AssembleMessageFromRing(void);
+static bool AddReceivedBytes(const uint8_t *data, size_t length, size_t *consumed);
 
 static void HandleRequest(const MessageProtocol_RequestMessage *request);
 static void HandleInitRequest(const MessageProtocol_RequestMessage *request);
@@ -18,7 +20,28 @@ static void SendMessageLen(uint8_t *msg, uint16_t len);
 static void SendResponse(
 	const MessageProtocol_RequestMessage *request, void *body, size_t bodyLength);
 
-static __IO ITStatus rxStatus;
+// The DMA controller writes data from the Azure Sphere device into this ring continuously.
+// The MCU is only interrupted when the line goes idle, which marks the end of a message,
+// or when the DMA controller reaches the middle or end of the ring. It is large enough to
+// hold two of the largest requests, so the data is read out before it can be overwritten.
+#define RX_RING_SIZE 512u
+_Static_assert(RX_RING_SIZE >= 2 * sizeof(MessageProtocol_RequestMessage),
+	"The RX ring must hold two requests");
+static uint8_t rxRing[RX_RING_SIZE];
+
+// Number of times the DMA controller has wrapped around to the start of the ring, and the
+// number of bytes which have been read from the ring, since reception started. Together
+// they show whether the DMA controller has overwritten data which has not been read yet.
+static __IO uint32_t rxRingWriteLaps;
+static uint32_t rxRingBytesRead;
+
+// Moved from RESET -> SET when the DMA controller has written new data into the ring.
+static __IO ITStatus rxDataPending;
+
+// Moved from RESET -> SET when a UART error occurs.
+static __IO ITStatus rxErrorPending;
+
+// A message is assembled here from the ring before it is handled.
 static size_t rxBytesReceived;
 static uint8_t _Alignas(MessageProtocol_RequestMessage) rxBuffer[sizeof(MessageProtocol_RequestMessage)];
 
@@ -26,71 +49,208 @@ static uint8_t _Alignas(MessageProtocol_RequestMessage) rxBuffer[sizeof(MessageP
 static __IO ITStatus txStatus;
 static MessageProtocol_ResponseMessage txResponse;
 
+// Start receiving data from the Azure Sphere device into the ring.
 void ReadMessageAsync(void)
 {
-	rxStatus = RESET;
+	rxDataPending = RESET;
+	rxErrorPending = RESET;
+	rxRingWriteLaps = 0;
+	rxRingBytesRead = 0;
 	rxBytesReceived = 0;
 
-	ReadMessageNextByteAsync();
+	if (HAL_UART_Receive_DMA(&huart2, rxRing, RX_RING_SIZE) != HAL_OK) {
+		Error_Handler();
+	}
+
+	__HAL_UART_CLEAR_IDLEFLAG(&huart2);
+	__HAL_UART_ENABLE_IT(&huart2, UART_IT_IDLE);
 }
 
-// Read a single byte from the UART which is connected to the Azure Sphere device.
-static void ReadMessageNextByteAsync(void)
+// Called from the USART2 interrupt handler when the RX line has gone idle.
+void UartRxIdleCallback(void)
 {
-	if (HAL_UART_Receive_IT(&huart2, &rxBuffer[rxBytesReceived], 1) != HAL_OK) {
-		Error_Handler();
+	rxDataPending = SET;
+}
+
+// Called when the DMA controller has filled the first half of the ring.
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *handle)
+{
+	rxDataPending = SET;
+}
+
+// Called when the DMA controller has filled the second half of the ring. It
+// then continues to write from the start of the ring.
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *handle)
+{
+	++rxRingWriteLaps;
+	rxDataPending = SET;
+}
+
+// Called when a UART error occurs. Errors in DMA mode abort the reception, which
+// HandleMessage starts again from non-interrupt context.
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *handle)
+{
+	rxErrorPending = SET;
+}
+
+// Gets the number of bytes which the DMA controller has written into the ring since
+// reception started. This wraps at 2^32, which is a multiple of RX_RING_SIZE.
+static uint32_t GetRingBytesWritten(void)
+{
+	uint32_t laps;
+	uint32_t writeIndex;
+
+	// Read the lap count on both sides of the DMA counter, in case the DMA controller
+	// wraps around between the two.
+	do {
+		laps = rxRingWriteLaps;
+		writeIndex = RX_RING_SIZE - __HAL_DMA_GET_COUNTER(huart2.hdmarx);
+	} while (laps != rxRingWriteLaps);
+
+	if (writeIndex == RX_RING_SIZE) {
+		writeIndex = 0;
+	}
+
+	uint32_t written = laps * RX_RING_SIZE + writeIndex;
+
+	// If the DMA controller has just wrapped around, its interrupt, which counts the lap,
+	// may not have run yet, so the write position appears to be behind the read position.
+	if ((int32_t) (written - rxRingBytesRead) < 0) {
+		written += RX_RING_SIZE;
 	}
+
+	return written;
 }
 
-// Called when the MCU has received a single byte from the Azure Sphere device.
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef * handle)
+// Moves data from the ring into rxBuffer until a whole message has been assembled.
+// Returns true if rxBuffer contains a complete message, false if more data is required.
+static bool AssembleMessageFromRing(void)
 {
-	// If latest data would overflow RX buffer then abort.
-	size_t currLength = ++rxBytesReceived;
-	if (currLength > sizeof(rxBuffer)) {
-		Error_Handler();
+	uint32_t written = GetRingBytesWritten();
+
+	// If the DMA controller has filled the ring since it was last read, it has overwritten
+	// data which had not been read. Discard the ring and any partial message, and resume
+	// from the write position; the preamble of the next message resynchronizes the stream.
+	if (written - rxRingBytesRead >= RX_RING_SIZE) {
+		rxRingBytesRead = written;
+		rxBytesReceived = 0;
+		return false;
 	}
 
-	// If still in header and does not match expected header then discard.
-	// This discards noise at the beginning of the transfer.
-	if (currLength <= sizeof(MessageProtocol_MessagePreamble)) {
-		if (rxBuffer[currLength - 1] != MessageProtocol_MessagePreamble[currLength - 1]) {
-			rxBytesReceived = 0;
-			ReadMessageNextByteAsync();
-			return;
+	while (rxRingBytesRead != written) {
+		// Process the contiguous data up to the write position or the end of the ring.
+		size_t readIndex = rxRingBytesRead % RX_RING_SIZE;
+		size_t length = written - rxRingBytesRead;
+		if (length > RX_RING_SIZE - readIndex) {
+			length = RX_RING_SIZE - readIndex;
+		}
+
+		size_t consumed;
+		bool complete = AddReceivedBytes(&rxRing[readIndex], length, &consumed);
+
+		rxRingBytesRead += consumed;
+		if (complete) {
+			return true;
 		}
 	}
 
-	// If received an entire message, set a flag to handle the message when
-	// the ISR completes. Otherwise, read another byte from the Azure Sphere device.
-	if (MessageProtocol_IsMessageComplete(rxBuffer, currLength)) {
-		rxStatus = SET;
-	} else {
-		ReadMessageNextByteAsync();
+	return false;
+}
+
+// Appends received data to the message in rxBuffer. Data which does not match
+// the preamble is discarded, which discards noise at the beginning of the transfer.
+// Returns true if rxBuffer contains a complete message, in which case *consumed
+// may be less than length; the remaining data belongs to the next message.
+static bool AddReceivedBytes(const uint8_t *data, size_t length, size_t *consumed)
+{
+	size_t i = 0;
+
+	while (i < length) {
+		// Match the preamble one byte at a time.
+		if (rxBytesReceived < sizeof(MessageProtocol_MessagePreamble)) {
+			uint8_t b = data[i++];
+			if (b == MessageProtocol_MessagePreamble[rxBytesReceived]) {
+				rxBuffer[rxBytesReceived++] = b;
+			} else {
+				rxBytesReceived = (b == MessageProtocol_MessagePreamble[0]) ? 1 : 0;
+				rxBuffer[0] = b;
+			}
+			continue;
+		}
+
+		// Copy the rest of the header, then the rest of the message, in bulk.
+		size_t required;
+		if (rxBytesReceived < sizeof(MessageProtocol_MessageHeader)) {
+			required = sizeof(MessageProtocol_MessageHeader) - rxBytesReceived;
+		} else {
+			const MessageProtocol_MessageHeader *header = (const MessageProtocol_MessageHeader *) rxBuffer;
+			size_t messageLength = sizeof(MessageProtocol_MessageHeader) + header->length;
+
+			// If the message is empty or would overflow the RX buffer, the header is
+			// corrupt. Discard it, and look for the next preamble.
+			if (header->length == 0 || messageLength > sizeof(rxBuffer)) {
+				rxBytesReceived = 0;
+				continue;
+			}
+
+			required = messageLength - rxBytesReceived;
+		}
+
+		if (required == 0) {
+			break;
+		}
+
+		size_t count = length - i;
+		if (count > required) {
+			count = required;
+		}
+
+		memcpy(&rxBuffer[rxBytesReceived], &data[i], count);
+		rxBytesReceived += count;
+		i += count;
 	}
+
+	*consumed = i;
+	return MessageProtocol_IsMessageComplete(rxBuffer, (uint8_t) rxBytesReceived);
 }
 
-// Called from non-interrupt context to handle a message.
+// Called from non-interrupt context to handle any messages which have been received.
 void HandleMessage(void)
 {
-	// Do nothing if a completed message has not yet been received.
-	if (rxStatus == RESET) {
+	// A UART error which aborted the reception discards any partial message, and
+	// reception starts again.
+	if (rxErrorPending == SET) {
+		rxErrorPending = RESET;
+		if (huart2.RxState == HAL_UART_STATE_READY) {
+			ReadMessageAsync();
+			return;
+		}
+	}
+
+	// Do nothing if no data has been received since this function was last called.
+	if (rxDataPending == RESET) {
 		return;
 	}
 
-	// Listen for the next command. This should occur before the response
-	// has been sent because the attached device may send the next request
-	// before the MCU has begun to wait for it.
-	ReadMessageAsync();
+	// Clear the flag before reading the ring, so that data which arrives
+	// while messages are being handled is picked up by the next call.
+	rxDataPending = RESET;
 
-	const MessageProtocol_MessageHeaderWithType *header = (MessageProtocol_MessageHeaderWithType *) rxBuffer;
-	if (header->type == MessageProtocol_RequestMessageType) {
-		HandleRequest((const MessageProtocol_RequestMessage *) header);
-	}
+	// The DMA controller continues to receive data while each message is
+	// handled, so the attached device may send the next request before the
+	// response to this one has been sent.
+	while (AssembleMessageFromRing()) {
+		rxBytesReceived = 0;
 
-	// Abort if unrecognized message type.
-	else {
-		Error_Handler();
+		const MessageProtocol_MessageHeaderWithType *header = (MessageProtocol_MessageHeaderWithType *) rxBuffer;
+		if (header->type == MessageProtocol_RequestMessageType) {
+			HandleRequest((const MessageProtocol_RequestMessage *) header);
+		}
+
+		// Abort if unrecognized message type.
+		else {
+			Error_Handler();
+		}
 	}
 }
 
@@ -2,127 +2,241 @@
    Licensed under the MIT License. */
 
 #include "main.h"
+#include "flash_port.h"
 
-// Persistent storage takes up two 128-byte pages of flash at 0x0800_4000, which is
-// 16KB after the start of flash. If the application code extends into this page, the
-// data page must be moved.
+// Persistent storage takes up eight 128-byte pages of flash at 0x0800_4000, which is
+// 16KB after the start of flash. If the application code extends into these pages, the
+// data area must be moved.
 //
-// The first page contains the magic words <"MSAS", "SODA">, followed by a sequence of
-// <stocked, issued> pairs.
+// The data area is a log of <stocked, issued> records which rotates through the pages.
+// Erased flash reads as 0x00, so a page or record which has not been written is all zeros.
 //
-// When the application starts, it reads the first two words of the first page.  If they
-// are not contain the magic values, it erases both pages, which sets all bytes to 0x00.
-// The application then writes the magic words to the start of the first page.
+// Each page starts with a header <"MSLG", sequence>, followed by a sequence of records
+// <stocked, issued, crc>. The sequence number is one greater than that of the previous
+// page, so the page with the greatest sequence number is the active page, which holds the
+// latest record. The CRC lets the application skip a record whose write was interrupted.
 //
-// When the application stores a new <stocked, issued> pair, it overwrites the first pair
-// of <0x00000000, 0x00000000> words that it finds. If all pages are full, it erases them,
-// re-writes the magic header, followed by the state, to the start of the first page.
+// When the application starts, it reads the header of each page to find the active page,
+// and then finds the last record in that page with a binary search, because the written
+// records are always at the start of the page. If no page has a valid header, it erases
+// the data area and writes the current state to the first page.
 //
-// This is intentionally simple.  In a full application, the number of erase cycles could
-// be reduced by only writing the machine state when it powers down.
-
-static void EraseAllPages(void);
-static void ReadStateFromExistingPage(void);
+// When the application stores a new <stocked, issued> record, it appends it to the active
+// page. If the active page is full, it erases the next page only, writes the record to it,
+// and then writes the header. Until the header is written the previous page is still the
+// active page, so the latest state survives a reset at any point. Because the pages are
+// used in turn, every page is erased once for each RECORDS_PER_PAGE * DATA_AREA_PAGES
+// records.
+//
+// The flash memory is only accessed through the functions in flash_port.h, so this file
+// can be tested on a PC with Tests/persist_test.c.
+
+static void FormatDataArea(void);
+static void FindLatestRecord(void);
+static void OpenNextPage(void);
+static uint32_t FindFirstFreeRecord(uint32_t page);
+static bool IsRecordUsed(uint32_t page, uint32_t record);
+static bool IsRecordValid(uint32_t page, uint32_t record);
+static void WriteRecord(uint32_t page, uint32_t record);
+static uint32_t ComputeRecordCrc(uint32_t stocked, uint32_t issued);
+static uint32_t PageAddr(uint32_t page);
+static uint32_t RecordAddr(uint32_t page, uint32_t record);
 
 #define DATA_AREA_ADDR		(FLASH_BASE + (128 * FLASH_PAGE_SIZE))
-#define DATA_AREA_LENGTH	(2 * FLASH_PAGE_SIZE)
-#define DATA_AREA_END		(DATA_AREA_ADDR + DATA_AREA_LENGTH)
+#define DATA_AREA_PAGES		8
 
 static const uint32_t DATA_AREA_SECTORS = OB_WRP_Pages128to159;
 
-static const uint32_t MAGIC_WORD_0 = ('M' << 24) | ('S' << 16) | ('A' << 8) | 'S';
-static const uint32_t MAGIC_WORD_1 = ('S' << 24) | ('O' << 16) | ('D' << 8) | 'A';
-static const uint32_t MAGIC_HEADER_SIZE = 2 * sizeof(uint32_t);
+static const uint32_t MAGIC_WORD = ('M' << 24) | ('S' << 16) | ('L' << 8) | 'G';
+
+// { uint32_t magic; uint32_t sequence; }
+#define PAGE_HEADER_SIZE	(2 * sizeof(uint32_t))
+#define PAGE_SEQUENCE_OFFSET	sizeof(uint32_t)
 
-// { uint32_t stocked; uint32_t issued; }
-static const uint32_t DATA_ENTRY_SIZE = 2 * sizeof(uint32_t);
+// { uint32_t stocked; uint32_t issued; uint32_t crc; }
+#define RECORD_SIZE			(3 * sizeof(uint32_t))
+#define RECORD_ISSUED_OFFSET	sizeof(uint32_t)
+#define RECORD_CRC_OFFSET		(2 * sizeof(uint32_t))
 
-// Address in flash where last valid entry was written.
-static uint32_t lastEntryAddr;
+#define RECORDS_PER_PAGE	((FLASH_PAGE_SIZE - PAGE_HEADER_SIZE) / RECORD_SIZE)
+
+// Page which holds the latest record, its sequence number, and the index in that page
+// where the next record will be written.
+static uint32_t activePage;
+static uint32_t activeSequence;
+static uint32_t nextRecord;
 
 void RestoreStateFromFlash(void)
 {
-	HAL_FLASH_Unlock();
-	HAL_FLASH_OB_Unlock();
-
-	FLASH_OBProgramInitTypeDef ob = { };
-	HAL_FLASHEx_OBGetConfig(&ob);
+	UnlockFlash();
 
 	// Ensure page is not write-protected.
 	// (If it is, write-protection can be disabled with HAL_FLASHEx_OBProgram.)
-	if ((ob.WRPSector & DATA_AREA_SECTORS) == DATA_AREA_SECTORS) {
+	if (IsFlashWriteProtected(DATA_AREA_SECTORS)) {
 		Error_Handler();
 	}
 
-	uint32_t magic0 = *(__IO uint32_t*) DATA_AREA_ADDR;
-	uint32_t magic1 = *(__IO uint32_t*) (DATA_AREA_ADDR + sizeof(uint32_t));
+	// Find the active page from the page headers.
+	bool hasBeenFormatted = false;
+	for (uint32_t page = 0; page < DATA_AREA_PAGES; ++page) {
+		uint32_t magic = ReadFlashWord(PageAddr(page));
+		uint32_t sequence = ReadFlashWord(PageAddr(page) + PAGE_SEQUENCE_OFFSET);
+		if (magic != MAGIC_WORD || sequence == 0) {
+			continue;
+		}
 
-	// If this is the first time that the device has been used, erase the data page.
-	bool hasBeenFormatted = (magic0 == MAGIC_WORD_0 && magic1 == MAGIC_WORD_1);
+		// Sequence numbers are compared so that they can wrap around.
+		if (! hasBeenFormatted || (int32_t)(sequence - activeSequence) > 0) {
+			activePage = page;
+			activeSequence = sequence;
+			hasBeenFormatted = true;
+		}
+	}
+
+	// If this is the first time that the device has been used, erase the data area.
 	if (! hasBeenFormatted) {
-		EraseAllPages();
+		FormatDataArea();
 	} else {
-		ReadStateFromExistingPage();
+		FindLatestRecord();
 	}
 }
 
 // Erase all pages which are used to store the machine state and write
-// the magic header followed by the current machine state to the start
-// of the first page.
-static void EraseAllPages(void)
+// the current machine state to the first page.
+static void FormatDataArea(void)
 {
-	FLASH_EraseInitTypeDef ei = { };
-	ei.TypeErase = FLASH_TYPEERASE_PAGES;
-	ei.PageAddress = DATA_AREA_ADDR;
-	ei.NbPages = DATA_AREA_LENGTH / FLASH_PAGE_SIZE;
+	EraseFlashPages(DATA_AREA_ADDR, DATA_AREA_PAGES);
+
+	activePage = 0;
+	activeSequence = 1;
+	WriteRecord(activePage, 0);
+	ProgramFlashWord(PageAddr(activePage), MAGIC_WORD);
+	ProgramFlashWord(PageAddr(activePage) + PAGE_SEQUENCE_OFFSET, activeSequence);
+	nextRecord = 1;
+}
 
-	uint32_t pageError;
+// Populate the global state variable with the most recently-written record in the
+// active page. Records whose write was interrupted are skipped.
+static void FindLatestRecord(void)
+{
+	nextRecord = FindFirstFreeRecord(activePage);
+
+	for (uint32_t record = nextRecord; record > 0; --record) {
+		if (IsRecordValid(activePage, record - 1)) {
+			uint32_t addr = RecordAddr(activePage, record - 1);
+			state.stockedDispenses = (int)ReadFlashWord(addr);
+			state.issuedDispenses = (int)ReadFlashWord(addr + RECORD_ISSUED_OFFSET);
+			return;
+		}
+	}
+}
 
-	if (HAL_FLASHEx_Erase(&ei, &pageError) != HAL_OK) {
-		Error_Handler();
+// Erase the page after the active page, write the current machine state to it, and
+// make it the active page.
+static void OpenNextPage(void)
+{
+	uint32_t page = (activePage + 1) % DATA_AREA_PAGES;
+	uint32_t sequence = activeSequence + 1;
+	if (sequence == 0) {
+		sequence = 1;
 	}
 
-	HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, DATA_AREA_ADDR + 0 * sizeof(uint32_t), MAGIC_WORD_0);
-	HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, DATA_AREA_ADDR + 1 * sizeof(uint32_t), MAGIC_WORD_1);
+	EraseFlashPages(PageAddr(page), 1);
+	WriteRecord(page, 0);
 
-	lastEntryAddr = DATA_AREA_ADDR + MAGIC_HEADER_SIZE;
-	HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, lastEntryAddr, ~state.stockedDispenses);
-	HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, lastEntryAddr + sizeof(uint32_t), ~state.issuedDispenses);
+	// The page only becomes the active page once its header has been written.
+	ProgramFlashWord(PageAddr(page), MAGIC_WORD);
+	ProgramFlashWord(PageAddr(page) + PAGE_SEQUENCE_OFFSET, sequence);
+
+	activePage = page;
+	activeSequence = sequence;
+	nextRecord = 1;
 }
 
-// Populate the global state variable with the most recently-written data.
-// This assumes the data pages have already been initialized with EraseAllPages.
-static void ReadStateFromExistingPage(void)
+// Records are written in order from the start of a page, so the used records are
+// followed by the free records, and the first free record can be found by bisection.
+static uint32_t FindFirstFreeRecord(uint32_t page)
 {
-	// Find the most recently-written data entry.
-	uint32_t searchAddr = DATA_AREA_ADDR + MAGIC_HEADER_SIZE;
-	while (searchAddr < DATA_AREA_END) {
-		uint32_t searchStockCmpl = *(__IO uint32_t*) searchAddr;
-		if (searchStockCmpl == 0x0) {
-			break;
+	uint32_t low = 0;
+	uint32_t high = RECORDS_PER_PAGE;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (IsRecordUsed(page, mid)) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
-		searchAddr += DATA_ENTRY_SIZE;
 	}
 
-	lastEntryAddr = searchAddr - DATA_ENTRY_SIZE;
-	uint32_t stockCmpl = *(__IO uint32_t*) lastEntryAddr;
-	state.stockedDispenses = ~stockCmpl;
-	uint32_t dispCmpl = *(__IO uint32_t*) (lastEntryAddr + sizeof(uint32_t));
-	state.issuedDispenses = ~dispCmpl;
+	return low;
 }
 
-// Append the current machine state to the flash memory. If the flash memory has been
-// exhausted, erase it and write the state to the start of the first page.
-void WriteLatestMachineState(void)
+// A record has been used if any of its words has been written, even if its write was
+// interrupted. The CRC is written first, so it is non-zero for every used record except
+// with a probability of 1 in 2^32.
+static bool IsRecordUsed(uint32_t page, uint32_t record)
 {
-	lastEntryAddr += DATA_ENTRY_SIZE;
+	uint32_t addr = RecordAddr(page, record);
+	return ReadFlashWord(addr + RECORD_CRC_OFFSET) != 0
+		|| ReadFlashWord(addr) != 0
+		|| ReadFlashWord(addr + RECORD_ISSUED_OFFSET) != 0;
+}
 
-	if (lastEntryAddr >= DATA_AREA_END) {
-		EraseAllPages();
-	} else {
-		HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, lastEntryAddr, ~state.stockedDispenses);
-		HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, lastEntryAddr + sizeof(uint32_t), ~state.issuedDispenses);
+static bool IsRecordValid(uint32_t page, uint32_t record)
+{
+	uint32_t addr = RecordAddr(page, record);
+	uint32_t stocked = ReadFlashWord(addr);
+	uint32_t issued = ReadFlashWord(addr + RECORD_ISSUED_OFFSET);
+	return ReadFlashWord(addr + RECORD_CRC_OFFSET) == ComputeRecordCrc(stocked, issued);
+}
+
+// Write the current machine state to a free record.
+static void WriteRecord(uint32_t page, uint32_t record)
+{
+	uint32_t addr = RecordAddr(page, record);
+	uint32_t stocked = (uint32_t)state.stockedDispenses;
+	uint32_t issued = (uint32_t)state.issuedDispenses;
+
+	ProgramFlashWord(addr + RECORD_CRC_OFFSET, ComputeRecordCrc(stocked, issued));
+	ProgramFlashWord(addr, stocked);
+	ProgramFlashWord(addr + RECORD_ISSUED_OFFSET, issued);
+}
+
+// CRC-32 (IEEE 802.3) of the little-endian record data. This is computed bitwise
+// rather than from a table because a table would take 1KB of the 32KB flash.
+static uint32_t ComputeRecordCrc(uint32_t stocked, uint32_t issued)
+{
+	const uint32_t words[] = { stocked, issued };
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+		for (uint32_t bit = 0; bit < 32; ++bit) {
+			uint32_t lsb = (crc ^ (words[i] >> bit)) & 1;
+			crc = (crc >> 1) ^ (lsb ? 0xEDB88320 : 0);
+		}
 	}
+
+	return ~crc;
 }
 
+static uint32_t PageAddr(uint32_t page)
+{
+	return DATA_AREA_ADDR + page * FLASH_PAGE_SIZE;
+}
+
+static uint32_t RecordAddr(uint32_t page, uint32_t record)
+{
+	return PageAddr(page) + PAGE_HEADER_SIZE + record * RECORD_SIZE;
+}
 
+// Append the current machine state to the flash memory. If the active page is full,
+// continue in the next page.
+void WriteLatestMachineState(void)
+{
+	if (nextRecord >= RECORDS_PER_PAGE) {
+		OpenNextPage();
+	} else {
+		WriteRecord(activePage, nextRecord);
+		++nextRecord;
+	}
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for Core/Inc/main.h when persist.c and message.c are built on a PC by the tests. It
+// only declares what they use, with a minimal stand-in for the HAL UART and DMA, which
+// message_test.c implements.
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLASH_BASE				0x08000000u
+#define FLASH_PAGE_SIZE			128u
+#define OB_WRP_Pages128to159	0x00000010u
+
+#define __IO volatile
+
+typedef enum { RESET = 0, SET = !RESET } ITStatus;
+
+typedef enum { HAL_OK = 0, HAL_ERROR = 1 } HAL_StatusTypeDef;
+
+typedef enum {
+	HAL_UART_STATE_READY = 0x20u,
+	HAL_UART_STATE_BUSY_RX = 0x22u
+} HAL_UART_StateTypeDef;
+
+// The DMA counter is the number of bytes which the DMA controller has still to write before it
+// returns to the start of the buffer.
+typedef struct {
+	__IO uint32_t counter;
+} DMA_HandleTypeDef;
+
+typedef struct {
+	DMA_HandleTypeDef *hdmarx;
+	__IO HAL_UART_StateTypeDef RxState;
+} UART_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(handle)			((handle)->counter)
+#define __HAL_UART_CLEAR_IDLEFLAG(handle)		((void) (handle))
+#define __HAL_UART_ENABLE_IT(handle, interrupt)	((void) (handle))
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *handle, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *handle, uint8_t *data, uint16_t size);
+
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *handle);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *handle);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *handle);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *handle);
+
+_Noreturn void Error_Handler(void);
+
+extern UART_HandleTypeDef huart2;
+
+typedef struct {
+	const int machineCapacity;
+	const int alertThreshold;
+	int stockedDispenses;
+	int issuedDispenses;
+} MachineState;
+
+extern MachineState state;
+
+void ReadMessageAsync(void);
+void UartRxIdleCallback(void);
+void HandleMessage(void);
+
+void SetFlavor(bool r, bool g, bool b);
+
+void RestoreStateFromFlash(void);
+void WriteLatestMachineState(void);
+
+float ReadBatteryLevel(void);
+
+#endif /* __MAIN_H */
@@ -0,0 +1,475 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for the request parser in Core/Src/message.c, which run on a PC against a simulated
+// UART and DMA controller.
+//
+// The simulation implements the HAL functions which message.c uses. Like the DMA controller
+// in circular mode, it writes each received byte into the ring which message.c passed to
+// HAL_UART_Receive_DMA, and calls the half-transfer and transfer-complete callbacks when it
+// reaches the middle and the end of the ring. The idle-line callback is called when the
+// sender stops. Each callback is counted as an interrupt, so the tests can report the number
+// of interrupts per message.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "messages.h"
+
+#define MAX_RESPONSES		16
+
+// The size of the largest request.
+#define MAX_REQUEST_SIZE	sizeof(MessageProtocol_RequestMessage)
+
+MachineState state = { .machineCapacity = 10, .alertThreshold = 2 };
+
+static DMA_HandleTypeDef hdmaRx;
+UART_HandleTypeDef huart2 = { .hdmarx = &hdmaRx };
+
+// The ring into which the simulated DMA controller writes received data.
+static uint8_t *dmaRing = NULL;
+static uint16_t dmaRingSize = 0;
+
+// True while a simulated interrupt handler is running.
+static bool inInterrupt = false;
+static unsigned long rxInterrupts = 0;
+static unsigned int receiveStarts = 0;
+
+// Responses which message.c has sent, since the last call to ClearResponses.
+static MessageProtocol_ResponseMessage responses[MAX_RESPONSES];
+static size_t responseCount = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+	printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+	++failures;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *handle, uint8_t *data, uint16_t size)
+{
+	if (inInterrupt) {
+		Fail("HAL_UART_Receive_DMA", "reception restarted in an interrupt handler", 0);
+	}
+
+	dmaRing = data;
+	dmaRingSize = size;
+	handle->hdmarx->counter = size;
+	handle->RxState = HAL_UART_STATE_BUSY_RX;
+	++receiveStarts;
+	return HAL_OK;
+}
+
+// Record the response, and complete the transmission at once.
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *handle, uint8_t *data, uint16_t size)
+{
+	if (size != sizeof(MessageProtocol_ResponseMessage)) {
+		Fail("HAL_UART_Transmit_IT", "wrong response size", size);
+	} else if (responseCount == MAX_RESPONSES) {
+		Fail("HAL_UART_Transmit_IT", "too many responses", (long) responseCount);
+	} else {
+		memcpy(&responses[responseCount++], data, size);
+	}
+
+	HAL_UART_TxCpltCallback(handle);
+	return HAL_OK;
+}
+
+void SetFlavor(bool r, bool g, bool b)
+{
+}
+
+float ReadBatteryLevel(void)
+{
+	return 3.0f;
+}
+
+_Noreturn void Error_Handler(void)
+{
+	printf("FAIL: Error_Handler called\n");
+	exit(EXIT_FAILURE);
+}
+
+// Receive data by simulated DMA, without the line going idle.
+static void ReceiveData(const uint8_t *data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i) {
+		// Data is lost if reception has been aborted.
+		if (dmaRing == NULL || huart2.RxState != HAL_UART_STATE_BUSY_RX) {
+			return;
+		}
+
+		dmaRing[dmaRingSize - hdmaRx.counter] = data[i];
+		--hdmaRx.counter;
+
+		inInterrupt = true;
+		if (hdmaRx.counter == dmaRingSize / 2) {
+			++rxInterrupts;
+			HAL_UART_RxHalfCpltCallback(&huart2);
+		} else if (hdmaRx.counter == 0) {
+			hdmaRx.counter = dmaRingSize;
+			++rxInterrupts;
+			HAL_UART_RxCpltCallback(&huart2);
+		}
+		inInterrupt = false;
+	}
+}
+
+static void LineIdle(void)
+{
+	inInterrupt = true;
+	++rxInterrupts;
+	UartRxIdleCallback();
+	inInterrupt = false;
+}
+
+// Receive data, after which the sender stops, so the line goes idle.
+static void Receive(const uint8_t *data, size_t length)
+{
+	ReceiveData(data, length);
+	LineIdle();
+}
+
+// Builds a request in buffer, and returns its length. A SetLed request carries dataLength
+// bytes, and echoes the first four back in its response; the others carry no data.
+static size_t BuildRequest(uint8_t *buffer, MessageProtocol_RequestId requestId,
+	uint16_t sequenceNumber, size_t dataLength)
+{
+	MessageProtocol_RequestMessage request;
+	memset(&request, 0, sizeof(request));
+
+	memcpy(request.requestHeader.messageHeaderWithType.messageHeader.preamble,
+		MessageProtocol_MessagePreamble, sizeof(MessageProtocol_MessagePreamble));
+	request.requestHeader.messageHeaderWithType.messageHeader.length = (uint16_t) (
+		sizeof(MessageProtocol_RequestHeader) - sizeof(MessageProtocol_MessageHeader) + dataLength);
+	request.requestHeader.messageHeaderWithType.type = MessageProtocol_RequestMessageType;
+	request.requestHeader.categoryId = MessageProtocol_McuToCloud_CategoryId;
+	request.requestHeader.requestId = requestId;
+	request.requestHeader.sequenceNumber = sequenceNumber;
+	for (size_t i = 0; i < dataLength; ++i) {
+		request.data[i] = (uint8_t) (sequenceNumber + i);
+	}
+
+	size_t length = sizeof(MessageProtocol_RequestHeader) + dataLength;
+	memcpy(buffer, &request, length);
+	return length;
+}
+
+static size_t BuildSetLedRequest(uint8_t *buffer, uint16_t sequenceNumber, size_t dataLength)
+{
+	return BuildRequest(buffer, MessageProtocol_McuToCloud_SetLed, sequenceNumber, dataLength);
+}
+
+static void ClearResponses(void)
+{
+	responseCount = 0;
+}
+
+// Checks that the response answers a request which BuildRequest built.
+static bool IsValidResponse(const MessageProtocol_ResponseMessage *response)
+{
+	const MessageProtocol_ResponseHeader *header = &response->responseHeader;
+	if (memcmp(header->messageHeaderWithType.messageHeader.preamble,
+			MessageProtocol_MessagePreamble, sizeof(MessageProtocol_MessagePreamble)) != 0
+		|| header->messageHeaderWithType.type != MessageProtocol_ResponseMessageType
+		|| header->categoryId != MessageProtocol_McuToCloud_CategoryId) {
+		return false;
+	}
+
+	if (header->requestId == MessageProtocol_McuToCloud_SetLed) {
+		for (size_t i = 0; i < sizeof(MessageProtocol_McuToCloud_SetLedStruct); ++i) {
+			if (response->data[i] != (uint8_t) (header->sequenceNumber + i)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Checks that the responses answer the requests with sequence numbers from first to last,
+// in order.
+static void CheckResponses(const char *test, uint16_t first, uint16_t last)
+{
+	if (responseCount != (size_t) (last - first + 1)) {
+		Fail(test, "wrong number of responses", (long) responseCount);
+		return;
+	}
+
+	for (size_t i = 0; i < responseCount; ++i) {
+		if (!IsValidResponse(&responses[i])
+			|| responses[i].responseHeader.sequenceNumber != first + i) {
+			Fail(test, "wrong response", (long) i);
+			return;
+		}
+	}
+}
+
+// Start each test with reception started afresh, and nothing waiting in the ring.
+static void Restart(void)
+{
+	ReadMessageAsync();
+	HandleMessage();
+	ClearResponses();
+}
+
+// Each type of request is answered.
+static void TestEachRequest(void)
+{
+	const char *test = "TestEachRequest";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	Restart();
+	Receive(buffer, BuildRequest(buffer, MessageProtocol_McuToCloud_Init, 1, 0));
+	HandleMessage();
+	Receive(buffer, BuildRequest(buffer, MessageProtocol_McuToCloud_RequestTelemetry, 2, 0));
+	HandleMessage();
+	Receive(buffer, BuildSetLedRequest(buffer, 3, sizeof(MessageProtocol_McuToCloud_SetLedStruct)));
+	HandleMessage();
+
+	CheckResponses(test, 1, 3);
+	if (responseCount == 3) {
+		const MessageProtocol_McuToCloud_InitStruct *init =
+			(const MessageProtocol_McuToCloud_InitStruct *) responses[0].data;
+		if (init->protocolVersion != MessageProtocol_McuToCloud_ProtocolVersion) {
+			Fail(test, "wrong protocol version", (long) init->protocolVersion);
+		}
+	}
+}
+
+// Requests which arrive in fragments of any size, in any position in the ring, are assembled.
+static void TestFragmentedRequests(void)
+{
+	const char *test = "TestFragmentedRequests";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	srand(1);
+	Restart();
+	for (uint16_t sequenceNumber = 1; sequenceNumber <= 200; ++sequenceNumber) {
+		size_t length = BuildSetLedRequest(buffer, sequenceNumber,
+			sizeof(MessageProtocol_McuToCloud_SetLedStruct) + (size_t) (rand() % 200));
+
+		for (size_t sent = 0; sent < length;) {
+			size_t fragment = 1 + (size_t) (rand() % 40);
+			if (fragment > length - sent) {
+				fragment = length - sent;
+			}
+			ReceiveData(&buffer[sent], fragment);
+			sent += fragment;
+
+			// The line may go idle between fragments, and the main loop may run at any time.
+			if (rand() % 2 == 0) {
+				LineIdle();
+			}
+			if (rand() % 2 == 0) {
+				HandleMessage();
+			}
+		}
+		LineIdle();
+		HandleMessage();
+
+		CheckResponses(test, sequenceNumber, sequenceNumber);
+		ClearResponses();
+	}
+}
+
+// Two of the largest requests fit in the ring, so both are answered even if the main loop
+// does not run until the second has been received.
+static void TestTwoLargestRequests(void)
+{
+	const char *test = "TestTwoLargestRequests";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	Restart();
+	for (uint16_t sequenceNumber = 1; sequenceNumber <= 10; sequenceNumber += 2) {
+		ReceiveData(buffer, BuildSetLedRequest(buffer, sequenceNumber, MAX_REQUEST_DATA_SIZE));
+		Receive(buffer, BuildSetLedRequest(buffer, sequenceNumber + 1, MAX_REQUEST_DATA_SIZE));
+		HandleMessage();
+
+		CheckResponses(test, sequenceNumber, (uint16_t) (sequenceNumber + 1));
+		ClearResponses();
+	}
+}
+
+// Noise, partial preambles and corrupt headers are discarded, and the next request is answered.
+static void TestNoiseAndCorruptHeaders(void)
+{
+	const char *test = "TestNoiseAndCorruptHeaders";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	static const uint8_t noise[] = { 0x00, 0x22, 0x22, 0xB5, 0x58, 0x00, 0x22, 0xB5, 0xFF };
+	static const uint8_t emptyMessage[] = { 0x22, 0xB5, 0x58, 0xB9, 0x00, 0x00 };
+	static const uint8_t longMessage[] = { 0x22, 0xB5, 0x58, 0xB9, 0xE8, 0x03 };
+
+	Restart();
+	ReceiveData(noise, sizeof(noise));
+	ReceiveData(emptyMessage, sizeof(emptyMessage));
+	ReceiveData(longMessage, sizeof(longMessage));
+	Receive(buffer, BuildSetLedRequest(buffer, 1, sizeof(MessageProtocol_McuToCloud_SetLedStruct)));
+	HandleMessage();
+
+	CheckResponses(test, 1, 1);
+}
+
+// If the main loop does not run until more than a ringful of data has been received, the
+// data which was overwritten is discarded rather than handled as a request, and the next
+// request is answered.
+static void TestRingOverrun(void)
+{
+	const char *test = "TestRingOverrun";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	// The main loop reads the start of the first request, and then does not run again
+	// until the DMA controller has gone round the ring.
+	Restart();
+	size_t length = BuildSetLedRequest(buffer, 1, MAX_REQUEST_DATA_SIZE);
+	Receive(buffer, 10);
+	HandleMessage();
+	ReceiveData(&buffer[10], length - 10);
+	for (uint16_t sequenceNumber = 2; sequenceNumber <= 3; ++sequenceNumber) {
+		ReceiveData(buffer, BuildSetLedRequest(buffer, sequenceNumber, MAX_REQUEST_DATA_SIZE));
+	}
+	LineIdle();
+	HandleMessage();
+
+	for (size_t i = 0; i < responseCount; ++i) {
+		if (!IsValidResponse(&responses[i])) {
+			Fail(test, "response to overwritten data", (long) i);
+		}
+	}
+
+	ClearResponses();
+	Receive(buffer, BuildSetLedRequest(buffer, 4, sizeof(MessageProtocol_McuToCloud_SetLedStruct)));
+	HandleMessage();
+	CheckResponses(test, 4, 4);
+}
+
+// A UART error which aborts the reception discards the partial request, and reception is
+// started again by the main loop rather than by the interrupt handler.
+static void TestUartError(void)
+{
+	const char *test = "TestUartError";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	Restart();
+	unsigned int startsBefore = receiveStarts;
+
+	size_t length = BuildSetLedRequest(buffer, 1, MAX_REQUEST_DATA_SIZE);
+	ReceiveData(buffer, length / 2);
+
+	// The HAL aborts the reception before it calls the error callback.
+	huart2.RxState = HAL_UART_STATE_READY;
+	inInterrupt = true;
+	HAL_UART_ErrorCallback(&huart2);
+	inInterrupt = false;
+
+	// The rest of the request is lost, because reception has stopped.
+	ReceiveData(&buffer[length / 2], length - length / 2);
+	HandleMessage();
+	if (receiveStarts != startsBefore + 1) {
+		Fail(test, "reception was not restarted", (long) (receiveStarts - startsBefore));
+	}
+
+	Receive(buffer, BuildSetLedRequest(buffer, 2, sizeof(MessageProtocol_McuToCloud_SetLedStruct)));
+	HandleMessage();
+	CheckResponses(test, 2, 2);
+}
+
+// An error which does not abort the reception, such as a noise error, does not restart it.
+static void TestUartErrorWithoutAbort(void)
+{
+	const char *test = "TestUartErrorWithoutAbort";
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	Restart();
+	unsigned int startsBefore = receiveStarts;
+
+	size_t length = BuildSetLedRequest(buffer, 1, sizeof(MessageProtocol_McuToCloud_SetLedStruct));
+	ReceiveData(buffer, length / 2);
+	inInterrupt = true;
+	HAL_UART_ErrorCallback(&huart2);
+	inInterrupt = false;
+	Receive(&buffer[length / 2], length - length / 2);
+	HandleMessage();
+
+	if (receiveStarts != startsBefore) {
+		Fail(test, "reception was restarted", (long) (receiveStarts - startsBefore));
+	}
+	CheckResponses(test, 1, 1);
+}
+
+// Report the number of receive interrupts per request, for requests which arrive one at a
+// time and for requests which arrive back to back, which is at most once per message.
+static void TestInterruptsPerRequest(void)
+{
+	const char *test = "TestInterruptsPerRequest";
+	const unsigned int requests = 1000;
+	uint8_t buffer[MAX_REQUEST_SIZE];
+
+	Restart();
+	unsigned long interruptsBefore = rxInterrupts;
+	size_t length = 0;
+	for (unsigned int i = 0; i < requests; ++i) {
+		length = BuildRequest(buffer, MessageProtocol_McuToCloud_RequestTelemetry, (uint16_t) i, 0);
+		Receive(buffer, length);
+		HandleMessage();
+		if (responseCount != 1 || !IsValidResponse(&responses[0])) {
+			Fail(test, "request was not answered", (long) i);
+			return;
+		}
+		ClearResponses();
+	}
+
+	double perRequest = (double) (rxInterrupts - interruptsBefore) / requests;
+	printf("%u requests of %zu bytes, one at a time: %.2f receive interrupts per request\n",
+		requests, length, perRequest);
+	if (perRequest > 2.0) {
+		Fail(test, "too many interrupts per request", (long) (rxInterrupts - interruptsBefore));
+	}
+
+	// Requests which arrive back to back are separated by an idle line only at the end.
+	interruptsBefore = rxInterrupts;
+	for (unsigned int i = 0; i < requests; i += 10) {
+		for (unsigned int j = 0; j < 10; ++j) {
+			length = BuildSetLedRequest(buffer, (uint16_t) (i + j),
+				sizeof(MessageProtocol_McuToCloud_SetLedStruct));
+			ReceiveData(buffer, length);
+		}
+		LineIdle();
+		HandleMessage();
+		CheckResponses(test, (uint16_t) i, (uint16_t) (i + 9));
+		ClearResponses();
+	}
+
+	perRequest = (double) (rxInterrupts - interruptsBefore) / requests;
+	printf("%u requests of %zu bytes, in bursts of 10: %.2f receive interrupts per request\n",
+		requests, length, perRequest);
+	if (perRequest > 1.0) {
+		Fail(test, "too many interrupts per request", (long) (rxInterrupts - interruptsBefore));
+	}
+}
+
+int main(void)
+{
+	TestEachRequest();
+	TestFragmentedRequests();
+	TestTwoLargestRequests();
+	TestNoiseAndCorruptHeaders();
+	TestRingOverrun();
+	TestUartError();
+	TestUartErrorWithoutAbort();
+	TestInterruptsPerRequest();
+
+	if (failures != 0) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("All tests passed\n");
+	return EXIT_SUCCESS;
+}
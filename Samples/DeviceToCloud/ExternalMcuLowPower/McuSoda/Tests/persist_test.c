@@ -0,0 +1,314 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for Core/Src/persist.c, which run on a PC against a simulated flash memory.
+//
+// The simulation implements flash_port.h in place of Core/Src/flash_port.c. Like the
+// STM32L031, erased flash reads as 0x00, pages are erased whole, and a word can only be
+// programmed once after it has been erased. A power cut can be injected before any program
+// or erase operation; the test then "reboots" by calling RestoreStateFromFlash, and checks
+// that the restored state is either the state before the interrupted write or the state
+// which it was writing.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "flash_port.h"
+
+#define FLASH_SIZE			(32 * 1024)
+#define FLASH_PAGES			(FLASH_SIZE / FLASH_PAGE_SIZE)
+
+// Must match persist.c.
+#define DATA_AREA_FIRST_PAGE	128
+#define DATA_AREA_PAGES			8
+#define RECORDS_PER_PAGE		10
+
+MachineState state = { .machineCapacity = 10, .alertThreshold = 2 };
+
+static uint32_t flash[FLASH_SIZE / sizeof(uint32_t)];
+static unsigned int pageEraseCount[FLASH_PAGES];
+
+// Number of program and erase operations which succeed before the power is cut, or -1 if
+// the power is not cut.
+static long operationsBeforePowerCut = -1;
+static jmp_buf powerCut;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+	printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+	++failures;
+}
+
+static uint32_t *FlashWord(uint32_t addr)
+{
+	if (addr < FLASH_BASE || addr >= FLASH_BASE + FLASH_SIZE || addr % sizeof(uint32_t) != 0) {
+		printf("FAIL: invalid flash address 0x%08x\n", (unsigned int) addr);
+		exit(EXIT_FAILURE);
+	}
+	return &flash[(addr - FLASH_BASE) / sizeof(uint32_t)];
+}
+
+static void TakePowerCutChance(void)
+{
+	if (operationsBeforePowerCut == 0) {
+		operationsBeforePowerCut = -1;
+		longjmp(powerCut, 1);
+	}
+	if (operationsBeforePowerCut > 0) {
+		--operationsBeforePowerCut;
+	}
+}
+
+void UnlockFlash(void)
+{
+}
+
+bool IsFlashWriteProtected(uint32_t sectors)
+{
+	return false;
+}
+
+uint32_t ReadFlashWord(uint32_t addr)
+{
+	return *FlashWord(addr);
+}
+
+void ProgramFlashWord(uint32_t addr, uint32_t value)
+{
+	TakePowerCutChance();
+
+	uint32_t *word = FlashWord(addr);
+	if (*word != 0) {
+		printf("FAIL: word 0x%08x programmed without being erased\n", (unsigned int) addr);
+		exit(EXIT_FAILURE);
+	}
+	*word = value;
+}
+
+void EraseFlashPages(uint32_t addr, uint32_t pageCount)
+{
+	for (uint32_t i = 0; i < pageCount; ++i) {
+		TakePowerCutChance();
+
+		uint32_t pageAddr = addr + i * FLASH_PAGE_SIZE;
+		memset(FlashWord(pageAddr), 0, FLASH_PAGE_SIZE);
+		++pageEraseCount[(pageAddr - FLASH_BASE) / FLASH_PAGE_SIZE];
+	}
+}
+
+_Noreturn void Error_Handler(void)
+{
+	printf("FAIL: Error_Handler called\n");
+	exit(EXIT_FAILURE);
+}
+
+// Fill the flash with a pattern which is not a valid page header, as on a new device.
+static void FillFlashWithGarbage(void)
+{
+	for (size_t i = 0; i < sizeof(flash) / sizeof(flash[0]); ++i) {
+		flash[i] = 0xA5A5A5A5 ^ (uint32_t) i;
+	}
+	memset(pageEraseCount, 0, sizeof(pageEraseCount));
+}
+
+static void SetState(int stocked)
+{
+	state.stockedDispenses = stocked;
+	state.issuedDispenses = stocked / 2;
+}
+
+// Forget the state in RAM and restore it from flash, as the application does when it starts.
+// Returns the restored number of stocked dispenses, after checking that the issued
+// dispenses were restored from the same record.
+static int Reboot(const char *test)
+{
+	state.stockedDispenses = -1;
+	state.issuedDispenses = -1;
+	RestoreStateFromFlash();
+
+	if (state.issuedDispenses != state.stockedDispenses / 2) {
+		Fail(test, "restored a mixture of two records", state.stockedDispenses);
+	}
+	return state.stockedDispenses;
+}
+
+// Write a state with the power cut after the given number of flash operations. Returns true
+// if the write completed before the power was cut.
+static bool WriteWithPowerCut(int stocked, long operations)
+{
+	SetState(stocked);
+	operationsBeforePowerCut = operations;
+
+	if (setjmp(powerCut) != 0) {
+		return false;
+	}
+	WriteLatestMachineState();
+	operationsBeforePowerCut = -1;
+	return true;
+}
+
+// A new device formats the data area, and then keeps its state across reboots.
+static void TestFirstBoot(void)
+{
+	const char *test = "TestFirstBoot";
+
+	FillFlashWithGarbage();
+	SetState(42);
+	RestoreStateFromFlash();
+	if (state.stockedDispenses != 42) {
+		Fail(test, "formatting changed the state", state.stockedDispenses);
+	}
+	if (Reboot(test) != 42) {
+		Fail(test, "state not restored after formatting", state.stockedDispenses);
+	}
+}
+
+// Write a long run of states, rebooting every N writes, and check that each reboot restores
+// the latest state. Reboots land at every position in a page for some N.
+static void TestRebootEveryN(void)
+{
+	const char *test = "TestRebootEveryN";
+	static const int rebootIntervals[] = { 1, 2, 3, 7, 9, 10, 11, 37, 80, 81 };
+	const int writes = 5000;
+
+	for (size_t n = 0; n < sizeof(rebootIntervals) / sizeof(rebootIntervals[0]); ++n) {
+		FillFlashWithGarbage();
+		SetState(0);
+		RestoreStateFromFlash();
+
+		for (int i = 1; i <= writes; ++i) {
+			SetState(i);
+			WriteLatestMachineState();
+
+			if (i % rebootIntervals[n] == 0 && Reboot(test) != i) {
+				Fail(test, "wrong state restored", rebootIntervals[n]);
+				break;
+			}
+		}
+
+		// Each page is erased once when the data area is formatted, and then once for each
+		// RECORDS_PER_PAGE * DATA_AREA_PAGES records.
+		unsigned int maxErases = 1 + writes / (RECORDS_PER_PAGE * DATA_AREA_PAGES) + 1;
+		for (uint32_t page = 0; page < FLASH_PAGES; ++page) {
+			bool inDataArea = page >= DATA_AREA_FIRST_PAGE
+				&& page < DATA_AREA_FIRST_PAGE + DATA_AREA_PAGES;
+			if (!inDataArea && pageEraseCount[page] != 0) {
+				Fail(test, "erased a page outside the data area", page);
+			} else if (pageEraseCount[page] > maxErases) {
+				Fail(test, "erases not spread over the data area", (long) pageEraseCount[page]);
+			}
+		}
+	}
+}
+
+// For each write in a run which fills every page twice, cut the power before each of its
+// flash operations in turn, and check that a reboot restores either the previous state or
+// the new state. Then check that the log can still be written after the reboot.
+static void TestPowerCutAtEachStep(void)
+{
+	const char *test = "TestPowerCutAtEachStep";
+	static uint32_t savedFlash[sizeof(flash) / sizeof(flash[0])];
+	const int writes = 2 * RECORDS_PER_PAGE * DATA_AREA_PAGES + 3;
+	long trials = 0;
+
+	FillFlashWithGarbage();
+	SetState(0);
+	RestoreStateFromFlash();
+
+	for (int i = 1; i <= writes; ++i) {
+		for (long cut = 0; ; ++cut) {
+			memcpy(savedFlash, flash, sizeof(flash));
+
+			bool completed = WriteWithPowerCut(i, cut);
+			int restored = Reboot(test);
+			++trials;
+
+			if (completed ? restored != i : (restored != i - 1 && restored != i)) {
+				Fail(test, "wrong state restored after power cut", restored);
+			}
+
+			// The log must carry on from wherever the interrupted write left it.
+			SetState(1000000 + i);
+			WriteLatestMachineState();
+			if (Reboot(test) != 1000000 + i) {
+				Fail(test, "write after power cut was lost", i);
+			}
+
+			// Put the flash back as it was before the write, and reboot so that persist.c
+			// reads its position in the log from the flash again.
+			memcpy(flash, savedFlash, sizeof(flash));
+			if (Reboot(test) != i - 1) {
+				Fail(test, "could not go back to the previous state", i);
+			}
+			if (completed) {
+				break;
+			}
+		}
+
+		// Continue from the completed write.
+		SetState(i);
+		WriteLatestMachineState();
+	}
+
+	printf("%s: %ld power cuts\n", test, trials);
+}
+
+// Cut the power at each step of formatting a new device, and check that the next boot
+// formats it again.
+static void TestPowerCutDuringFormat(void)
+{
+	const char *test = "TestPowerCutDuringFormat";
+
+	for (long cut = 0; ; ++cut) {
+		FillFlashWithGarbage();
+		SetState(7);
+		operationsBeforePowerCut = cut;
+
+		bool completed = false;
+		if (setjmp(powerCut) == 0) {
+			RestoreStateFromFlash();
+			operationsBeforePowerCut = -1;
+			completed = true;
+		}
+
+		SetState(7);
+		RestoreStateFromFlash();
+		if (state.stockedDispenses != 7) {
+			Fail(test, "wrong state after formatting", cut);
+		}
+
+		SetState(8);
+		WriteLatestMachineState();
+		if (Reboot(test) != 8) {
+			Fail(test, "write after formatting was lost", cut);
+		}
+
+		if (completed) {
+			break;
+		}
+	}
+}
+
+int main(void)
+{
+	TestFirstBoot();
+	TestRebootEveryN();
+	TestPowerCutAtEachStep();
+	TestPowerCutDuringFormat();
+
+	if (failures != 0) {
+		printf("%d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("All tests passed\n");
+	return EXIT_SUCCESS;
+}
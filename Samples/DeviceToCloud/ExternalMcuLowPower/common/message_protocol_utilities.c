@@ -2,6 +2,7 @@
    Licensed under the MIT License. */
 
 #include "message_protocol_utilities.h"
+#include <stddef.h>
 #include <string.h>
 
 bool MessageProtocol_IsMessageComplete(uint8_t *message, uint8_t messageLength)
@@ -10,9 +11,11 @@ bool MessageProtocol_IsMessageComplete(uint8_t *message, uint8_t messageLength)
     if (messageLength > sizeof(MessageProtocol_MessageHeader) &&
         memcmp(MessageProtocol_MessagePreamble, message, sizeof(MessageProtocol_MessagePreamble)) ==
             0) {
-        // Check whether the overall length is equal or greater than message header size + length
-        MessageProtocol_MessageHeader *messageHeader = (MessageProtocol_MessageHeader *)message;
-        return (messageLength >= messageHeader->length + sizeof(MessageProtocol_MessageHeader));
+        // Check whether the overall length is equal or greater than message header size + length.
+        // The message may not be aligned, so copy the length out of the header.
+        uint16_t length;
+        memcpy(&length, message + offsetof(MessageProtocol_MessageHeader, length), sizeof(length));
+        return (messageLength >= length + sizeof(MessageProtocol_MessageHeader));
     }
     return false;
 }
\ No newline at end of file
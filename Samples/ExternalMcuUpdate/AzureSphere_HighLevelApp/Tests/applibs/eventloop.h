@@ -0,0 +1,41 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/eventloop.h when the sample is built on a Linux PC. It
+// declares the subset of the API which the sample uses, and eventloop_epoll.c implements it with
+// epoll.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct EventLoop EventLoop;
+typedef struct EventRegistration EventRegistration;
+
+typedef uint32_t EventLoop_IoEvents;
+enum {
+    EventLoop_None = 0x0,
+    EventLoop_Input = 0x1,
+    EventLoop_Output = 0x4,
+    EventLoop_Error = 0x8
+};
+
+typedef enum {
+    EventLoop_Run_Failed = -1,
+    EventLoop_Run_FinishedEmpty = 0,
+    EventLoop_Run_Finished = 1
+} EventLoop_Run_Result;
+
+typedef void EventLoopIoCallback(EventLoop *el, int fd, EventLoop_IoEvents events,
+                                 void *context);
+
+EventLoop *EventLoop_Create(void);
+void EventLoop_Close(EventLoop *el);
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event);
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context);
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask);
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg);
@@ -0,0 +1,13 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/gpio.h when the sample is built on a PC. Each test
+// program defines GPIO_SetValue.
+
+#pragma once
+
+typedef enum { GPIO_Value_Low = 0, GPIO_Value_High = 1 } GPIO_Value;
+
+typedef unsigned char GPIO_Value_Type;
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value);
@@ -0,0 +1,9 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/storage.h when the sample is built on a PC. Each test
+// program defines Storage_OpenFileInImagePackage to open an ordinary file.
+
+#pragma once
+
+int Storage_OpenFileInImagePackage(const char *relativePath);
@@ -0,0 +1,178 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Benchmark and test for nordic/crc.c, which run on a Linux PC. The test checks CalcCrc32WithSeed
+// against a bitwise CRC-32 for the standard check value, and for random data at random lengths,
+// alignments and seeds, which is passed in random pieces as the DFU protocol passes each write.
+//
+// The benchmark reports the throughput of CalcCrc32WithSeed and of a byte-at-a-time table
+// lookup, which is how nordic/crc.c calculated the checksum before it used slicing-by-8. It
+// measures both 4 KB blocks, which is the size of an nRF52 data object, and 64-byte blocks, which
+// is the size of each write when the MTU is 131 bytes.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nordic/crc.h"
+
+#define DATA_SIZE (64 * 1024)
+#define RANDOM_CASES 20000
+#define BENCHMARK_BYTES (256L * 1024 * 1024)
+
+static uint8_t data[DATA_SIZE + 8];
+
+static uint32_t byteTable[256];
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+// Bitwise CRC-32, which is the reference for the test.
+static uint32_t BitwiseCrc32(const uint8_t *buf, size_t len, uint32_t seed)
+{
+    uint32_t crc = ~seed;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void InitializeByteTable(void)
+{
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+        byteTable[n] = crc;
+    }
+}
+
+// One table lookup for each byte.
+static uint32_t ByteTableCrc32(const uint8_t *buf, size_t len, uint32_t seed)
+{
+    uint32_t crc = seed ^ 0xFFFFFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc = byteTable[(crc & 0xff) ^ buf[i]] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static double GetNowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// The CRC-32 of "123456789" is 0xCBF43926.
+static void TestCheckValue(void)
+{
+    const uint8_t check[] = "123456789";
+    uint32_t crc = CalcCrc32(check, 9);
+    if (crc != 0xCBF43926) {
+        Fail("TestCheckValue", "wrong CRC", (long)crc);
+    }
+}
+
+// Random lengths, alignments and seeds give the same result as the bitwise CRC, including when
+// the data is passed in pieces.
+static void TestRandomData(void)
+{
+    for (int i = 0; i < RANDOM_CASES; ++i) {
+        size_t offset = (size_t)(rand() % 8);
+        size_t len = (size_t)(rand() % 4200);
+        uint32_t seed = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+        const uint8_t *buf = &data[offset];
+
+        uint32_t expected = BitwiseCrc32(buf, len, seed);
+        if (CalcCrc32WithSeed(buf, len, seed) != expected) {
+            Fail("TestRandomData", "whole block differs", i);
+            continue;
+        }
+
+        uint32_t crc = seed;
+        size_t done = 0;
+        while (done < len) {
+            size_t piece = 1 + (size_t)(rand() % 100);
+            if (piece > len - done) {
+                piece = len - done;
+            }
+            crc = CalcCrc32WithSeed(&buf[done], piece, crc);
+            done += piece;
+        }
+        if (crc != expected) {
+            Fail("TestRandomData", "pieces differ", i);
+        }
+    }
+}
+
+static double MeasureMegabytesPerSecond(uint32_t (*crc32)(const uint8_t *, size_t, uint32_t),
+                                        size_t blockSize, uint32_t *result)
+{
+    uint32_t crc = 0;
+    size_t offset = 0;
+    double start = GetNowSeconds();
+    for (long done = 0; done < BENCHMARK_BYTES; done += (long)blockSize) {
+        crc = crc32(&data[offset], blockSize, crc);
+        offset = (offset + blockSize) % (DATA_SIZE - blockSize + 1);
+    }
+    double elapsed = GetNowSeconds() - start;
+
+    *result = crc;
+    return (double)BENCHMARK_BYTES / elapsed / 1e6;
+}
+
+static void BenchmarkBlockSizes(void)
+{
+    static const size_t blockSizes[] = {4096, 64};
+
+    printf("%-12s %20s %20s %10s\n", "block bytes", "byte table MB/s", "CalcCrc32 MB/s",
+           "speedup");
+    for (size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); ++i) {
+        uint32_t byteTableResult;
+        uint32_t result;
+        double byteTable = MeasureMegabytesPerSecond(ByteTableCrc32, blockSizes[i],
+                                                     &byteTableResult);
+        double calc = MeasureMegabytesPerSecond(CalcCrc32WithSeed, blockSizes[i], &result);
+        if (result != byteTableResult) {
+            Fail("BenchmarkBlockSizes", "results differ", (long)blockSizes[i]);
+        }
+
+        printf("%-12zu %20.0f %20.0f %9.1fx\n", blockSizes[i], byteTable, calc, calc / byteTable);
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)rand();
+    }
+    InitializeByteTable();
+
+    TestCheckValue();
+    TestRandomData();
+    BenchmarkBlockSizes();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,506 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for nordic/dfu_uart_protocol.c, which runs on a Linux PC. The attached nRF52 is replaced
+// by a fake bootloader, which runs in a thread on the other side of a pseudoterminal. It decodes
+// each SLIP request and responds as the Nordic serial DFU bootloader does, and it keeps the init
+// packet and firmware which it receives, so that the test can check that they were transferred
+// intact. The fake bootloader sends some noise before the ping request, as an nRF52 can after it
+// is reset.
+//
+// Each scenario writes a firmware image to the fake bootloader:
+// - with each response sent in a single write;
+// - with packet receipt notifications, which arrive without a request;
+// - with each response sent a byte at a time, so that it is read in pieces;
+// - with a response which contains an invalid escape sequence, which must fail the update.
+//
+// read() and write() are wrapped at link time (-Wl,--wrap), and the test reports the number of
+// reads from the UART for each response which the fake bootloader sent, after the reads which
+// clear the noise. When each response is sent in a single write, the sample must read it in at
+// most two reads: one which finds no data, and one which reads the whole response.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+
+#include "nordic/dfu_uart_protocol.h"
+
+#define MTU 131
+#define COMMAND_OBJECT_SIZE 512
+#define DATA_OBJECT_SIZE 4096
+#define INIT_PACKET_SIZE 140
+#define FIRMWARE_SIZE 40000
+#define NOISE_SIZE 40
+
+// Most reads which the sample may make for each response, when each is sent in a single write.
+#define MAX_READS_PER_RESPONSE 2.0
+
+#define SLIP_END 0300
+#define SLIP_ESC 0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+typedef struct {
+    const char *name;
+
+    // Number of writes after which the bootloader reports its offset and checksum, or zero.
+    uint16_t writesPerNotification;
+
+    // Send each response a byte at a time.
+    bool fragmented;
+
+    // One-based index of a response which contains an invalid escape sequence, or zero.
+    unsigned int corruptResponse;
+
+    DfuResultStatus expectedResult;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"whole responses", 0, false, 0, DfuResult_Success},
+    {"receipt notifications", 8, false, 0, DfuResult_Success},
+    {"fragmented responses", 0, true, 0, DfuResult_Success},
+    {"corrupt response", 0, false, 5, DfuResult_Fail},
+};
+
+// The fake bootloader's state. The thread which runs it is joined before the test reads it.
+typedef struct {
+    const Scenario *scenario;
+    int fd;
+    uint16_t writesPerNotification;
+    uint16_t writesSinceCreate;
+    uint8_t objectType;
+    unsigned int responsesSent;
+
+    // Data which has been written for the command (init packet) and data (firmware) objects,
+    // and the CRC-32 of that data.
+    uint8_t objects[2][FIRMWARE_SIZE];
+    uint32_t objectSizes[2];
+    uint32_t objectCrcs[2];
+} Bootloader;
+
+static Bootloader bootloader;
+
+static uint8_t initPacket[INIT_PACKET_SIZE];
+static uint8_t firmware[FIRMWARE_SIZE];
+static char initPacketPath[64];
+static char firmwarePath[64];
+
+// The sample's end of the pseudoterminal, the number of times it is read, and the number of
+// those reads which were made before the first request was written.
+static int uartFd = -1;
+static unsigned long uartReads = 0;
+static unsigned long uartReadsBeforeRequest = 0;
+static bool requestWritten = false;
+
+static bool finished = false;
+static DfuResultStatus result;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+    return 0;
+}
+
+int Storage_OpenFileInImagePackage(const char *relativePath)
+{
+    return open(relativePath, O_RDONLY);
+}
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    if (fd == uartFd) {
+        ++uartReads;
+    }
+    return __real_read(fd, buf, count);
+}
+
+ssize_t __real_write(int fd, const void *buf, size_t count);
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    if (fd == uartFd && !requestWritten) {
+        requestWritten = true;
+        uartReadsBeforeRequest = uartReads;
+    }
+    return __real_write(fd, buf, count);
+}
+
+// Bitwise CRC-32, which is independent of the table-driven implementation in nordic/crc.c.
+static uint32_t Crc32(const uint8_t *data, size_t len, uint32_t crc)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void PutLe16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void PutLe32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void WriteAll(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(bootloader.fd, data, len);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+// Sends a response with the given opcode and payload, SLIP-encoded.
+static void Respond(uint8_t op, const uint8_t *payload, size_t len)
+{
+    uint8_t decoded[3 + 16] = {0x60, op, 0x01};
+    memcpy(&decoded[3], payload, len);
+
+    uint8_t encoded[2 * sizeof(decoded) + 3];
+    size_t encodedLen = 0;
+
+    const Scenario *scenario = bootloader.scenario;
+    if (++bootloader.responsesSent == scenario->corruptResponse) {
+        encoded[encodedLen++] = SLIP_ESC;
+        encoded[encodedLen++] = 0x01;
+    }
+
+    for (size_t i = 0; i < 3 + len; ++i) {
+        if (decoded[i] == SLIP_END) {
+            encoded[encodedLen++] = SLIP_ESC;
+            encoded[encodedLen++] = SLIP_ESC_END;
+        } else if (decoded[i] == SLIP_ESC) {
+            encoded[encodedLen++] = SLIP_ESC;
+            encoded[encodedLen++] = SLIP_ESC_ESC;
+        } else {
+            encoded[encodedLen++] = decoded[i];
+        }
+    }
+    encoded[encodedLen++] = SLIP_END;
+
+    if (!scenario->fragmented) {
+        WriteAll(encoded, encodedLen);
+        return;
+    }
+
+    for (size_t i = 0; i < encodedLen; ++i) {
+        WriteAll(&encoded[i], 1);
+        usleep(100);
+    }
+}
+
+// Responds with the offset and CRC-32 of the current object type.
+static void RespondWithCrc(void)
+{
+    uint8_t payload[8];
+    size_t index = bootloader.objectType - 1u;
+    PutLe32(&payload[0], bootloader.objectSizes[index]);
+    PutLe32(&payload[4], bootloader.objectCrcs[index]);
+    Respond(0x03, payload, sizeof(payload));
+}
+
+static void HandleRequest(const uint8_t *request, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    uint8_t payload[16] = {0};
+    switch (request[0]) {
+    case 0x09: // Ping, which starts an update.
+        memset(bootloader.objectSizes, 0, sizeof(bootloader.objectSizes));
+        memset(bootloader.objectCrcs, 0, sizeof(bootloader.objectCrcs));
+        Respond(request[0], &request[1], 1);
+        break;
+
+    case 0x02: // Set packet receipt notification interval.
+        bootloader.writesPerNotification = (uint16_t)(request[1] | request[2] << 8);
+        Respond(request[0], NULL, 0);
+        break;
+
+    case 0x07: // Get MTU.
+        PutLe16(payload, MTU);
+        Respond(request[0], payload, 2);
+        break;
+
+    case 0x0B: // Get firmware version. No firmware is installed.
+        payload[0] = 0xFF;
+        Respond(request[0], payload, 13);
+        break;
+
+    case 0x06: // Select object.
+        bootloader.objectType = request[1];
+        PutLe32(&payload[0], request[1] == 0x01 ? COMMAND_OBJECT_SIZE : DATA_OBJECT_SIZE);
+        PutLe32(&payload[4], bootloader.objectSizes[request[1] - 1u]);
+        PutLe32(&payload[8], bootloader.objectCrcs[request[1] - 1u]);
+        Respond(request[0], payload, 12);
+        break;
+
+    case 0x01: // Create object.
+        bootloader.objectType = request[1];
+        bootloader.writesSinceCreate = 0;
+        Respond(request[0], NULL, 0);
+        break;
+
+    case 0x08: { // Write object, which has no response.
+        size_t index = bootloader.objectType - 1u;
+        size_t dataLen = len - 1;
+        if (bootloader.objectSizes[index] + dataLen > FIRMWARE_SIZE) {
+            break;
+        }
+        memcpy(&bootloader.objects[index][bootloader.objectSizes[index]], &request[1], dataLen);
+        bootloader.objectCrcs[index] = Crc32(&request[1], dataLen, bootloader.objectCrcs[index]);
+        bootloader.objectSizes[index] += (uint32_t)dataLen;
+
+        if (bootloader.writesPerNotification != 0 &&
+            ++bootloader.writesSinceCreate == bootloader.writesPerNotification) {
+            bootloader.writesSinceCreate = 0;
+            RespondWithCrc();
+        }
+        break;
+    }
+
+    case 0x03: // Get CRC.
+        RespondWithCrc();
+        break;
+
+    case 0x04: // Execute object.
+        Respond(request[0], NULL, 0);
+        break;
+
+    default: // Abort, and anything else, has no response.
+        break;
+    }
+}
+
+// Decodes SLIP requests from the pseudoterminal until the sample closes its end.
+static void *RunBootloader(void *arg)
+{
+    static const uint8_t noise[NOISE_SIZE] = {0x55, 0xC0, 0xDB, 0x00};
+    WriteAll(noise, sizeof(noise));
+
+    uint8_t request[MTU];
+    size_t len = 0;
+    bool escaped = false;
+    for (;;) {
+        uint8_t buf[256];
+        ssize_t n = read(bootloader.fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+
+        for (ssize_t i = 0; i < n; ++i) {
+            uint8_t b = buf[i];
+            if (b == SLIP_END) {
+                HandleRequest(request, len);
+                len = 0;
+                escaped = false;
+                continue;
+            }
+
+            if (escaped) {
+                b = (b == SLIP_ESC_END) ? SLIP_END : SLIP_ESC;
+                escaped = false;
+            } else if (b == SLIP_ESC) {
+                escaped = true;
+                continue;
+            }
+
+            if (len < sizeof(request)) {
+                request[len++] = b;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void DfuTerminationHandler(DfuResultStatus status)
+{
+    result = status;
+    finished = true;
+}
+
+// Opens a pseudoterminal in raw mode. The sample uses the non-blocking subsidiary end, as it
+// would use the UART, and the fake bootloader uses the main end.
+static bool OpenPseudoterminal(int *bootloaderFd, int *sampleFd)
+{
+    *bootloaderFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*bootloaderFd == -1 || grantpt(*bootloaderFd) != 0 || unlockpt(*bootloaderFd) != 0) {
+        return false;
+    }
+
+    *sampleFd = open(ptsname(*bootloaderFd), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (*sampleFd == -1) {
+        return false;
+    }
+
+    struct termios attributes;
+    if (tcgetattr(*sampleFd, &attributes) != 0) {
+        return false;
+    }
+    cfmakeraw(&attributes);
+    return tcsetattr(*sampleFd, TCSANOW, &attributes) == 0;
+}
+
+static void RunScenario(const Scenario *scenario)
+{
+    const char *test = scenario->name;
+
+    memset(&bootloader, 0, sizeof(bootloader));
+    bootloader.scenario = scenario;
+    if (!OpenPseudoterminal(&bootloader.fd, &uartFd)) {
+        Fail(test, "could not open pseudoterminal", errno);
+        return;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, RunBootloader, NULL) != 0) {
+        Fail(test, "could not start fake bootloader", 0);
+        return;
+    }
+
+    EventLoop *eventLoop = EventLoop_Create();
+    DfuImageData image = {.datPathname = initPacketPath,
+                          .binPathname = firmwarePath,
+                          .firmwareType = DfuFirmware_Application,
+                          .version = 1};
+
+    uartReads = 0;
+    requestWritten = false;
+    finished = false;
+    InitUartProtocol(uartFd, -1, -1, eventLoop);
+    SetPacketReceiptNotificationInterval(scenario->writesPerNotification);
+    ProgramImages(&image, 1, DfuTerminationHandler);
+    while (!finished) {
+        if (EventLoop_Run(eventLoop, -1, true) == EventLoop_Run_Failed) {
+            Fail(test, "event loop failed", errno);
+            break;
+        }
+    }
+    unsigned long reads = uartReads - uartReadsBeforeRequest;
+
+    // Closing the sample's end stops the fake bootloader.
+    close(uartFd);
+    uartFd = -1;
+    pthread_join(thread, NULL);
+    close(bootloader.fd);
+    EventLoop_Close(eventLoop);
+
+    if (result != scenario->expectedResult) {
+        Fail(test, "unexpected result", result);
+    }
+
+    double readsPerResponse = (double)reads / bootloader.responsesSent;
+    printf("%-24s %10u %10lu %20.2f\n", test, bootloader.responsesSent, reads, readsPerResponse);
+
+    if (scenario->expectedResult != DfuResult_Success) {
+        return;
+    }
+
+    if (bootloader.objectSizes[0] != INIT_PACKET_SIZE ||
+        memcmp(bootloader.objects[0], initPacket, INIT_PACKET_SIZE) != 0) {
+        Fail(test, "init packet was not received intact", bootloader.objectSizes[0]);
+    }
+    if (bootloader.objectSizes[1] != FIRMWARE_SIZE ||
+        memcmp(bootloader.objects[1], firmware, FIRMWARE_SIZE) != 0) {
+        Fail(test, "firmware was not received intact", bootloader.objectSizes[1]);
+    }
+
+    if (!scenario->fragmented && readsPerResponse > MAX_READS_PER_RESPONSE) {
+        Fail(test, "too many reads for each response", (long)readsPerResponse);
+    }
+}
+
+static bool WriteFile(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+int main(void)
+{
+    // Random images, in which one byte in eight must be escaped.
+    srand(1);
+    for (size_t i = 0; i < sizeof(initPacket); ++i) {
+        initPacket[i] = (uint8_t)rand();
+    }
+    for (size_t i = 0; i < sizeof(firmware); ++i) {
+        int r = rand() % 16;
+        firmware[i] = (r == 0) ? SLIP_END : (r == 1) ? SLIP_ESC : (uint8_t)rand();
+    }
+
+    char directory[] = "/tmp/dfu_uart_protocol_test.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("Could not create %s\n", directory);
+        return EXIT_FAILURE;
+    }
+    snprintf(initPacketPath, sizeof(initPacketPath), "%s/app.dat", directory);
+    snprintf(firmwarePath, sizeof(firmwarePath), "%s/app.bin", directory);
+    if (!WriteFile(initPacketPath, initPacket, sizeof(initPacket)) ||
+        !WriteFile(firmwarePath, firmware, sizeof(firmware))) {
+        printf("Could not write images to %s\n", directory);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-24s %10s %10s %20s\n", "scenario", "responses", "reads", "reads per response");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        RunScenario(&scenarios[i]);
+    }
+
+    unlink(initPacketPath);
+    unlink(firmwarePath);
+    rmdir(directory);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
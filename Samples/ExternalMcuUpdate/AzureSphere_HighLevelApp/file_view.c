@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 
 #include <applibs/log.h>
@@ -29,12 +30,9 @@ FileView *OpenFileView(const char *path, size_t windowSize)
     self->fd = -1;
     self->fileOffset = NO_VALID_WINDOW;
     self->window = NULL;
+    self->mapping = NULL;
 
     self->windowSize = windowSize;
-    self->window = malloc(windowSize);
-    if (!self->window) {
-        goto failed;
-    }
 
     self->fd = Storage_OpenFileInImagePackage(path);
     if (self->fd == -1) {
@@ -46,6 +44,24 @@ FileView *OpenFileView(const char *path, size_t windowSize)
         goto failed;
     }
 
+    // Map the whole file if possible, so moving the window does not block on reads.
+    // Otherwise, fall back to reading each window into a buffer.
+    if (self->fileSize > 0) {
+        void *mapping = mmap(NULL, (size_t)self->fileSize, PROT_READ, MAP_PRIVATE, self->fd, 0);
+        if (mapping != MAP_FAILED) {
+            self->mapping = mapping;
+            return self;
+        }
+
+        Log_Debug("INFO: Could not map %s (errno=%d); reading it into a buffer instead.\n", path,
+                  errno);
+    }
+
+    self->window = malloc(windowSize);
+    if (!self->window) {
+        goto failed;
+    }
+
     return self;
 
 failed:
@@ -59,16 +75,33 @@ void CloseFileView(FileView *self)
         return;
     }
 
+    if (self->mapping) {
+        munmap((void *)self->mapping, (size_t)self->fileSize);
+    } else {
+        free(self->window);
+    }
+
     if (self->fd != -1) {
         close(self->fd);
     }
 
-    free(self->window);
     free(self);
 }
 
 bool FileViewMoveWindow(FileView *self, off_t offset)
 {
+    if (self->mapping) {
+        if (offset < 0 || offset > self->fileSize) {
+            Log_Debug("ERROR:%s: could not seek to %lld\n", __func__, offset);
+            return false;
+        }
+
+        // The window data is never written through this pointer.
+        self->window = (uint8_t *)&self->mapping[offset];
+        self->fileOffset = offset;
+        return true;
+    }
+
     if (lseek(self->fd, offset, SEEK_SET) == -1) {
         Log_Debug("ERROR:%s: could not seek to %lld (errno=%d)\n", __func__, offset, errno);
         return false;
@@ -11,6 +11,8 @@
 /// <summary>
 /// Provides a movable window to a file's contents.
 /// This removes the need to load the entire file into memory at once.
+/// If the file can be memory-mapped, then the window points into the mapping
+/// and moving the window does not copy any data.
 /// </summary>
 typedef struct {
     /// <summary>
@@ -24,6 +26,12 @@ typedef struct {
     /// <summary>Start of window in memory.</summary>
     uint8_t *window;
 
+    /// <summary>
+    /// Read-only mapping of the whole file, or NULL if the file could not be mapped,
+    /// in which case the window is a separately-allocated buffer.
+    /// </summary>
+    const uint8_t *mapping;
+
     /// <summary>Data in window starts at this offset in the file.</summary>
     off_t fileOffset;
 
@@ -51,7 +59,8 @@ void CloseFileView(FileView *self);
 /// <summary>
 /// Move the internal window so it starts at the supplied offset.
 /// This function will read data up to the end of the window or the
-/// end of the file, whichever is sooner.
+/// end of the file, whichever is sooner. If the file is memory-mapped
+/// then no data is read; the window is moved within the mapping.
 /// <param name="self">File view returned by OpenFileView.</param>
 /// <param name="offset">Offset in file from which to read data.</param>
 /// <returns>true if successfully read data into the window; false otherwise.
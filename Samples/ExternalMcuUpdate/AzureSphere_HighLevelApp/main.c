@@ -90,6 +90,11 @@ static DfuImageData images[] = {
 
 static const size_t imageCount = sizeof(images) / sizeof(images[0]);
 
+// Number of write requests which can be sent to the attached board before waiting for it to
+// report its offset and checksum. When each object is a multiple of this many write requests,
+// the last report for an object replaces the separate checksum request for that object.
+static const uint16_t writesPerReceiptNotification = 16;
+
 // Whether currently writing images to attached board.
 static bool inDfuMode = false;
 
@@ -193,6 +198,7 @@ static ExitCode InitPeripheralsAndHandlers(void)
     }
 
     InitUartProtocol(nrfUartFd, nrfResetGpioFd, nrfDfuModeGpioFd, eventLoop);
+    SetPacketReceiptNotificationInterval(writesPerReceiptNotification);
 
     Log_Debug("Opening SAMPLE_BUTTON_1 as input\n");
     triggerUpdateButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
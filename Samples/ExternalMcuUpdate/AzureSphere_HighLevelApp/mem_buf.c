@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 // Define _BSD_SOURCE to access le16toh and le32toh to internalize data from a
 // little-endian source.
@@ -143,6 +144,29 @@ void MemBufAppend8(MemBuf *self, uint8_t val)
     MemBufWrite8(self, self->curSize - 1, val);
 }
 
+void MemBufAppend(MemBuf *self, const uint8_t *data, size_t len)
+{
+    assert(len <= self->maxSize - self->curSize);
+
+    memcpy(&self->data[self->curSize], data, len);
+    self->curSize += len;
+}
+
+ssize_t MemBufAppendFromFd(MemBuf *self, int fd, size_t maxLen)
+{
+    size_t freeBytes = self->maxSize - self->curSize;
+    if (maxLen > freeBytes) {
+        maxLen = freeBytes;
+    }
+
+    ssize_t bytesRead = read(fd, &self->data[self->curSize], maxLen);
+    if (bytesRead > 0) {
+        self->curSize += (size_t)bytesRead;
+    }
+
+    return bytesRead;
+}
+
 uint16_t MemBufReadLe16(const MemBuf *self, size_t offset)
 {
     // Copy to a local value to avoid alignment problems.
@@ -130,6 +130,30 @@ uint8_t MemBufRead8(const MemBuf *self, size_t idx);
 /// </summary>
 void MemBufAppend8(MemBuf *self, uint8_t val);
 
+/// <summary>
+/// <para>Append a sequence of bytes to the end of the buffer.</para>
+/// <para>On exit the current size is increased by len.  It must not
+/// exceed the maximum size.</para>
+/// <param name="self">Buffer which was allocated by AllocMemBuf.</param>
+/// <param name="data">Start of data to append to the buffer.</param>
+/// <param name="len">Length of data in bytes.</param>
+/// </summary>
+void MemBufAppend(MemBuf *self, const uint8_t *data, size_t len);
+
+/// <summary>
+/// <para>Read data from a file descriptor and append it to the end of the
+/// buffer, with a single call to read().</para>
+/// <para>No more than maxLen bytes are read, and no more than the free
+/// space in the buffer.</para>
+/// <param name="self">Buffer which was allocated by AllocMemBuf.</param>
+/// <param name="fd">Descriptor to read from.</param>
+/// <param name="maxLen">Maximum number of bytes to read.</param>
+/// <returns>The value returned by read().  On success the current size
+/// is increased by this amount.  On failure, returns -1 and errno is set
+/// by read().</returns>
+/// </summary>
+ssize_t MemBufAppendFromFd(MemBuf *self, int fd, size_t maxLen);
+
 /// <summary>
 /// Read a unsigned little-endian 16-bit value from the buffer.
 /// <param name="self">Buffer which was allocated by AllocMemBuf.</param>
@@ -1,6 +1,17 @@
 /* This code is a C port of the nrfutil Python tool from Nordic Semiconductor ASA. The porting was done by Microsoft. See the
 LICENSE.txt in this directory, and for more background, see the README.md for this sample. */
 
+#include <stdbool.h>
+#include <string.h>
+
+// Define _BSD_SOURCE to access le32toh, to read data which is in little-endian format.
+#define _BSD_SOURCE
+#include <endian.h>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 #include "crc.h"
 
 uint32_t CalcCrc32(const uint8_t *data, size_t len)
@@ -44,13 +55,82 @@ static const uint32_t crc32Table[] = {
     0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
     0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D};
 
-uint32_t CalcCrc32WithSeed(const uint8_t *data, size_t len, uint32_t seed)
+#if defined(__ARM_FEATURE_CRC32)
+
+// The target supports the ARMv8 CRC32 instructions, which use the same polynomial as
+// the table above, so process a word at a time with those instead of the tables.
+static uint32_t UpdateCrc32(const uint8_t *data, size_t len, uint32_t crc32)
 {
-    uint32_t crc32 = seed ^ 0xFFFFFFFF;
+    while (len >= sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc32 = __crc32w(crc32, le32toh(word));
+        data += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    while (len > 0) {
+        crc32 = __crc32b(crc32, *data++);
+        --len;
+    }
+
+    return crc32;
+}
+
+#else
+
+// Slicing-by-8 tables. crc32Slices[k - 1][n] is the CRC of byte n followed by k zero
+// bytes, which allows eight bytes to be processed with eight independent table lookups.
+// These are derived from crc32Table the first time a checksum is calculated.
+static uint32_t crc32Slices[7][256];
+static bool crc32SlicesInitialized = false;
+
+static void InitializeCrc32Slices(void)
+{
+    for (size_t n = 0; n < 256; ++n) {
+        uint32_t crc32 = crc32Table[n];
+        for (size_t k = 0; k < 7; ++k) {
+            crc32 = crc32Table[crc32 & 0xff] ^ (crc32 >> 8);
+            crc32Slices[k][n] = crc32;
+        }
+    }
+
+    crc32SlicesInitialized = true;
+}
+
+static uint32_t UpdateCrc32(const uint8_t *data, size_t len, uint32_t crc32)
+{
+    if (!crc32SlicesInitialized) {
+        InitializeCrc32Slices();
+    }
+
+    // Copy each block into local words to avoid alignment problems.
+    while (len >= 2 * sizeof(uint32_t)) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, sizeof(lo));
+        memcpy(&hi, data + sizeof(lo), sizeof(hi));
+        lo = le32toh(lo) ^ crc32;
+        hi = le32toh(hi);
+
+        crc32 = crc32Slices[6][lo & 0xff] ^ crc32Slices[5][(lo >> 8) & 0xff] ^
+                crc32Slices[4][(lo >> 16) & 0xff] ^ crc32Slices[3][lo >> 24] ^
+                crc32Slices[2][hi & 0xff] ^ crc32Slices[1][(hi >> 8) & 0xff] ^
+                crc32Slices[0][(hi >> 16) & 0xff] ^ crc32Table[hi >> 24];
+
+        data += 2 * sizeof(uint32_t);
+        len -= 2 * sizeof(uint32_t);
+    }
 
     for (size_t index = 0; index < len; ++index) {
         crc32 = crc32Table[(crc32 & 0xff) ^ data[index]] ^ (crc32 >> 8);
     }
 
-    return crc32 ^ 0xFFFFFFFF;
+    return crc32;
+}
+
+#endif
+
+uint32_t CalcCrc32WithSeed(const uint8_t *data, size_t len, uint32_t seed)
+{
+    return UpdateCrc32(data, len, seed ^ 0xFFFFFFFF) ^ 0xFFFFFFFF;
 }
@@ -5,6 +5,7 @@ LICENSE.txt in this directory, and for more background, see the README.md for th
 
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "../file_view.h"
 #include "../mem_buf.h"
@@ -180,6 +181,12 @@ typedef enum {
     /// <summary>Have received response to NrfDfuOp_CrcGet request.</summary>
     DfuState_FileTrnasferReceivedWindowChecksumResponse,
 
+    /// <summary>
+    /// Have received the packet receipt notification which the attached board sends
+    /// after every dts.prn NrfDfuOp_ObjectWrite requests.
+    /// </summary>
+    DfuState_FileTransferReceivedReceiptNotification,
+
     /// <summary>Have received response to NrfDfuOp_ObjectExecute request.</summary>
     DfuState_FileTransferReceivedExecuteResponse,
 } DfuProtocolStates;
@@ -278,15 +285,32 @@ struct DeviceTransferState {
     /// </summary>
     MemBuf *decodedRxBuf;
 
+    /// <summary>
+    /// Holds up to one MTU worth of SLIP-encoded data which has been read from
+    /// the attached board but not yet decoded. Data is read from the UART in
+    /// bulk, so any bytes which follow the end of a packet are kept here for the
+    /// next read.
+    /// </summary>
+    MemBuf *rawRxBuf;
+
     /// <summary>
     /// Identifier sent with ping request. The state machine verifies that
     /// the ping response contains the same identifier.
     /// </summary>
     uint8_t pingId;
 
-    /// <summary>Packet receipt notification. Always set to zero.</summary>
+    /// <summary>
+    /// Packet receipt notification. If this is non-zero, the attached board reports
+    /// its offset and checksum after this many NrfDfuOp_ObjectWrite requests.
+    /// </summary>
     uint16_t prn;
 
+    /// <summary>
+    /// Number of NrfDfuOp_ObjectWrite requests sent since the object was created
+    /// or since the last packet receipt notification, whichever is more recent.
+    /// </summary>
+    uint16_t writesSinceNotification;
+
     /// <summary>Maximum transfer unit size in bytes.</summary>
     uint16_t mtu;
 
@@ -342,8 +366,8 @@ struct DeviceTransferState {
     bool readAfterWrite;
 
     /// <summary>
-    /// How the SLIP decoding is progressing. Data is read from the UART one
-    /// byte at a time and so need to keep track of whether in escape sequence.
+    /// How the SLIP decoding is progressing. A packet may arrive over several
+    /// reads and so need to keep track of whether in escape sequence.
     /// </summary>
     NrfSlipDecodeState decodeState;
 
@@ -367,5 +391,8 @@ struct DeviceTransferState {
     ///     Timer used to detect when attached board does not respond.
     /// </summary>
     EventLoopTimer *timeoutTimer;
+
+    /// <summary>When the transfer of the current file started.</summary>
+    struct timespec transferStartTime;
 };
 
@@ -7,6 +7,7 @@ for this sample. */
 #include <stdbool.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <applibs/log.h>
 #include <applibs/gpio.h>
@@ -73,6 +74,11 @@ static StateTransition HandleFileTransferReceivedCreateResponse(void);
 static StateTransition HandleFileTransferSendNextFragmentFromFileView(void);
 static StateTransition HandleFileTransferSentWriteObjectRequest(void);
 static StateTransition HandleFileTransferReceivedWindowChecksumResponse(void);
+static StateTransition HandleFileTransferReceivedReceiptNotification(void);
+static StateTransition SendNextFragmentOrCompleteObject(bool checksumVerified);
+static bool VerifyReportedOffsetAndCrc(off_t expectedOffset);
+static void StartTransferTimer(void);
+static void LogTransferThroughput(void);
 static StateTransition HandleFileTransferReceivedExecuteResponse(void);
 
 static StateTransition HandlePostValidateImage(void);
@@ -107,6 +113,9 @@ static const DfuImageData *currentImage = NULL;
 // Tracks image number requested from nRF52
 static uint8_t nrfImageIndex = 0;
 
+// Number of write requests after which the nRF52 reports its offset and checksum.
+static uint16_t writesPerReceiptNotification = 0;
+
 void ProgramImages(DfuImageData *imagesToWrite, size_t imageCount, DfuResultHandler exitHandler)
 {
     assert(exitHandler != NULL);
@@ -141,6 +150,11 @@ void InitUartProtocol(int openedUartFd, int openedResetFd, int openedDfuFd,
     dts.mtu = PREAMBLE_MTU_SIZE;
 }
 
+void SetPacketReceiptNotificationInterval(uint16_t writesPerNotification)
+{
+    writesPerReceiptNotification = writesPerNotification;
+}
+
 /// <summary>
 ///     Encodes the header and (optionally) the payload.
 /// </summary>
@@ -293,40 +307,50 @@ static void ReadEventHandler(bool fromEvent)
 
     bool finished = false;
     while (!finished && dts.bytesRead < dts.mtu) {
-        // Read a single byte from the UART and decode it.
-        uint8_t b;
-        ssize_t bytesReadOneSysCall = read(nrfUartFd, &b, 1);
-
-        // Successfully read a single byte.
-        if (bytesReadOneSysCall == 1) {
-            ++dts.bytesRead;
-
-            SlipDecodeAddByte(b, dts.decodedRxBuf, &dts.decodeState, &finished);
-
-            // If the incoming data could not be decoded then abort the transfer.
-            if (dts.decodeState == NRF_SLIP_STATE_CLEARING_INVALID_PACKET) {
-                dts.state = DfuState_Failed;
-                finished = true;
+        // If all of the data which was previously read has been decoded, then read
+        // as much as is available from the UART, up to the end of the MTU.
+        if (MemBufCurSize(dts.rawRxBuf) == 0) {
+            ssize_t bytesReadOneSysCall =
+                MemBufAppendFromFd(dts.rawRxBuf, nrfUartFd, dts.mtu - dts.bytesRead);
+
+            // If the underlying buffer is empty then stay in current state and wait for
+            // the next read event.
+            if ((bytesReadOneSysCall == 0) || (bytesReadOneSysCall < 0 && errno == EAGAIN)) {
+                if (StartTimeoutTimer() == -1) {
+                    dts.state = DfuState_Failed;
+                    break;
+                }
+
+                // Return rather than transition to next state.
+                EventLoop_ModifyIoEvents(eventLoop, dts.uartEventReg, EventLoop_Input);
+                return;
             }
-        }
 
-        // If the underlying buffer is empty then stay in current state and wait for
-        // the next read event.
-        else if ((bytesReadOneSysCall == 0) || (bytesReadOneSysCall < 0 && errno == EAGAIN)) {
-            if (StartTimeoutTimer() == -1) {
+            // Another error occured so abort the transfer.
+            else if (bytesReadOneSysCall < 0) {
                 dts.state = DfuState_Failed;
                 break;
             }
+        }
 
-            // Return rather than transition to next state.
-            EventLoop_ModifyIoEvents(eventLoop, dts.uartEventReg, EventLoop_Input);
-            return;
+        // Decode the received data in a single call. Any data which follows the end
+        // of the packet stays in the raw buffer.
+        const uint8_t *rawData;
+        size_t rawBytes;
+        MemBufData(dts.rawRxBuf, &rawData, &rawBytes);
+        if (rawBytes > dts.mtu - dts.bytesRead) {
+            rawBytes = dts.mtu - dts.bytesRead;
         }
 
-        // Another error occured so abort the transfer.
-        else {
+        size_t consumed = SlipDecodeAddBytes(rawData, rawBytes, dts.decodedRxBuf,
+                                             &dts.decodeState, &finished);
+        dts.bytesRead += consumed;
+        MemBufShiftLeft(dts.rawRxBuf, consumed);
+
+        // If the incoming data could not be decoded then abort the transfer.
+        if (dts.decodeState == NRF_SLIP_STATE_CLEARING_INVALID_PACKET) {
             dts.state = DfuState_Failed;
-            break;
+            finished = true;
         }
     }
 
@@ -560,6 +584,10 @@ static void MoveToNextDfuState(void)
             sttr = HandleFileTransferReceivedWindowChecksumResponse();
             break;
 
+        case DfuState_FileTransferReceivedReceiptNotification:
+            sttr = HandleFileTransferReceivedReceiptNotification();
+            break;
+
         case DfuState_FileTransferReceivedExecuteResponse:
             sttr = HandleFileTransferReceivedExecuteResponse();
             break;
@@ -663,6 +691,9 @@ static void CleanUpStateMachine(void)
 
     FreeMemBuf(dts.decodedRxBuf);
     dts.decodedRxBuf = NULL;
+
+    FreeMemBuf(dts.rawRxBuf);
+    dts.rawRxBuf = NULL;
 }
 
 // Called on DfuState_Start.
@@ -675,6 +706,7 @@ static StateTransition HandleStart(void)
     // error occurs before they are all initialized.
     dts.txBuf = NULL;
     dts.decodedRxBuf = NULL;
+    dts.rawRxBuf = NULL;
     dts.fv = NULL;
 
     dts.initTimer = NULL;
@@ -697,6 +729,11 @@ static StateTransition HandleStart(void)
         return StateTransition_Failed;
     }
 
+    dts.rawRxBuf = AllocMemBuf(PREAMBLE_MTU_SIZE);
+    if (!dts.rawRxBuf) {
+        return StateTransition_Failed;
+    }
+
     // Create UART event. It is updated to listen for read or write events as required.
     dts.uartEventReg =
         EventLoop_RegisterIo(eventLoop, nrfUartFd, 0x0, UartEventHandler, /* context */ NULL);
@@ -750,23 +787,25 @@ static StateTransition HandleInitTimerExpired(void)
     // At this point the nRF52 should not be sending any data so
     // clear any previously-sent data from the OS receive buffer.
 
+    MemBufReset(dts.rawRxBuf);
+
     bool cleared = false;
     do {
-        uint8_t b;
-        int r = read(nrfUartFd, &b, 1);
+        ssize_t r = MemBufAppendFromFd(dts.rawRxBuf, nrfUartFd, MemBufMaxSize(dts.rawRxBuf));
+        MemBufReset(dts.rawRxBuf);
 
         // If a read error occurred then abort.
-        if (r == -1) {
+        if (r == -1 && errno != EAGAIN) {
             return StateTransition_Failed;
         }
 
         // If no data was read then have exhausted the OS receive
         // buffer so stop reading from the UART.
-        else if (r == 0) {
+        else if (r <= 0) {
             cleared = true;
         }
 
-        // Else a byte was read from the buffer, so iterate again.
+        // Else data was read from the buffer, so iterate again.
     } while (!cleared);
 
     // Send the ping command.
@@ -796,7 +835,7 @@ static StateTransition HandlePingReceivedResponse(void)
     }
 
     // Send the packet receipt notification (PRN).
-    dts.prn = 0;
+    dts.prn = writesPerReceiptNotification;
     uint16_t sendPrn = htole16(dts.prn);
     EncodeHeaderAndPayload(NrfDfuOp_ReceiptNotificationSet, (const uint8_t *)&sendPrn, 2);
 
@@ -852,6 +891,12 @@ static StateTransition HandleMtuReceivedResponse(void)
         return StateTransition_Failed;
     }
 
+    // The raw RX buffer contains encoded data which has been read
+    // from the UART, which is limited to the MTU.
+    if (!MemBufResize(dts.rawRxBuf, dts.mtu)) {
+        return StateTransition_Failed;
+    }
+
     // if the nextImageIndex is greater than 0
     // then the image isInstalled and installedVersion
     // fields have been set for all images which
@@ -984,6 +1029,7 @@ static StateTransition HandleInitPacketDoneSelectCommand(void)
         return StateTransition_Failed;
     }
 
+    StartTransferTimer();
     return TransferDataInFileViewWindow(0x1, DfuState_FirmwareStart);
 }
 
@@ -1011,6 +1057,7 @@ static StateTransition HandleFirmwareDoneSelectData(void)
         return StateTransition_Failed;
     }
 
+    StartTransferTimer();
     return TransferDataInFileViewWindow(0x2, DfuState_PostValidateImage);
 }
 
@@ -1091,6 +1138,9 @@ static StateTransition HandleFileTransferReceivedCreateResponse(void)
     dts.stepSize = (dts.mtu - 1) / 2 - 1;
     dts.offsetIntoFileView = 0;
 
+    // The attached board restarts its packet receipt count when an object is created.
+    dts.writesSinceNotification = 0;
+
     dts.state = DfuState_FileTransferSendNextFragmentFromFileView;
     return StateTransition_MoveImmediately;
 }
@@ -1125,6 +1175,45 @@ static StateTransition HandleFileTransferSentWriteObjectRequest(void)
 
     dts.offsetIntoFileView += dts.fvFragmentLen;
 
+    // If packet receipt notifications are enabled, then the attached board reports its
+    // offset and checksum after every dts.prn writes. Until then, keep sending data without
+    // waiting for a response, so that up to dts.prn write requests are in flight at once.
+    if (dts.prn != 0 && ++dts.writesSinceNotification == dts.prn) {
+        dts.writesSinceNotification = 0;
+        dts.state = DfuState_FileTransferReceivedReceiptNotification;
+        return StateTransition_LaunchRead;
+    }
+
+    return SendNextFragmentOrCompleteObject(/* checksumVerified */ false);
+}
+
+// Called on DfuState_FileTransferReceivedReceiptNotification.
+static StateTransition HandleFileTransferReceivedReceiptNotification(void)
+{
+    // The notification has the same format as the response to NrfDfuOp_CrcGet.
+    if (!ValidateAndRemoveHeader(NrfDfuOp_CrcGet)) {
+        return StateTransition_Failed;
+    }
+
+    off_t fileOffset;
+    FileViewFileOffsetSize(dts.fv, &fileOffset, /* size */ NULL);
+    if (!VerifyReportedOffsetAndCrc(fileOffset + dts.offsetIntoFileView)) {
+        return StateTransition_Failed;
+    }
+
+    return SendNextFragmentOrCompleteObject(/* checksumVerified */ true);
+}
+
+/// <summary>
+///     Sends the next fragment from the file view if any data remains. Otherwise the
+///     whole object has been written, so verify its checksum and execute it.
+/// </summary>
+/// <param name="checksumVerified">
+///     true if the checksum has already been verified up to the current offset, in
+///     which case the object can be executed without requesting a checksum.
+/// </param>
+static StateTransition SendNextFragmentOrCompleteObject(bool checksumVerified)
+{
     // If data remaining in file view, then send next fragment.
     off_t extent;
     FileViewWindow(dts.fv, /* data */ NULL, &extent);
@@ -1133,12 +1222,36 @@ static StateTransition HandleFileTransferSentWriteObjectRequest(void)
         return StateTransition_MoveImmediately;
     }
 
+    if (checksumVerified) {
+        EncodeHeaderOnly(NrfDfuOp_ObjectExecute);
+        dts.state = DfuState_FileTransferReceivedExecuteResponse;
+        return StateTransition_LaunchWriteThenRead;
+    }
+
     // Have sent all data in file view, so ask for a checksum.
     EncodeHeaderOnly(NrfDfuOp_CrcGet);
     dts.state = DfuState_FileTrnasferReceivedWindowChecksumResponse;
     return StateTransition_LaunchWriteThenRead;
 }
 
+/// <summary>
+///     Checks whether the offset and CRC in a decoded NrfDfuOp_CrcGet response, with the
+///     header removed, match the expected offset and the running CRC.
+/// </summary>
+/// <param name="expectedOffset">Offset into the file up to which data has been sent.</param>
+/// <returns>true if the offset and CRC match; false otherwise.</returns>
+static bool VerifyReportedOffsetAndCrc(off_t expectedOffset)
+{
+    if (MemBufCurSize(dts.decodedRxBuf) < 8) {
+        return false;
+    }
+
+    uint32_t reportedOffset = MemBufReadLe32(dts.decodedRxBuf, 0);
+    uint32_t reportedCrc32 = MemBufReadLe32(dts.decodedRxBuf, 4);
+
+    return reportedOffset == expectedOffset && reportedCrc32 == dts.runningCrc32;
+}
+
 // DfuState_FileTrnasferReceivedWindowChecksumResponse
 static StateTransition HandleFileTransferReceivedWindowChecksumResponse(void)
 {
@@ -1146,10 +1259,6 @@ static StateTransition HandleFileTransferReceivedWindowChecksumResponse(void)
         return StateTransition_Failed;
     }
 
-    // Check whether the reported offset and CRC match the expected values.
-    uint32_t reportedOffset = MemBufReadLe32(dts.decodedRxBuf, 0);
-    uint32_t reportedCrc32 = MemBufReadLe32(dts.decodedRxBuf, 4);
-
     // Have just sent another window's worth of data from the
     // file, so ensure the offset matches the expected file position.
 
@@ -1158,11 +1267,8 @@ static StateTransition HandleFileTransferReceivedWindowChecksumResponse(void)
     off_t windowExtent;
     FileViewWindow(dts.fv, /* data */ NULL, &windowExtent);
 
-    if (reportedOffset != fileOffset + windowExtent) {
-        return StateTransition_Failed;
-    }
-
-    if (reportedCrc32 != dts.runningCrc32) {
+    // Check whether the reported offset and CRC match the expected values.
+    if (!VerifyReportedOffsetAndCrc(fileOffset + windowExtent)) {
         return StateTransition_Failed;
     }
 
@@ -1194,6 +1300,8 @@ static StateTransition HandleFileTransferReceivedExecuteResponse(void)
         return TransferDataInFileViewWindow(0x2, DfuState_PostValidateImage);
     }
 
+    LogTransferThroughput();
+
     CloseFileView(dts.fv);
     dts.fv = NULL;
 
@@ -1240,3 +1348,26 @@ static void PostValidateTimerEventHandler(EventLoopTimer *timer)
     MoveToNextDfuState();
 }
 
+// Records when the transfer of the file in dts.fv started.
+static void StartTransferTimer(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &dts.transferStartTime);
+}
+
+// Logs how long the file in dts.fv took to transfer, and the resulting throughput.
+static void LogTransferThroughput(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long elapsedMs = (now.tv_sec - dts.transferStartTime.tv_sec) * 1000LL +
+                          (now.tv_nsec - dts.transferStartTime.tv_nsec) / (1000 * 1000);
+    if (elapsedMs <= 0) {
+        elapsedMs = 1;
+    }
+
+    off_t fileSize;
+    FileViewFileOffsetSize(dts.fv, /* offset */ NULL, &fileSize);
+    Log_Debug("Transferred %lld bytes in %lld ms (%lld bytes per second).\n", (long long)fileSize,
+              elapsedMs, (long long)fileSize * 1000 / elapsedMs);
+}
@@ -89,6 +89,19 @@ typedef void (*DfuResultHandler)(DfuResultStatus statusToReturn);
 void InitUartProtocol(int openedUartFd, int openedResetFd, int openedDfuFd,
                       EventLoop *eventLoopInstance);
 
+/// <summary>
+/// <para>Sets how many write requests may be sent to the attached board before it reports
+/// the offset and checksum of the data which it has received so far. The reported checksum
+/// is verified, and further data is not sent until the report has been received.</para>
+/// <para>The default value is zero, where the attached board is only asked for a checksum
+/// after each object has been written.  If the object size is a multiple of this value, then
+/// the report which arrives at the end of each object replaces that separate checksum request.
+/// This value takes effect the next time that ProgramImages is called.</para>
+/// <param name="writesPerNotification">Number of write requests between reports, or zero to
+/// disable the reports.</param>
+/// </summary>
+void SetPacketReceiptNotificationInterval(uint16_t writesPerNotification);
+
 /// <summary>
 /// Start writing the supplied images to the attached board.  When the
 /// images have been successfully written, or when the operation has failed,
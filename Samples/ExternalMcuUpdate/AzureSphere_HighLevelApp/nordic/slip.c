@@ -65,3 +65,36 @@ void SlipDecodeAddByte(uint8_t b, MemBuf *decBuf, NrfSlipDecodeState *state, boo
         break;
     }
 }
+
+size_t SlipDecodeAddBytes(const uint8_t *data, size_t len, MemBuf *decBuf,
+                          NrfSlipDecodeState *state, bool *finished)
+{
+    *finished = false;
+
+    size_t i = 0;
+    while (i < len) {
+        if (*state == NRF_SLIP_STATE_DECODING) {
+            // Copy the run of bytes up to the next special character in one go.
+            size_t runStart = i;
+            while (i < len && data[i] != NRF_SLIP_BYTE_END && data[i] != NRF_SLIP_BYTE_ESC) {
+                ++i;
+            }
+
+            MemBufAppend(decBuf, &data[runStart], i - runStart);
+            if (i == len) {
+                break;
+            }
+        }
+
+        NrfSlipDecodeState prevState = *state;
+        SlipDecodeAddByte(data[i], decBuf, state, finished);
+        ++i;
+
+        if (*finished || (*state == NRF_SLIP_STATE_CLEARING_INVALID_PACKET &&
+                          prevState != NRF_SLIP_STATE_CLEARING_INVALID_PACKET)) {
+            break;
+        }
+    }
+
+    return i;
+}
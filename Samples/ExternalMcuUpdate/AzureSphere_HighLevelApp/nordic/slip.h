@@ -58,3 +58,21 @@ void SlipEncodeAddEndMarker(MemBuf *encBuf);
 /// <param name="finished">Set to true if reached end of packet, false otherwise.</param>
 /// </summary>
 void SlipDecodeAddByte(uint8_t b, MemBuf *decBuf, NrfSlipDecodeState *state, bool *finished);
+
+/// <summary>
+/// <para>Process a span of SLIP-encoded bytes and add them to the buffer which
+/// contains decoded data. Runs of bytes which do not need to be decoded are
+/// copied into the buffer in one operation.</para>
+/// <para>Decoding stops after the end-of-packet marker, or after an invalid escape
+/// sequence moves the state to NRF_SLIP_STATE_CLEARING_INVALID_PACKET. Any bytes
+/// which follow are not consumed.</para>
+/// <param name="data">Start of encoded data to process.</param>
+/// <param name="len">Length of encoded data in bytes.</param>
+/// <param name="decBuf">Buffer which contains decoded data.</param>
+/// <param name="state">Keeps track of whether in escaped sequence or
+/// processing invalid data.</param>
+/// <param name="finished">Set to true if reached end of packet, false otherwise.</param>
+/// <returns>Number of encoded bytes which were consumed.</returns>
+/// </summary>
+size_t SlipDecodeAddBytes(const uint8_t *data, size_t len, MemBuf *decBuf,
+                          NrfSlipDecodeState *state, bool *finished);
@@ -0,0 +1,12 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/log.h when the sample is built on a PC. Each test
+// program defines Log_Debug and Log_DebugVarArgs.
+
+#pragma once
+
+#include <stdarg.h>
+
+int Log_Debug(const char *fmt, ...);
+int Log_DebugVarArgs(const char *fmt, va_list args);
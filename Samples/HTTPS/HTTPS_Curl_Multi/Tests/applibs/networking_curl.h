@@ -0,0 +1,11 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/networking_curl.h when the sample is built on a PC. The
+// tests bypass the proxy, so each test program defines Networking_Curl_SetDefaultProxy to fail.
+
+#pragma once
+
+#include <curl/curl.h>
+
+int Networking_Curl_SetDefaultProxy(CURL *curlHandle);
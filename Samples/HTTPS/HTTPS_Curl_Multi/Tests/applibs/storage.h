@@ -0,0 +1,10 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/storage.h when the sample is built on a PC. Each test
+// program defines these functions to use ordinary files.
+
+#pragma once
+
+char *Storage_GetAbsolutePathInImagePackage(const char *relativePath);
+int Storage_OpenMutableFile(void);
@@ -0,0 +1,114 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Implements the subset of applibs/eventloop.h which the sample uses, with epoll, so that its
+// timers and cURL sockets can run on a Linux PC. Events are level-triggered, as on the device.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+
+#include <applibs/eventloop.h>
+
+struct EventLoop {
+    int epollFd;
+};
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+};
+
+static uint32_t ToEpollEvents(EventLoop_IoEvents events)
+{
+    return ((events & EventLoop_Input) ? EPOLLIN : 0u) |
+           ((events & EventLoop_Output) ? EPOLLOUT : 0u);
+}
+
+static EventLoop_IoEvents FromEpollEvents(uint32_t events)
+{
+    return ((events & EPOLLIN) ? EventLoop_Input : 0u) |
+           ((events & EPOLLOUT) ? EventLoop_Output : 0u) |
+           ((events & (EPOLLERR | EPOLLHUP)) ? EventLoop_Error : 0u);
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *el = malloc(sizeof(*el));
+    if (el == NULL) {
+        return NULL;
+    }
+
+    el->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (el->epollFd == -1) {
+        free(el);
+        return NULL;
+    }
+    return el;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (el != NULL) {
+        close(el->epollFd);
+        free(el);
+    }
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event)
+{
+    struct epoll_event events[16];
+    int maxEvents = process_one_event ? 1 : (int)(sizeof(events) / sizeof(events[0]));
+    int count = epoll_wait(el->epollFd, events, maxEvents, duration_in_milliseconds);
+    if (count == -1) {
+        return (errno == EINTR) ? EventLoop_Run_Finished : EventLoop_Run_Failed;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        EventRegistration *reg = events[i].data.ptr;
+        reg->callback(el, reg->fd, FromEpollEvents(events[i].events), reg->context);
+    }
+
+    return (count == 0) ? EventLoop_Run_FinishedEmpty : EventLoop_Run_Finished;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context)
+{
+    EventRegistration *reg = malloc(sizeof(*reg));
+    if (reg == NULL) {
+        return NULL;
+    }
+    reg->fd = fd;
+    reg->callback = callback;
+    reg->context = context;
+
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        free(reg);
+        return NULL;
+    }
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask)
+{
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    return epoll_ctl(el->epollFd, EPOLL_CTL_MOD, reg->fd, &event);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (reg == NULL) {
+        return 0;
+    }
+
+    int result = epoll_ctl(el->epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+    free(reg);
+    return result;
+}
@@ -0,0 +1,340 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test and benchmark for the timer wheel in eventloop_timer_utilities.c, which run on a Linux PC
+// with the epoll event loop in eventloop_epoll.c. Every sample has an identical copy of the file,
+// so this one stands for them all. The test wraps timerfd_create and timerfd_settime at link
+// time, to count them, and counts a wakeup for each call to EventLoop_Run which handles an event.
+// EventLoop_Run is called as the samples call it, to process one event at a time.
+//
+// The test checks that the timers on an event loop share one timerfd, that timers which expire in
+// the same tick are handled with one wakeup, and that a handler can dispose of a timer which has
+// expired but not been handled yet. The benchmark runs 1000 timers for 3 seconds: half of them
+// periodic, and half one-shot timers which their handlers arm again, with random delays from 10 to
+// 200 ms. Handlers sometimes change the period of another timer. It checks that no timer expires
+// early or is missed, and reports the timerfds, wakeups and timerfd_settime calls.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sys/timerfd.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/log.h>
+
+#include "eventloop_timer_utilities.h"
+
+#define SAME_TICK_TIMERS 100
+#define BENCHMARK_TIMERS 1000
+#define BENCHMARK_SECONDS 3
+#define MIN_DELAY_MS 10
+#define MAX_DELAY_MS 200
+// A timer which has not expired this long after it was due has been missed.
+#define MISSED_NS (100 * 1000000LL)
+
+typedef struct {
+    EventLoopTimer *timer;
+    bool isPeriodic;
+    // For a periodic timer, when it was armed and its period; the nth expiry must not come
+    // before armedAt + n * period. For a one-shot timer, when it is due, or 0 if it is disarmed.
+    int64_t armedAt;
+    int64_t period;
+    int64_t due;
+    unsigned expiries;
+} BenchmarkTimer;
+
+static unsigned long timerFdsCreated = 0;
+static unsigned long timerFdSettings = 0;
+
+static EventLoop *eventLoop = NULL;
+static BenchmarkTimer timers[BENCHMARK_TIMERS];
+static size_t handledTimers = 0;
+static EventLoopTimer *disposingTimers[2];
+
+static unsigned long earlyExpiries = 0;
+static int64_t maxLateness = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = Log_DebugVarArgs(fmt, args);
+    va_end(args);
+    return result;
+}
+
+int Log_DebugVarArgs(const char *fmt, va_list args)
+{
+    return vprintf(fmt, args);
+}
+
+int __real_timerfd_create(int clockid, int flags);
+int __wrap_timerfd_create(int clockid, int flags)
+{
+    ++timerFdsCreated;
+    return __real_timerfd_create(clockid, flags);
+}
+
+int __real_timerfd_settime(int fd, int flags, const struct itimerspec *newValue,
+                           struct itimerspec *oldValue);
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec *newValue,
+                           struct itimerspec *oldValue)
+{
+    ++timerFdSettings;
+    return __real_timerfd_settime(fd, flags, newValue, oldValue);
+}
+
+static int64_t GetNowNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct timespec NanosecondsToTimespec(int64_t ns)
+{
+    return (struct timespec){.tv_sec = (time_t)(ns / 1000000000),
+                             .tv_nsec = (long)(ns % 1000000000)};
+}
+
+// Runs the event loop until handledTimers reaches target, and returns the number of wakeups.
+static unsigned long RunUntilHandled(size_t target)
+{
+    unsigned long wakeups = 0;
+    int64_t deadline = GetNowNanoseconds() + 1000000000;
+    while (handledTimers < target && GetNowNanoseconds() < deadline) {
+        if (EventLoop_Run(eventLoop, 100, true) == EventLoop_Run_Finished) {
+            ++wakeups;
+        }
+    }
+    return wakeups;
+}
+
+static void CountHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEvent(timer);
+    ++handledTimers;
+}
+
+// Timers on one event loop share a timerfd, which is closed with the last of them.
+static void TestSharedTimerFd(void)
+{
+    timerFdsCreated = 0;
+    static EventLoopTimer *created[BENCHMARK_TIMERS];
+    for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+        created[i] = CreateEventLoopDisarmedTimer(eventLoop, CountHandler);
+    }
+    if (timerFdsCreated != 1) {
+        Fail("TestSharedTimerFd", "wrong number of timerfds", (long)timerFdsCreated);
+    }
+    for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+        DisposeEventLoopTimer(created[i]);
+    }
+
+    EventLoopTimer *timer = CreateEventLoopDisarmedTimer(eventLoop, CountHandler);
+    if (timerFdsCreated != 2) {
+        Fail("TestSharedTimerFd", "timerfd was not closed", (long)timerFdsCreated);
+    }
+    DisposeEventLoopTimer(timer);
+}
+
+// Timers which are armed together with the same delay expire in the same tick.
+static void TestSameTickOneWakeup(void)
+{
+    EventLoopTimer *sameTick[SAME_TICK_TIMERS];
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 20 * 1000000};
+    for (size_t i = 0; i < SAME_TICK_TIMERS; ++i) {
+        sameTick[i] = CreateEventLoopDisarmedTimer(eventLoop, CountHandler);
+        SetEventLoopTimerOneShot(sameTick[i], &delay);
+    }
+
+    handledTimers = 0;
+    unsigned long wakeups = RunUntilHandled(SAME_TICK_TIMERS);
+    if (handledTimers != SAME_TICK_TIMERS || wakeups != 1) {
+        Fail("TestSameTickOneWakeup", "wrong number of wakeups", (long)wakeups);
+    }
+
+    for (size_t i = 0; i < SAME_TICK_TIMERS; ++i) {
+        DisposeEventLoopTimer(sameTick[i]);
+    }
+}
+
+// Disposes of the other timer in disposingTimers, and then of its own.
+static void DisposingHandler(EventLoopTimer *timer)
+{
+    ++handledTimers;
+    for (size_t i = 0; i < 2; ++i) {
+        if (disposingTimers[i] != timer) {
+            DisposeEventLoopTimer(disposingTimers[i]);
+        }
+        disposingTimers[i] = NULL;
+    }
+    DisposeEventLoopTimer(timer);
+}
+
+// A handler can dispose of its own timer, and of a timer which expired in the same tick, whose
+// handler is then not called.
+static void TestDisposeInHandler(void)
+{
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 5 * 1000000};
+    for (size_t i = 0; i < 2; ++i) {
+        disposingTimers[i] = CreateEventLoopDisarmedTimer(eventLoop, DisposingHandler);
+        SetEventLoopTimerOneShot(disposingTimers[i], &delay);
+    }
+
+    handledTimers = 0;
+    RunUntilHandled(2);
+    if (handledTimers != 1) {
+        Fail("TestDisposeInHandler", "disposed timer was handled", (long)handledTimers);
+    }
+}
+
+static int64_t GetRandomDelay(void)
+{
+    return (MIN_DELAY_MS + rand() % (MAX_DELAY_MS - MIN_DELAY_MS + 1)) * 1000000LL +
+           rand() % 1000000;
+}
+
+static void ArmBenchmarkTimer(BenchmarkTimer *timer)
+{
+    int64_t delay = GetRandomDelay();
+    struct timespec delaySpec = NanosecondsToTimespec(delay);
+    if (timer->isPeriodic) {
+        timer->armedAt = GetNowNanoseconds();
+        timer->period = delay;
+        timer->expiries = 0;
+        SetEventLoopTimerPeriod(timer->timer, &delaySpec);
+    } else {
+        timer->due = GetNowNanoseconds() + delay;
+        SetEventLoopTimerOneShot(timer->timer, &delaySpec);
+    }
+}
+
+static void BenchmarkHandler(EventLoopTimer *eventLoopTimer)
+{
+    ConsumeEventLoopTimerEvent(eventLoopTimer);
+    int64_t now = GetNowNanoseconds();
+    ++handledTimers;
+
+    BenchmarkTimer *timer = NULL;
+    for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+        if (timers[i].timer == eventLoopTimer) {
+            timer = &timers[i];
+            break;
+        }
+    }
+    if (timer == NULL) {
+        Fail("BenchmarkHandler", "unknown timer", 0);
+        return;
+    }
+
+    if (timer->isPeriodic) {
+        ++timer->expiries;
+        if (now < timer->armedAt + (int64_t)timer->expiries * timer->period) {
+            ++earlyExpiries;
+        }
+    } else {
+        if (timer->due == 0 || now < timer->due) {
+            ++earlyExpiries;
+        }
+        if (now - timer->due > maxLateness) {
+            maxLateness = now - timer->due;
+        }
+        ArmBenchmarkTimer(timer);
+    }
+
+    // Sometimes change the period of another timer.
+    if (rand() % 10 == 0) {
+        BenchmarkTimer *other = &timers[rand() % BENCHMARK_TIMERS];
+        if (other->isPeriodic) {
+            ArmBenchmarkTimer(other);
+        }
+    }
+}
+
+static void BenchmarkMixedTimers(void)
+{
+    srand(1);
+    timerFdsCreated = 0;
+    timerFdSettings = 0;
+    for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+        timers[i].timer = CreateEventLoopDisarmedTimer(eventLoop, BenchmarkHandler);
+        timers[i].isPeriodic = (i % 2 == 0);
+        ArmBenchmarkTimer(&timers[i]);
+    }
+
+    handledTimers = 0;
+    unsigned long wakeups = 0;
+    size_t missedTimer = BENCHMARK_TIMERS;
+    int64_t end = GetNowNanoseconds() + BENCHMARK_SECONDS * 1000000000LL;
+    while (GetNowNanoseconds() < end && missedTimer == BENCHMARK_TIMERS) {
+        if (EventLoop_Run(eventLoop, 100, true) == EventLoop_Run_Finished) {
+            ++wakeups;
+        }
+
+        int64_t now = GetNowNanoseconds();
+        for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+            if (!timers[i].isPeriodic && now - timers[i].due > MISSED_NS) {
+                missedTimer = i;
+            }
+        }
+    }
+
+    printf("%d timers for %d s: %lu timerfds, %zu expiries, %lu wakeups, %lu timerfd_settime "
+           "calls, %.1f ms maximum lateness\n",
+           BENCHMARK_TIMERS, BENCHMARK_SECONDS, timerFdsCreated, handledTimers, wakeups,
+           timerFdSettings, (double)maxLateness / 1e6);
+
+    if (missedTimer != BENCHMARK_TIMERS) {
+        Fail("BenchmarkMixedTimers", "timer was missed", (long)missedTimer);
+    }
+    if (earlyExpiries != 0) {
+        Fail("BenchmarkMixedTimers", "timers expired early", (long)earlyExpiries);
+    }
+    if (timerFdsCreated != 1) {
+        Fail("BenchmarkMixedTimers", "timers did not share a timerfd", (long)timerFdsCreated);
+    }
+
+    for (size_t i = 0; i < BENCHMARK_TIMERS; ++i) {
+        DisposeEventLoopTimer(timers[i].timer);
+    }
+}
+
+int main(void)
+{
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        printf("ERROR: Could not create the event loop.\n");
+        return EXIT_FAILURE;
+    }
+
+    TestSharedTimerFd();
+    TestSameTickOneWakeup();
+    TestDisposeInHandler();
+    BenchmarkMixedTimers();
+
+    EventLoop_Close(eventLoop);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for response_sink.c, which runs on a Linux PC. Data is written to each sink in chunks of
+// the sizes which cURL passes to a write callback.
+//
+// The buffer sink receives a multi-megabyte response, and the test reports its allocations, the
+// bytes it copied and its peak heap use. It checks that the buffer grows geometrically, that it
+// is reused by the next transfer, and that a response over the limit fails the transfer. The
+// ring sink receives random streams of lines in random chunk sizes, through a ring smaller than
+// the chunks, with a consumer which only takes whole lines; every stream must be reassembled
+// intact. The mutable storage sink writes to a temporary file, which each transfer replaces.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "response_sink.h"
+
+// cURL passes at most CURL_MAX_WRITE_SIZE bytes to a write callback.
+#define CHUNK_SIZE 16384
+#define LARGE_RESPONSE_SIZE (4u * 1024 * 1024)
+
+#define RING_CAPACITY 64
+#define LINE_STREAMS 20000
+#define MAX_LINES 40
+#define MAX_STREAM_SIZE (MAX_LINES * RING_CAPACITY)
+#define MAX_WRITE_SIZE 100
+
+static int storageFd = -1;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+// The sinks log the errors which the test provokes on purpose.
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Log_DebugVarArgs(const char *fmt, va_list args)
+{
+    return 0;
+}
+
+char *Storage_GetAbsolutePathInImagePackage(const char *relativePath)
+{
+    return NULL;
+}
+
+int Storage_OpenMutableFile(void)
+{
+    char path[] = "/tmp/response_sink_test_XXXXXX";
+    storageFd = mkstemp(path);
+    if (storageFd != -1) {
+        unlink(path);
+    }
+    return storageFd;
+}
+
+static uint8_t GetResponseByte(size_t index)
+{
+    return (uint8_t)(index * 31 + (index >> 11));
+}
+
+// Writes size bytes of the test response to the sink in chunks, and returns false if the sink
+// did not accept all of them.
+static bool WriteResponse(ResponseSink *sink, size_t size)
+{
+    static uint8_t chunk[CHUNK_SIZE];
+    for (size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+        size_t chunkSize = (size - offset < CHUNK_SIZE) ? size - offset : CHUNK_SIZE;
+        for (size_t i = 0; i < chunkSize; ++i) {
+            chunk[i] = GetResponseByte(offset + i);
+        }
+        if (ResponseSink_Write(sink, chunk, chunkSize) != chunkSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool IsResponseValid(const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != GetResponseByte(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A large response needs a logarithmic number of allocations and less than twice its size in
+// heap. The sink counts each reallocation as moving the data, so it copies less than three times
+// the size of the response. The next transfer reuses the buffer, and a response over the limit
+// fails.
+static void TestBufferSink(void)
+{
+    ResponseSink_Buffer buffer;
+    ResponseSink_InitBuffer(&buffer, LARGE_RESPONSE_SIZE);
+
+    ResponseSink_Begin(&buffer.base);
+    if (!WriteResponse(&buffer.base, LARGE_RESPONSE_SIZE) || !ResponseSink_End(&buffer.base)) {
+        Fail("TestBufferSink", "large response failed", (long)buffer.size);
+    } else if (buffer.size != LARGE_RESPONSE_SIZE || buffer.data[buffer.size] != 0 ||
+               !IsResponseValid(buffer.data, buffer.size)) {
+        Fail("TestBufferSink", "wrong response", (long)buffer.size);
+    }
+
+    const ResponseSinkStats *stats = &buffer.base.stats;
+    printf("buffer sink, %u byte response in %u byte chunks: %zu allocations, %zu bytes copied, "
+           "%zu bytes peak heap\n",
+           LARGE_RESPONSE_SIZE, CHUNK_SIZE, stats->allocations, stats->bytesCopied,
+           stats->peakHeapBytes);
+    if (stats->allocations > 16) {
+        Fail("TestBufferSink", "buffer did not grow geometrically", (long)stats->allocations);
+    }
+    if (stats->bytesCopied > 3 * (size_t)LARGE_RESPONSE_SIZE) {
+        Fail("TestBufferSink", "too many bytes copied", (long)stats->bytesCopied);
+    }
+    if (stats->peakHeapBytes > 2 * (size_t)LARGE_RESPONSE_SIZE) {
+        Fail("TestBufferSink", "too much heap", (long)stats->peakHeapBytes);
+    }
+
+    ResponseSink_Begin(&buffer.base);
+    if (!WriteResponse(&buffer.base, LARGE_RESPONSE_SIZE / 2) ||
+        buffer.base.stats.allocations != 0) {
+        Fail("TestBufferSink", "buffer was not reused", (long)buffer.base.stats.allocations);
+    }
+
+    ResponseSink_Begin(&buffer.base);
+    if (WriteResponse(&buffer.base, LARGE_RESPONSE_SIZE + 1)) {
+        Fail("TestBufferSink", "response over the limit was accepted", (long)buffer.size);
+    }
+
+    ResponseSink_Dispose(&buffer.base);
+}
+
+typedef struct {
+    uint8_t output[MAX_STREAM_SIZE];
+    size_t outputSize;
+} LineConsumer;
+
+// Takes whole lines only, as a consumer which parses records would. The last part of the
+// response may end without a newline.
+static size_t ConsumeLines(const uint8_t *data, size_t size, bool final, void *context)
+{
+    LineConsumer *consumer = context;
+    size_t consumed = 0;
+
+    while (consumed < size) {
+        const uint8_t *newline = memchr(data + consumed, '\n', size - consumed);
+        if (newline == NULL && !final) {
+            break;
+        }
+        size_t lineSize =
+            (newline == NULL) ? size - consumed : (size_t)(newline - data) + 1 - consumed;
+        memcpy(consumer->output + consumer->outputSize, data + consumed, lineSize);
+        consumer->outputSize += lineSize;
+        consumed += lineSize;
+    }
+
+    return consumed;
+}
+
+// Each line is shorter than the ring, but lines straddle the end of the ring often, so the
+// consumer must be offered them contiguously.
+static void TestRingLineStreams(void)
+{
+    static uint8_t input[MAX_STREAM_SIZE];
+    static LineConsumer consumer;
+    uint8_t storage[RING_CAPACITY];
+    ResponseSink_Ring ring;
+    ResponseSink_InitRing(&ring, storage, sizeof(storage), ConsumeLines, &consumer);
+
+    unsigned failedStreams = 0;
+    size_t bytesCopied = 0;
+    size_t totalSize = 0;
+    srand(1);
+    for (unsigned stream = 0; stream < LINE_STREAMS; ++stream) {
+        size_t inputSize = 0;
+        int lines = rand() % MAX_LINES;
+        for (int line = 0; line < lines; ++line) {
+            int lineSize = rand() % (RING_CAPACITY - 1);
+            for (int i = 0; i < lineSize; ++i) {
+                input[inputSize++] = (uint8_t)('a' + rand() % 26);
+            }
+            input[inputSize++] = '\n';
+        }
+
+        consumer.outputSize = 0;
+        ResponseSink_Begin(&ring.base);
+        bool succeeded = true;
+        for (size_t offset = 0; offset < inputSize && succeeded;) {
+            size_t size = 1 + (size_t)rand() % MAX_WRITE_SIZE;
+            if (size > inputSize - offset) {
+                size = inputSize - offset;
+            }
+            succeeded = ResponseSink_Write(&ring.base, input + offset, size) == size;
+            offset += size;
+        }
+        succeeded = succeeded && ResponseSink_End(&ring.base);
+
+        if (!succeeded || consumer.outputSize != inputSize ||
+            memcmp(consumer.output, input, inputSize) != 0) {
+            ++failedStreams;
+        }
+        bytesCopied += ring.base.stats.bytesCopied;
+        totalSize += inputSize;
+    }
+
+    printf("ring sink, %d line streams through a %d byte ring: %u failed, %.2f bytes copied per "
+           "byte\n",
+           LINE_STREAMS, RING_CAPACITY, failedStreams, (double)bytesCopied / (double)totalSize);
+    if (failedStreams != 0) {
+        Fail("TestRingLineStreams", "streams were not reassembled", (long)failedStreams);
+    }
+
+    // A line which does not fit in the ring fails the transfer.
+    memset(input, 'a', 2 * RING_CAPACITY);
+    ResponseSink_Begin(&ring.base);
+    if (ResponseSink_Write(&ring.base, input, 2 * RING_CAPACITY) == 2 * RING_CAPACITY) {
+        Fail("TestRingLineStreams", "line longer than the ring was accepted", 0);
+    }
+}
+
+// Each transfer replaces the file, and a response over the limit fails.
+static void TestMutableStorageSink(void)
+{
+    ResponseSink_MutableStorage storage;
+    ResponseSink_InitMutableStorage(&storage, 2 * CHUNK_SIZE);
+
+    for (size_t size = 2 * CHUNK_SIZE; size >= CHUNK_SIZE / 2; size /= 2) {
+        if (!ResponseSink_Begin(&storage.base) || !WriteResponse(&storage.base, size) ||
+            !ResponseSink_End(&storage.base)) {
+            Fail("TestMutableStorageSink", "response failed", (long)size);
+            break;
+        }
+
+        static uint8_t contents[2 * CHUNK_SIZE + 1];
+        struct stat status;
+        if (fstat(storageFd, &status) == -1 || (size_t)status.st_size != size ||
+            pread(storageFd, contents, sizeof(contents), 0) != (ssize_t)size ||
+            !IsResponseValid(contents, size)) {
+            Fail("TestMutableStorageSink", "wrong file contents", (long)size);
+        }
+    }
+
+    ResponseSink_Begin(&storage.base);
+    if (WriteResponse(&storage.base, 2 * CHUNK_SIZE + 1)) {
+        Fail("TestMutableStorageSink", "response over the limit was accepted", 0);
+    }
+
+    ResponseSink_Dispose(&storage.base);
+}
+
+int main(void)
+{
+    TestBufferSink();
+    TestRingLineStreams();
+    TestMutableStorageSink();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
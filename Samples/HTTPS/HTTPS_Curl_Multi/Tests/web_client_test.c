@@ -0,0 +1,450 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for web_client.c, which runs the sample's transfers on a Linux PC against a local HTTPS
+// server. The server runs in this program with OpenSSL, and its self-signed certificate for
+// httpstat.us replaces the DigiCert root in the image package. It answers /<status>?sleep=<ms>
+// as httpstat.us does, but sleeps for a hundredth of the time. Each transfer is sent to it with
+// CURLOPT_CONNECT_TO, which the test sets by wrapping curl_multi_add_handle at link time. The
+// test also wraps curl_multi_info_read, to record the timings of each completed transfer.
+//
+// The test runs six rounds of the sample's transfers through the event loop. In the fourth round
+// the server closes each connection after its response, so later rounds must open new ones. It
+// reports the new connections, TLS handshakes and mean times of each round, and checks that:
+//   - no more than two connections to the server are open at once;
+//   - rounds after the first reuse their connections, unless the server closed them;
+//   - new connections after the first round resume a TLS session rather than starting a new one.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <curl/curl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/log.h>
+#include <applibs/networking_curl.h>
+#include <applibs/storage.h>
+
+#include "web_client.h"
+
+// The sample's transfers, and the number of connections which it opens to one host at once.
+#define TRANSFERS_PER_ROUND 3
+#define MAX_HOST_CONNECTIONS 2
+
+// Each ?sleep= value is divided by this, so a round takes tens of milliseconds.
+#define SLEEP_DIVISOR 100
+
+typedef struct {
+    const char *description;
+    // The server closes each connection after its response.
+    bool closeConnections;
+} Round;
+
+typedef struct {
+    unsigned transfers;
+    unsigned failedTransfers;
+    long newConnections;
+    curl_off_t connectTime;
+    curl_off_t tlsTime;
+    curl_off_t firstByteTime;
+    curl_off_t totalTime;
+} RoundStats;
+
+static const Round rounds[] = {{"cold", false},      {"keep-alive", false},
+                               {"keep-alive", false}, {"server closes", true},
+                               {"after close", false}, {"keep-alive", false}};
+
+static char caPath[] = "/tmp/web_client_test_ca_XXXXXX";
+static struct curl_slist *connectTo = NULL;
+
+static SSL_CTX *serverContext = NULL;
+static int listenFd = -1;
+static volatile bool closeConnections = false;
+static unsigned long fullHandshakes = 0;
+static unsigned long resumedHandshakes = 0;
+static unsigned long openConnections = 0;
+static unsigned long maxOpenConnections = 0;
+
+static RoundStats roundStats;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Log_DebugVarArgs(const char *fmt, va_list args)
+{
+    return 0;
+}
+
+char *Storage_GetAbsolutePathInImagePackage(const char *relativePath)
+{
+    return strdup(caPath);
+}
+
+int Storage_OpenMutableFile(void)
+{
+    char path[] = "/tmp/web_client_test_storage_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1) {
+        unlink(path);
+    }
+    return fd;
+}
+
+int Networking_Curl_SetDefaultProxy(CURL *curlHandle)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+// Sends every transfer to the local server.
+CURLMcode __real_curl_multi_add_handle(CURLM *multi, CURL *easy);
+CURLMcode __wrap_curl_multi_add_handle(CURLM *multi, CURL *easy)
+{
+    curl_easy_setopt(easy, CURLOPT_CONNECT_TO, connectTo);
+    return __real_curl_multi_add_handle(multi, easy);
+}
+
+// Records the result and timings of each completed transfer, before the sample handles it.
+CURLMsg *__real_curl_multi_info_read(CURLM *multi, int *messagesInQueue);
+CURLMsg *__wrap_curl_multi_info_read(CURLM *multi, int *messagesInQueue)
+{
+    CURLMsg *message = __real_curl_multi_info_read(multi, messagesInQueue);
+    if (message == NULL || message->msg != CURLMSG_DONE) {
+        return message;
+    }
+
+    CURL *easy = message->easy_handle;
+    char *url = NULL;
+    long responseCode = 0;
+    long newConnections = 0;
+    curl_off_t connectTime = 0, tlsTime = 0, firstByteTime = 0, totalTime = 0;
+    curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &responseCode);
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &newConnections);
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connectTime);
+    curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &tlsTime);
+    curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &firstByteTime);
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &totalTime);
+
+    // Each URL asks for the status code which follows the host name.
+    const char *path = (url != NULL) ? strstr(url, ".us/") : NULL;
+    if (message->data.result != CURLE_OK || path == NULL || atol(path + 4) != responseCode) {
+        Fail("CompletedTransfer", "transfer failed", (long)message->data.result);
+        ++roundStats.failedTransfers;
+    }
+
+    ++roundStats.transfers;
+    roundStats.newConnections += newConnections;
+    roundStats.connectTime += connectTime;
+    roundStats.tlsTime += tlsTime;
+    roundStats.firstByteTime += firstByteTime;
+    roundStats.totalTime += totalTime;
+    return message;
+}
+
+static const char *GetReasonPhrase(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    default:
+        return "Unknown";
+    }
+}
+
+// Answers requests on one connection until the client closes it, or the server is set to close
+// connections after each response.
+static void ServeRequests(SSL *ssl)
+{
+    char request[2048];
+    size_t length = 0;
+
+    for (;;) {
+        int result = SSL_read(ssl, request + length, (int)(sizeof(request) - 1 - length));
+        if (result <= 0) {
+            return;
+        }
+        length += (size_t)result;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") == NULL) {
+            if (length == sizeof(request) - 1) {
+                return;
+            }
+            continue;
+        }
+
+        int status = 0;
+        sscanf(request, "GET /%d", &status);
+        const char *sleepParameter = strstr(request, "sleep=");
+        if (sleepParameter != NULL) {
+            usleep((useconds_t)atoi(sleepParameter + 6) * 1000 / SLEEP_DIVISOR);
+        }
+
+        bool closeAfterResponse = closeConnections;
+        char body[64];
+        char response[256];
+        int bodyLength = snprintf(body, sizeof(body), "%d %s", status, GetReasonPhrase(status));
+        int responseLength = snprintf(response, sizeof(response),
+                                      "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\n"
+                                      "Content-Length: %d\r\n%s\r\n%s",
+                                      status, GetReasonPhrase(status), bodyLength,
+                                      closeAfterResponse ? "Connection: close\r\n" : "", body);
+        if (SSL_write(ssl, response, responseLength) <= 0 || closeAfterResponse) {
+            return;
+        }
+        length = 0;
+    }
+}
+
+static void *ConnectionThread(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    unsigned long open = __atomic_add_fetch(&openConnections, 1, __ATOMIC_SEQ_CST);
+    unsigned long max = __atomic_load_n(&maxOpenConnections, __ATOMIC_SEQ_CST);
+    while (open > max && !__atomic_compare_exchange_n(&maxOpenConnections, &max, open, false,
+                                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+
+    SSL *ssl = SSL_new(serverContext);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+        __atomic_add_fetch(SSL_session_reused(ssl) ? &resumedHandshakes : &fullHandshakes, 1,
+                           __ATOMIC_SEQ_CST);
+        ServeRequests(ssl);
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+
+    // The connection is counted as closed before the client can see it close.
+    __atomic_sub_fetch(&openConnections, 1, __ATOMIC_SEQ_CST);
+    close(fd);
+    return NULL;
+}
+
+static void *AcceptThread(void *arg)
+{
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd == -1) {
+            return NULL;
+        }
+
+        pthread_t thread;
+        pthread_create(&thread, NULL, ConnectionThread, (void *)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+}
+
+// Creates a self-signed certificate for httpstat.us, and saves it where the sample looks for its
+// CA certificate.
+static bool CreateCertificate(EVP_PKEY **key, X509 **certificate)
+{
+    *key = EVP_EC_gen("P-256");
+    *certificate = X509_new();
+    X509 *cert = *certificate;
+    if (*key == NULL || cert == NULL) {
+        return false;
+    }
+
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, *key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"httpstat.us", -1,
+                               -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    X509V3_CTX context;
+    X509V3_set_ctx_nodb(&context);
+    X509V3_set_ctx(&context, cert, cert, NULL, NULL, 0);
+    static const struct {
+        int nid;
+        const char *value;
+    } extensions[] = {{NID_subject_alt_name, "DNS:httpstat.us"},
+                      {NID_basic_constraints, "critical,CA:TRUE"}};
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        X509_EXTENSION *extension =
+            X509V3_EXT_conf_nid(NULL, &context, extensions[i].nid, extensions[i].value);
+        if (extension == NULL) {
+            return false;
+        }
+        X509_add_ext(cert, extension, -1);
+        X509_EXTENSION_free(extension);
+    }
+    if (X509_sign(cert, *key, EVP_sha256()) == 0) {
+        return false;
+    }
+
+    int fd = mkstemp(caPath);
+    FILE *file = (fd == -1) ? NULL : fdopen(fd, "w");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = PEM_write_X509(file, cert) == 1;
+    return (fclose(file) == 0) && written;
+}
+
+// Starts the server on a loopback port, and directs the sample's transfers to it.
+static bool StartServer(void)
+{
+    EVP_PKEY *key;
+    X509 *certificate;
+    if (!CreateCertificate(&key, &certificate)) {
+        return false;
+    }
+
+    static const unsigned char sessionIdContext[] = "web_client_test";
+    serverContext = SSL_CTX_new(TLS_server_method());
+    if (serverContext == NULL || SSL_CTX_use_certificate(serverContext, certificate) != 1 ||
+        SSL_CTX_use_PrivateKey(serverContext, key) != 1 ||
+        SSL_CTX_set_session_id_context(serverContext, sessionIdContext,
+                                       sizeof(sessionIdContext) - 1) != 1) {
+        return false;
+    }
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET,
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addressLength = sizeof(address);
+    if (listenFd == -1 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listenFd, 16) != 0 ||
+        getsockname(listenFd, (struct sockaddr *)&address, &addressLength) != 0) {
+        return false;
+    }
+
+    char target[64];
+    snprintf(target, sizeof(target), "httpstat.us:443:127.0.0.1:%u", ntohs(address.sin_port));
+    connectTo = curl_slist_append(NULL, target);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, AcceptThread, NULL) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+static double MeanMilliseconds(curl_off_t total, unsigned count)
+{
+    return (count == 0) ? 0.0 : (double)total / count / 1000.0;
+}
+
+// Runs one round of the sample's transfers, and checks how many connections it opened.
+static void RunRound(EventLoop *eventLoop, size_t index)
+{
+    const Round *round = &rounds[index];
+    closeConnections = round->closeConnections;
+    roundStats = (RoundStats){0};
+    unsigned long fullBefore = __atomic_load_n(&fullHandshakes, __ATOMIC_SEQ_CST);
+    unsigned long resumedBefore = __atomic_load_n(&resumedHandshakes, __ATOMIC_SEQ_CST);
+
+    if (WebClient_StartTransfers() != 0) {
+        Fail("RunRound", "could not start transfers", (long)index);
+        return;
+    }
+
+    time_t deadline = time(NULL) + 10;
+    while (roundStats.transfers < TRANSFERS_PER_ROUND && time(NULL) < deadline) {
+        if (EventLoop_Run(eventLoop, 100, true) == EventLoop_Run_Failed) {
+            Fail("RunRound", "event loop failed", errno);
+            return;
+        }
+    }
+    if (roundStats.transfers < TRANSFERS_PER_ROUND) {
+        Fail("RunRound", "transfers did not complete", (long)index);
+        return;
+    }
+
+    unsigned long full = __atomic_load_n(&fullHandshakes, __ATOMIC_SEQ_CST) - fullBefore;
+    unsigned long resumed = __atomic_load_n(&resumedHandshakes, __ATOMIC_SEQ_CST) - resumedBefore;
+    printf("%-5zu %-14s %9ld %9lu %9lu %10.2f %10.2f %10.2f %10.2f\n", index + 1,
+           round->description, roundStats.newConnections, full, resumed,
+           MeanMilliseconds(roundStats.connectTime, roundStats.transfers),
+           MeanMilliseconds(roundStats.tlsTime, roundStats.transfers),
+           MeanMilliseconds(roundStats.firstByteTime, roundStats.transfers),
+           MeanMilliseconds(roundStats.totalTime, roundStats.transfers));
+
+    if ((unsigned long)roundStats.newConnections != full + resumed) {
+        Fail("RunRound", "new connections and handshakes differ", roundStats.newConnections);
+    }
+    if (index > 0 && full != 0) {
+        Fail("RunRound", "TLS session was not resumed", (long)index);
+    }
+    if (index > 0 && !rounds[index - 1].closeConnections && !round->closeConnections &&
+        roundStats.newConnections != 0) {
+        Fail("RunRound", "connections were not reused", (long)index);
+    }
+}
+
+int main(void)
+{
+    if (!StartServer()) {
+        printf("ERROR: Could not start the HTTPS server.\n");
+        ERR_print_errors_fp(stdout);
+        return EXIT_FAILURE;
+    }
+
+    EventLoop *eventLoop = EventLoop_Create();
+    if (eventLoop == NULL || WebClient_Init(eventLoop, true) != ExitCode_Success) {
+        printf("ERROR: Could not initialize the web client.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-5s %-14s %9s %9s %9s %10s %10s %10s %10s\n", "round", "server", "new conns",
+           "full TLS", "resumed", "connect ms", "TLS ms", "1st byte", "total ms");
+    for (size_t i = 0; i < sizeof(rounds) / sizeof(rounds[0]); ++i) {
+        RunRound(eventLoop, i);
+    }
+
+    if (maxOpenConnections > MAX_HOST_CONNECTIONS) {
+        Fail("main", "too many connections to one host", (long)maxOpenConnections);
+    }
+
+    WebClient_Fini();
+    EventLoop_Close(eventLoop);
+    shutdown(listenFd, SHUT_RDWR);
+    unlink(caPath);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
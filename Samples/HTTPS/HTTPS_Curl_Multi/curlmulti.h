@@ -43,5 +43,12 @@ typedef enum {
     ExitCode_CurlSetupEasy_StoragePath = 22,
     ExitCode_CurlSetupEasy_CAInfo = 23,
     ExitCode_CurlSetupEasy_Verbose = 24,
-    ExitCode_CurlSetupEasy_CurlSetDefaultProxy = 25
+    ExitCode_CurlSetupEasy_CurlSetDefaultProxy = 25,
+    ExitCode_CurlSetupEasy_OptShare = 26,
+
+    ExitCode_CurlInit_ShareInit = 27,
+    ExitCode_CurlInit_ShareSetOptDns = 28,
+    ExitCode_CurlInit_ShareSetOptSslSession = 29,
+    ExitCode_CurlInit_MultiSetOptMaxHostConnections = 30,
+    ExitCode_CurlInit_MultiSetOptMaxConnects = 31
 } ExitCode;
@@ -0,0 +1,370 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// applibs_versions.h defines the API struct versions to use for applibs APIs.
+#include "applibs_versions.h"
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "log_utils.h"
+#include "response_sink.h"
+
+// Smallest buffer which a buffer sink allocates. The buffer doubles in size from here.
+static const size_t minBufferCapacity = 256;
+
+static bool BufferBegin(ResponseSink *sink);
+static size_t BufferWrite(ResponseSink *sink, const uint8_t *data, size_t size);
+static bool BufferEnd(ResponseSink *sink);
+static void BufferDispose(ResponseSink *sink);
+
+static void ReverseBytes(uint8_t *begin, uint8_t *end);
+static void RingRotateToStart(ResponseSink_Ring *ring);
+static size_t RingDrain(ResponseSink_Ring *ring, bool final);
+static bool RingBegin(ResponseSink *sink);
+static size_t RingWrite(ResponseSink *sink, const uint8_t *data, size_t size);
+static bool RingEnd(ResponseSink *sink);
+static void RingDispose(ResponseSink *sink);
+
+static bool StorageBegin(ResponseSink *sink);
+static size_t StorageWrite(ResponseSink *sink, const uint8_t *data, size_t size);
+static bool StorageEnd(ResponseSink *sink);
+static void StorageDispose(ResponseSink *sink);
+
+static bool BufferBegin(ResponseSink *sink)
+{
+    ResponseSink_Buffer *buffer = (ResponseSink_Buffer *)sink;
+    buffer->size = 0;
+
+    // The buffer which was kept from an earlier transfer still counts towards the peak.
+    sink->stats.peakHeapBytes = buffer->capacity;
+    if (buffer->data != NULL) {
+        buffer->data[0] = 0;
+    }
+    return true;
+}
+
+static size_t BufferWrite(ResponseSink *sink, const uint8_t *data, size_t size)
+{
+    ResponseSink_Buffer *buffer = (ResponseSink_Buffer *)sink;
+
+    if (size > buffer->maxSize - buffer->size) {
+        Log_Debug("ERROR: Response is larger than %zu bytes.\n", buffer->maxSize);
+        return 0;
+    }
+
+    // Leave room for the null terminator.
+    size_t required = buffer->size + size + 1;
+    if (required > buffer->capacity) {
+        // Double the capacity, so a response of n bytes needs O(log n) reallocations.
+        size_t newCapacity = (buffer->capacity < minBufferCapacity) ? minBufferCapacity
+                                                                    : buffer->capacity;
+        while (newCapacity < required && newCapacity <= buffer->maxSize / 2) {
+            newCapacity *= 2;
+        }
+        if (newCapacity < required || newCapacity > buffer->maxSize + 1) {
+            newCapacity = buffer->maxSize + 1;
+        }
+
+        uint8_t *newData = realloc(buffer->data, newCapacity);
+        if (newData == NULL) {
+            LogErrno("ERROR: Could not grow the response buffer to %zu bytes", newCapacity);
+            return 0;
+        }
+
+        // realloc may have moved the existing data.
+        sink->stats.bytesCopied += buffer->size;
+        ++sink->stats.allocations;
+        if (newCapacity > sink->stats.peakHeapBytes) {
+            sink->stats.peakHeapBytes = newCapacity;
+        }
+        buffer->data = newData;
+        buffer->capacity = newCapacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    sink->stats.bytesCopied += size;
+    buffer->size += size;
+    buffer->data[buffer->size] = 0;
+    return size;
+}
+
+static bool BufferEnd(ResponseSink *sink)
+{
+    return true;
+}
+
+static void BufferDispose(ResponseSink *sink)
+{
+    ResponseSink_Buffer *buffer = (ResponseSink_Buffer *)sink;
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+void ResponseSink_InitBuffer(ResponseSink_Buffer *sink, size_t maxSize)
+{
+    *sink = (ResponseSink_Buffer){.base = {.begin = BufferBegin,
+                                           .write = BufferWrite,
+                                           .end = BufferEnd,
+                                           .dispose = BufferDispose},
+                                  .maxSize = maxSize};
+}
+
+/// <summary>
+///     Reverses the order of the bytes in the range [begin, end).
+/// </summary>
+static void ReverseBytes(uint8_t *begin, uint8_t *end)
+{
+    while (begin + 1 < end) {
+        uint8_t byte = *begin;
+        *begin++ = *--end;
+        *end = byte;
+    }
+}
+
+/// <summary>
+///     Moves the data in the ring so that it begins at the start of the ring, and so is
+///     contiguous. The ring is rotated in place with three reversals, so no other memory is
+///     needed.
+/// </summary>
+/// <param name="ring">The ring sink.</param>
+static void RingRotateToStart(ResponseSink_Ring *ring)
+{
+    ReverseBytes(ring->ring, ring->ring + ring->readIndex);
+    ReverseBytes(ring->ring + ring->readIndex, ring->ring + ring->capacity);
+    ReverseBytes(ring->ring, ring->ring + ring->capacity);
+
+    ring->base.stats.bytesCopied += ring->capacity;
+    ring->readIndex = 0;
+}
+
+/// <summary>
+///     Offers the data in the ring to the consumer, until the ring is empty or the consumer
+///     stops consuming it.
+/// </summary>
+/// <param name="ring">The ring sink.</param>
+/// <param name="final">true if no more data will be written to the ring; false otherwise.</param>
+/// <returns>The number of bytes which remain in the ring.</returns>
+static size_t RingDrain(ResponseSink_Ring *ring, bool final)
+{
+    while (ring->count > 0) {
+        // Offer the data up to the end of the ring. Data which wraps around is offered next.
+        size_t contiguous = ring->capacity - ring->readIndex;
+        if (contiguous > ring->count) {
+            contiguous = ring->count;
+        }
+        bool wrapped = contiguous < ring->count;
+
+        size_t consumed = ring->consumer(ring->ring + ring->readIndex, contiguous,
+                                         final && !wrapped, ring->context);
+        if (consumed > contiguous) {
+            consumed = contiguous;
+        }
+
+        ring->readIndex = (ring->readIndex + consumed) % ring->capacity;
+        ring->count -= consumed;
+        if (consumed < contiguous) {
+            if (!wrapped) {
+                break;
+            }
+
+            // The consumer is waiting for data which wraps around the end of the ring, such as
+            // a record which straddles it. Move the data to the start of the ring, so that it
+            // is offered again as one part.
+            RingRotateToStart(ring);
+        }
+    }
+
+    if (ring->count == 0) {
+        ring->readIndex = 0;
+    }
+    return ring->count;
+}
+
+static bool RingBegin(ResponseSink *sink)
+{
+    ResponseSink_Ring *ring = (ResponseSink_Ring *)sink;
+    ring->readIndex = 0;
+    ring->count = 0;
+    return true;
+}
+
+static size_t RingWrite(ResponseSink *sink, const uint8_t *data, size_t size)
+{
+    ResponseSink_Ring *ring = (ResponseSink_Ring *)sink;
+    size_t written = 0;
+
+    // Data which is larger than the ring is passed through it in parts.
+    while (written < size) {
+        size_t space = ring->capacity - ring->count;
+        if (space == 0) {
+            Log_Debug("ERROR: The response consumer did not keep up with the transfer.\n");
+            break;
+        }
+
+        size_t part = size - written;
+        if (part > space) {
+            part = space;
+        }
+
+        // Copy the part to the free space, which may wrap around the end of the ring.
+        size_t writeIndex = (ring->readIndex + ring->count) % ring->capacity;
+        size_t firstPart = ring->capacity - writeIndex;
+        if (firstPart > part) {
+            firstPart = part;
+        }
+        memcpy(ring->ring + writeIndex, data + written, firstPart);
+        memcpy(ring->ring, data + written + firstPart, part - firstPart);
+
+        sink->stats.bytesCopied += part;
+        ring->count += part;
+        written += part;
+
+        RingDrain(ring, false);
+    }
+
+    return written;
+}
+
+static bool RingEnd(ResponseSink *sink)
+{
+    ResponseSink_Ring *ring = (ResponseSink_Ring *)sink;
+
+    // If the ring is already empty, tell the consumer that the response is complete.
+    if (ring->count == 0) {
+        ring->consumer(ring->ring, 0, true, ring->context);
+        return true;
+    }
+
+    size_t remaining = RingDrain(ring, true);
+    if (remaining > 0) {
+        Log_Debug("ERROR: The response consumer left %zu bytes unconsumed.\n", remaining);
+        return false;
+    }
+    return true;
+}
+
+static void RingDispose(ResponseSink *sink)
+{
+    ResponseSink_Ring *ring = (ResponseSink_Ring *)sink;
+    ring->count = 0;
+}
+
+void ResponseSink_InitRing(ResponseSink_Ring *sink, uint8_t *ring, size_t capacity,
+                           ResponseSink_ConsumerCallback consumer, void *context)
+{
+    *sink = (ResponseSink_Ring){.base = {.begin = RingBegin,
+                                         .write = RingWrite,
+                                         .end = RingEnd,
+                                         .dispose = RingDispose},
+                                .ring = ring,
+                                .capacity = capacity,
+                                .consumer = consumer,
+                                .context = context};
+}
+
+static bool StorageBegin(ResponseSink *sink)
+{
+    ResponseSink_MutableStorage *storage = (ResponseSink_MutableStorage *)sink;
+
+    if (storage->fd == -1) {
+        storage->fd = Storage_OpenMutableFile();
+        if (storage->fd == -1) {
+            LogErrno("ERROR: Could not open mutable file");
+            return false;
+        }
+    }
+
+    // Replace the previous response.
+    if (ftruncate(storage->fd, 0) == -1 || lseek(storage->fd, 0, SEEK_SET) == -1) {
+        LogErrno("ERROR: Could not truncate mutable file");
+        return false;
+    }
+
+    storage->size = 0;
+    return true;
+}
+
+static size_t StorageWrite(ResponseSink *sink, const uint8_t *data, size_t size)
+{
+    ResponseSink_MutableStorage *storage = (ResponseSink_MutableStorage *)sink;
+
+    if (size > storage->maxSize - storage->size) {
+        Log_Debug("ERROR: Response is larger than %zu bytes.\n", storage->maxSize);
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(storage->fd, data + written, size - written);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LogErrno("ERROR: Could not write to mutable file");
+            break;
+        }
+        written += (size_t)result;
+    }
+
+    sink->stats.bytesCopied += written;
+    storage->size += written;
+    return written;
+}
+
+static bool StorageEnd(ResponseSink *sink)
+{
+    ResponseSink_MutableStorage *storage = (ResponseSink_MutableStorage *)sink;
+
+    // Commit the response to flash now, rather than when the file is closed.
+    if (fsync(storage->fd) == -1) {
+        LogErrno("ERROR: Could not commit mutable file");
+        return false;
+    }
+    return true;
+}
+
+static void StorageDispose(ResponseSink *sink)
+{
+    ResponseSink_MutableStorage *storage = (ResponseSink_MutableStorage *)sink;
+    CloseFdAndLogOnError(storage->fd, "MutableFile");
+    storage->fd = -1;
+}
+
+void ResponseSink_InitMutableStorage(ResponseSink_MutableStorage *sink, size_t maxSize)
+{
+    *sink = (ResponseSink_MutableStorage){.base = {.begin = StorageBegin,
+                                                   .write = StorageWrite,
+                                                   .end = StorageEnd,
+                                                   .dispose = StorageDispose},
+                                          .fd = -1,
+                                          .maxSize = maxSize};
+}
+
+bool ResponseSink_Begin(ResponseSink *sink)
+{
+    sink->stats = (ResponseSinkStats){0};
+    return sink->begin(sink);
+}
+
+size_t ResponseSink_Write(ResponseSink *sink, const uint8_t *data, size_t size)
+{
+    sink->stats.bytesReceived += size;
+    return sink->write(sink, data, size);
+}
+
+bool ResponseSink_End(ResponseSink *sink)
+{
+    return sink->end(sink);
+}
+
+void ResponseSink_Dispose(ResponseSink *sink)
+{
+    sink->dispose(sink);
+}
@@ -0,0 +1,158 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A response sink receives the data of a web transfer as it arrives, so the transfer does not
+// need to know whether the data is kept in memory, handed on to a consumer, or written to
+// storage. Three sinks are provided:
+//
+//   - ResponseSink_Buffer keeps the whole response in a heap buffer, which grows geometrically
+//     up to a fixed limit.
+//   - ResponseSink_Ring copies the response through a fixed-size ring, and hands it to a
+//     consumer callback as it arrives.
+//   - ResponseSink_MutableStorage writes the response to the application's mutable storage file.
+//
+// Each sink counts the bytes which it copies and the heap memory which it uses, so the cost of
+// a transfer can be compared across sinks.
+
+/// <summary>Counters which describe the work that a sink did for a transfer.</summary>
+typedef struct {
+    /// <summary>Number of bytes passed to the sink.</summary>
+    size_t bytesReceived;
+    /// <summary>
+    ///     Number of bytes which the sink copied, including data which may have been moved when
+    ///     a buffer was reallocated.
+    /// </summary>
+    size_t bytesCopied;
+    /// <summary>Number of heap allocations and reallocations.</summary>
+    size_t allocations;
+    /// <summary>Largest amount of heap memory which the sink held, in bytes.</summary>
+    size_t peakHeapBytes;
+} ResponseSinkStats;
+
+typedef struct ResponseSink ResponseSink;
+
+/// <summary>
+///     Operations which every sink provides. Use the ResponseSink_* functions below rather than
+///     calling these directly.
+/// </summary>
+struct ResponseSink {
+    bool (*begin)(ResponseSink *sink);
+    size_t (*write)(ResponseSink *sink, const uint8_t *data, size_t size);
+    bool (*end)(ResponseSink *sink);
+    void (*dispose)(ResponseSink *sink);
+    ResponseSinkStats stats;
+};
+
+/// <summary>
+///     Consumer which receives the data that passes through a <see cref="ResponseSink_Ring" />.
+/// </summary>
+/// <param name="data">Next contiguous part of the response.</param>
+/// <param name="size">Size of the data in bytes.</param>
+/// <param name="final">true if this is the end of the response; false otherwise.</param>
+/// <param name="context">The context which was passed to ResponseSink_InitRing.</param>
+/// <returns>
+///     Number of bytes consumed. Bytes which are not consumed are offered again with the next
+///     data, so a consumer can wait for a complete record. If the ring fills up, the transfer
+///     fails.
+/// </returns>
+typedef size_t (*ResponseSink_ConsumerCallback)(const uint8_t *data, size_t size, bool final,
+                                                void *context);
+
+/// <summary>Sink which keeps the whole response in a heap buffer.</summary>
+typedef struct {
+    ResponseSink base;
+    /// <summary>The response, followed by a null terminator. NULL until data arrives.</summary>
+    uint8_t *data;
+    /// <summary>Size of the response in bytes, not including the null terminator.</summary>
+    size_t size;
+    size_t capacity;
+    size_t maxSize;
+} ResponseSink_Buffer;
+
+/// <summary>Sink which hands the response to a consumer through a fixed-size ring.</summary>
+typedef struct {
+    ResponseSink base;
+    uint8_t *ring;
+    size_t capacity;
+    size_t readIndex;
+    size_t count;
+    ResponseSink_ConsumerCallback consumer;
+    void *context;
+} ResponseSink_Ring;
+
+/// <summary>Sink which writes the response to the application's mutable storage file.</summary>
+typedef struct {
+    ResponseSink base;
+    int fd;
+    /// <summary>Size of the response which has been written, in bytes.</summary>
+    size_t size;
+    size_t maxSize;
+} ResponseSink_MutableStorage;
+
+/// <summary>
+///     Initializes a buffer sink. The buffer is kept between transfers, so later transfers of a
+///     similar size do not need to allocate.
+/// </summary>
+/// <param name="sink">Sink to initialize.</param>
+/// <param name="maxSize">
+///     Largest response which the sink accepts, in bytes. Larger responses fail the transfer.
+/// </param>
+void ResponseSink_InitBuffer(ResponseSink_Buffer *sink, size_t maxSize);
+
+/// <summary>
+///     Initializes a ring sink. The sink does not allocate any memory.
+/// </summary>
+/// <param name="sink">Sink to initialize.</param>
+/// <param name="ring">Storage for the ring, which must outlive the sink.</param>
+/// <param name="capacity">Size of the ring in bytes.</param>
+/// <param name="consumer">Callback which receives the response.</param>
+/// <param name="context">Passed to the consumer.</param>
+void ResponseSink_InitRing(ResponseSink_Ring *sink, uint8_t *ring, size_t capacity,
+                           ResponseSink_ConsumerCallback consumer, void *context);
+
+/// <summary>
+///     Initializes a mutable storage sink. Each transfer replaces the contents of the file. The
+///     application manifest must include the MutableStorage capability, and only one sink can
+///     use the file at a time.
+/// </summary>
+/// <param name="sink">Sink to initialize.</param>
+/// <param name="maxSize">
+///     Largest response which the sink accepts, in bytes. This should not be more than the size
+///     which is set in the MutableStorage capability.
+/// </param>
+void ResponseSink_InitMutableStorage(ResponseSink_MutableStorage *sink, size_t maxSize);
+
+/// <summary>
+///     Prepares a sink for a new transfer, and resets its counters.
+/// </summary>
+/// <returns>true on success; false on failure.</returns>
+bool ResponseSink_Begin(ResponseSink *sink);
+
+/// <summary>
+///     Passes the next part of the response to a sink.
+/// </summary>
+/// <param name="sink">The sink.</param>
+/// <param name="data">Response data.</param>
+/// <param name="size">Size of the data in bytes.</param>
+/// <returns>
+///     The number of bytes accepted. If this is less than <paramref name="size" />, the transfer
+///     should be abandoned.
+/// </returns>
+size_t ResponseSink_Write(ResponseSink *sink, const uint8_t *data, size_t size);
+
+/// <summary>
+///     Completes the transfer, flushing any data which the sink still holds.
+/// </summary>
+/// <returns>true on success; false on failure.</returns>
+bool ResponseSink_End(ResponseSink *sink);
+
+/// <summary>
+///     Releases the resources which a sink holds.
+/// </summary>
+void ResponseSink_Dispose(ResponseSink *sink);
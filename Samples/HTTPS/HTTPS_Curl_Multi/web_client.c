@@ -19,43 +19,59 @@
 #include "log_utils.h"
 #include "web_client.h"
 #include "curlmulti.h"
+#include "response_sink.h"
 
 /// File descriptor for the timerfd running for cURL.
 static EventLoopTimer *curlTimer = NULL;
 static EventLoop *eventLoop = NULL; // not owned
 
-/// <summary>
-///     Data pointer and size of a block of memory allocated on the heap.
-/// </summary>
-typedef struct {
-    uint8_t *data;
-    size_t size;
-} MemoryBlock;
-
-/// <summary>
-///     The storage for an HTTP response content.
-/// </summary>
-typedef struct {
-    MemoryBlock content;
-} HttpResponse;
-
-// The cURL's 'multi' interface instance.
+// The cURL's 'multi' interface instance. Its connection cache is kept for the lifetime of the
+// web client, so transfers in later rounds can reuse connections opened by earlier rounds.
 static CURLM *curlMulti = 0;
+// Shares the DNS cache and TLS sessions between the easy handles, so a handle which has to open
+// a new connection can still skip the DNS lookup and resume a TLS session.
+static CURLSH *curlShare = 0;
+
+// The kinds of response sink which a web transfer can use.
+typedef enum {
+    // Keeps the response in memory, and prints it when the transfer completes.
+    WebTransferSink_Buffer,
+    // Prints each line of the response as it arrives, without keeping the whole response.
+    WebTransferSink_Ring,
+    // Writes the response to the application's mutable storage file.
+    WebTransferSink_MutableStorage
+} WebTransferSinkType;
 
 // Data type containing data for each web transfer.
 typedef struct {
     CURL *easyHandle;
     char *url;
-    HttpResponse httpResponse;
+    WebTransferSinkType sinkType;
+    // Receives the HTTP headers and content of the response. Every sink starts with the
+    // ResponseSink operations, so base can be used whichever sink is in use.
+    union {
+        ResponseSink base;
+        ResponseSink_Buffer buffer;
+        ResponseSink_Ring ring;
+        ResponseSink_MutableStorage storage;
+    } response;
     struct timespec startTime;
 } WebTransfer;
 
 // The web transfers executed with cURL.
 WebTransfer webTransfers[] = {
     // Download a web page with a delay of 5 seconds with status 200.
-    {.url = "https://httpstat.us/200?sleep=5000", .easyHandle = NULL},
+    {.url = "https://httpstat.us/200?sleep=5000",
+     .easyHandle = NULL,
+     .sinkType = WebTransferSink_Buffer},
     // Download a web page with a delay of 1 second with status 400.
-    {.url = "https://httpstat.us/400?sleep=1000", .easyHandle = NULL}};
+    {.url = "https://httpstat.us/400?sleep=1000",
+     .easyHandle = NULL,
+     .sinkType = WebTransferSink_Ring},
+    // Download a web page with status 200, and save it to mutable storage.
+    {.url = "https://httpstat.us/200",
+     .easyHandle = NULL,
+     .sinkType = WebTransferSink_MutableStorage}};
 static const size_t transferCount = sizeof(webTransfers) / sizeof(*webTransfers);
 
 /// cURL transfers in progress (i.e. not completed) as reported by curl_multi_socket_action().
@@ -64,6 +80,17 @@ static int runningEasyHandles = 0;
 size_t curlTransferInProgress = 0;
 // The maximum number of characters which are printed from the HTTP response body.
 static const size_t maxResponseCharsToPrint = 2048;
+// The largest response which is kept in memory. Larger responses fail the transfer.
+static const size_t maxResponseSize = 64 * 1024;
+// The largest response which is saved to mutable storage. This must not be more than the
+// MutableStorage size in app_manifest.json.
+static const size_t maxStoredResponseSize = 8 * 1024;
+// The ring through which a ring sink passes the response. A line which is longer than the ring
+// is printed in parts.
+static uint8_t responseRing[256];
+// The maximum number of connections which are opened to a single host at the same time.
+// Transfers beyond this limit wait for a connection to become free.
+static const long maxConnectionsPerHost = 2;
 
 /// <summary>
 ///     Logs a cURL easy error.
@@ -88,27 +115,32 @@ static void LogCurlMultiError(const char *message, CURLMcode code)
 }
 
 /// <summary>
-///     cURL callback that aggregates all the downloaded chunks in a single
-///     memory block.
+///     Logs a cURL share error.
+/// </summary>
+/// <param name="message">The message to print</param>
+/// <param name="curlErrCode">The cURL error code to describe</param>
+static void LogCurlShareError(const char *message, CURLSHcode code)
+{
+    Log_Debug(message);
+    Log_Debug(" (curl share err=%d, '%s')\n", code, curl_share_strerror(code));
+}
+
+/// <summary>
+///     cURL callback that passes the downloaded chunks to the response sink of the transfer.
 /// </summary>
 /// <param name="chunks">The pointer to the chunks array</param>
 /// <param name="chunkSize">The size of each chunk</param>
 /// <param name="chunksCount">The count of the chunks</param>
-/// <param name="memoryBlock">The pointer where all the downloaded chunks are aggregated</param>
-static size_t CurlStoreDownloadedContentCallback(void *chunks, size_t chunkSize, size_t chunksCount,
-                                                 void *userData)
+/// <param name="userData">The <see cref="ResponseSink" /> which receives the chunks</param>
+/// <returns>
+///     The number of bytes accepted by the sink. If this is less than the size of the chunks,
+///     cURL abandons the transfer with CURLE_WRITE_ERROR.
+/// </returns>
+static size_t CurlWriteToSinkCallback(void *chunks, size_t chunkSize, size_t chunksCount,
+                                      void *userData)
 {
-    MemoryBlock *block = (MemoryBlock *)userData;
-    size_t additionalDataSize = chunkSize * chunksCount;
-    block->data = realloc(block->data, block->size + additionalDataSize + 1);
-    if (block->data == NULL) {
-        LogErrno("ERROR: Out of memory, realloc returned NULL");
-        abort();
-    }
-    memcpy(block->data + block->size, chunks, additionalDataSize);
-    block->size += additionalDataSize;
-    block->data[block->size] = 0; // Ensure the block of memory is null terminated.
-    return additionalDataSize;
+    ResponseSink *sink = (ResponseSink *)userData;
+    return ResponseSink_Write(sink, (const uint8_t *)chunks, chunkSize * chunksCount);
 }
 
 /// <summary>
@@ -120,7 +152,7 @@ static size_t CurlStoreDownloadedContentCallback(void *chunks, size_t chunkSize,
 ///           in app_manifest.json.
 /// </summary>
 /// <param name="url">HTTP or HTTPS URL to download</param>
-/// <param name="response">Storage of the response</param>
+/// <param name="sink">Sink which receives the headers and content of the response</param>
 /// <param name="callerExitCode">
 ///     Set to ExitCode_Success if succeeded, in which case the return value is non-NULL.
 ///     Otherwise set to another exit code which indicates the specific failure.
@@ -130,7 +162,7 @@ static size_t CurlStoreDownloadedContentCallback(void *chunks, size_t chunkSize,
 ///     Pointer to a curl easy handle, which must be disposed of with curl_easy_cleanup.
 ///     On failure, returns NULL and puts a specific failure reason in *status.
 /// </returns>
-static CURL *CurlSetupEasyHandle(char *url, HttpResponse *response, ExitCode *callerExitCode,
+static CURL *CurlSetupEasyHandle(char *url, ResponseSink *sink, ExitCode *callerExitCode,
                                  bool bypassProxy)
 {
     CURL *returnedEasyHandle = NULL; // Easy cURL handle for a transfer.
@@ -176,27 +208,34 @@ static CURL *CurlSetupEasyHandle(char *url, HttpResponse *response, ExitCode *ca
 
     // Set up callback for cURL to use when downloading data.
     if ((res = curl_easy_setopt(easyHandle, CURLOPT_WRITEFUNCTION,
-                                &CurlStoreDownloadedContentCallback)) != CURLE_OK) {
+                                &CurlWriteToSinkCallback)) != CURLE_OK) {
         LogCurlEasyError("curl_easy_setopt CURLOPT_WRITEFUNCTION", res);
         *callerExitCode = ExitCode_CurlSetupEasy_OptWriteFunction;
         goto errorLabel;
     }
 
-    // Set the custom parameter of the callback to the memory block.
-    if ((res = curl_easy_setopt(easyHandle, CURLOPT_WRITEDATA, (void *)&response->content)) !=
-        CURLE_OK) {
+    // Set the custom parameter of the callback to the response sink.
+    if ((res = curl_easy_setopt(easyHandle, CURLOPT_WRITEDATA, (void *)sink)) != CURLE_OK) {
         LogCurlEasyError("curl_easy_setopt CURLOPT_WRITEDATA", res);
         *callerExitCode = ExitCode_CurlSetupEasy_OptWriteData;
         goto errorLabel;
     }
 
-    // Set the custom parameter of the for headers retrieval.
-    if ((res = curl_easy_setopt(easyHandle, CURLOPT_HEADERDATA, (void *)response)) != CURLE_OK) {
+    // Set the custom parameter of the for headers retrieval. There is no header callback, so
+    // cURL passes the headers to the write callback, and they are stored before the content.
+    if ((res = curl_easy_setopt(easyHandle, CURLOPT_HEADERDATA, (void *)sink)) != CURLE_OK) {
         LogCurlEasyError("curl_easy_setopt CURLOPT_HEADERDATA", res);
         *callerExitCode = ExitCode_CurlSetupEasy_OptHeaderData;
         goto errorLabel;
     }
 
+    // Share the DNS cache and TLS sessions with the other transfers.
+    if ((res = curl_easy_setopt(easyHandle, CURLOPT_SHARE, curlShare)) != CURLE_OK) {
+        LogCurlEasyError("curl_easy_setopt CURLOPT_SHARE", res);
+        *callerExitCode = ExitCode_CurlSetupEasy_OptShare;
+        goto errorLabel;
+    }
+
     // Specify a user agent.
     if ((res = curl_easy_setopt(easyHandle, CURLOPT_USERAGENT, "libcurl/1.0")) != CURLE_OK) {
         LogCurlEasyError("curl_easy_setopt CURLOPT_USERAGENT", res);
@@ -309,6 +348,106 @@ static void PrintResponse(const char *data, size_t actualLength, size_t maxPrint
     }
 }
 
+/// <summary>
+///     Converts a cURL time value, in microseconds, to milliseconds.
+/// </summary>
+static long MicrosecondsToMilliseconds(curl_off_t us)
+{
+    return (long)(us / 1000);
+}
+
+/// <summary>
+///     Log how long each phase of a completed transfer took, and whether it opened a new
+///     connection. Each time is measured from the start of the transfer. A transfer which reused
+///     a connection reports zero new connections and no connect or TLS handshake time.
+/// </summary>
+/// <param name="easyHandle">The cURL easy handle of the completed transfer</param>
+static void LogTransferTimings(CURL *easyHandle)
+{
+    curl_off_t nameLookupTime = 0, connectTime = 0, appConnectTime = 0, startTransferTime = 0,
+               totalTime = 0;
+    long newConnections = 0;
+
+    curl_easy_getinfo(easyHandle, CURLINFO_NAMELOOKUP_TIME_T, &nameLookupTime);
+    curl_easy_getinfo(easyHandle, CURLINFO_CONNECT_TIME_T, &connectTime);
+    curl_easy_getinfo(easyHandle, CURLINFO_APPCONNECT_TIME_T, &appConnectTime);
+    curl_easy_getinfo(easyHandle, CURLINFO_STARTTRANSFER_TIME_T, &startTransferTime);
+    curl_easy_getinfo(easyHandle, CURLINFO_TOTAL_TIME_T, &totalTime);
+    curl_easy_getinfo(easyHandle, CURLINFO_NUM_CONNECTS, &newConnections);
+
+    Log_Debug(" -==- Timings (milliseconds): DNS %ld, connect %ld, TLS %ld, first byte %ld, total "
+              "%ld; new connections: %ld -==-\n",
+              MicrosecondsToMilliseconds(nameLookupTime), MicrosecondsToMilliseconds(connectTime),
+              MicrosecondsToMilliseconds(appConnectTime),
+              MicrosecondsToMilliseconds(startTransferTime), MicrosecondsToMilliseconds(totalTime),
+              newConnections);
+}
+
+/// <summary>
+///     Ring sink consumer which prints each complete line of the response as it arrives. A line
+///     which has not fully arrived is left in the ring, unless it fills the ring.
+///     See <see cref="ResponseSink_ConsumerCallback" /> for parameter descriptions.
+/// </summary>
+static size_t PrintResponseLines(const uint8_t *data, size_t size, bool final, void *context)
+{
+    size_t consumed = 0;
+    while (consumed < size) {
+        const uint8_t *line = data + consumed;
+        const uint8_t *newline = memchr(line, '\n', size - consumed);
+        size_t lineLength;
+        if (newline != NULL) {
+            lineLength = (size_t)(newline - line) + 1;
+        } else if (final || (consumed == 0 && size == sizeof(responseRing))) {
+            lineLength = size - consumed;
+        } else {
+            // Wait for the rest of the line.
+            break;
+        }
+
+        // Print the line without its line ending.
+        size_t printLength = lineLength;
+        while (printLength > 0 &&
+               (line[printLength - 1] == '\n' || line[printLength - 1] == '\r')) {
+            --printLength;
+        }
+        Log_Debug(" | %.*s\n", (int)printLength, (const char *)line);
+        consumed += lineLength;
+    }
+
+    return consumed;
+}
+
+/// <summary>
+///     Initializes the response sink of a web transfer, according to its sink type.
+/// </summary>
+/// <param name="transfer">The web transfer</param>
+static void InitResponseSink(WebTransfer *transfer)
+{
+    switch (transfer->sinkType) {
+    case WebTransferSink_Buffer:
+        ResponseSink_InitBuffer(&transfer->response.buffer, maxResponseSize);
+        break;
+    case WebTransferSink_Ring:
+        ResponseSink_InitRing(&transfer->response.ring, responseRing, sizeof(responseRing),
+                              PrintResponseLines, NULL);
+        break;
+    case WebTransferSink_MutableStorage:
+        ResponseSink_InitMutableStorage(&transfer->response.storage, maxStoredResponseSize);
+        break;
+    }
+}
+
+/// <summary>
+///     Log how much the response sink of a completed transfer copied and allocated.
+/// </summary>
+/// <param name="stats">The counters of the response sink</param>
+static void LogResponseSinkStats(const ResponseSinkStats *stats)
+{
+    Log_Debug(" -==- Response sink: %zu bytes received, %zu bytes copied, %zu allocations, peak "
+              "heap %zu bytes -==-\n",
+              stats->bytesReceived, stats->bytesCopied, stats->allocations, stats->peakHeapBytes);
+}
+
 /// <summary>
 ///     Process a completed web transfer by display HTTP status and content of the transfer.
 /// </summary>
@@ -332,14 +471,29 @@ static void CurlProcessCompletedTransfer(void)
                         // Compute the elapsed time in milliseconds out of the timespecs.
                         (currentTime.tv_sec - webTransfers[i].startTime.tv_sec) * 1000 +
                             (currentTime.tv_nsec - webTransfers[i].startTime.tv_nsec) / 1000000);
-
-                    PrintResponse(webTransfers[i].httpResponse.content.data,
-                                  webTransfers[i].httpResponse.content.size,
-                                  maxResponseCharsToPrint);
-
-                    free(webTransfers[i].httpResponse.content.data);
-                    webTransfers[i].httpResponse.content.data = 0;
-                    webTransfers[i].httpResponse.content.size = 0;
+                    LogTransferTimings(e);
+
+                    WebTransfer *transfer = &webTransfers[i];
+                    bool sinkCompleted = ResponseSink_End(&transfer->response.base);
+                    LogResponseSinkStats(&transfer->response.base.stats);
+
+                    if (curlMessage->data.result != CURLE_OK) {
+                        LogCurlEasyError("ERROR: Download failed", curlMessage->data.result);
+                    } else if (sinkCompleted) {
+                        if (transfer->sinkType == WebTransferSink_Buffer &&
+                            transfer->response.buffer.data != NULL) {
+                            PrintResponse((const char *)transfer->response.buffer.data,
+                                          transfer->response.buffer.size,
+                                          maxResponseCharsToPrint);
+                        } else if (transfer->sinkType == WebTransferSink_MutableStorage) {
+                            Log_Debug(" -===- Saved downloaded content (%zu bytes) to mutable "
+                                      "storage. -===- \n",
+                                      transfer->response.storage.size);
+                        }
+                    }
+
+                    // The response buffer is kept for the next round, so it does not need to be
+                    // allocated again.
                 }
             }
         }
@@ -463,10 +617,34 @@ static ExitCode CurlInit(bool bypassProxy)
     Log_Debug("Using %s\n", curl_version());
 
     ExitCode localExitCode;
+    CURLSHcode shareRes;
+
+    // Set up the share object before the easy handles, which refer to it. The application is
+    // single-threaded, so the share object does not need lock callbacks.
+    curlShare = curl_share_init();
+    if (curlShare == NULL) {
+        Log_Debug("curl_share_init() failed!\n");
+        localExitCode = ExitCode_CurlInit_ShareInit;
+        goto errorLabel;
+    }
+
+    if ((shareRes = curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS)) !=
+        CURLSHE_OK) {
+        LogCurlShareError("curl_share_setopt CURL_LOCK_DATA_DNS", shareRes);
+        localExitCode = ExitCode_CurlInit_ShareSetOptDns;
+        goto errorLabel;
+    }
+    if ((shareRes = curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION)) !=
+        CURLSHE_OK) {
+        LogCurlShareError("curl_share_setopt CURL_LOCK_DATA_SSL_SESSION", shareRes);
+        localExitCode = ExitCode_CurlInit_ShareSetOptSslSession;
+        goto errorLabel;
+    }
 
     for (size_t i = 0; i < transferCount; i++) {
+        InitResponseSink(&webTransfers[i]);
         webTransfers[i].easyHandle = CurlSetupEasyHandle(
-            webTransfers[i].url, &webTransfers[i].httpResponse, &localExitCode, bypassProxy);
+            webTransfers[i].url, &webTransfers[i].response.base, &localExitCode, bypassProxy);
 
         if (webTransfers[i].easyHandle == NULL) {
             goto errorLabel;
@@ -494,6 +672,22 @@ static ExitCode CurlInit(bool bypassProxy)
         goto errorLabel;
     }
 
+    // Limit the number of concurrent connections to each host.
+    if ((res = curl_multi_setopt(curlMulti, CURLMOPT_MAX_HOST_CONNECTIONS,
+                                 maxConnectionsPerHost)) != CURLM_OK) {
+        LogCurlMultiError("curl_multi_setopt CURLMOPT_MAX_HOST_CONNECTIONS", res);
+        localExitCode = ExitCode_CurlInit_MultiSetOptMaxHostConnections;
+        goto errorLabel;
+    }
+
+    // Keep enough idle connections in the cache for every transfer to reuse one in the next round.
+    if ((res = curl_multi_setopt(curlMulti, CURLMOPT_MAXCONNECTS, (long)transferCount)) !=
+        CURLM_OK) {
+        LogCurlMultiError("curl_multi_setopt CURLMOPT_MAXCONNECTS", res);
+        localExitCode = ExitCode_CurlInit_MultiSetOptMaxConnects;
+        goto errorLabel;
+    }
+
     return ExitCode_Success;
 
 errorLabel:
@@ -503,6 +697,9 @@ errorLabel:
         // Set pointer to NULL so not cleaned up again in CurlFini.
         webTransfers[i].easyHandle = NULL;
     }
+    // The share object can only be cleaned up after the easy handles which use it.
+    curl_share_cleanup(curlShare);
+    curlShare = NULL;
     return localExitCode;
 }
 
@@ -513,12 +710,19 @@ static void CurlFini(void)
 {
     for (size_t i = 0; i < transferCount; i++) {
         curl_easy_cleanup(webTransfers[i].easyHandle);
+        ResponseSink_Dispose(&webTransfers[i].response.base);
     }
 
     CURLMcode res;
     if ((res = curl_multi_cleanup(curlMulti)) != CURLM_OK) {
         LogCurlMultiError("curl_multi_cleanup failed", res);
     }
+
+    // The share object can only be cleaned up after the easy handles which use it.
+    CURLSHcode shareRes;
+    if ((shareRes = curl_share_cleanup(curlShare)) != CURLSHE_OK) {
+        LogCurlShareError("curl_share_cleanup failed", shareRes);
+    }
     curl_global_cleanup();
 }
 
@@ -535,6 +739,11 @@ int WebClient_StartTransfers(void)
                 LogCurlMultiError("curl_multi_remove_handle", res);
                 return -1;
             }
+            if (!ResponseSink_Begin(&webTransfers[i].response.base)) {
+                Log_Debug("ERROR: Could not prepare the response sink for %s\n",
+                          webTransfers[i].url);
+                return -1;
+            }
             if ((res = curl_multi_add_handle(curlMulti, webTransfers[i].easyHandle)) != CURLM_OK) {
                 LogCurlMultiError("curl_multi_add_handle", res);
                 return -1;
@@ -0,0 +1,347 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Loopback benchmark and test for sample_stream.c, which run on a Linux PC. A socketpair stands in
+// for the intercore socket. A second thread plays the RTApp as sample-stream.c does: it sends a
+// frame only if it has credit and the socket has space, and otherwise drops the frame but still
+// uses its sequence number. Each frame carries its send time in its samples. The main thread
+// plays the high-level app, and waits for the socket with poll and runs the same receive loop as
+// SocketEventHandler in main.c.
+//
+// The test checks the counters for dropped, malformed and text messages, and that credit is
+// returned in batches. The benchmark reports frames per second and poll wakeups per frame when
+// the RTApp sends as fast as its credit allows, both when the handler drains the socket and when
+// it reads one message per wakeup, as the handler did before the sample stream. It then paces
+// the RTApp at 1 kHz and 10 kHz, and reports one-way latency percentiles and dropped frames.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include "sample_stream.h"
+
+// Same as the high-level app.
+#define MAX_RTAPP_MESSAGE_SIZE 1040
+#define CREDIT_WINDOW 64
+
+#define THROUGHPUT_FRAMES 200000u
+#define PACED_SECONDS 2
+
+typedef struct {
+    SampleStreamFrameHeader header;
+    int16_t samples[SAMPLE_STREAM_SAMPLES_PER_FRAME];
+} SamplesFrame;
+
+typedef struct {
+    SampleStreamFrameHeader header;
+    uint32_t credit;
+} CreditFrame;
+
+// Fields which are set before the RTApp thread starts, or read after it finishes.
+typedef struct {
+    // Frames per second, or zero to send as fast as credit allows.
+    unsigned rate;
+    uint32_t frames;
+    uint32_t sent;
+    uint32_t dropped;
+} RtAppRun;
+
+// The high-level app uses sockets[0], and the simulated RTApp uses sockets[1].
+static int sockets[2] = {-1, -1};
+
+static uint64_t *latencies = NULL;
+static size_t latencyCount = 0;
+static size_t textMessages = 0;
+static unsigned long wakeups = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+static uint64_t GetNowNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void OpenSockets(void)
+{
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) == -1) {
+        printf("ERROR: socketpair: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void CloseSockets(void)
+{
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+// Returns false if the socket is full, which is how the outbound buffer being full shows up.
+static bool SendSamplesFrame(uint32_t sequence, uint16_t length)
+{
+    SamplesFrame frame = {.header = {.magic = SAMPLE_STREAM_MAGIC,
+                                     .type = SampleStreamFrameType_Samples,
+                                     .length = length,
+                                     .sequence = sequence}};
+    uint64_t now = GetNowNanoseconds();
+    memcpy(frame.samples, &now, sizeof(now));
+    return send(sockets[1], &frame, sizeof(frame), MSG_DONTWAIT) == sizeof(frame);
+}
+
+// Reads the credit which the high-level app has sent, without waiting.
+static uint32_t ReceiveCredit(void)
+{
+    uint32_t credit = 0;
+    CreditFrame frame;
+    while (recv(sockets[1], &frame, sizeof(frame), MSG_DONTWAIT) == sizeof(frame)) {
+        if (frame.header.magic == SAMPLE_STREAM_MAGIC &&
+            frame.header.type == SampleStreamFrameType_Credit) {
+            credit += frame.credit;
+        }
+    }
+    return credit;
+}
+
+// Copy of SocketEventHandler in main.c, which also records the latency of each frame. If drain is
+// false, only one message is read, as the handler did before the sample stream was added.
+// Returns false once the RTApp's closing text message has been read.
+static bool HandleSocketEvent(bool drain)
+{
+    do {
+        char rxBuf[MAX_RTAPP_MESSAGE_SIZE];
+        int bytesReceived = recv(sockets[0], rxBuf, sizeof(rxBuf), MSG_DONTWAIT);
+
+        if (bytesReceived == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Fail("HandleSocketEvent", "recv failed", errno);
+                return false;
+            }
+            return true;
+        }
+
+        if (!SampleStream_IsFrame(rxBuf, (size_t)bytesReceived)) {
+            ++textMessages;
+            return false;
+        }
+
+        if (latencies != NULL && (size_t)bytesReceived == sizeof(SamplesFrame)) {
+            uint64_t sendTime;
+            memcpy(&sendTime, rxBuf + sizeof(SampleStreamFrameHeader), sizeof(sendTime));
+            latencies[latencyCount++] = GetNowNanoseconds() - sendTime;
+        }
+
+        if (SampleStream_HandleFrame(rxBuf, (size_t)bytesReceived) == -1) {
+            Fail("HandleSocketEvent", "credit not sent", errno);
+            return false;
+        }
+    } while (drain);
+
+    return true;
+}
+
+// Waits for messages with poll, as the event loop does, until the RTApp's closing text message.
+static void RunHighLevelApp(bool drain)
+{
+    struct pollfd pfd = {.fd = sockets[0], .events = POLLIN};
+    for (;;) {
+        if (poll(&pfd, 1, -1) == -1) {
+            Fail("RunHighLevelApp", "poll failed", errno);
+            return;
+        }
+        ++wakeups;
+        if (!HandleSocketEvent(drain)) {
+            return;
+        }
+    }
+}
+
+// Sends run->frames frames, as sample-stream.c does. If run->rate is zero, the RTApp waits for
+// credit instead of dropping frames, so the channel runs as fast as it can.
+static void *RtAppThread(void *arg)
+{
+    RtAppRun *run = arg;
+    uint32_t credits = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (uint32_t sequence = 0; sequence < run->frames; ++sequence) {
+        if (run->rate != 0) {
+            next.tv_nsec += 1000000000L / run->rate;
+            if (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                ++next.tv_sec;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+
+        credits += ReceiveCredit();
+        if (credits == 0 && run->rate == 0) {
+            struct pollfd pfd = {.fd = sockets[1], .events = POLLIN};
+            while (credits == 0) {
+                poll(&pfd, 1, -1);
+                credits += ReceiveCredit();
+            }
+        }
+
+        if (credits == 0 ||
+            !SendSamplesFrame(sequence, SAMPLE_STREAM_SAMPLES_PER_FRAME * sizeof(int16_t))) {
+            ++run->dropped;
+            continue;
+        }
+        --credits;
+        ++run->sent;
+    }
+
+    send(sockets[1], "done", 4, 0);
+    return NULL;
+}
+
+static int CompareLatencies(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double GetPercentileMicroseconds(double percentile)
+{
+    size_t index = (size_t)(percentile / 100.0 * (double)(latencyCount - 1));
+    return (double)latencies[index] / 1000.0;
+}
+
+// Runs the RTApp thread against the high-level app, and checks the counters afterwards.
+static void RunStream(const char *label, RtAppRun *run, bool drain)
+{
+    OpenSockets();
+    latencies = malloc(run->frames * sizeof(*latencies));
+    latencyCount = 0;
+    textMessages = 0;
+    wakeups = 0;
+
+    SampleStream_Start(sockets[0], CREDIT_WINDOW);
+
+    pthread_t thread;
+    uint64_t start = GetNowNanoseconds();
+    pthread_create(&thread, NULL, RtAppThread, run);
+    RunHighLevelApp(drain);
+    pthread_join(thread, NULL);
+    double elapsed = (double)(GetNowNanoseconds() - start) / 1e9;
+
+    // Frames which are dropped after the last one which was sent do not leave a gap.
+    SampleStreamCounters counters;
+    SampleStream_GetCounters(&counters);
+    if (counters.framesReceived != run->sent || counters.framesDiscarded != 0 ||
+        counters.framesDropped > run->dropped) {
+        Fail(label, "wrong counters", (long)counters.framesReceived);
+    }
+
+    SampleStream_FlushCredit();
+    SampleStream_GetCounters(&counters);
+    if (counters.creditsGranted != CREDIT_WINDOW + run->sent) {
+        Fail(label, "credit not returned", (long)counters.creditsGranted);
+    }
+
+    qsort(latencies, latencyCount, sizeof(*latencies), CompareLatencies);
+    printf("%-20s %10.0f %12.3f %10.1f %10.1f %10.1f %8u\n", label, run->sent / elapsed,
+           (double)wakeups / run->sent, GetPercentileMicroseconds(50),
+           GetPercentileMicroseconds(99), GetPercentileMicroseconds(100), run->dropped);
+
+    free(latencies);
+    latencies = NULL;
+    CloseSockets();
+}
+
+// Gaps in the sequence are counted as dropped frames, malformed frames and frames from earlier in
+// the sequence are discarded, text messages are passed on, and credit is returned in batches of
+// half the window.
+static void TestCounters(void)
+{
+    OpenSockets();
+
+    SampleStream_Start(sockets[0], 4);
+    if (ReceiveCredit() != 4) {
+        Fail("TestCounters", "wrong initial credit", 0);
+    }
+
+    const uint16_t length = SAMPLE_STREAM_SAMPLES_PER_FRAME * sizeof(int16_t);
+    SendSamplesFrame(0, length);
+    SendSamplesFrame(1, length);
+    SendSamplesFrame(4, length);
+    SendSamplesFrame(2, length);
+    SendSamplesFrame(5, length + 2);
+    SendSamplesFrame(5, length);
+    send(sockets[1], "text", 4, 0);
+    RunHighLevelApp(true);
+
+    SampleStreamCounters counters;
+    SampleStream_GetCounters(&counters);
+    if (counters.framesReceived != 4 || counters.framesDropped != 2 ||
+        counters.framesDiscarded != 2 || textMessages != 1) {
+        Fail("TestCounters", "wrong counters", (long)counters.framesReceived);
+    }
+
+    // Five frames used credit, so two batches of two were returned.
+    CreditFrame frame;
+    for (int i = 0; i < 2; ++i) {
+        if (recv(sockets[1], &frame, sizeof(frame), MSG_DONTWAIT) != sizeof(frame) ||
+            frame.credit != 2 || frame.header.sequence != (uint32_t)i + 1) {
+            Fail("TestCounters", "wrong credit batch", i);
+        }
+    }
+    if (ReceiveCredit() != 0) {
+        Fail("TestCounters", "too much credit", 0);
+    }
+
+    CloseSockets();
+}
+
+static void BenchmarkStream(void)
+{
+    printf("%-20s %10s %12s %10s %10s %10s %8s\n", "run", "frames/s", "wakeups/frm",
+           "p50 us", "p99 us", "max us", "dropped");
+
+    RtAppRun run = {.rate = 0, .frames = THROUGHPUT_FRAMES};
+    RunStream("max rate, drain", &run, true);
+
+    run = (RtAppRun){.rate = 0, .frames = THROUGHPUT_FRAMES};
+    RunStream("max rate, one read", &run, false);
+
+    static const unsigned rates[] = {1000, 10000};
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+        char label[32];
+        snprintf(label, sizeof(label), "%u Hz, drain", rates[i]);
+        run = (RtAppRun){.rate = rates[i], .frames = rates[i] * PACED_SECONDS};
+        RunStream(label, &run, true);
+    }
+}
+
+int main(void)
+{
+    TestCounters();
+    BenchmarkStream();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
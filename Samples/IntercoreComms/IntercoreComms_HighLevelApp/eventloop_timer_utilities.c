@@ -2,6 +2,7 @@
    Licensed under the MIT License. */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <errno.h>
@@ -14,37 +15,424 @@
 
 #include "eventloop_timer_utilities.h"
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat);
+// All of the timers on an event loop share a single timerfd. The timers are kept in a
+// hierarchical timer wheel, so arming and disarming a timer takes constant time, and the timerfd
+// only needs to be set when the earliest expiry changes. Time is counted in ticks of one
+// millisecond; timers which expire in the same tick are handled with a single wakeup.
+//
+// Each level of the wheel has WHEEL_SLOTS slots. A slot at level 0 holds the timers which expire
+// in one tick; a slot at level n holds the timers which expire in a span of WHEEL_SLOTS^n ticks.
+// When time reaches the start of a slot at a higher level, its timers are moved down to the
+// lower levels. A bitmap of the slots in use lets the wheel find the next expiry without
+// visiting empty slots.
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat)
+#define WHEEL_LEVELS 6
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1u << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+#define EXPIRED_LEVEL UINT8_MAX
+#define NO_TICK UINT64_MAX
+
+#define NANOSECONDS_PER_TICK 1000000
+#define TICKS_PER_SECOND 1000
+
+typedef struct TimerWheel TimerWheel;
+
+typedef struct {
+    EventLoopTimer *head;
+} TimerList;
+
+struct EventLoopTimer {
+    TimerWheel *wheel;
+    EventLoopTimerHandler handler;
+    // Links in the list which holds the timer while it is armed.
+    EventLoopTimer *next;
+    EventLoopTimer *prev;
+    TimerList *list;
+    uint8_t level;
+    // Tick at which the timer expires, and its period in ticks, or 0 for a one-shot timer.
+    uint64_t expiry;
+    uint64_t period;
+};
+
+struct TimerWheel {
+    EventLoop *eventLoop;
+    int fd;
+    EventRegistration *registration;
+    TimerWheel *nextWheel;
+    size_t timerCount;
+    // Every tick up to and including this one has been processed.
+    uint64_t currentTick;
+    // Tick at which the timerfd is set to expire, or NO_TICK if it is disarmed.
+    uint64_t armedTick;
+    bool isDispatching;
+    uint64_t slotsInUse[WHEEL_LEVELS];
+    TimerList slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    // Timers which have expired, and whose handlers have not been called yet.
+    TimerList expired;
+};
+
+static TimerWheel *wheels = NULL;
+
+static uint64_t GetCurrentTick(bool roundUp);
+static uint64_t TimespecToTicks(const struct timespec *duration);
+static void LinkTimer(TimerWheel *wheel, EventLoopTimer *timer);
+static void UnlinkTimer(EventLoopTimer *timer);
+static void CascadeSlot(TimerWheel *wheel, unsigned int level, unsigned int slot);
+static uint64_t GetNextWheelTick(const TimerWheel *wheel);
+static void AdvanceWheel(TimerWheel *wheel, uint64_t targetTick);
+static int SetWheelTimerFd(TimerWheel *wheel, uint64_t tick);
+static int UpdateWheelTimerFd(TimerWheel *wheel, bool onlyIfEarlier);
+static void WheelCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
+static TimerWheel *GetWheel(EventLoop *eventLoop);
+static void DisposeWheel(TimerWheel *wheel);
+static int ArmTimer(EventLoopTimer *timer, const struct timespec *delay,
+                    const struct timespec *period);
+
+/// <summary>
+/// Gets the current time in ticks.
+/// </summary>
+/// <param name="roundUp">
+/// If true, a partly elapsed tick is counted, so timers which are armed from this time never
+/// expire early. If false, only whole ticks are counted, so timers are not processed early.
+/// </param>
+static uint64_t GetCurrentTick(bool roundUp)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t nanoseconds = (uint64_t)now.tv_nsec + (roundUp ? NANOSECONDS_PER_TICK - 1 : 0);
+    return (uint64_t)now.tv_sec * TICKS_PER_SECOND + nanoseconds / NANOSECONDS_PER_TICK;
+}
+
+/// <summary>
+/// Converts a duration to ticks, rounded up so timers never expire early.
+/// </summary>
+/// <returns>The number of ticks, or 0 if the duration is NULL or zero.</returns>
+static uint64_t TimespecToTicks(const struct timespec *duration)
+{
+    if (duration == NULL) {
+        return 0;
+    }
+
+    return (uint64_t)duration->tv_sec * TICKS_PER_SECOND +
+           ((uint64_t)duration->tv_nsec + NANOSECONDS_PER_TICK - 1) / NANOSECONDS_PER_TICK;
+}
+
+/// <summary>
+/// Adds an armed timer to the slot for its expiry, or to the expired list if it is due.
+/// </summary>
+static void LinkTimer(TimerWheel *wheel, EventLoopTimer *timer)
+{
+    TimerList *list = &wheel->expired;
+    uint8_t level = EXPIRED_LEVEL;
+
+    if (timer->expiry > wheel->currentTick) {
+        // Use the lowest level whose slots can tell the expiry apart from the current tick.
+        unsigned int slot = 0;
+        for (level = 0; level < WHEEL_LEVELS; ++level) {
+            unsigned int shift = level * WHEEL_SLOT_BITS;
+            uint64_t distance = (timer->expiry >> shift) - (wheel->currentTick >> shift);
+            if (distance < WHEEL_SLOTS) {
+                slot = (unsigned int)(timer->expiry >> shift) & WHEEL_SLOT_MASK;
+                break;
+            }
+        }
+
+        if (level == WHEEL_LEVELS) {
+            // The expiry is beyond the range of the wheel. Put the timer in the last slot of the
+            // top level, and it will be placed again when that slot is reached.
+            level = WHEEL_LEVELS - 1;
+            unsigned int shift = level * WHEEL_SLOT_BITS;
+            slot = (unsigned int)((wheel->currentTick >> shift) + WHEEL_SLOT_MASK) &
+                   WHEEL_SLOT_MASK;
+        }
+
+        list = &wheel->slots[level][slot];
+        wheel->slotsInUse[level] |= (uint64_t)1 << slot;
+    }
+
+    timer->list = list;
+    timer->level = level;
+    timer->prev = NULL;
+    timer->next = list->head;
+    if (list->head != NULL) {
+        list->head->prev = timer;
+    }
+    list->head = timer;
+}
+
+/// <summary>
+/// Removes a timer from the list which holds it, if any.
+/// </summary>
+static void UnlinkTimer(EventLoopTimer *timer)
+{
+    TimerList *list = timer->list;
+    if (list == NULL) {
+        return;
+    }
+
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        list->head = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+
+    if (list->head == NULL && timer->level != EXPIRED_LEVEL) {
+        unsigned int slot = (unsigned int)(list - timer->wheel->slots[timer->level]);
+        timer->wheel->slotsInUse[timer->level] &= ~((uint64_t)1 << slot);
+    }
+
+    timer->list = NULL;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/// <summary>
+/// Moves the timers in a slot of a higher level to the slots for their expiries.
+/// </summary>
+static void CascadeSlot(TimerWheel *wheel, unsigned int level, unsigned int slot)
+{
+    EventLoopTimer *timer = wheel->slots[level][slot].head;
+    wheel->slots[level][slot].head = NULL;
+    wheel->slotsInUse[level] &= ~((uint64_t)1 << slot);
+
+    while (timer != NULL) {
+        EventLoopTimer *next = timer->next;
+        LinkTimer(wheel, timer);
+        timer = next;
+    }
+}
+
+/// <summary>
+/// Finds the next tick at which a slot in use is reached. This is either the expiry of a timer
+/// at level 0, or the start of a slot at a higher level, whose timers then need to be cascaded.
+/// </summary>
+/// <returns>The tick, or NO_TICK if no timers are in the wheel.</returns>
+static uint64_t GetNextWheelTick(const TimerWheel *wheel)
+{
+    uint64_t nextTick = NO_TICK;
+
+    for (unsigned int level = 0; level < WHEEL_LEVELS; ++level) {
+        uint64_t inUse = wheel->slotsInUse[level];
+        if (inUse == 0) {
+            continue;
+        }
+
+        // Rotate the bitmap so that bit 0 is the slot after the current one.
+        unsigned int shift = level * WHEEL_SLOT_BITS;
+        unsigned int rotation = ((unsigned int)(wheel->currentTick >> shift) + 1) & WHEEL_SLOT_MASK;
+        uint64_t rotated =
+            (inUse >> rotation) | (inUse << ((WHEEL_SLOTS - rotation) & WHEEL_SLOT_MASK));
+        uint64_t distance = (uint64_t)__builtin_ctzll(rotated) + 1;
+
+        uint64_t tick = ((wheel->currentTick >> shift) + distance) << shift;
+        if (tick < nextTick) {
+            nextTick = tick;
+        }
+    }
+
+    return nextTick;
+}
+
+/// <summary>
+/// Processes every tick up to the target tick, moving the timers which expire to the expired
+/// list. Ticks at which nothing happens are skipped.
+/// </summary>
+static void AdvanceWheel(TimerWheel *wheel, uint64_t targetTick)
 {
-    static const struct timespec nullTimeSpec = {.tv_sec = 0, .tv_nsec = 0};
-    struct itimerspec newValue = {.it_value = initial ? *initial : nullTimeSpec,
-                                  .it_interval = repeat ? *repeat : nullTimeSpec};
+    while (wheel->currentTick < targetTick) {
+        uint64_t nextTick = GetNextWheelTick(wheel);
+        if (nextTick > targetTick) {
+            wheel->currentTick = targetTick;
+            return;
+        }
 
-    if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+        wheel->currentTick = nextTick;
+
+        for (unsigned int level = 1; level < WHEEL_LEVELS; ++level) {
+            unsigned int shift = level * WHEEL_SLOT_BITS;
+            if ((nextTick & (((uint64_t)1 << shift) - 1)) != 0) {
+                break;
+            }
+            CascadeSlot(wheel, level, (unsigned int)(nextTick >> shift) & WHEEL_SLOT_MASK);
+        }
+
+        CascadeSlot(wheel, 0, (unsigned int)nextTick & WHEEL_SLOT_MASK);
+    }
+}
+
+/// <summary>
+/// Sets the timerfd of a wheel to expire at an absolute tick, or disarms it.
+/// </summary>
+static int SetWheelTimerFd(TimerWheel *wheel, uint64_t tick)
+{
+    struct itimerspec newValue = {.it_interval = {.tv_sec = 0, .tv_nsec = 0}};
+    if (tick != NO_TICK) {
+        newValue.it_value.tv_sec = (time_t)(tick / TICKS_PER_SECOND);
+        newValue.it_value.tv_nsec = (long)(tick % TICKS_PER_SECOND) * NANOSECONDS_PER_TICK;
+    }
+
+    if (timerfd_settime(wheel->fd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) == -1) {
         Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
+    wheel->armedTick = tick;
     return 0;
 }
 
-struct EventLoopTimer {
-    EventLoop *eventLoop;
-    EventLoopTimerHandler handler;
-    int fd;
-    EventRegistration *registration;
-};
+/// <summary>
+/// Sets the timerfd of a wheel to expire when the wheel next needs attention.
+/// </summary>
+/// <param name="onlyIfEarlier">
+/// If true, the timerfd is only changed if it needs to expire sooner. A timerfd which expires
+/// when nothing is due costs a wakeup, but saves a system call each time a timer is disarmed.
+/// </param>
+static int UpdateWheelTimerFd(TimerWheel *wheel, bool onlyIfEarlier)
+{
+    uint64_t nextTick = (wheel->expired.head != NULL) ? wheel->currentTick
+                                                      : GetNextWheelTick(wheel);
+    if (nextTick == wheel->armedTick || (onlyIfEarlier && nextTick > wheel->armedTick)) {
+        return 0;
+    }
+
+    return SetWheelTimerFd(wheel, nextTick);
+}
 
 // This satisfies the EventLoopIoCallback signature.
-static void TimerCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+static void WheelCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    TimerWheel *wheel = (TimerWheel *)context;
+
+    uint64_t timerData = 0;
+    if (read(wheel->fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+    wheel->armedTick = NO_TICK;
+
+    uint64_t now = GetCurrentTick(/* roundUp */ false);
+    AdvanceWheel(wheel, now);
+
+    // Handlers may arm, disarm and dispose of any timer, including their own. Periodic timers
+    // are placed back in the wheel before their handlers are called.
+    wheel->isDispatching = true;
+    while (wheel->expired.head != NULL) {
+        EventLoopTimer *timer = wheel->expired.head;
+        UnlinkTimer(timer);
+
+        if (timer->period != 0) {
+            // Skip the periods which have already passed, as a timerfd does.
+            uint64_t missedPeriods = (now - timer->expiry) / timer->period;
+            timer->expiry += (missedPeriods + 1) * timer->period;
+            LinkTimer(wheel, timer);
+        }
+
+        timer->handler(timer);
+    }
+    wheel->isDispatching = false;
+
+    if (wheel->timerCount == 0) {
+        DisposeWheel(wheel);
+        return;
+    }
+
+    UpdateWheelTimerFd(wheel, /* onlyIfEarlier */ false);
+}
+
+/// <summary>
+/// Gets the wheel for an event loop, creating it if it does not exist.
+/// </summary>
+static TimerWheel *GetWheel(EventLoop *eventLoop)
+{
+    for (TimerWheel *wheel = wheels; wheel != NULL; wheel = wheel->nextWheel) {
+        if (wheel->eventLoop == eventLoop) {
+            return wheel;
+        }
+    }
+
+    TimerWheel *wheel = calloc(1, sizeof(TimerWheel));
+    if (wheel == NULL) {
+        return NULL;
+    }
+
+    wheel->eventLoop = eventLoop;
+    wheel->armedTick = NO_TICK;
+    wheel->currentTick = GetCurrentTick(/* roundUp */ false);
+
+    wheel->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (wheel->fd == -1) {
+        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        free(wheel);
+        return NULL;
+    }
+
+    wheel->registration =
+        EventLoop_RegisterIo(eventLoop, wheel->fd, EventLoop_Input, WheelCallback, wheel);
+    if (wheel->registration == NULL) {
+        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        close(wheel->fd);
+        free(wheel);
+        return NULL;
+    }
+
+    wheel->nextWheel = wheels;
+    wheels = wheel;
+    return wheel;
+}
+
+/// <summary>
+/// Removes a wheel which no longer has any timers.
+/// </summary>
+static void DisposeWheel(TimerWheel *wheel)
 {
-    EventLoopTimer *timer = (EventLoopTimer *)context;
+    for (TimerWheel **link = &wheels; *link != NULL; link = &(*link)->nextWheel) {
+        if (*link == wheel) {
+            *link = wheel->nextWheel;
+            break;
+        }
+    }
 
-    timer->handler(timer);
+    EventLoop_UnregisterIo(wheel->eventLoop, wheel->registration);
+    close(wheel->fd);
+    free(wheel);
+}
+
+/// <summary>
+/// Arms a timer to expire after a delay, and then at a period, or disarms it.
+/// </summary>
+/// <param name="timer">The timer.</param>
+/// <param name="delay">Delay before the first expiry, or NULL or zero to disarm the timer.</param>
+/// <param name="period">Period of later expiries, or NULL or zero for a one-shot timer.</param>
+static int ArmTimer(EventLoopTimer *timer, const struct timespec *delay,
+                    const struct timespec *period)
+{
+    TimerWheel *wheel = timer->wheel;
+    UnlinkTimer(timer);
+
+    uint64_t delayTicks = TimespecToTicks(delay);
+    if (delayTicks == 0) {
+        // The timerfd is left as it is; if it expires, the wheel finds nothing to do.
+        return 0;
+    }
+
+    // Bring the wheel up to date, so the timer is placed relative to the current time. During
+    // dispatch, the wheel is already up to date.
+    if (!wheel->isDispatching) {
+        AdvanceWheel(wheel, GetCurrentTick(/* roundUp */ false));
+    }
+
+    timer->expiry = GetCurrentTick(/* roundUp */ true) + delayTicks;
+    timer->period = TimespecToTicks(period);
+    LinkTimer(wheel, timer);
+
+    // After dispatch, the timerfd is set for all of the timers at once.
+    if (wheel->isDispatching) {
+        return 0;
+    }
+    return UpdateWheelTimerFd(wheel, /* onlyIfEarlier */ true);
 }
 
 EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
@@ -61,35 +449,20 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
     }
     memset(timer, 0, sizeof(EventLoopTimer));
 
-    timer->eventLoop = eventLoop;
     timer->handler = handler;
-
-    // Initialize to unused values in case have to clean up partially initialized object.
-    timer->fd = -1;
-    timer->registration = NULL;
-
-    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer->fd == -1) {
-        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
-        goto failed;
-    }
-
-    if (SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period) == -1) {
-        goto failed;
+    timer->wheel = GetWheel(eventLoop);
+    if (timer->wheel == NULL) {
+        free(timer);
+        return NULL;
     }
+    ++timer->wheel->timerCount;
 
-    timer->registration =
-        EventLoop_RegisterIo(eventLoop, timer->fd, EventLoop_Input, TimerCallback, timer);
-    if (timer->registration == NULL) {
-        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
-        goto failed;
+    if (ArmTimer(timer, /* delay */ period, /* period */ period) == -1) {
+        DisposeEventLoopTimer(timer);
+        return NULL;
     }
 
     return timer;
-
-failed:
-    DisposeEventLoopTimer(timer);
-    return NULL;
 }
 
 EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
@@ -103,38 +476,35 @@ void DisposeEventLoopTimer(EventLoopTimer *timer)
         return;
     }
 
-    EventLoop_UnregisterIo(timer->eventLoop, timer->registration);
+    TimerWheel *wheel = timer->wheel;
+    UnlinkTimer(timer);
+    free(timer);
 
-    if (timer->fd != -1) {
-        close(timer->fd);
+    // The wheel is disposed of with its last timer, unless it is calling handlers, in which
+    // case it is disposed of when they return.
+    if (--wheel->timerCount == 0 && !wheel->isDispatching) {
+        DisposeWheel(wheel);
     }
-
-    free(timer);
 }
 
 int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
 {
-    uint64_t timerData = 0;
-
-    if (read(timer->fd, &timerData, sizeof(timerData)) == -1) {
-        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
-        return -1;
-    }
-
+    // The wheel reads the shared timerfd before it calls the handlers, so there is nothing left
+    // to consume. This function is kept so that handlers work with either implementation.
     return 0;
 }
 
 int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period);
+    return ArmTimer(timer, /* delay */ period, /* period */ period);
 }
 
 int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ delay, /* repeat */ NULL);
+    return ArmTimer(timer, /* delay */ delay, /* period */ NULL);
 }
 
 int DisarmEventLoopTimer(EventLoopTimer *timer)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
+    return ArmTimer(timer, /* delay */ NULL, /* period */ NULL);
 }
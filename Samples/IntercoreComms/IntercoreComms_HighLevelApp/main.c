@@ -4,6 +4,8 @@
 // This sample C application for Azure Sphere sends messages to, and receives
 // responses from, a real-time capable application. It sends a message every
 // second and prints the message which was sent, and the response which was received.
+// It also receives a stream of sample frames from the real-time capable application, and
+// prints the frame rate every second.
 //
 // It uses the following Azure Sphere libraries
 // - log (displays messages in the Device Output window during debugging)
@@ -25,6 +27,7 @@
 #include <applibs/application.h>
 
 #include "eventloop_timer_utilities.h"
+#include "sample_stream.h"
 
 /// <summary>
 /// Exit codes for this application. These are used for the
@@ -42,7 +45,10 @@ typedef enum {
     ExitCode_Init_Connection = 7,
     ExitCode_Init_SetSockOpt = 8,
     ExitCode_Init_RegisterIo = 9,
-    ExitCode_Main_EventLoopFail = 10
+    ExitCode_Main_EventLoopFail = 10,
+    ExitCode_Init_SampleStream = 11,
+    ExitCode_SocketHandler_SampleStream = 12,
+    ExitCode_TimerHandler_SampleStream = 13
 } ExitCode;
 
 static int sockFd = -1;
@@ -53,9 +59,16 @@ static volatile sig_atomic_t exitCode = ExitCode_Success;
 
 static const char rtAppComponentId[] = "005180bc-402f-4cb3-a662-72937dbcde47";
 
+// Maximum number of sample frames which the RTApp can send before they are consumed.
+static const uint32_t sampleStreamCreditWindow = 64;
+// Largest message which the RTApp can send.
+#define MAX_RTAPP_MESSAGE_SIZE 1040
+
 static void TerminationHandler(int signalNumber);
 static void SendTimerEventHandler(EventLoopTimer *timer);
 static void SendMessageToRTApp(void);
+static void LogSampleStreamStatistics(void);
+static void PrintTextMessage(const char *message, int size);
 static void SocketEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
 static ExitCode InitHandlers(void);
 static void CloseHandlers(void);
@@ -80,6 +93,32 @@ static void SendTimerEventHandler(EventLoopTimer *timer)
     }
 
     SendMessageToRTApp();
+    LogSampleStreamStatistics();
+
+    if (SampleStream_FlushCredit() == -1) {
+        Log_Debug("ERROR: Unable to send sample stream credit: %d (%s)\n", errno, strerror(errno));
+        exitCode = ExitCode_TimerHandler_SampleStream;
+    }
+}
+
+/// <summary>
+///     Helper function for TimerEventHandler logs the number of sample frames which were
+///     received and dropped since it was last called.
+/// </summary>
+static void LogSampleStreamStatistics(void)
+{
+    static SampleStreamCounters previous = {0};
+
+    SampleStreamCounters current;
+    SampleStream_GetCounters(&current);
+
+    Log_Debug("Sample stream: %u frames/s, %u dropped, %u discarded, %u credit granted\n",
+              current.framesReceived - previous.framesReceived,
+              current.framesDropped - previous.framesDropped,
+              current.framesDiscarded - previous.framesDiscarded,
+              current.creditsGranted - previous.creditsGranted);
+
+    previous = current;
 }
 
 /// <summary>
@@ -103,27 +142,51 @@ static void SendMessageToRTApp(void)
     }
 }
 
+/// <summary>
+///     Prints a text message which was received from the real-time capable application.
+/// </summary>
+static void PrintTextMessage(const char *message, int size)
+{
+    Log_Debug("Received %d bytes: ", size);
+    for (int i = 0; i < size; ++i) {
+        Log_Debug("%c", isprint(message[i]) ? message[i] : '.');
+    }
+    Log_Debug("\n");
+}
+
 /// <summary>
 ///     Handle socket event by reading incoming data from real-time capable application.
+///     Each message is read separately, so the handler drains the socket until no more
+///     messages are available, rather than waiting for another event for each one.
 /// </summary>
 static void SocketEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
-    // Read response from real-time capable application.
-    // If the RTApp has sent more than 32 bytes, then truncate.
-    char rxBuf[32];
-    int bytesReceived = recv(fd, rxBuf, sizeof(rxBuf), 0);
-
-    if (bytesReceived == -1) {
-        Log_Debug("ERROR: Unable to receive message: %d (%s)\n", errno, strerror(errno));
-        exitCode = ExitCode_SocketHandler_Recv;
-        return;
-    }
+    for (;;) {
+        char rxBuf[MAX_RTAPP_MESSAGE_SIZE];
+        int bytesReceived = recv(fd, rxBuf, sizeof(rxBuf), MSG_DONTWAIT);
+
+        if (bytesReceived == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+
+            Log_Debug("ERROR: Unable to receive message: %d (%s)\n", errno, strerror(errno));
+            exitCode = ExitCode_SocketHandler_Recv;
+            return;
+        }
 
-    Log_Debug("Received %d bytes: ", bytesReceived);
-    for (int i = 0; i < bytesReceived; ++i) {
-        Log_Debug("%c", isprint(rxBuf[i]) ? rxBuf[i] : '.');
+        if (!SampleStream_IsFrame(rxBuf, (size_t)bytesReceived)) {
+            PrintTextMessage(rxBuf, bytesReceived);
+            continue;
+        }
+
+        if (SampleStream_HandleFrame(rxBuf, (size_t)bytesReceived) == -1) {
+            Log_Debug("ERROR: Unable to send sample stream credit: %d (%s)\n", errno,
+                      strerror(errno));
+            exitCode = ExitCode_SocketHandler_SampleStream;
+            return;
+        }
     }
-    Log_Debug("\n");
 }
 
 /// <summary>
@@ -177,6 +240,12 @@ static ExitCode InitHandlers(void)
         return ExitCode_Init_RegisterIo;
     }
 
+    // Allow the RTApp to start streaming sample frames.
+    if (SampleStream_Start(sockFd, sampleStreamCreditWindow) == -1) {
+        Log_Debug("ERROR: Unable to start sample stream: %d (%s)\n", errno, strerror(errno));
+        return ExitCode_Init_SampleStream;
+    }
+
     return ExitCode_Success;
 }
 
@@ -0,0 +1,127 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/socket.h>
+
+#include "sample_stream.h"
+
+static int streamFd = -1;
+static uint32_t creditBatch = 1;
+static uint32_t pendingCredit = 0;
+static uint32_t nextCreditSequence = 0;
+
+static bool haveSequence = false;
+static uint32_t expectedSequence = 0;
+static SampleStreamCounters streamCounters;
+
+static int SendCredit(uint32_t credit);
+
+/// <summary>
+///     Sends a credit frame to the RTApp.
+/// </summary>
+/// <param name="credit">Number of additional frames which the RTApp may send.</param>
+/// <returns>0 on success; -1 on failure, in which case errno is set.</returns>
+static int SendCredit(uint32_t credit)
+{
+    struct {
+        SampleStreamFrameHeader header;
+        uint32_t credit;
+    } frame = {.header = {.magic = SAMPLE_STREAM_MAGIC,
+                          .type = SampleStreamFrameType_Credit,
+                          .length = sizeof(frame.credit),
+                          .sequence = nextCreditSequence},
+               .credit = credit};
+
+    if (send(streamFd, &frame, sizeof(frame), MSG_DONTWAIT) == -1) {
+        return -1;
+    }
+
+    ++nextCreditSequence;
+    streamCounters.creditsGranted += credit;
+    return 0;
+}
+
+int SampleStream_Start(int fd, uint32_t creditWindow)
+{
+    streamFd = fd;
+    haveSequence = false;
+    memset(&streamCounters, 0, sizeof(streamCounters));
+
+    // Return credit when half of the window has been consumed, so the RTApp can keep sending
+    // while the credit frame is in flight.
+    creditBatch = (creditWindow > 1) ? creditWindow / 2 : 1;
+    pendingCredit = creditWindow;
+    return SampleStream_FlushCredit();
+}
+
+bool SampleStream_IsFrame(const void *data, size_t size)
+{
+    uint32_t magic;
+    if (size < sizeof(SampleStreamFrameHeader)) {
+        return false;
+    }
+
+    memcpy(&magic, data, sizeof(magic));
+    return magic == SAMPLE_STREAM_MAGIC;
+}
+
+int SampleStream_HandleFrame(const void *data, size_t size)
+{
+    SampleStreamFrameHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.type != SampleStreamFrameType_Samples ||
+        header.length != SAMPLE_STREAM_SAMPLES_PER_FRAME * sizeof(int16_t) ||
+        size < sizeof(header) + header.length) {
+        ++streamCounters.framesDiscarded;
+        return 0;
+    }
+
+    // Every samples frame used one credit, so return it even if the frame is discarded below.
+    ++pendingCredit;
+
+    // Frames which the RTApp dropped leave a gap in the sequence. The difference is computed
+    // modulo 2^32, so a frame which is older than the expected one shows up as a large gap.
+    uint32_t gap = header.sequence - expectedSequence;
+    if (haveSequence && gap > UINT32_MAX / 2) {
+        ++streamCounters.framesDiscarded;
+    } else {
+        if (haveSequence) {
+            streamCounters.framesDropped += gap;
+        }
+        haveSequence = true;
+        expectedSequence = header.sequence + 1;
+        ++streamCounters.framesReceived;
+
+        // The samples would be processed here. They start immediately after the header, and
+        // are not necessarily aligned.
+    }
+
+    if (pendingCredit < creditBatch) {
+        return 0;
+    }
+    return SampleStream_FlushCredit();
+}
+
+int SampleStream_FlushCredit(void)
+{
+    if (pendingCredit == 0) {
+        return 0;
+    }
+
+    if (SendCredit(pendingCredit) == -1) {
+        // If the socket is full, keep the credit and try again later.
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    pendingCredit = 0;
+    return 0;
+}
+
+void SampleStream_GetCounters(SampleStreamCounters *counters)
+{
+    *counters = streamCounters;
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The sample stream is a framed binary channel which carries blocks of sensor samples from
+// the real-time capable application (RTApp), alongside the text messages which the sample
+// exchanges. Each frame is sent in its own intercore message and starts with a
+// SampleStreamFrameHeader.
+//
+// This application controls the rate with credits. Each credit allows the RTApp to send one more
+// frame. Credit is returned in batches as frames are consumed, so the RTApp never has more than
+// the credit window in flight. Frames which the RTApp drops still use a sequence number, so gaps
+// in the sequence are counted as dropped frames.
+//
+// This header must match sample-stream.h in the RTApp.
+
+/// <summary>First word of every sample stream frame, "STRM" in little-endian order.</summary>
+#define SAMPLE_STREAM_MAGIC 0x4D525453u
+
+/// <summary>Number of 16-bit samples in each samples frame.</summary>
+#define SAMPLE_STREAM_SAMPLES_PER_FRAME 16
+
+/// <summary>Sample stream frame types.</summary>
+typedef enum {
+    /// <summary>RTApp to HLApp. The payload is SAMPLE_STREAM_SAMPLES_PER_FRAME samples.</summary>
+    SampleStreamFrameType_Samples = 1,
+    /// <summary>HLApp to RTApp. The payload is a uint32_t count of additional frames.</summary>
+    SampleStreamFrameType_Credit = 2
+} SampleStreamFrameType;
+
+/// <summary>Header which starts every sample stream frame.</summary>
+typedef struct {
+    /// <summary>Always <see cref="SAMPLE_STREAM_MAGIC" />.</summary>
+    uint32_t magic;
+    /// <summary>One of the <see cref="SampleStreamFrameType" /> values.</summary>
+    uint16_t type;
+    /// <summary>Payload length in bytes, not including this header.</summary>
+    uint16_t length;
+    /// <summary>Incremented for each frame of this type, including dropped frames.</summary>
+    uint32_t sequence;
+} SampleStreamFrameHeader;
+
+/// <summary>Counters which describe the activity of the sample stream.</summary>
+typedef struct {
+    /// <summary>Number of samples frames received.</summary>
+    uint32_t framesReceived;
+    /// <summary>Number of samples frames which were missing from the sequence.</summary>
+    uint32_t framesDropped;
+    /// <summary>Number of frames which were malformed, or arrived out of sequence.</summary>
+    uint32_t framesDiscarded;
+    /// <summary>Total credit granted to the RTApp.</summary>
+    uint32_t creditsGranted;
+} SampleStreamCounters;
+
+/// <summary>
+///     Starts the sample stream by granting the RTApp its initial credit.
+/// </summary>
+/// <param name="fd">Socket which is connected to the RTApp.</param>
+/// <param name="creditWindow">
+///     Maximum number of frames which the RTApp can send before this application consumes them.
+/// </param>
+/// <returns>0 on success; -1 on failure, in which case errno is set.</returns>
+int SampleStream_Start(int fd, uint32_t creditWindow);
+
+/// <summary>
+///     Checks whether a message from the RTApp is a sample stream frame.
+/// </summary>
+/// <param name="data">Message payload.</param>
+/// <param name="size">Message payload size in bytes.</param>
+/// <returns>true if the message is a sample stream frame; false otherwise.</returns>
+bool SampleStream_IsFrame(const void *data, size_t size);
+
+/// <summary>
+///     Handles a sample stream frame, and returns credit to the RTApp when a batch of frames
+///     has been consumed.
+/// </summary>
+/// <param name="data">Frame, which <see cref="SampleStream_IsFrame" /> accepted.</param>
+/// <param name="size">Frame size in bytes.</param>
+/// <returns>0 on success; -1 if credit could not be sent, in which case errno is set.</returns>
+int SampleStream_HandleFrame(const void *data, size_t size);
+
+/// <summary>
+///     Sends any credit which could not be sent earlier because the socket was full. Call this
+///     periodically, so the stream recovers if the RTApp has run out of credit.
+/// </summary>
+/// <returns>0 on success; -1 if credit could not be sent, in which case errno is set.</returns>
+int SampleStream_FlushCredit(void);
+
+/// <summary>Gets the sample stream counters.</summary>
+/// <param name="counters">Populated with the current counter values.</param>
+void SampleStream_GetCounters(SampleStreamCounters *counters);
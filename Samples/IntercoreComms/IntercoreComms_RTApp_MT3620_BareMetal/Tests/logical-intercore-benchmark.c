@@ -0,0 +1,353 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test and benchmark for the batched calls in logical-intercore.c, which run on a Linux PC. Two
+// IntercoreComm handles share a pair of buffers in memory, with their inbound and outbound buffers
+// swapped, so one thread plays the RTApp and the other plays the high-level app. The mailbox
+// doorbells, MT3620_SignalHLCoreMessageSent and MT3620_SignalHLCoreMessageReceived, are counted
+// rather than sent.
+//
+// The test checks that partial batches stop at the first message which cannot be moved, and that
+// an empty batch rings no doorbell. The benchmark sends messages of random sizes from one thread
+// to the other, with IntercoreSend and IntercoreRecv and then with batches of several sizes. It
+// checks the content and order of every message, and reports messages per second and doorbells
+// per message.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logical-intercore.h"
+
+// The high-level core's buffers are a power of two in size, including the 64-byte header.
+#define BUFFER_SIZE 4096
+#define HEADER_SIZE 64
+#define MAX_BATCH 16
+#define MAX_MESSAGE_SIZE 120
+#define BENCHMARK_MESSAGES 1000000u
+
+static _Alignas(HEADER_SIZE) uint8_t bufferA[BUFFER_SIZE];
+static _Alignas(HEADER_SIZE) uint8_t bufferB[BUFFER_SIZE];
+
+// The RTApp sends through bufferB and receives through bufferA; the high-level app is the
+// opposite.
+static IntercoreComm rtApp;
+static IntercoreComm highLevelApp;
+
+static const ComponentId componentId = {
+    .data1 = 0x25025d2c, .data2 = 0x66da, .data3 = 0x4448, .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc,
+                                                                      0xdd, 0x36, 0x27}};
+
+static unsigned long sentDoorbells = 0;
+static unsigned long receivedDoorbells = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+void MT3620_SetupIntercoreComm(uint32_t *inboundBase, uint32_t *outboundBase, Callback recvCallback)
+{
+}
+
+void MT3620_SignalHLCoreMessageSent(void)
+{
+    ++sentDoorbells;
+}
+
+void MT3620_SignalHLCoreMessageReceived(void)
+{
+    ++receivedDoorbells;
+}
+
+static void ResetBuffers(void)
+{
+    memset(bufferA, 0, sizeof(bufferA));
+    memset(bufferB, 0, sizeof(bufferB));
+
+    rtApp.inbound = (BufferHeader *)bufferA;
+    rtApp.outbound = (BufferHeader *)bufferB;
+    rtApp.inboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+    rtApp.outboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+
+    highLevelApp.inbound = (BufferHeader *)bufferB;
+    highLevelApp.outbound = (BufferHeader *)bufferA;
+    highLevelApp.inboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+    highLevelApp.outboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+
+    sentDoorbells = 0;
+    receivedDoorbells = 0;
+}
+
+static double GetNowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// Each message starts with its sequence number, and the rest of the payload is derived from it.
+static size_t GetMessageSize(uint32_t sequence)
+{
+    return sizeof(sequence) + (sequence * 2654435761u >> 16) % (MAX_MESSAGE_SIZE - 3);
+}
+
+static void FillMessage(uint8_t *message, uint32_t sequence, size_t size)
+{
+    memcpy(message, &sequence, sizeof(sequence));
+    for (size_t i = sizeof(sequence); i < size; ++i) {
+        message[i] = (uint8_t)(sequence * 7 + i);
+    }
+}
+
+static bool IsMessageValid(const uint8_t *message, uint32_t sequence, size_t size)
+{
+    uint8_t expected[MAX_MESSAGE_SIZE];
+    if (size != GetMessageSize(sequence)) {
+        return false;
+    }
+    FillMessage(expected, sequence, size);
+    return memcmp(message, expected, size) == 0;
+}
+
+// A batch which does not fit is sent up to the first message which does not fit, with one
+// doorbell; a batch which cannot send anything rings no doorbell.
+static void TestPartialSendBatch(void)
+{
+    ResetBuffers();
+
+    static uint8_t payload[1000];
+    const IntercoreSendMessage messages[] = {
+        {payload, sizeof(payload)}, {payload, sizeof(payload)}, {payload, sizeof(payload)},
+        {payload, sizeof(payload)}, {payload, sizeof(payload)}};
+    size_t sent;
+    IntercoreResult icr = IntercoreSendBatch(&rtApp, &componentId, messages, 5, &sent);
+    if (icr != Intercore_Send_NotEnoughBufferSpace) {
+        Fail("TestPartialSendBatch", "wrong result", icr);
+    }
+    if (sent != 3) {
+        Fail("TestPartialSendBatch", "wrong number sent", (long)sent);
+    }
+    if (sentDoorbells != 1) {
+        Fail("TestPartialSendBatch", "wrong number of doorbells", (long)sentDoorbells);
+    }
+
+    icr = IntercoreSendBatch(&rtApp, &componentId, messages, 5, &sent);
+    if (icr != Intercore_Send_NotEnoughBufferSpace || sent != 0 || sentDoorbells != 1) {
+        Fail("TestPartialSendBatch", "full buffer sent a message", (long)sent);
+    }
+
+    const IntercoreSendMessage tooLarge = {payload, INTERCORE_MAX_PAYLOAD_LEN + 1};
+    icr = IntercoreSendBatch(&highLevelApp, &componentId, &tooLarge, 1, &sent);
+    if (icr != Intercore_Send_MessageTooLarge || sent != 0) {
+        Fail("TestPartialSendBatch", "too large message was sent", icr);
+    }
+}
+
+// A batch stops at a message which does not fit in its buffer, and leaves that message to be
+// received later; an empty buffer rings no doorbell.
+static void TestPartialRecvBatch(void)
+{
+    ResetBuffers();
+
+    uint8_t sendData[3][MAX_MESSAGE_SIZE];
+    IntercoreSendMessage sendMessages[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        sendMessages[i].data = sendData[i];
+        sendMessages[i].size = GetMessageSize(i);
+        FillMessage(sendData[i], i, sendMessages[i].size);
+    }
+    size_t sent;
+    IntercoreSendBatch(&highLevelApp, &componentId, sendMessages, 3, &sent);
+
+    // The second message is larger than the first, so it does not fit in a buffer of the same
+    // size.
+    const size_t firstSize = GetMessageSize(0);
+    uint8_t recvData[3][MAX_MESSAGE_SIZE];
+    IntercoreRecvMessage recvMessages[3] = {{.data = recvData[0], .size = firstSize},
+                                            {.data = recvData[1], .size = firstSize},
+                                            {.data = recvData[2], .size = firstSize}};
+    size_t received;
+    IntercoreResult icr = IntercoreRecvBatch(&rtApp, recvMessages, 3, &received);
+    if (icr != Intercore_Recv_BufferTooSmall || received != 1) {
+        Fail("TestPartialRecvBatch", "wrong number received", (long)received);
+    }
+    if (!IsMessageValid(recvData[0], 0, recvMessages[0].size)) {
+        Fail("TestPartialRecvBatch", "wrong first message", (long)recvMessages[0].size);
+    }
+    if (recvMessages[1].size != firstSize) {
+        Fail("TestPartialRecvBatch", "descriptor modified", (long)recvMessages[1].size);
+    }
+    if (receivedDoorbells != 1) {
+        Fail("TestPartialRecvBatch", "wrong number of doorbells", (long)receivedDoorbells);
+    }
+
+    for (size_t i = 0; i < 3; ++i) {
+        recvMessages[i].size = MAX_MESSAGE_SIZE;
+    }
+    icr = IntercoreRecvBatch(&rtApp, recvMessages, 3, &received);
+    if (icr != Intercore_Recv_NoBlockSize || received != 2) {
+        Fail("TestPartialRecvBatch", "remaining messages not received", (long)received);
+    }
+    for (uint32_t i = 0; i < received; ++i) {
+        if (!IsMessageValid(recvData[i], i + 1, recvMessages[i].size) ||
+            memcmp(&recvMessages[i].sender, &componentId, sizeof(componentId)) != 0) {
+            Fail("TestPartialRecvBatch", "wrong message", (long)i);
+        }
+    }
+
+    icr = IntercoreRecvBatch(&rtApp, recvMessages, 3, &received);
+    if (icr != Intercore_Recv_NoBlockSize || received != 0 || receivedDoorbells != 2) {
+        Fail("TestPartialRecvBatch", "empty buffer rang doorbell", (long)receivedDoorbells);
+    }
+}
+
+static size_t batchSize;
+static uint32_t receivedCount;
+static volatile bool receiveFailed;
+
+// Sends BENCHMARK_MESSAGES messages from the RTApp. A batch size of zero uses IntercoreSend.
+static void *SendThread(void *arg)
+{
+    static uint8_t data[MAX_BATCH][MAX_MESSAGE_SIZE];
+    IntercoreSendMessage messages[MAX_BATCH];
+    uint32_t sequence = 0;
+
+    while (sequence < BENCHMARK_MESSAGES && !receiveFailed) {
+        size_t count = (batchSize == 0) ? 1 : batchSize;
+        if (count > BENCHMARK_MESSAGES - sequence) {
+            count = BENCHMARK_MESSAGES - sequence;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            messages[i].data = data[i];
+            messages[i].size = GetMessageSize(sequence + (uint32_t)i);
+            FillMessage(data[i], sequence + (uint32_t)i, messages[i].size);
+        }
+
+        size_t sent;
+        if (batchSize == 0) {
+            sent = (IntercoreSend(&rtApp, &componentId, messages[0].data, messages[0].size) ==
+                    Intercore_OK)
+                       ? 1
+                       : 0;
+        } else {
+            IntercoreSendBatch(&rtApp, &componentId, messages, count, &sent);
+        }
+
+        sequence += (uint32_t)sent;
+        if (sent < count) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+// Receives the messages in the high-level app, and checks each of them.
+static void *RecvThread(void *arg)
+{
+    static uint8_t data[MAX_BATCH][MAX_MESSAGE_SIZE];
+    IntercoreRecvMessage messages[MAX_BATCH];
+
+    while (receivedCount < BENCHMARK_MESSAGES) {
+        size_t count = (batchSize == 0) ? 1 : batchSize;
+        for (size_t i = 0; i < count; ++i) {
+            messages[i].data = data[i];
+            messages[i].size = MAX_MESSAGE_SIZE;
+        }
+
+        size_t received;
+        if (batchSize == 0) {
+            received = (IntercoreRecv(&highLevelApp, &messages[0].sender, messages[0].data,
+                                      &messages[0].size) == Intercore_OK)
+                           ? 1
+                           : 0;
+        } else {
+            IntercoreRecvBatch(&highLevelApp, messages, count, &received);
+        }
+
+        for (size_t i = 0; i < received; ++i) {
+            if (!IsMessageValid(data[i], receivedCount, messages[i].size) ||
+                memcmp(&messages[i].sender, &componentId, sizeof(componentId)) != 0) {
+                Fail("RecvThread", "wrong message", (long)receivedCount);
+                receiveFailed = true;
+                return NULL;
+            }
+            ++receivedCount;
+        }
+        if (received == 0) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void BenchmarkBatchSizes(void)
+{
+    static const size_t batchSizes[] = {0, 1, 4, 16};
+
+    printf("%-18s %14s %20s %20s\n", "batch", "messages/s", "sent doorbells/msg",
+           "recv doorbells/msg");
+    for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); ++i) {
+        ResetBuffers();
+        batchSize = batchSizes[i];
+        receivedCount = 0;
+        receiveFailed = false;
+
+        pthread_t sendThread, recvThread;
+        double start = GetNowSeconds();
+        pthread_create(&recvThread, NULL, RecvThread, NULL);
+        pthread_create(&sendThread, NULL, SendThread, NULL);
+        pthread_join(sendThread, NULL);
+        pthread_join(recvThread, NULL);
+        double elapsed = GetNowSeconds() - start;
+
+        if (receiveFailed) {
+            return;
+        }
+
+        char label[32];
+        if (batchSize == 0) {
+            snprintf(label, sizeof(label), "IntercoreSend");
+        } else {
+            snprintf(label, sizeof(label), "batch of %zu", batchSize);
+        }
+        printf("%-18s %14.0f %20.3f %20.3f\n", label, BENCHMARK_MESSAGES / elapsed,
+               (double)sentDoorbells / BENCHMARK_MESSAGES,
+               (double)receivedDoorbells / BENCHMARK_MESSAGES);
+
+        if (batchSize == 0 && sentDoorbells != BENCHMARK_MESSAGES) {
+            Fail("BenchmarkBatchSizes", "IntercoreSend did not ring once per message",
+                 (long)sentDoorbells);
+        }
+        if (batchSize > 1 && sentDoorbells > BENCHMARK_MESSAGES / 2) {
+            Fail("BenchmarkBatchSizes", "batches did not share doorbells", (long)sentDoorbells);
+        }
+    }
+}
+
+int main(void)
+{
+    TestPartialSendBatch();
+    TestPartialRecvBatch();
+    BenchmarkBatchSizes();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stress test for the zero-copy calls in logical-intercore.c, which runs on a Linux PC. As in
+// logical-intercore-benchmark.c, two IntercoreComm handles share a pair of buffers with their
+// inbound and outbound buffers swapped. The buffers are 1 KB, so messages wrap around the end of
+// the ring often.
+//
+// The producer thread sends each message with IntercoreSend, or writes it in place with
+// IntercoreReserve and IntercoreCommit, sometimes after abandoning a reservation or committing less
+// than it reserved. The consumer thread receives each message with IntercoreRecv, or reads it in
+// place with IntercorePeek and IntercoreRelease. The consumer checks the content and order of
+// every message. INTERCORE_ASSERT spins forever, so a broken invariant makes the test time out.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logical-intercore.h"
+
+#define BUFFER_SIZE 1024
+#define HEADER_SIZE 64
+#define MAX_MESSAGE_SIZE 200
+#define MAX_UNUSED_SIZE 64
+#define STRESS_MESSAGES 2000000u
+
+static _Alignas(HEADER_SIZE) uint8_t bufferA[BUFFER_SIZE];
+static _Alignas(HEADER_SIZE) uint8_t bufferB[BUFFER_SIZE];
+
+static IntercoreComm producer;
+static IntercoreComm consumer;
+
+static const ComponentId componentId = {
+    .data1 = 0x25025d2c, .data2 = 0x66da, .data3 = 0x4448, .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc,
+                                                                      0xdd, 0x36, 0x27}};
+
+static unsigned long wrappedReservations = 0;
+static unsigned long wrappedViews = 0;
+static volatile bool stressFailed = false;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+void MT3620_SetupIntercoreComm(uint32_t *inboundBase, uint32_t *outboundBase, Callback recvCallback)
+{
+}
+
+void MT3620_SignalHLCoreMessageSent(void)
+{
+}
+
+void MT3620_SignalHLCoreMessageReceived(void)
+{
+}
+
+static void ResetBuffers(void)
+{
+    memset(bufferA, 0, sizeof(bufferA));
+    memset(bufferB, 0, sizeof(bufferB));
+
+    producer.inbound = (BufferHeader *)bufferA;
+    producer.outbound = (BufferHeader *)bufferB;
+    producer.inboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+    producer.outboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+
+    consumer.inbound = (BufferHeader *)bufferB;
+    consumer.outbound = (BufferHeader *)bufferA;
+    consumer.inboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+    consumer.outboundBufSize = BUFFER_SIZE - HEADER_SIZE;
+}
+
+// Each thread uses its own generator, so the threads do not share state.
+static uint32_t NextRandom(uint32_t *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Each message starts with its sequence number, and the rest of the payload is derived from it.
+static size_t GetMessageSize(uint32_t sequence)
+{
+    return sizeof(sequence) + (sequence * 2654435761u >> 16) % (MAX_MESSAGE_SIZE - 3);
+}
+
+static void FillMessage(uint8_t *message, uint32_t sequence, size_t size)
+{
+    memcpy(message, &sequence, sizeof(sequence));
+    for (size_t i = sizeof(sequence); i < size; ++i) {
+        message[i] = (uint8_t)(sequence * 7 + i);
+    }
+}
+
+static bool IsMessageValid(const uint8_t *message, uint32_t sequence, size_t size)
+{
+    uint8_t expected[MAX_MESSAGE_SIZE];
+    if (size != GetMessageSize(sequence)) {
+        return false;
+    }
+    FillMessage(expected, sequence, size);
+    return memcmp(message, expected, size) == 0;
+}
+
+// Writes a message into a reservation, which may be split in two at the end of the ring.
+static void WriteReservation(const IntercoreReservation *reservation, const uint8_t *message,
+                             size_t size)
+{
+    size_t firstSize = size < reservation->size[0] ? size : reservation->size[0];
+    memcpy(reservation->data[0], message, firstSize);
+    memcpy(reservation->data[1], message + firstSize, size - firstSize);
+}
+
+// An abandoned reservation is not sent, and a commit smaller than the reservation returns the
+// unused space to the buffer.
+static void TestAbandonAndShrink(void)
+{
+    ResetBuffers();
+
+    IntercoreReservation reservation;
+    IntercoreResult icr = IntercoreReserve(&producer, 100, &reservation);
+    if (icr != Intercore_OK || reservation.size[0] + reservation.size[1] != 100) {
+        Fail("TestAbandonAndShrink", "reserve failed", icr);
+        return;
+    }
+    memset(reservation.data[0], 0xAA, reservation.size[0]);
+
+    uint8_t message[MAX_MESSAGE_SIZE];
+    FillMessage(message, 0, GetMessageSize(0));
+    IntercoreSend(&producer, &componentId, message, GetMessageSize(0));
+
+    // Reserve nearly the whole ring, and commit only one message.
+    size_t largest = BUFFER_SIZE - HEADER_SIZE - 2 * 48;
+    icr = IntercoreReserve(&producer, largest, &reservation);
+    if (icr != Intercore_OK) {
+        Fail("TestAbandonAndShrink", "large reserve failed", icr);
+        return;
+    }
+    FillMessage(message, 1, GetMessageSize(1));
+    WriteReservation(&reservation, message, GetMessageSize(1));
+    IntercoreCommit(&producer, &componentId, &reservation, GetMessageSize(1));
+
+    FillMessage(message, 2, GetMessageSize(2));
+    icr = IntercoreSend(&producer, &componentId, message, GetMessageSize(2));
+    if (icr != Intercore_OK) {
+        Fail("TestAbandonAndShrink", "unused space not returned", icr);
+    }
+
+    for (uint32_t sequence = 0; sequence < 3; ++sequence) {
+        IntercoreMessageView view;
+        icr = IntercorePeek(&consumer, &view);
+        if (icr != Intercore_OK || view.size[1] != 0 ||
+            !IsMessageValid(view.data[0], sequence, view.size[0])) {
+            Fail("TestAbandonAndShrink", "wrong message", (long)sequence);
+            return;
+        }
+        IntercoreRelease(&consumer, &view);
+    }
+
+    IntercoreMessageView view;
+    if (IntercorePeek(&consumer, &view) != Intercore_Recv_NoBlockSize) {
+        Fail("TestAbandonAndShrink", "abandoned reservation was sent", (long)view.size[0]);
+    }
+}
+
+static void *ProducerThread(void *arg)
+{
+    uint8_t message[MAX_MESSAGE_SIZE];
+    uint32_t state = 1;
+    uint32_t sequence = 0;
+
+    while (sequence < STRESS_MESSAGES && !stressFailed) {
+        size_t size = GetMessageSize(sequence);
+        FillMessage(message, sequence, size);
+
+        uint32_t choice = NextRandom(&state) % 8;
+        if (choice < 3) {
+            if (IntercoreSend(&producer, &componentId, message, size) != Intercore_OK) {
+                sched_yield();
+                continue;
+            }
+        } else {
+            size_t reserveSize = size + NextRandom(&state) % MAX_UNUSED_SIZE;
+            IntercoreReservation reservation;
+            if (IntercoreReserve(&producer, reserveSize, &reservation) != Intercore_OK) {
+                sched_yield();
+                continue;
+            }
+            if (reservation.size[0] + reservation.size[1] != reserveSize) {
+                Fail("ProducerThread", "wrong reservation size", (long)reserveSize);
+                stressFailed = true;
+                break;
+            }
+            if (reservation.size[1] != 0) {
+                ++wrappedReservations;
+            }
+            WriteReservation(&reservation, message, size);
+
+            // Sometimes abandon the reservation, and send the same message again.
+            if (choice == 3) {
+                continue;
+            }
+            IntercoreCommit(&producer, &componentId, &reservation, size);
+        }
+        ++sequence;
+    }
+
+    return NULL;
+}
+
+static void *ConsumerThread(void *arg)
+{
+    uint8_t message[MAX_MESSAGE_SIZE];
+    uint32_t state = 2;
+    uint32_t sequence = 0;
+
+    while (sequence < STRESS_MESSAGES) {
+        if (NextRandom(&state) % 2 == 0) {
+            ComponentId sender;
+            size_t size = sizeof(message);
+            if (IntercoreRecv(&consumer, &sender, message, &size) != Intercore_OK) {
+                sched_yield();
+                continue;
+            }
+            if (!IsMessageValid(message, sequence, size) ||
+                memcmp(&sender, &componentId, sizeof(sender)) != 0) {
+                Fail("ConsumerThread", "wrong received message", (long)sequence);
+                stressFailed = true;
+                break;
+            }
+        } else {
+            IntercoreMessageView view;
+            if (IntercorePeek(&consumer, &view) != Intercore_OK) {
+                sched_yield();
+                continue;
+            }
+
+            // Check the payload in place. It is split in two if it wraps around.
+            size_t size = view.size[0] + view.size[1];
+            if (size != GetMessageSize(sequence) ||
+                memcmp(&view.sender, &componentId, sizeof(view.sender)) != 0) {
+                Fail("ConsumerThread", "wrong peeked size", (long)sequence);
+                stressFailed = true;
+                break;
+            }
+            FillMessage(message, sequence, size);
+            if (memcmp(view.data[0], message, view.size[0]) != 0 ||
+                memcmp(view.data[1], message + view.size[0], view.size[1]) != 0) {
+                Fail("ConsumerThread", "wrong peeked message", (long)sequence);
+                stressFailed = true;
+                break;
+            }
+            if (view.size[1] != 0) {
+                ++wrappedViews;
+            }
+            IntercoreRelease(&consumer, &view);
+        }
+        ++sequence;
+    }
+
+    return NULL;
+}
+
+static void TestConcurrentStress(void)
+{
+    ResetBuffers();
+
+    pthread_t producerThread, consumerThread;
+    pthread_create(&consumerThread, NULL, ConsumerThread, NULL);
+    pthread_create(&producerThread, NULL, ProducerThread, NULL);
+    pthread_join(producerThread, NULL);
+    pthread_join(consumerThread, NULL);
+
+    // Make sure that the split payloads were exercised.
+    printf("%u messages; %lu reservations and %lu peeked messages wrapped around\n",
+           STRESS_MESSAGES, wrappedReservations, wrappedViews);
+    if (wrappedReservations == 0 || wrappedViews == 0) {
+        Fail("TestConcurrentStress", "no payload wrapped around", 0);
+    }
+}
+
+int main(void)
+{
+    TestAbandonAndShrink();
+    TestConcurrentStress();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
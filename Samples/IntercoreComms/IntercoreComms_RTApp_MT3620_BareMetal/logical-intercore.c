@@ -50,6 +50,47 @@ static uint32_t ReadInboundCircular(const IntercoreComm *icc, uint32_t startPos,
 static uint32_t WriteOutboundCircular(const IntercoreComm *icc, uint32_t startPos, const void *src,
                                       size_t size);
 
+static uint32_t NextBlockPosition(uint32_t bufSize, uint32_t payloadPosition, size_t size);
+static size_t SizeBeforeWrap(uint32_t bufSize, uint32_t *position, size_t size);
+
+static void LoadInboundPositions(const IntercoreComm *icc, uint32_t *remoteWritePosition,
+                                 uint32_t *localReadPosition);
+static void StoreInboundReadPosition(IntercoreComm *icc, uint32_t localReadPosition);
+static IntercoreResult LocateInboundBlock(const IntercoreComm *icc, uint32_t remoteWritePosition,
+                                          uint32_t readPosition, ComponentId *srcAppId,
+                                          uint32_t *payloadPosition, size_t *payloadSize,
+                                          uint32_t *nextReadPosition);
+static IntercoreResult RecvBlock(const IntercoreComm *icc, uint32_t remoteWritePosition,
+                                 uint32_t *localReadPosition, ComponentId *srcAppId, void *dest,
+                                 size_t *size);
+
+static void LoadOutboundPositions(const IntercoreComm *icc, uint32_t *remoteReadPosition,
+                                  uint32_t *localWritePosition);
+static void StoreOutboundWritePosition(IntercoreComm *icc, uint32_t localWritePosition);
+static IntercoreResult AllocateOutboundBlock(const IntercoreComm *icc, uint32_t remoteReadPosition,
+                                             uint32_t writePosition, size_t size,
+                                             uint32_t *payloadPosition);
+static uint32_t FinishOutboundBlock(const IntercoreComm *icc, uint32_t writePosition,
+                                    const ComponentId *destAppId, size_t size);
+static IntercoreResult SendBlock(const IntercoreComm *icc, uint32_t remoteReadPosition,
+                                 uint32_t *localWritePosition, const ComponentId *destAppId,
+                                 const void *data, size_t size);
+
+/// <summary>
+///     Each block in the shared buffer starts with this header, which is followed
+///     by the sender-supplied data.
+/// </summary>
+typedef struct {
+    /// <summary>
+    ///     Size of the block in bytes. This does not include the space taken by this field.
+    /// </summary>
+    uint32_t blockSize;
+    /// <summary>On send, the recipient's component ID; on receive, the sender's.</summary>
+    ComponentId componentId;
+    /// <summary>Reserved word.</summary>
+    uint32_t reserved;
+} BlockHeader;
+
 // If intercore debugging is enabled and the application detects a corrupt buffer,
 // it will spin forever in the Assert function. The user can then use a debugger
 // to see the type of corruption was detected.
@@ -86,7 +127,7 @@ static uint32_t GetBufferSize(uint32_t bufferBase)
 // stored in the top 27 bits.
 static BufferHeader *GetBufferHeader(uint32_t bufferBase)
 {
-    return (BufferHeader *)(bufferBase & ~0x1F);
+    return (BufferHeader *)(uintptr_t)(bufferBase & ~0x1F);
 }
 
 IntercoreResult SetupIntercoreComm(IntercoreComm *icc, Callback recvCallback)
@@ -154,32 +195,79 @@ static uint32_t ReadInboundCircular(const IntercoreComm *icc, uint32_t startPos,
     return finalPos;
 }
 
-IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *dest, size_t *size)
+// Returns the position of the block which follows a block whose payload occupies size bytes
+// from payloadPosition. Blocks start on a RINGBUFFER_ALIGNMENT boundary, so this may wrap around.
+static uint32_t NextBlockPosition(uint32_t bufSize, uint32_t payloadPosition, size_t size)
+{
+    uint32_t position = payloadPosition + size;
+    if (position > bufSize) {
+        position -= bufSize;
+    }
+
+    position = RoundUp(position, RINGBUFFER_ALIGNMENT);
+    if (position >= bufSize) {
+        position -= bufSize;
+    }
+    return position;
+}
+
+// Returns how many bytes of a region which starts at position, and is size bytes long, lie
+// before the end of the buffer. The remainder of the region starts at the beginning of the buffer.
+static size_t SizeBeforeWrap(uint32_t bufSize, uint32_t *position, size_t size)
+{
+    if (*position >= bufSize) {
+        *position -= bufSize;
+    }
+
+    uint32_t sizeToEnd = bufSize - *position;
+    return (size > sizeToEnd) ? sizeToEnd : size;
+}
+
+// Reads the remote write position and the local read position for the inbound buffer.
+static void LoadInboundPositions(const IntercoreComm *icc, uint32_t *remoteWritePosition,
+                                 uint32_t *localReadPosition)
 {
     // Don't read message content until have seen that remote write position has been updated.
     // Corresponding release occurs on high-level core.
-    uint32_t remoteWritePosition;
-    __atomic_load(&icc->inbound->writePosition, &remoteWritePosition, __ATOMIC_ACQUIRE);
+    __atomic_load(&icc->inbound->writePosition, remoteWritePosition, __ATOMIC_ACQUIRE);
     // Last position read from by this RTApp.
-    uint32_t localReadPosition = icc->outbound->readPosition;
+    *localReadPosition = icc->outbound->readPosition;
 
     // sanity check read and write positions
-    INTERCORE_ASSERT(remoteWritePosition < icc->inboundBufSize);
-    INTERCORE_ASSERT((remoteWritePosition % RINGBUFFER_ALIGNMENT) == 0);
-    INTERCORE_ASSERT(localReadPosition < icc->inboundBufSize);
-    INTERCORE_ASSERT((localReadPosition % RINGBUFFER_ALIGNMENT) == 0);
+    INTERCORE_ASSERT(*remoteWritePosition < icc->inboundBufSize);
+    INTERCORE_ASSERT((*remoteWritePosition % RINGBUFFER_ALIGNMENT) == 0);
+    INTERCORE_ASSERT(*localReadPosition < icc->inboundBufSize);
+    INTERCORE_ASSERT((*localReadPosition % RINGBUFFER_ALIGNMENT) == 0);
+}
 
+// Publishes the local read position for the inbound buffer, and tells the HLApp.
+static void StoreInboundReadPosition(IntercoreComm *icc, uint32_t localReadPosition)
+{
+    // The message content must have been retrieved before the high-level core sees the read
+    // position has been updated. Corresponding acquire occurs on high-level core.
+    __atomic_store(&icc->outbound->readPosition, &localReadPosition, __ATOMIC_RELEASE);
+
+    MT3620_SignalHLCoreMessageReceived();
+}
+
+// Helper function for RecvBlock and IntercorePeek. Checks the block at readPosition and
+// finds its payload, which is not copied.
+static IntercoreResult LocateInboundBlock(const IntercoreComm *icc, uint32_t remoteWritePosition,
+                                          uint32_t readPosition, ComponentId *srcAppId,
+                                          uint32_t *payloadPosition, size_t *payloadSize,
+                                          uint32_t *nextReadPosition)
+{
     // Get the maximum amount of available data. The actual block size may be
     // smaller than this.
 
     uint32_t availData;
     // If data is contiguous in buffer then difference between write and read positions...
-    if (remoteWritePosition >= localReadPosition) {
-        availData = remoteWritePosition - localReadPosition;
+    if (remoteWritePosition >= readPosition) {
+        availData = remoteWritePosition - readPosition;
     }
     // ...else data wraps around end and resumes at start of buffer
     else {
-        availData = remoteWritePosition - localReadPosition + icc->inboundBufSize;
+        availData = remoteWritePosition - readPosition + icc->inboundBufSize;
     }
 
     // The amount of available data must be at least enough to hold the block size.
@@ -190,12 +278,12 @@ IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *d
     }
 
     // The block size must be stored in four contiguous bytes before wraparound.
-    uint32_t dataToEnd = icc->inboundBufSize - localReadPosition;
+    uint32_t dataToEnd = icc->inboundBufSize - readPosition;
     INTERCORE_ASSERT(blockSizeSize <= dataToEnd);
 
     // The block size followed by the actual block can be no longer than the available data.
     uint32_t blockSize;
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, &blockSize, sizeof(blockSize));
+    __builtin_memcpy(&blockSize, DataAreaOffset8(icc->inbound, readPosition), sizeof(blockSize));
     uint32_t totalBlockSize;
     // clang-tidy fails with "error: use of unknown builtin '__builtin_add_overflow_p'"
 #ifndef __clang_analyzer__
@@ -206,44 +294,131 @@ IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *d
 
     // The payload contains a sender ID (16 bytes) followed by a reserved word
     // (4 bytes) followed by the sender-supplied data.
-    const uint32_t senderComponentIdSize = sizeof(*srcAppId);
-    const uint32_t reservedWordSize = sizeof(uint32_t);
-    const uint32_t minReqBlockSize = senderComponentIdSize + reservedWordSize;
+    const uint32_t minReqBlockSize = sizeof(BlockHeader) - blockSizeSize;
     INTERCORE_ASSERT(blockSize >= minReqBlockSize);
 
+    // Read the header, which may wraparound to the start of the buffer. The sender-supplied
+    // data follows it.
+    BlockHeader header;
+    *payloadPosition = ReadInboundCircular(icc, readPosition, &header, sizeof(header));
+    *srcAppId = header.componentId;
+    *payloadSize = blockSize - minReqBlockSize;
+
+    // Align read position to next possible location for next buffer. This may wrap around.
+    *nextReadPosition = NextBlockPosition(icc->inboundBufSize, *payloadPosition, *payloadSize);
+    return Intercore_OK;
+}
+
+// Helper function for IntercoreRecvBatch. Reads the block at *localReadPosition, and
+// advances *localReadPosition to the start of the next block. Does not publish the new
+// read position to the high-level core.
+static IntercoreResult RecvBlock(const IntercoreComm *icc, uint32_t remoteWritePosition,
+                                 uint32_t *localReadPosition, ComponentId *srcAppId, void *dest,
+                                 size_t *size)
+{
+    ComponentId sender;
+    uint32_t payloadPosition;
+    size_t senderPayloadSize;
+    uint32_t nextReadPosition;
+    IntercoreResult icr =
+        LocateInboundBlock(icc, remoteWritePosition, *localReadPosition, &sender,
+                           &payloadPosition, &senderPayloadSize, &nextReadPosition);
+    if (icr != Intercore_OK) {
+        return icr;
+    }
+
     // The caller-supplied buffer must be large enough to contain the payload in the buffer,
     // excluding component ID and reserved word.
-    size_t senderPayloadSize = blockSize - minReqBlockSize;
     if (senderPayloadSize > *size) {
         return Intercore_Recv_BufferTooSmall;
     }
 
-    // Tell the caller the actual block size.
+    // Tell the caller the actual block size and sender, and copy out the app-specific payload.
+    // This may wraparound to the start of the buffer.
     *size = senderPayloadSize;
+    *srcAppId = sender;
+    ReadInboundCircular(icc, payloadPosition, dest, senderPayloadSize);
 
-    // Read the sender component ID, reserved word, and app-specific payload from the block.
-    // This may wraparound to the start of the buffer.
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, srcAppId, sizeof(*srcAppId));
-    uint32_t reservedWord; // discarded
-    localReadPosition =
-        ReadInboundCircular(icc, localReadPosition, &reservedWord, sizeof(reservedWord));
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, dest, senderPayloadSize);
+    *localReadPosition = nextReadPosition;
+    return Intercore_OK;
+}
 
-    // Align read position to next possible location for next buffer. This may wrap around.
-    localReadPosition = RoundUp(localReadPosition, RINGBUFFER_ALIGNMENT);
-    if (localReadPosition >= icc->inboundBufSize) {
-        localReadPosition -= icc->inboundBufSize;
+IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *dest, size_t *size)
+{
+    IntercoreRecvMessage message = {.data = dest, .size = *size};
+    size_t received;
+    IntercoreResult icr = IntercoreRecvBatch(icc, &message, 1, &received);
+
+    if (received == 1) {
+        *srcAppId = message.sender;
+        *size = message.size;
     }
 
-    // The message content must have been retrieved before the high-level core sees the read
-    // position has been updated. Corresponding acquire occurs on high-level core.
-    __atomic_store(&icc->outbound->readPosition, &localReadPosition, __ATOMIC_RELEASE);
+    return icr;
+}
 
-    MT3620_SignalHLCoreMessageReceived();
+IntercoreResult IntercoreRecvBatch(IntercoreComm *icc, IntercoreRecvMessage *messages, size_t count,
+                                   size_t *received)
+{
+    *received = 0;
+
+    uint32_t remoteWritePosition, localReadPosition;
+    LoadInboundPositions(icc, &remoteWritePosition, &localReadPosition);
+
+    // Read as many messages as are available, up to count, with the same view of the
+    // remote write position.
+    IntercoreResult icr = Intercore_OK;
+    while (*received < count) {
+        IntercoreRecvMessage *m = &messages[*received];
+        icr = RecvBlock(icc, remoteWritePosition, &localReadPosition, &m->sender, m->data,
+                        &m->size);
+        if (icr != Intercore_OK) {
+            break;
+        }
+        ++*received;
+    }
+
+    if (*received > 0) {
+        StoreInboundReadPosition(icc, localReadPosition);
+    }
+
+    return icr;
+}
+
+IntercoreResult IntercorePeek(IntercoreComm *icc, IntercoreMessageView *view)
+{
+    uint32_t remoteWritePosition, localReadPosition;
+    LoadInboundPositions(icc, &remoteWritePosition, &localReadPosition);
+
+    uint32_t payloadPosition;
+    size_t payloadSize;
+    uint32_t nextReadPosition;
+    IntercoreResult icr =
+        LocateInboundBlock(icc, remoteWritePosition, localReadPosition, &view->sender,
+                           &payloadPosition, &payloadSize, &nextReadPosition);
+    if (icr != Intercore_OK) {
+        return icr;
+    }
+
+    // The payload may wrap around to the start of the buffer.
+    view->size[0] = SizeBeforeWrap(icc->inboundBufSize, &payloadPosition, payloadSize);
+    view->size[1] = payloadSize - view->size[0];
+    view->data[0] = DataAreaOffset8(icc->inbound, payloadPosition);
+    view->data[1] = DataAreaOffset8(icc->inbound, 0);
+    view->blockPosition = localReadPosition;
+    view->nextBlockPosition = nextReadPosition;
 
     return Intercore_OK;
 }
 
+void IntercoreRelease(IntercoreComm *icc, const IntercoreMessageView *view)
+{
+    // Messages must be released in order, and only once.
+    INTERCORE_ASSERT(view->blockPosition == icc->outbound->readPosition);
+
+    StoreInboundReadPosition(icc, view->nextBlockPosition);
+}
+
 // Helper function for IntercoreSend. Writes data to the outbound buffer,
 // and wraps around to start of buffer if required. Returns updated write position.
 static uint32_t WriteOutboundCircular(const IntercoreComm *icc, uint32_t startPos, const void *src,
@@ -271,68 +446,169 @@ static uint32_t WriteOutboundCircular(const IntercoreComm *icc, uint32_t startPo
     return finalPos;
 }
 
-IntercoreResult IntercoreSend(IntercoreComm *icc, const ComponentId *destAppId, const void *data,
-                              size_t size)
+// Reads the remote read position and the local write position for the outbound buffer.
+static void LoadOutboundPositions(const IntercoreComm *icc, uint32_t *remoteReadPosition,
+                                  uint32_t *localWritePosition)
 {
-    if (size > INTERCORE_MAX_PAYLOAD_LEN) {
-        return Intercore_Send_MessageTooLarge;
-    }
-
     // Last position read by HLApp. Corresponding release occurs on high-level core.
-    uint32_t remoteReadPosition;
-    __atomic_load(&icc->inbound->readPosition, &remoteReadPosition, __ATOMIC_ACQUIRE);
+    __atomic_load(&icc->inbound->readPosition, remoteReadPosition, __ATOMIC_ACQUIRE);
     // Last position written to by RTApp.
-    uint32_t localWritePosition = icc->outbound->writePosition;
+    *localWritePosition = icc->outbound->writePosition;
 
     // Sanity check read and write positions.
-    INTERCORE_ASSERT(remoteReadPosition < icc->outboundBufSize);
-    INTERCORE_ASSERT((remoteReadPosition % RINGBUFFER_ALIGNMENT) == 0);
-    INTERCORE_ASSERT(localWritePosition < icc->outboundBufSize);
-    INTERCORE_ASSERT((localWritePosition % RINGBUFFER_ALIGNMENT) == 0);
+    INTERCORE_ASSERT(*remoteReadPosition < icc->outboundBufSize);
+    INTERCORE_ASSERT((*remoteReadPosition % RINGBUFFER_ALIGNMENT) == 0);
+    INTERCORE_ASSERT(*localWritePosition < icc->outboundBufSize);
+    INTERCORE_ASSERT((*localWritePosition % RINGBUFFER_ALIGNMENT) == 0);
+}
+
+// Publishes the local write position for the outbound buffer, and tells the HLApp.
+static void StoreOutboundWritePosition(IntercoreComm *icc, uint32_t localWritePosition)
+{
+    // Ensure write position update is seen after new content has been written.
+    // Corresponding acquire is on high-level core.
+    __atomic_store(&icc->outbound->writePosition, &localWritePosition, __ATOMIC_RELEASE);
+
+    MT3620_SignalHLCoreMessageSent();
+}
+
+// Helper function for SendBlock and IntercoreReserve. Checks there is space for a block with
+// the supplied payload size at writePosition, and finds where its payload should be written.
+static IntercoreResult AllocateOutboundBlock(const IntercoreComm *icc, uint32_t remoteReadPosition,
+                                             uint32_t writePosition, size_t size,
+                                             uint32_t *payloadPosition)
+{
+    if (size > INTERCORE_MAX_PAYLOAD_LEN) {
+        return Intercore_Send_MessageTooLarge;
+    }
 
     // If the read pointer is behind the write pointer, then the free space
     // wraps around, and the used space doesn't.
     uint32_t availSpace;
-    if (remoteReadPosition <= localWritePosition) {
-        availSpace = remoteReadPosition - localWritePosition + icc->outboundBufSize;
+    if (remoteReadPosition <= writePosition) {
+        availSpace = remoteReadPosition - writePosition + icc->outboundBufSize;
     } else {
-        availSpace = remoteReadPosition - localWritePosition;
+        availSpace = remoteReadPosition - writePosition;
     }
 
-    // Check whether there is enough space to enqueue the next block.
-    uint32_t reqBlockSize = 0;
-    reqBlockSize += sizeof(uint32_t);    // block size field
-    reqBlockSize += sizeof(ComponentId); // destination HLApp ID
-    reqBlockSize += sizeof(uint32_t);    // reserved word
-    reqBlockSize += size;                // payload
+    // Check whether there is enough space to enqueue the next block. The header contains
+    // the block size field, destination HLApp ID, and reserved word.
+    uint32_t reqBlockSize = sizeof(BlockHeader) + size;
 
     if (availSpace < reqBlockSize + RINGBUFFER_ALIGNMENT) {
         return Intercore_Send_NotEnoughBufferSpace;
     }
 
+    *payloadPosition = writePosition + sizeof(BlockHeader);
+    if (*payloadPosition > icc->outboundBufSize) {
+        *payloadPosition -= icc->outboundBufSize;
+    }
+    return Intercore_OK;
+}
+
+// Helper function for SendBlock and IntercoreCommit. Writes the header for the block at
+// writePosition, whose payload has already been written. Returns the start of the next block.
+static uint32_t FinishOutboundBlock(const IntercoreComm *icc, uint32_t writePosition,
+                                    const ComponentId *destAppId, size_t size)
+{
     // The value in the block size field does not include the space taken by the
     // block size field itself.
-    uint32_t blockSizeExcSizeField = reqBlockSize - sizeof(uint32_t);
-    localWritePosition = WriteOutboundCircular(icc, localWritePosition, &blockSizeExcSizeField,
-                                               sizeof(blockSizeExcSizeField));
-    localWritePosition =
-        WriteOutboundCircular(icc, localWritePosition, destAppId, sizeof(*destAppId));
-    uint32_t reservedWord = 0;
-    localWritePosition =
-        WriteOutboundCircular(icc, localWritePosition, &reservedWord, sizeof(reservedWord));
-    localWritePosition = WriteOutboundCircular(icc, localWritePosition, data, size);
+    BlockHeader header = {.blockSize = sizeof(BlockHeader) + size - sizeof(uint32_t),
+                          .componentId = *destAppId,
+                          .reserved = 0};
+    uint32_t payloadPosition = WriteOutboundCircular(icc, writePosition, &header, sizeof(header));
 
     // Advance write position to start of next possible block.
-    localWritePosition = RoundUp(localWritePosition, RINGBUFFER_ALIGNMENT);
-    if (localWritePosition >= icc->outboundBufSize) {
-        localWritePosition -= icc->outboundBufSize;
+    return NextBlockPosition(icc->outboundBufSize, payloadPosition, size);
+}
+
+// Helper function for IntercoreSendBatch. Writes a block at *localWritePosition, and
+// advances *localWritePosition to the start of the next block. Does not publish the new
+// write position to the high-level core.
+static IntercoreResult SendBlock(const IntercoreComm *icc, uint32_t remoteReadPosition,
+                                 uint32_t *localWritePosition, const ComponentId *destAppId,
+                                 const void *data, size_t size)
+{
+    uint32_t payloadPosition;
+    IntercoreResult icr =
+        AllocateOutboundBlock(icc, remoteReadPosition, *localWritePosition, size, &payloadPosition);
+    if (icr != Intercore_OK) {
+        return icr;
     }
 
-    // Ensure write position update is seen after new content has been written.
-    // Corresponding acquire is on high-level core.
-    __atomic_store(&icc->outbound->writePosition, &localWritePosition, __ATOMIC_RELEASE);
+    WriteOutboundCircular(icc, payloadPosition, data, size);
+    *localWritePosition = FinishOutboundBlock(icc, *localWritePosition, destAppId, size);
+    return Intercore_OK;
+}
 
-    MT3620_SignalHLCoreMessageSent();
+IntercoreResult IntercoreSend(IntercoreComm *icc, const ComponentId *destAppId, const void *data,
+                              size_t size)
+{
+    const IntercoreSendMessage message = {.data = data, .size = size};
+    size_t sent;
+    return IntercoreSendBatch(icc, destAppId, &message, 1, &sent);
+}
+
+IntercoreResult IntercoreSendBatch(IntercoreComm *icc, const ComponentId *destAppId,
+                                   const IntercoreSendMessage *messages, size_t count,
+                                   size_t *sent)
+{
+    *sent = 0;
+
+    uint32_t remoteReadPosition, localWritePosition;
+    LoadOutboundPositions(icc, &remoteReadPosition, &localWritePosition);
+
+    // Write as many messages as will fit, in order, with the same view of the remote
+    // read position.
+    IntercoreResult icr = Intercore_OK;
+    while (*sent < count) {
+        const IntercoreSendMessage *m = &messages[*sent];
+        icr = SendBlock(icc, remoteReadPosition, &localWritePosition, destAppId, m->data,
+                        m->size);
+        if (icr != Intercore_OK) {
+            break;
+        }
+        ++*sent;
+    }
+
+    if (*sent > 0) {
+        StoreOutboundWritePosition(icc, localWritePosition);
+    }
+
+    return icr;
+}
+
+IntercoreResult IntercoreReserve(IntercoreComm *icc, size_t size,
+                                 IntercoreReservation *reservation)
+{
+    uint32_t remoteReadPosition, localWritePosition;
+    LoadOutboundPositions(icc, &remoteReadPosition, &localWritePosition);
+
+    uint32_t payloadPosition;
+    IntercoreResult icr =
+        AllocateOutboundBlock(icc, remoteReadPosition, localWritePosition, size, &payloadPosition);
+    if (icr != Intercore_OK) {
+        return icr;
+    }
+
+    // The payload may wrap around to the start of the buffer.
+    reservation->size[0] = SizeBeforeWrap(icc->outboundBufSize, &payloadPosition, size);
+    reservation->size[1] = size - reservation->size[0];
+    reservation->data[0] = DataAreaOffset8(icc->outbound, payloadPosition);
+    reservation->data[1] = DataAreaOffset8(icc->outbound, 0);
+    reservation->blockPosition = localWritePosition;
 
     return Intercore_OK;
 }
+
+void IntercoreCommit(IntercoreComm *icc, const ComponentId *recipient,
+                     const IntercoreReservation *reservation, size_t size)
+{
+    // No other message can have been sent since the space was reserved, and the message
+    // cannot be larger than the reserved space.
+    INTERCORE_ASSERT(reservation->blockPosition == icc->outbound->writePosition);
+    INTERCORE_ASSERT(size <= reservation->size[0] + reservation->size[1]);
+
+    uint32_t writePosition = FinishOutboundBlock(icc, reservation->blockPosition, recipient, size);
+    StoreOutboundWritePosition(icc, writePosition);
+}
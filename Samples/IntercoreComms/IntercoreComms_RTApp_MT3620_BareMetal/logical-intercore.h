@@ -33,6 +33,63 @@ typedef struct {
 
 typedef struct BufferHeaderImpl BufferHeader;
 
+/// <summary>
+///     Describes one message which is passed to <see cref="IntercoreSendBatch" />.
+/// </summary>
+typedef struct {
+    /// <summary>Data to send to the HLApp.</summary>
+    const void *data;
+    /// <summary>Amount of data in bytes.</summary>
+    size_t size;
+} IntercoreSendMessage;
+
+/// <summary>
+///     Describes one message which is retrieved by <see cref="IntercoreRecvBatch" />.
+/// </summary>
+typedef struct {
+    /// <summary>Populated with the sending HLApp's component ID.</summary>
+    ComponentId sender;
+    /// <summary>Buffer which will store the payload sent by the HLApp.</summary>
+    void *data;
+    /// <summary>
+    ///     On entry, contains the size of the data buffer. On exit, set to
+    ///     the amount of payload data.
+    /// </summary>
+    size_t size;
+} IntercoreRecvMessage;
+
+/// <summary>
+///     Space in the outbound buffer which was reserved by <see cref="IntercoreReserve" />.
+///     The payload may wrap around the end of the buffer, so it is described as two
+///     contiguous parts; the second part is empty if the payload does not wrap around.
+/// </summary>
+typedef struct {
+    /// <summary>Start of each part of the payload.</summary>
+    uint8_t *data[2];
+    /// <summary>Size of each part of the payload in bytes.</summary>
+    size_t size[2];
+    /// <summary>Position of the reserved block. The caller should not modify this.</summary>
+    uint32_t blockPosition;
+} IntercoreReservation;
+
+/// <summary>
+///     An incoming message which was found by <see cref="IntercorePeek" />. The payload
+///     may wrap around the end of the buffer, so it is described as two contiguous parts;
+///     the second part is empty if the payload does not wrap around.
+/// </summary>
+typedef struct {
+    /// <summary>The sending HLApp's component ID.</summary>
+    ComponentId sender;
+    /// <summary>Start of each part of the payload.</summary>
+    const uint8_t *data[2];
+    /// <summary>Size of each part of the payload in bytes.</summary>
+    size_t size[2];
+    /// <summary>Position of this block. The caller should not modify this.</summary>
+    uint32_t blockPosition;
+    /// <summary>Position of the following block. The caller should not modify this.</summary>
+    uint32_t nextBlockPosition;
+} IntercoreMessageView;
+
 /// <summary>
 ///     Encapsulates information which is used to send data to, and receive data from HLApps.
 ///     This object is a handle, so the caller should not read or write the contained data.
@@ -124,3 +181,95 @@ IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *sender, void *des
 /// </returns>
 IntercoreResult IntercoreSend(IntercoreComm *icc, const ComponentId *recipient, const void *data,
                               size_t size);
+
+/// <summary>
+///     Retrieves up to <paramref name="count" /> incoming messages from the HLApp. The shared
+///     read position is published, and the HLApp is signalled, once for the whole batch
+///     rather than once per message.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="messages">Array of <paramref name="count" /> message descriptors.</param>
+/// <param name="count">Maximum number of messages to retrieve.</param>
+/// <param name="received">Set to the number of messages which were retrieved.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if <paramref name="count" /> messages were retrieved.
+///     Otherwise, the result which <see cref="IntercoreRecv" /> would have returned for the
+///     first message which was not retrieved. Messages before it are retrieved as normal,
+///     and its descriptor is not modified.
+/// </returns>
+IntercoreResult IntercoreRecvBatch(IntercoreComm *icc, IntercoreRecvMessage *messages, size_t count,
+                                   size_t *received);
+
+/// <summary>
+///     Sends up to <paramref name="count" /> messages to the HLApp, in order. The shared
+///     write position is published, and the HLApp is signalled, once for the whole batch
+///     rather than once per message.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the messages.</param>
+/// <param name="messages">Array of <paramref name="count" /> messages to send.</param>
+/// <param name="count">Number of messages to send.</param>
+/// <param name="sent">Set to the number of messages which were placed into the buffer.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if all of the messages were placed into the outbound
+///     buffer. Otherwise, the result which <see cref="IntercoreSend" /> would have returned
+///     for the first message which was not sent. No later messages are sent.
+/// </returns>
+IntercoreResult IntercoreSendBatch(IntercoreComm *icc, const ComponentId *recipient,
+                                   const IntercoreSendMessage *messages, size_t count,
+                                   size_t *sent);
+
+/// <summary>
+///     Reserves space for a message in the outbound buffer, so the caller can write the
+///     payload directly into shared memory instead of copying it from another buffer.
+///     Nothing is sent until <see cref="IntercoreCommit" /> is called. To abandon the
+///     message, do not call IntercoreCommit; the next send reuses the space. Only one
+///     reservation can be outstanding, and no other message can be sent until it is
+///     committed or abandoned.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="size">Maximum payload size in bytes.</param>
+/// <param name="reservation">Populated with the location of the reserved space.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if the space was reserved; or the result which
+///     <see cref="IntercoreSend" /> would have returned for a message of this size.
+/// </returns>
+IntercoreResult IntercoreReserve(IntercoreComm *icc, size_t size,
+                                 IntercoreReservation *reservation);
+
+/// <summary>
+///     Sends a message whose payload was written into space reserved by
+///     <see cref="IntercoreReserve" />.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the message.</param>
+/// <param name="reservation">Reservation which was populated by IntercoreReserve.</param>
+/// <param name="size">
+///     Payload size in bytes. This can be smaller than the reserved size, in which case
+///     the unused space is returned to the buffer.
+/// </param>
+void IntercoreCommit(IntercoreComm *icc, const ComponentId *recipient,
+                     const IntercoreReservation *reservation, size_t size);
+
+/// <summary>
+///     Finds the next incoming message from the HLApp, without copying it out of the
+///     inbound buffer. The message stays in the buffer, and the payload can be read in
+///     place, until it is released with <see cref="IntercoreRelease" />. Only one
+///     message can be peeked at a time, and no other message can be received until it
+///     is released.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="view">Populated with the sender and the location of the payload.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if a message was found; or
+///     <see cref="Intercore_Recv_NoBlockSize" /> if there was no message to retrieve.
+/// </returns>
+IntercoreResult IntercorePeek(IntercoreComm *icc, IntercoreMessageView *view);
+
+/// <summary>
+///     Removes a message which was found by <see cref="IntercorePeek" /> from the inbound
+///     buffer. The payload must not be accessed after this call.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="view">View which was populated by IntercorePeek.</param>
+void IntercoreRelease(IntercoreComm *icc, const IntercoreMessageView *view);
@@ -3,12 +3,13 @@
 
 // This sample C application for the real-time core demonstrates intercore communications by
 // sending a message to a high-level application every second, and printing out any received
-// messages.
+// messages. It also streams frames of synthetic sensor samples to the high-level application
+// once per millisecond, at the rate allowed by the high-level application.
 //
 // It demontrates the following hardware
 // - UART (used to write a message via the built-in UART)
 // - mailbox (used to report buffer sizes and send / receive events)
-// - timer (used to send a message to the HLApp)
+// - timer (used to send a message to the HLApp, and to generate sample frames)
 
 #include <ctype.h>
 #include <stddef.h>
@@ -18,6 +19,7 @@
 
 #include "logical-dpc.h"
 #include "logical-intercore.h"
+#include "sample-stream.h"
 
 #include "mt3620-baremetal.h"
 #include "mt3620-uart-poll.h"
@@ -29,13 +31,27 @@ extern uint32_t StackTop; // &StackTop == end of TCM
 static IntercoreComm icc;
 
 static const uint32_t sendTimerIntervalMs = 1000;
+static const uint32_t sampleTimerIntervalMs = 1;
+
+// The component ID for IntercoreComms_HighLevelApp.
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+// Maximum number of messages retrieved from the inbound buffer with each call.
+#define RX_BATCH_SIZE 4
 
 static _Noreturn void DefaultExceptionHandler(void);
 static void HandleSendTimerIrq(void);
 static void HandleSendTimerDeferred(void);
+static void HandleSampleTimerIrq(void);
+static void HandleSampleTimerDeferred(void);
+static void PrintStreamCounters(void);
 
 static void PrintBytes(const void *buf, int start, int end);
 static void PrintGuid(const ComponentId *cid);
+static void PrintReceivedMessage(const IntercoreRecvMessage *message);
 
 static _Noreturn void RTCoreMain(void);
 
@@ -88,11 +104,6 @@ static void HandleSendTimerIrq(void)
 static void HandleSendTimerDeferred(void)
 {
     static int iter = 0;
-    // The component ID for IntercoreComms_HighLevelApp.
-    static const ComponentId hlAppId = {.data1 = 0x25025d2c,
-                                        .data2 = 0x66da,
-                                        .data3 = 0x4448,
-                                        .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
 
     // The number cycles from "00" to "99".
     static char txMsg[] = "rt-app-to-hl-app-00";
@@ -109,9 +120,51 @@ static void HandleSendTimerDeferred(void)
     txMsg[txMsgLen - 2] = '0' + (iter % 10);
     iter = (iter + 1) % 100;
 
+    PrintStreamCounters();
+
     MT3620_Gpt_LaunchTimerMs(TimerGpt0, sendTimerIntervalMs, HandleSendTimerIrq);
 }
 
+// Runs in IRQ context. Restarts the timer immediately, so the sample rate does not depend on
+// how long the DPC takes to run, and schedules HandleSampleTimerDeferred to run later.
+static void HandleSampleTimerIrq(void)
+{
+    static CallbackNode cbn = {.enqueued = false, .cb = HandleSampleTimerDeferred};
+    MT3620_Gpt_LaunchTimerMs(TimerGpt1, sampleTimerIntervalMs, HandleSampleTimerIrq);
+    EnqueueDeferredProc(&cbn);
+}
+
+// Queued by HandleSampleTimerIrq. Generates a frame of samples, which stand in for readings
+// from a sensor, and streams them to the HLApp.
+static void HandleSampleTimerDeferred(void)
+{
+    // The samples form a sawtooth wave.
+    static int16_t nextSample = 0;
+
+    int16_t samples[SAMPLE_STREAM_SAMPLES_PER_FRAME];
+    for (size_t i = 0; i < SAMPLE_STREAM_SAMPLES_PER_FRAME; ++i) {
+        samples[i] = nextSample;
+        nextSample = (int16_t)(nextSample + 64);
+    }
+
+    SampleStream_SendFrame(samples);
+}
+
+// Prints the number of sample frames which have been sent and dropped.
+static void PrintStreamCounters(void)
+{
+    SampleStreamCounters counters;
+    SampleStream_GetCounters(&counters);
+
+    Uart_WriteStringPoll("Stream frames sent: ");
+    Uart_WriteIntegerPoll((int)counters.framesSent);
+    Uart_WriteStringPoll(", dropped (no credit): ");
+    Uart_WriteIntegerPoll((int)counters.framesDroppedNoCredit);
+    Uart_WriteStringPoll(", dropped (buffer full): ");
+    Uart_WriteIntegerPoll((int)counters.framesDroppedBufferFull);
+    Uart_WriteStringPoll("\r\n");
+}
+
 // Prints a sequence of bytes. If the start position occurs after the end
 // position, they are printed in reverse order. Therefore, this function can
 // print big- or little-endian values.
@@ -141,16 +194,63 @@ static void PrintGuid(const ComponentId *cid)
     PrintBytes(&cid->data4, 2, 7); // 6 bytes
 }
 
-// Runs with interrupts enabled. Retrieves messages from the inbound buffer
-// and prints their sender ID, length, and content (hex and text).
+// Prints a received message's sender ID, length, and content (hex and text).
+static void PrintReceivedMessage(const IntercoreRecvMessage *message)
+{
+    const uint8_t *rxData = message->data;
+    size_t rxDataSize = message->size;
+
+    // Display sender component ID.
+    Uart_WriteStringPoll("Sender: ");
+    PrintGuid(&message->sender);
+    Uart_WriteStringPoll("\r\n");
+
+    Uart_WriteStringPoll("Message size: ");
+    Uart_WriteIntegerPoll((int)rxDataSize);
+    Uart_WriteStringPoll(" bytes:\r\n");
+
+    // Print message as hex.
+    Uart_WriteStringPoll("Hex: ");
+    for (uint32_t i = 0; i < rxDataSize; ++i) {
+        Uart_WriteHexBytePoll(rxData[i]);
+        if (i != rxDataSize - 1) {
+            Uart_WriteStringPoll(":");
+        }
+    }
+    Uart_WriteStringPoll("\r\n");
+
+    // Print message as text.
+    Uart_WriteStringPoll("Text: ");
+    for (uint32_t i = 0; i < rxDataSize; ++i) {
+        char c[2];
+        c[0] = isprint(rxData[i]) ? rxData[i] : '.';
+        c[1] = '\0';
+        Uart_WriteStringPoll(c);
+    }
+    Uart_WriteStringPoll("\r\n");
+}
+
+// Runs with interrupts enabled. Retrieves messages from the inbound buffer in batches,
+// so the HLApp is only signalled once per batch, and prints each message.
 static void HandleReceivedMessageDeferred(void)
 {
     for (;;) {
-        ComponentId sender;
-        uint8_t rxData[32];
-        size_t rxDataSize = sizeof(rxData);
+        uint8_t rxData[RX_BATCH_SIZE][32];
+        IntercoreRecvMessage messages[RX_BATCH_SIZE];
+        for (size_t i = 0; i < RX_BATCH_SIZE; ++i) {
+            messages[i].data = rxData[i];
+            messages[i].size = sizeof(rxData[i]);
+        }
 
-        IntercoreResult icr = IntercoreRecv(&icc, &sender, rxData, &rxDataSize);
+        size_t received;
+        IntercoreResult icr = IntercoreRecvBatch(&icc, messages, RX_BATCH_SIZE, &received);
+
+        for (size_t i = 0; i < received; ++i) {
+            // Sample stream frames, such as credit grants, are handled without printing them.
+            if (!SampleStream_HandleMessage(messages[i].data, messages[i].size)) {
+                PrintReceivedMessage(&messages[i]);
+            }
+        }
 
         // Return if read all messages in buffer.
         if (icr == Intercore_Recv_NoBlockSize) {
@@ -164,35 +264,6 @@ static void HandleReceivedMessageDeferred(void)
             Uart_WriteStringPoll("\r\n");
             return;
         }
-
-        // Display sender component ID.
-        Uart_WriteStringPoll("Sender: ");
-        PrintGuid(&sender);
-        Uart_WriteStringPoll("\r\n");
-
-        Uart_WriteStringPoll("Message size: ");
-        Uart_WriteIntegerPoll((int)rxDataSize);
-        Uart_WriteStringPoll(" bytes:\r\n");
-
-        // Print message as hex.
-        Uart_WriteStringPoll("Hex: ");
-        for (uint32_t i = 0; i < rxDataSize; ++i) {
-            Uart_WriteHexBytePoll(rxData[i]);
-            if (i != rxDataSize - 1) {
-                Uart_WriteStringPoll(":");
-            }
-        }
-        Uart_WriteStringPoll("\r\n");
-
-        // Print message as text.
-        Uart_WriteStringPoll("Text: ");
-        for (uint32_t i = 0; i < rxDataSize; ++i) {
-            char c[2];
-            c[0] = isprint(rxData[i]) ? rxData[i] : '.';
-            c[1] = '\0';
-            Uart_WriteStringPoll(c);
-        }
-        Uart_WriteStringPoll("\r\n");
     }
 }
 
@@ -222,7 +293,9 @@ static _Noreturn void RTCoreMain(void)
         Uart_WriteIntegerPoll(icr);
         Uart_WriteStringPoll("\r\n");
     } else {
+        SampleStream_Init(&icc, &hlAppId);
         MT3620_Gpt_LaunchTimerMs(TimerGpt0, sendTimerIntervalMs, HandleSendTimerIrq);
+        MT3620_Gpt_LaunchTimerMs(TimerGpt1, sampleTimerIntervalMs, HandleSampleTimerIrq);
     }
 
     for (;;) {
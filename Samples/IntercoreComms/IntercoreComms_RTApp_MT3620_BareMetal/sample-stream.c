@@ -0,0 +1,104 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "sample-stream.h"
+
+static IntercoreComm *streamIcc = NULL;
+static ComponentId streamRecipient;
+
+// Number of frames which the HLApp has allowed the RTApp to send.
+static uint32_t credits = 0;
+static uint32_t nextSequence = 0;
+static SampleStreamCounters streamCounters;
+
+static void WriteReservation(const IntercoreReservation *reservation, size_t offset,
+                             const void *src, size_t size);
+
+void SampleStream_Init(IntercoreComm *icc, const ComponentId *recipient)
+{
+    streamIcc = icc;
+    streamRecipient = *recipient;
+    credits = 0;
+    nextSequence = 0;
+    streamCounters = (SampleStreamCounters){0};
+}
+
+bool SampleStream_HandleMessage(const void *data, size_t size)
+{
+    SampleStreamFrameHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    __builtin_memcpy(&header, data, sizeof(header));
+    if (header.magic != SAMPLE_STREAM_MAGIC) {
+        return false;
+    }
+
+    // Ignore frames which are not understood, but do not treat them as text.
+    uint32_t grant;
+    if (header.type != SampleStreamFrameType_Credit || header.length != sizeof(grant) ||
+        size < sizeof(header) + sizeof(grant)) {
+        return true;
+    }
+
+    __builtin_memcpy(&grant, (const uint8_t *)data + sizeof(header), sizeof(grant));
+    credits += grant;
+    return true;
+}
+
+// Copies data to an offset in a reservation, whose payload may wrap around the end of the
+// outbound buffer.
+static void WriteReservation(const IntercoreReservation *reservation, size_t offset,
+                             const void *src, size_t size)
+{
+    const uint8_t *src8 = src;
+
+    if (offset < reservation->size[0]) {
+        size_t firstPart = reservation->size[0] - offset;
+        if (firstPart > size) {
+            firstPart = size;
+        }
+        __builtin_memcpy(reservation->data[0] + offset, src8, firstPart);
+        src8 += firstPart;
+        offset += firstPart;
+        size -= firstPart;
+    }
+
+    __builtin_memcpy(reservation->data[1] + (offset - reservation->size[0]), src8, size);
+}
+
+void SampleStream_SendFrame(const int16_t *samples)
+{
+    // The sequence number is used even if the frame is dropped, so the HLApp can see the gap.
+    const SampleStreamFrameHeader header = {.magic = SAMPLE_STREAM_MAGIC,
+                                            .type = SampleStreamFrameType_Samples,
+                                            .length = SAMPLE_STREAM_SAMPLES_PER_FRAME *
+                                                      sizeof(int16_t),
+                                            .sequence = nextSequence++};
+
+    if (credits == 0) {
+        ++streamCounters.framesDroppedNoCredit;
+        return;
+    }
+
+    const size_t frameSize = sizeof(header) + header.length;
+    IntercoreReservation reservation;
+    IntercoreResult icr = IntercoreReserve(streamIcc, frameSize, &reservation);
+    if (icr != Intercore_OK) {
+        ++streamCounters.framesDroppedBufferFull;
+        return;
+    }
+
+    WriteReservation(&reservation, 0, &header, sizeof(header));
+    WriteReservation(&reservation, sizeof(header), samples, header.length);
+    IntercoreCommit(streamIcc, &streamRecipient, &reservation, frameSize);
+
+    --credits;
+    ++streamCounters.framesSent;
+}
+
+void SampleStream_GetCounters(SampleStreamCounters *counters)
+{
+    *counters = streamCounters;
+}
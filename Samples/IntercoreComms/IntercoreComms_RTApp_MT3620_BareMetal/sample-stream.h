@@ -0,0 +1,82 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logical-intercore.h"
+
+// The sample stream is a framed binary channel which carries blocks of sensor samples from
+// the RTApp to the HLApp, alongside the text messages which the sample exchanges. Each frame
+// is sent in its own intercore message and starts with a SampleStreamFrameHeader.
+//
+// The HLApp controls the rate with credits. Each credit allows the RTApp to send one more
+// frame. If the RTApp has no credit, or the outbound buffer is full, the frame is dropped,
+// but its sequence number is still used, so the HLApp can count the gaps.
+//
+// This header must match sample_stream.h in the HLApp.
+
+/// <summary>First word of every sample stream frame, "STRM" in little-endian order.</summary>
+#define SAMPLE_STREAM_MAGIC 0x4D525453u
+
+/// <summary>Number of 16-bit samples in each samples frame.</summary>
+#define SAMPLE_STREAM_SAMPLES_PER_FRAME 16
+
+/// <summary>Sample stream frame types.</summary>
+typedef enum {
+    /// <summary>RTApp to HLApp. The payload is SAMPLE_STREAM_SAMPLES_PER_FRAME samples.</summary>
+    SampleStreamFrameType_Samples = 1,
+    /// <summary>HLApp to RTApp. The payload is a uint32_t count of additional frames.</summary>
+    SampleStreamFrameType_Credit = 2
+} SampleStreamFrameType;
+
+/// <summary>Header which starts every sample stream frame.</summary>
+typedef struct {
+    /// <summary>Always <see cref="SAMPLE_STREAM_MAGIC" />.</summary>
+    uint32_t magic;
+    /// <summary>One of the <see cref="SampleStreamFrameType" /> values.</summary>
+    uint16_t type;
+    /// <summary>Payload length in bytes, not including this header.</summary>
+    uint16_t length;
+    /// <summary>Incremented for each frame of this type, including dropped frames.</summary>
+    uint32_t sequence;
+} SampleStreamFrameHeader;
+
+/// <summary>Counters which describe the activity of the sample stream.</summary>
+typedef struct {
+    /// <summary>Number of frames placed into the outbound buffer.</summary>
+    uint32_t framesSent;
+    /// <summary>Number of frames dropped because there was no credit.</summary>
+    uint32_t framesDroppedNoCredit;
+    /// <summary>Number of frames dropped because the outbound buffer was full.</summary>
+    uint32_t framesDroppedBufferFull;
+} SampleStreamCounters;
+
+/// <summary>
+///     Sets up the sample stream. No frames are sent until the HLApp grants credit.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" />.</param>
+/// <param name="recipient">HLApp which should receive the frames.</param>
+void SampleStream_Init(IntercoreComm *icc, const ComponentId *recipient);
+
+/// <summary>
+///     Handles a message from the HLApp if it is a sample stream frame.
+/// </summary>
+/// <param name="data">Message payload.</param>
+/// <param name="size">Message payload size in bytes.</param>
+/// <returns>true if the message was a sample stream frame; false otherwise.</returns>
+bool SampleStream_HandleMessage(const void *data, size_t size);
+
+/// <summary>
+///     Sends a frame of samples to the HLApp, if there is credit and space to do so. The frame
+///     is written directly into the outbound buffer. Call this from a DPC.
+/// </summary>
+/// <param name="samples">SAMPLE_STREAM_SAMPLES_PER_FRAME samples to send.</param>
+void SampleStream_SendFrame(const int16_t *samples);
+
+/// <summary>Gets the sample stream counters.</summary>
+/// <param name="counters">Populated with the current counter values.</param>
+void SampleStream_GetCounters(SampleStreamCounters *counters);
@@ -0,0 +1,11 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/networking.h when the sample is built on a PC. Each test
+// program defines Networking_IsNetworkingReady.
+
+#pragma once
+
+#include <stdbool.h>
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
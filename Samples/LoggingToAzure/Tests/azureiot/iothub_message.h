@@ -0,0 +1,34 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure IoT C SDK iothub_message.h when the sample is built on a Linux PC.
+
+#pragma once
+
+#include <stddef.h>
+
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+typedef enum {
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR
+} IOTHUB_MESSAGE_RESULT;
+
+typedef enum {
+    IOTHUBMESSAGE_BYTEARRAY,
+    IOTHUBMESSAGE_STRING,
+    IOTHUBMESSAGE_UNKNOWN
+} IOTHUBMESSAGE_CONTENT_TYPE;
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value);
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+IOTHUBMESSAGE_CONTENT_TYPE IoTHubMessage_GetContentType(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+const char *IoTHubMessage_GetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                 const unsigned char **buffer, size_t *size);
+const char *IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
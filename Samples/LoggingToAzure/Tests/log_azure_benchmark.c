@@ -0,0 +1,371 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Benchmark and test for log_azure.c and azure_iot.c together, which run on a Linux PC. This file
+// implements a stub IoT Hub client in place of the Azure IoT C SDK, and a stub connection in place
+// of connection_iot_hub.c: when the network is up, the connection completes at once, the client
+// authenticates on its first DoWork, and each telemetry message which the client is given is
+// counted. The timers run on the epoll event loop in eventloop_epoll.c.
+//
+// The benchmark logs a burst of records while the device is offline, and another once it is
+// connected, and reports how long each call to Log_Azure takes and how many telemetry messages
+// are sent. It checks that no message is sent from within a call to Log_Azure, so the caller never
+// waits for the network, and that the records logged while offline are sent once the device
+// connects.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/networking.h>
+
+#include "iothub.h"
+#include "iothub_message.h"
+
+#include "azure_iot.h"
+#include "connection.h"
+#include "log_azure.h"
+
+#define RECORDS_PER_BURST 10000
+#define MAX_HUB_MESSAGE_SIZE 2048
+
+// The sample flushes every 5 seconds; the benchmark flushes more often so that it runs quickly.
+static const struct timespec flushPeriod = {.tv_sec = 0, .tv_nsec = 200 * 1000 * 1000};
+
+static EventLoop *eventLoop = NULL;
+
+// State of the stub network, connection and IoT Hub client.
+static bool networkReady = false;
+static Connection_StatusCallbackType connectionStatusCallback = NULL;
+static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK clientStatusCallback = NULL;
+static void *clientStatusContext = NULL;
+static bool clientAuthenticated = false;
+
+// A message which has been passed to the stub IoT Hub client.
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    char text[MAX_HUB_MESSAGE_SIZE];
+};
+
+// Counts of the messages which have been passed to the stub IoT Hub client, and the text of the
+// first of them.
+static size_t hubMessageCount = 0;
+static size_t hubMessagesSentByCaller = 0;
+static char firstHubMessage[MAX_HUB_MESSAGE_SIZE];
+
+// Confirmation callbacks for the messages which have been sent, but not yet confirmed.
+#define MAX_PENDING_MESSAGES 64
+static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK pendingCallbacks[MAX_PENDING_MESSAGES];
+static void *pendingContexts[MAX_PENDING_MESSAGES];
+static size_t pendingCount = 0;
+
+// True while the benchmark is in a call to Log_Azure.
+static bool inLogCall = false;
+
+// A non-NULL handle for the stub client.
+static struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *const clientHandle =
+    (struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *)&clientAuthenticated;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady)
+{
+    *outIsNetworkingReady = networkReady;
+    return 0;
+}
+
+ExitCode Connection_Initialise(EventLoop *el, Connection_StatusCallbackType statusCallBack,
+                               ExitCode_CallbackType failureCallback, const char *modelId,
+                               void *context)
+{
+    connectionStatusCallback = statusCallBack;
+    return ExitCode_Success;
+}
+
+void Connection_Start(void)
+{
+    connectionStatusCallback(Connection_Complete, clientHandle);
+}
+
+void Connection_Cleanup(void) {}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+    IOTHUB_MESSAGE_HANDLE message = calloc(1, sizeof(*message));
+    if (message != NULL) {
+        snprintf(message->text, sizeof(message->text), "%s", source);
+    }
+    return message;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value)
+{
+    return IOTHUB_MESSAGE_OK;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    free(iotHubMessageHandle);
+}
+
+// The benchmark does not send cloud-to-device messages.
+IOTHUBMESSAGE_CONTENT_TYPE IoTHubMessage_GetContentType(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return IOTHUBMESSAGE_UNKNOWN;
+}
+
+const char *IoTHubMessage_GetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return NULL;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                 const unsigned char **buffer, size_t *size)
+{
+    return IOTHUB_MESSAGE_INVALID_TYPE;
+}
+
+const char *IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    return NULL;
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle) {}
+
+// Authenticate on the first call, and confirm every message which has been sent.
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    if (!clientAuthenticated && clientStatusCallback != NULL) {
+        clientAuthenticated = true;
+        clientStatusCallback(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK,
+                             clientStatusContext);
+    }
+
+    size_t count = pendingCount;
+    pendingCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        pendingCallbacks[i](IOTHUB_CLIENT_CONFIRMATION_OK, pendingContexts[i]);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void *userContextCallback)
+{
+    if (!clientAuthenticated || pendingCount == MAX_PENDING_MESSAGES) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    if (hubMessageCount == 0) {
+        memcpy(firstHubMessage, eventMessageHandle->text, sizeof(firstHubMessage));
+    }
+    ++hubMessageCount;
+    if (inLogCall) {
+        ++hubMessagesSentByCaller;
+    }
+    pendingCallbacks[pendingCount] = eventConfirmationCallback;
+    pendingContexts[pendingCount] = userContextCallback;
+    ++pendingCount;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, const unsigned char *reportedState,
+    size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback)
+{
+    // The benchmark does not report device twin state.
+    return IOTHUB_CLIENT_ERROR;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void *userContextCallback)
+{
+    clientStatusCallback = connectionStatusCallback;
+    clientStatusContext = userContextCallback;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetMessageCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback, void *userContextCallback)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+static void FailureCallback(ExitCode exitCode)
+{
+    Fail("FailureCallback", "application failed", exitCode);
+}
+
+static long GetNowNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Run the event loop until the condition is true, or until the timeout, in milliseconds, has
+// passed.
+static void RunUntil(bool (*condition)(void), int timeout)
+{
+    long end = GetNowNanoseconds() + timeout * 1000000L;
+    while ((condition == NULL || !condition()) && GetNowNanoseconds() < end) {
+        EventLoop_Run(eventLoop, 10, false);
+    }
+}
+
+static bool IsMessageReceived(void)
+{
+    return hubMessageCount > 0;
+}
+
+// Log a burst of records, as an application which logs a repeated status line and an occasional
+// error would, and report how long each call takes. If runEventLoop is true, the event loop runs
+// between every 100 records, so the records can be sent while they are logged.
+static void LogBurst(const char *test, const char *name, bool runEventLoop)
+{
+    long total = 0;
+    long worst = 0;
+    for (int i = 0; i < RECORDS_PER_BURST; ++i) {
+        long start = GetNowNanoseconds();
+        inLogCall = true;
+        if (i % 4 == 0) {
+            Log_AzureWithSeverity(LogAzure_Severity_Error, "sensor %d failed", i / 100);
+        } else {
+            Log_Azure("Memory used %d Kb", (i / 50) % 7);
+        }
+        inLogCall = false;
+        long elapsed = GetNowNanoseconds() - start;
+        total += elapsed;
+        if (elapsed > worst) {
+            worst = elapsed;
+        }
+
+        if (runEventLoop && i % 100 == 99) {
+            EventLoop_Run(eventLoop, 0, false);
+        }
+    }
+
+    printf("%s: %d calls to Log_Azure, average %ld ns, worst %ld ns\n", name, RECORDS_PER_BURST,
+           total / RECORDS_PER_BURST, worst);
+    if (hubMessagesSentByCaller != 0) {
+        Fail(test, "message sent from within Log_Azure", (long)hubMessagesSentByCaller);
+    }
+}
+
+// Print the activity of the log pipeline since the statistics in before were taken.
+static void PrintStatistics(const char *name, const LogAzure_Statistics *before)
+{
+    LogAzure_Statistics after;
+    Log_Azure_GetStatistics(&after);
+    printf("%s: %u records queued, %u coalesced, %u dropped; %u messages sent\n", name,
+           after.recordsQueued - before->recordsQueued,
+           after.recordsCoalesced - before->recordsCoalesced,
+           after.recordsDropped - before->recordsDropped,
+           after.messagesSent - before->messagesSent);
+}
+
+// Every call is either stored in the ring, counted as a repeat of the previous record, or dropped.
+static void CheckAccounted(const char *test, unsigned int calls)
+{
+    LogAzure_Statistics statistics;
+    Log_Azure_GetStatistics(&statistics);
+    if (statistics.recordsQueued + statistics.recordsCoalesced + statistics.recordsDropped !=
+        calls) {
+        Fail(test, "records not accounted for", (long)statistics.recordsQueued);
+    }
+    if (statistics.messagesSent != hubMessageCount) {
+        Fail(test, "wrong number of messages counted", (long)statistics.messagesSent);
+    }
+}
+
+int main(void)
+{
+    const char *test = "LogAzureBenchmark";
+
+    eventLoop = EventLoop_Create();
+    AzureIoT_Callbacks callbacks = {NULL};
+    if (eventLoop == NULL ||
+        AzureIoT_Initialize(eventLoop, FailureCallback, NULL, NULL, callbacks) !=
+            ExitCode_Success ||
+        Log_Azure_StartFlushTimer(eventLoop, &flushPeriod) != 0) {
+        printf("FAIL: could not initialize logging\n");
+        return EXIT_FAILURE;
+    }
+
+    // While the device is offline, records wait in the ring, and nothing is sent.
+    LogAzure_Statistics before;
+    Log_Azure_GetStatistics(&before);
+    networkReady = false;
+    LogBurst(test, "offline", false);
+    RunUntil(NULL, 500);
+    if (hubMessageCount != 0) {
+        Fail(test, "message sent while offline", (long)hubMessageCount);
+    }
+    CheckAccounted(test, RECORDS_PER_BURST);
+    PrintStatistics("offline", &before);
+
+    // Once the device connects, the flush timer sends the records which were logged while it was
+    // offline, starting with the first record.
+    networkReady = true;
+    RunUntil(IsMessageReceived, 5000);
+    if (hubMessageCount == 0) {
+        Fail(test, "records logged while offline were not sent", 0);
+    } else if (strstr(firstHubMessage, "[ERROR] sensor 0 failed") == NULL ||
+               strstr(firstHubMessage, "Memory used 0 Kb (repeated 2 times)") == NULL) {
+        Fail(test, "wrong records sent", (long)strlen(firstHubMessage));
+    }
+
+    // Records logged while the device is connected are sent in batches from the event loop.
+    Log_Azure_GetStatistics(&before);
+    LogBurst(test, "online", true);
+    RunUntil(NULL, 500);
+    CheckAccounted(test, 2 * RECORDS_PER_BURST);
+    PrintStatistics("online", &before);
+
+    Log_Azure_Cleanup();
+    AzureIoT_Cleanup();
+    EventLoop_Close(eventLoop);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
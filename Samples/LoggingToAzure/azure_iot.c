@@ -1,8 +1,10 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <applibs/eventloop.h>
 #include <applibs/log.h>
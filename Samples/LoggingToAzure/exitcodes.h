@@ -57,6 +57,8 @@ typedef enum {
 
     ExitCode_Init_AzureIoTDoWorkTimer = 30,
     ExitCode_AzureIoTDoWorkTimer_Consume = 31,
+
+    ExitCode_Init_LogFlushTimer = 32,
 } ExitCode;
 
 /// <summary>
@@ -0,0 +1,242 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+// Same number format as parson, so that payloads are unchanged.
+#define NUMBER_FORMAT "%1.17g"
+#define NUMBER_BUFFER_SIZE 32
+
+static bool AppendChars(JsonWriter *writer, const char *chars, size_t count);
+static bool AppendChar(JsonWriter *writer, char c);
+static bool AppendEscapedString(JsonWriter *writer, const char *value);
+static bool BeginValue(JsonWriter *writer, const char *name);
+static bool BeginContainer(JsonWriter *writer, const char *name, char open);
+static bool EndContainer(JsonWriter *writer, char close);
+
+void JsonWriter_Init(JsonWriter *writer, char *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->depth = 0;
+    writer->hasValue = 0;
+    writer->failed = (buffer == NULL || size == 0);
+
+    if (!writer->failed) {
+        writer->buffer[0] = '\0';
+    }
+}
+
+bool JsonWriter_BeginObject(JsonWriter *writer, const char *name)
+{
+    return BeginContainer(writer, name, '{');
+}
+
+bool JsonWriter_EndObject(JsonWriter *writer)
+{
+    return EndContainer(writer, '}');
+}
+
+bool JsonWriter_BeginArray(JsonWriter *writer, const char *name)
+{
+    return BeginContainer(writer, name, '[');
+}
+
+bool JsonWriter_EndArray(JsonWriter *writer)
+{
+    return EndContainer(writer, ']');
+}
+
+bool JsonWriter_AppendNumber(JsonWriter *writer, const char *name, double value)
+{
+    if (!isfinite(value)) {
+        // JSON has no representation for NaN or infinity.
+        writer->failed = true;
+        return false;
+    }
+
+    char number[NUMBER_BUFFER_SIZE];
+    int written = snprintf(number, sizeof(number), NUMBER_FORMAT, value);
+    if (written < 0 || (size_t)written >= sizeof(number)) {
+        writer->failed = true;
+        return false;
+    }
+
+    return BeginValue(writer, name) && AppendChars(writer, number, (size_t)written);
+}
+
+bool JsonWriter_AppendBool(JsonWriter *writer, const char *name, bool value)
+{
+    const char *text = value ? "true" : "false";
+    return BeginValue(writer, name) && AppendChars(writer, text, strlen(text));
+}
+
+bool JsonWriter_AppendString(JsonWriter *writer, const char *name, const char *value)
+{
+    return BeginValue(writer, name) && AppendEscapedString(writer, value);
+}
+
+const char *JsonWriter_GetString(const JsonWriter *writer)
+{
+    if (writer->failed || writer->depth != 0 || writer->length == 0) {
+        return NULL;
+    }
+
+    return writer->buffer;
+}
+
+/// <summary>
+///     Write the separator and name, if any, which precede a value.
+/// </summary>
+static bool BeginValue(JsonWriter *writer, const char *name)
+{
+    if (writer->failed) {
+        return false;
+    }
+
+    // Only one root value is allowed.
+    if (writer->depth == 0 && writer->length != 0) {
+        writer->failed = true;
+        return false;
+    }
+
+    uint32_t depthBit = (uint32_t)1 << writer->depth;
+    if ((writer->hasValue & depthBit) != 0 && !AppendChar(writer, ',')) {
+        return false;
+    }
+    writer->hasValue |= depthBit;
+
+    if (name != NULL) {
+        return AppendEscapedString(writer, name) && AppendChar(writer, ':');
+    }
+
+    return true;
+}
+
+static bool BeginContainer(JsonWriter *writer, const char *name, char open)
+{
+    if (!BeginValue(writer, name)) {
+        return false;
+    }
+
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->failed = true;
+        return false;
+    }
+
+    if (!AppendChar(writer, open)) {
+        return false;
+    }
+
+    ++writer->depth;
+    writer->hasValue &= ~((uint32_t)1 << writer->depth);
+    return true;
+}
+
+static bool EndContainer(JsonWriter *writer, char close)
+{
+    if (writer->failed) {
+        return false;
+    }
+
+    if (writer->depth == 0) {
+        writer->failed = true;
+        return false;
+    }
+
+    --writer->depth;
+    return AppendChar(writer, close);
+}
+
+static bool AppendEscapedString(JsonWriter *writer, const char *value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    if (!AppendChar(writer, '"')) {
+        return false;
+    }
+
+    // Copy runs of characters which need no escaping in one go.
+    const char *runStart = value;
+    for (const char *p = value; *p != '\0'; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\' && c != '/') {
+            continue;
+        }
+
+        if (!AppendChars(writer, runStart, (size_t)(p - runStart))) {
+            return false;
+        }
+        runStart = p + 1;
+
+        char escape[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t escapeLength = 2;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            // '/' is escaped, as parson does, so that the JSON can be embedded in HTML.
+            escape[1] = (char)c;
+            break;
+        case '\b':
+            escape[1] = 'b';
+            break;
+        case '\f':
+            escape[1] = 'f';
+            break;
+        case '\n':
+            escape[1] = 'n';
+            break;
+        case '\r':
+            escape[1] = 'r';
+            break;
+        case '\t':
+            escape[1] = 't';
+            break;
+        default:
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hexDigits[c >> 4];
+            escape[5] = hexDigits[c & 0xf];
+            escapeLength = 6;
+            break;
+        }
+
+        if (!AppendChars(writer, escape, escapeLength)) {
+            return false;
+        }
+    }
+
+    return AppendChars(writer, runStart, strlen(runStart)) && AppendChar(writer, '"');
+}
+
+static bool AppendChar(JsonWriter *writer, char c)
+{
+    return AppendChars(writer, &c, 1);
+}
+
+/// <summary>
+///     Append characters to the buffer, keeping it NULL-terminated.
+/// </summary>
+static bool AppendChars(JsonWriter *writer, const char *chars, size_t count)
+{
+    if (writer->failed) {
+        return false;
+    }
+
+    if (count >= writer->size - writer->length) {
+        writer->failed = true;
+        return false;
+    }
+
+    memcpy(writer->buffer + writer->length, chars, count);
+    writer->length += count;
+    writer->buffer[writer->length] = '\0';
+    return true;
+}
@@ -4,17 +4,74 @@
 #include <applibs/eventloop.h>
 #include <applibs/log.h>
 
+#include "eventloop_timer_utilities.h"
+#include "json_writer.h"
 #include "parson.h"
 #include "log_azure.h"
 
-#define _GNU_SOURCE // enable vasprintf
+#include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define MAX_SERIALIZED_LOG_SIZE 2048
+#define MAX_BATCH_TEXT_SIZE 1536
+
+// Records are sent as soon as this many are waiting, rather than when the flush timer expires.
+#define FLUSH_THRESHOLD (LOG_AZURE_RING_SIZE / 2)
+
+/// <summary>
+///     A formatted log record which is waiting to be sent.
+/// </summary>
+typedef struct {
+    LogAzure_Severity severity;
+    /// <summary>Number of times the record was repeated after it was first logged.</summary>
+    unsigned int repeatCount;
+    char text[LOG_AZURE_MAX_RECORD_LENGTH];
+} LogRecord;
 
 static int cloudLogEnabled = 1;
 static int cloudLogInitialized = 0;
+static LogAzure_Severity minimumSeverity = LogAzure_Severity_Info;
+
+// Records which are waiting to be sent, oldest first, starting at logRingHead.
+static LogRecord logRing[LOG_AZURE_RING_SIZE];
+static unsigned int logRingHead = 0;
+static unsigned int logRingCount = 0;
+static unsigned int recordsDroppedSinceLastBatch = 0;
+static LogAzure_Statistics logStatistics;
+
+// Records are formatted here first, so they can be compared with the previous record.
+static char formatBuffer[LOG_AZURE_MAX_RECORD_LENGTH];
+
+// Batches are assembled and serialized here rather than on the heap; AzureIoT_SendTelemetry
+// copies the payload before returning.
+static char batchText[MAX_BATCH_TEXT_SIZE];
+static char serializedLogBuffer[MAX_SERIALIZED_LOG_SIZE];
+
+// The rate limit is a token bucket: each record uses one token, and tokens are replaced at
+// rateLimitRecordsPerMinute, up to rateLimitBurst. Tokens are counted in thousandths.
+static const int64_t rateLimitRecordsPerMinute = 60;
+static const int64_t rateLimitBurst = LOG_AZURE_RING_SIZE;
+static int64_t rateLimitTokens = -1;
+static int64_t rateLimitLastRefillMs = 0;
+
+static EventLoopTimer *flushTimer = NULL;
+static struct timespec logFlushPeriod;
+static bool isFlushScheduled = false;
+
+static const char *const severityNames[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+static int64_t GetNowMilliseconds(void);
+static bool TakeRateLimitToken(void);
+static void ScheduleFlush(const struct timespec *delay);
+static void FlushTimerEventHandler(EventLoopTimer *timer);
+static size_t AppendBatchLine(size_t length, const char *format, ...);
+static const char *SerializeBatch(unsigned int recordCount);
+static AzureIoT_Result Log_AzureVarArgs(LogAzure_Severity severity, const char *fmt,
+                                        va_list args);
 
 void Log_Azure_C2D_Message_Received(IOTHUB_MESSAGE_HANDLE message)
 {
@@ -78,21 +135,161 @@ void Log_Azure_C2D_Message_Received(IOTHUB_MESSAGE_HANDLE message)
         free(decodedMessage);
 }
 
-static AzureIoT_Result Log_Azure_Internal(char *log)
+static int64_t GetNowMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/// <summary>
+///     Takes a token from the rate limit bucket, if one is available.
+/// </summary>
+/// <returns>true if the record may be logged; false if it exceeds the rate limit.</returns>
+static bool TakeRateLimitToken(void)
+{
+    int64_t now = GetNowMilliseconds();
+    if (rateLimitTokens < 0) {
+        rateLimitTokens = rateLimitBurst * 1000;
+    } else {
+        // One token per minute is 1000 thousandths per 60000 ms.
+        rateLimitTokens += (now - rateLimitLastRefillMs) * rateLimitRecordsPerMinute / 60;
+        if (rateLimitTokens > rateLimitBurst * 1000) {
+            rateLimitTokens = rateLimitBurst * 1000;
+        }
+    }
+    rateLimitLastRefillMs = now;
+
+    if (rateLimitTokens < 1000) {
+        return false;
+    }
+    rateLimitTokens -= 1000;
+    return true;
+}
+
+static void ScheduleFlush(const struct timespec *delay)
+{
+    if (SetEventLoopTimerOneShot(flushTimer, delay) == 0) {
+        isFlushScheduled = true;
+    }
+}
+
+static void FlushTimerEventHandler(EventLoopTimer *timer)
 {
-    Log_Debug("[D2C] Sending: %s\n", log);
-    JSON_Value *telemetryValue = json_value_init_object();
-    JSON_Object *telemetryRoot = json_value_get_object(telemetryValue);
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        Log_Debug("ERROR: Could not consume the log flush timer event.\n");
+    }
+    isFlushScheduled = false;
 
-    json_object_dotset_string(telemetryRoot, "debugMessage", log);
+    // If the records could not be sent, for example because the device is not connected, try
+    // again after the flush period, so records logged while offline are sent once the device
+    // connects.
+    if (Log_Azure_Flush() != AzureIoT_Result_OK && logRingCount > 0) {
+        ScheduleFlush(&logFlushPeriod);
+    }
+}
+
+/// <summary>
+///     Appends a line to the batch text, if it fits.
+/// </summary>
+/// <param name="length">Length of the batch text before the line is appended</param>
+/// <param name="format">A conventional printf format string for the line</param>
+/// <returns>The new length of the batch text, or 0 if the line did not fit.</returns>
+static size_t AppendBatchLine(size_t length, const char *format, ...)
+{
+    if (length > 0) {
+        if (length + 1 >= sizeof(batchText)) {
+            return 0;
+        }
+        batchText[length++] = '\n';
+    }
 
-    char *serializedTelemetry = json_serialize_to_string(telemetryValue);
-    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedTelemetry, NULL, NULL);
+    va_list args;
+    va_start(args, format);
+    int lineLength = vsnprintf(batchText + length, sizeof(batchText) - length, format, args);
+    va_end(args);
+
+    if (lineLength < 0 || (size_t)lineLength >= sizeof(batchText) - length) {
+        return 0;
+    }
+    return length + (size_t)lineLength;
+}
+
+/// <summary>
+///     Serializes the oldest waiting records as one telemetry message.
+/// </summary>
+/// <param name="recordCount">Number of records to serialize</param>
+/// <returns>The serialized message, or NULL if the records do not fit in one message.</returns>
+static const char *SerializeBatch(unsigned int recordCount)
+{
+    size_t length = 0;
+    batchText[0] = '\0';
+    if (recordsDroppedSinceLastBatch > 0) {
+        length = AppendBatchLine(length, "[WARNING] %u log records were dropped.",
+                                 recordsDroppedSinceLastBatch);
+    }
+
+    for (unsigned int i = 0; i < recordCount; ++i) {
+        const LogRecord *record = &logRing[(logRingHead + i) % LOG_AZURE_RING_SIZE];
+        if (record->repeatCount > 0) {
+            length = AppendBatchLine(length, "[%s] %s (repeated %u times)",
+                                     severityNames[record->severity], record->text,
+                                     record->repeatCount);
+        } else {
+            length =
+                AppendBatchLine(length, "[%s] %s", severityNames[record->severity], record->text);
+        }
+        if (length == 0) {
+            return NULL;
+        }
+    }
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, serializedLogBuffer, sizeof(serializedLogBuffer));
+    JsonWriter_BeginObject(&writer, NULL);
+    JsonWriter_AppendString(&writer, "debugMessage", batchText);
+    JsonWriter_EndObject(&writer);
+    return JsonWriter_GetString(&writer);
+}
+
+AzureIoT_Result Log_Azure_Flush(void)
+{
+    while (logRingCount > 0 || recordsDroppedSinceLastBatch > 0) {
+        if (!AzureIoT_IsConnected()) {
+            return AzureIoT_Result_NoNetwork;
+        }
+
+        // Send as many records as fit in one message.
+        unsigned int recordCount = logRingCount;
+        const char *serializedTelemetry;
+        while ((serializedTelemetry = SerializeBatch(recordCount)) == NULL && recordCount > 1) {
+            --recordCount;
+        }
+
+        if (serializedTelemetry == NULL) {
+            // The oldest record does not fit in a message on its own, so it can never be sent.
+            Log_Debug("ERROR: Log message is too long to send (maximum %d bytes serialized).\n",
+                      MAX_SERIALIZED_LOG_SIZE);
+            logRingHead = (logRingHead + 1) % LOG_AZURE_RING_SIZE;
+            --logRingCount;
+            ++recordsDroppedSinceLastBatch;
+            ++logStatistics.recordsDropped;
+            continue;
+        }
+
+        Log_Debug("[D2C] Sending %u log records: %s\n", recordCount, batchText);
+        AzureIoT_Result result = AzureIoT_SendTelemetry(serializedTelemetry, NULL, NULL);
+        if (result != AzureIoT_Result_OK) {
+            return result;
+        }
 
-    json_free_serialized_string(serializedTelemetry);
-    json_value_free(telemetryValue);
+        ++logStatistics.messagesSent;
+        recordsDroppedSinceLastBatch = 0;
+        logRingHead = (logRingHead + recordCount) % LOG_AZURE_RING_SIZE;
+        logRingCount -= recordCount;
+    }
 
-    return aziotResult;
+    return AzureIoT_Result_OK;
 }
 
 void Log_Azure_Init(bool override_callback)
@@ -114,40 +311,137 @@ void Log_AzureSetEnabled(bool enabled)
     cloudLogEnabled = enabled;
 }
 
-AzureIoT_Result Log_Azure(const char *fmt, ...)
+void Log_AzureSetMinimumSeverity(LogAzure_Severity severity)
+{
+    minimumSeverity = severity;
+}
+
+int Log_Azure_StartFlushTimer(EventLoop *eventLoop, const struct timespec *flushPeriod)
+{
+    flushTimer = CreateEventLoopDisarmedTimer(eventLoop, &FlushTimerEventHandler);
+    if (flushTimer == NULL) {
+        return -1;
+    }
+
+    logFlushPeriod = *flushPeriod;
+    isFlushScheduled = false;
+    if (logRingCount > 0) {
+        ScheduleFlush(&logFlushPeriod);
+    }
+    return 0;
+}
+
+void Log_Azure_Cleanup(void)
+{
+    if (AzureIoT_IsInitialized()) {
+        Log_Azure_Flush();
+    }
+
+    DisposeEventLoopTimer(flushTimer);
+    flushTimer = NULL;
+    isFlushScheduled = false;
+}
+
+void Log_Azure_GetStatistics(LogAzure_Statistics *statistics)
+{
+    *statistics = logStatistics;
+}
+
+/// <summary>
+///     Formats a record into the ring, and arranges for it to be sent.
+/// </summary>
+static AzureIoT_Result Log_AzureVarArgs(LogAzure_Severity severity, const char *fmt,
+                                        va_list args)
 {
     if (!AzureIoT_IsInitialized()) {
         Log_Debug("AzureIoT not initialized.\n");
         return AzureIoT_Result_OtherFailure;
     }
 
-    if (!AzureIoT_IsConnected()) {
-        Log_Debug("No network.\n");
-        return AzureIoT_Result_NoNetwork;
-    }
-
     if (cloudLogEnabled == 0) {
         Log_Debug("Cloud logging is disabled.\n");
         return AzureIoT_Result_OtherFailure;
     }
 
+    // A severity outside the enumeration is treated as an error, so it is not filtered out and
+    // has a name when the record is sent.
+    if ((unsigned int)severity > (unsigned int)LogAzure_Severity_Error) {
+        severity = LogAzure_Severity_Error;
+    }
+
+    if (severity < minimumSeverity) {
+        return AzureIoT_Result_OK;
+    }
+
     Log_Azure_Init(true);
 
-    Log_Debug("Attempting message send.\n");
+    int length = vsnprintf(formatBuffer, sizeof(formatBuffer), fmt, args);
+    if (length < 0) {
+        return AzureIoT_Result_OtherFailure;
+    }
+    if ((size_t)length >= sizeof(formatBuffer)) {
+        // Mark the record as truncated.
+        memcpy(formatBuffer + sizeof(formatBuffer) - 4, "...", 4);
+    }
 
-    va_list args;
-    va_start(args, fmt);
-    char *formatted_string;
-    int length = vasprintf(&formatted_string, fmt, args);
+    // A record which repeats the previous one, which has not been sent yet, is counted
+    // rather than stored again.
+    if (logRingCount > 0) {
+        LogRecord *previous =
+            &logRing[(logRingHead + logRingCount - 1) % LOG_AZURE_RING_SIZE];
+        if (previous->severity == severity && strcmp(previous->text, formatBuffer) == 0) {
+            ++previous->repeatCount;
+            ++logStatistics.recordsCoalesced;
+            return AzureIoT_Result_OK;
+        }
+    }
 
-    int result = AzureIoT_Result_OtherFailure;
+    if (logRingCount == LOG_AZURE_RING_SIZE ||
+        (severity != LogAzure_Severity_Error && !TakeRateLimitToken())) {
+        ++recordsDroppedSinceLastBatch;
+        ++logStatistics.recordsDropped;
+        return AzureIoT_Result_OtherFailure;
+    }
 
-    if (length != -1) {
-        result = Log_Azure_Internal(formatted_string);
-        free(formatted_string);
+    LogRecord *record = &logRing[(logRingHead + logRingCount) % LOG_AZURE_RING_SIZE];
+    record->severity = severity;
+    record->repeatCount = 0;
+    memcpy(record->text, formatBuffer, sizeof(record->text));
+    ++logRingCount;
+    ++logStatistics.recordsQueued;
+
+    // Without the flush timer, send each record immediately. If the device is not connected, the
+    // record waits in the ring, and is sent by the next flush.
+    if (flushTimer == NULL) {
+        return AzureIoT_IsConnected() ? Log_Azure_Flush() : AzureIoT_Result_OK;
     }
 
+    // Records which are logged while the device is not connected wait for the flush timer, which
+    // retries until the connection is available.
+    if (logRingCount >= FLUSH_THRESHOLD && AzureIoT_IsConnected()) {
+        // Send from the event loop rather than from the caller.
+        static const struct timespec flushNow = {.tv_sec = 0, .tv_nsec = 1000000};
+        ScheduleFlush(&flushNow);
+    } else if (!isFlushScheduled) {
+        ScheduleFlush(&logFlushPeriod);
+    }
+    return AzureIoT_Result_OK;
+}
+
+AzureIoT_Result Log_Azure(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    AzureIoT_Result result = Log_AzureVarArgs(LogAzure_Severity_Info, fmt, args);
     va_end(args);
+    return result;
+}
 
+AzureIoT_Result Log_AzureWithSeverity(LogAzure_Severity severity, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    AzureIoT_Result result = Log_AzureVarArgs(severity, fmt, args);
+    va_end(args);
     return result;
 }
@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
 #include "azure_iot.h"
 
 /// <summary>
@@ -26,13 +30,103 @@
 /// </summary>
 
 /// <summary>
-///     Log data to Azure
+/// Log records are formatted into a fixed-size ring when they are logged, and sent later in
+/// batches, so logging does not allocate memory or wait for the network. A batch is one telemetry
+/// message whose "debugMessage" holds the records, one per line. Batches are sent by a timer,
+/// which <see cref="Log_Azure_StartFlushTimer" /> starts; until the timer is started, each record
+/// is sent as soon as it is logged.
+///
+/// A record which repeats the previous record is not stored again; instead, the previous record
+/// is sent with "(repeated N times)". Records below the minimum severity are ignored, and records
+/// beyond the rate limit or the capacity of the ring are dropped, and counted in the next batch.
+/// Records of Error severity are not rate limited.
+///
+/// Records are stored in the ring whether or not the device is connected to Azure IoT Hub.
+/// Records logged while the device is offline are sent by the flush timer once it connects.
+/// </summary>
+
+/// <summary>Number of records which can wait to be sent.</summary>
+#define LOG_AZURE_RING_SIZE 16
+
+/// <summary>Maximum length of a formatted record. Longer records are truncated.</summary>
+#define LOG_AZURE_MAX_RECORD_LENGTH 256
+
+/// <summary>Severity of a log record.</summary>
+typedef enum {
+    LogAzure_Severity_Debug = 0,
+    LogAzure_Severity_Info = 1,
+    LogAzure_Severity_Warning = 2,
+    LogAzure_Severity_Error = 3
+} LogAzure_Severity;
+
+/// <summary>Counters which describe the activity of the log pipeline.</summary>
+typedef struct {
+    /// <summary>Number of records stored in the ring.</summary>
+    unsigned int recordsQueued;
+    /// <summary>Number of records which repeated the previous record.</summary>
+    unsigned int recordsCoalesced;
+    /// <summary>Number of records dropped by the rate limit or because the ring was full.</summary>
+    unsigned int recordsDropped;
+    /// <summary>Number of telemetry messages sent.</summary>
+    unsigned int messagesSent;
+} LogAzure_Statistics;
+
+/// <summary>
+///     Log data to Azure, with Info severity.
 /// </summary>
 /// <param name="fmt_string">A conventional printf format string</param>
 /// <param name="...">variables to log into the format string</param>
-/// <returns>An <see cref="AzureIoT_Result" /> indicating success or failure.</returns>
+/// <returns>
+///     An <see cref="AzureIoT_Result" /> indicating whether the record was accepted for sending.
+/// </returns>
 AzureIoT_Result Log_Azure(const char *fmt_string, ...);
 
+/// <summary>
+///     Log data to Azure with the given severity.
+/// </summary>
+/// <param name="severity">Severity of the record</param>
+/// <param name="fmt_string">A conventional printf format string</param>
+/// <param name="...">variables to log into the format string</param>
+/// <returns>
+///     An <see cref="AzureIoT_Result" /> indicating whether the record was accepted for sending.
+/// </returns>
+AzureIoT_Result Log_AzureWithSeverity(LogAzure_Severity severity, const char *fmt_string, ...);
+
+/// <summary>
+///     Sets the lowest severity which is logged to Azure. The default is Info.
+/// </summary>
+/// <param name="severity">The minimum severity</param>
+void Log_AzureSetMinimumSeverity(LogAzure_Severity severity);
+
+/// <summary>
+///     Starts the timer which sends the waiting records in batches. Records are also sent as soon
+///     as half of the ring is in use.
+/// </summary>
+/// <param name="eventLoop">The event loop which runs the timer</param>
+/// <param name="flushPeriod">The longest time which a record waits to be sent</param>
+/// <returns>0 on success; -1 on failure.</returns>
+int Log_Azure_StartFlushTimer(EventLoop *eventLoop, const struct timespec *flushPeriod);
+
+/// <summary>
+///     Sends the waiting records now.
+/// </summary>
+/// <returns>
+///     AzureIoT_Result_OK if every waiting record was sent; otherwise the failure of the first
+///     batch which could not be sent.
+/// </returns>
+AzureIoT_Result Log_Azure_Flush(void);
+
+/// <summary>
+///     Sends the waiting records, if possible, and stops the flush timer.
+/// </summary>
+void Log_Azure_Cleanup(void);
+
+/// <summary>
+///     Gets the counters which describe the activity of the log pipeline.
+/// </summary>
+/// <param name="statistics">Populated with the current counter values</param>
+void Log_Azure_GetStatistics(LogAzure_Statistics *statistics);
+
 /// <summary>
 ///     Enables/disables logging to Azure.
 /// </summary>
@@ -178,8 +178,13 @@ static void LogDebugCallbackHandler(EventLoopTimer *timer)
                 (ret == 0) ? osVersion.version : "Unknown", APP_VERSION, ifaceString, datetime,
                 (lastBootString && *lastBootString != 0) ? lastBootString : "None");
 
-            // ensure the diagnostic information was logged correctly.
+            // Once the record is in the log ring, it is sent even if the connection drops, because
+            // the flush timer retries until it is sent; so it is logged once. Send it now rather
+            // than with the next batch, if possible.
             loggedOsInformation = logResult == AzureIoT_Result_OK;
+            if (loggedOsInformation) {
+                Log_Azure_Flush();
+            }
 
             if (fd) {
                 if (lastBootString)
@@ -248,8 +253,20 @@ static ExitCode InitPeripheralsAndHandlers(void)
                                     .deviceMethodCallbackFunction = NULL,
                                     .cloudToDeviceCallbackFunction = NULL};
 
-    return AzureIoT_Initialize(eventLoop, ExitCodeCallbackHandler, NULL, connectionContext,
-                               callbacks);
+    ExitCode result = AzureIoT_Initialize(eventLoop, ExitCodeCallbackHandler, NULL,
+                                          connectionContext, callbacks);
+    if (result != ExitCode_Success) {
+        return result;
+    }
+
+    // Log_Azure collects log records and sends them in batches, at most this long after they
+    // were logged.
+    static const struct timespec logFlushPeriod = {.tv_sec = 5, .tv_nsec = 0};
+    if (Log_Azure_StartFlushTimer(eventLoop, &logFlushPeriod) != 0) {
+        return ExitCode_Init_LogFlushTimer;
+    }
+
+    return ExitCode_Success;
 }
 
 /// <summary>
@@ -258,6 +275,7 @@ static ExitCode InitPeripheralsAndHandlers(void)
 static void ClosePeripheralsAndHandlers(void)
 {
     DisposeEventLoopTimer(telemetryTimer);
+    Log_Azure_Cleanup();
     AzureIoT_Cleanup();
     Connection_Cleanup();
     EventLoop_Close(eventLoop);
@@ -0,0 +1,10 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/log.h when the TCP server is built on a Linux PC.
+// eventloop_epoll.c implements Log_Debug, which prints only if ECHO_SERVER_VERBOSE is set in
+// the environment.
+
+#pragma once
+
+int Log_Debug(const char *fmt, ...);
@@ -0,0 +1,278 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Load generator for the TCP echo server. It measures:
+// - connections per second, each of which connects, exchanges one line and disconnects;
+// - lines per second with several clients, each of which keeps a window of lines in flight;
+// - the latency from sending a line to receiving its response, as the median and 99th
+//   percentile.
+//
+// By default, it runs echo_tcp_server.c in a thread of the same process, on the loopback
+// interface, with the epoll event loop in eventloop_epoll.c. Give an address and port to measure
+// the server on a device instead, such as 192.168.100.10 11000.
+//
+// Usage: echo_load_generator [-c clients] [-n lines per client] [-w window] [address port]
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "echo_tcp_server.h"
+
+typedef struct {
+    int id;
+    bool connected;
+    size_t linesReceived;
+    double *latencies;
+} Client;
+
+static struct sockaddr_in serverAddr;
+static int linesPerClient = 10000;
+static int window = 8;
+
+static atomic_bool stopServer = false;
+
+static double GetSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void ServerStopped(EchoServer_StopReason reason)
+{
+    printf("ERROR: server stopped (%d)\n", reason);
+    exit(EXIT_FAILURE);
+}
+
+static void *RunServer(void *arg)
+{
+    EventLoop *eventLoop = arg;
+    while (!atomic_load(&stopServer)) {
+        EventLoop_Run(eventLoop, 100, false);
+    }
+    return NULL;
+}
+
+static int Connect(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (const struct sockaddr *)&serverAddr, sizeof(serverAddr)) != 0) {
+        printf("ERROR: could not connect: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return fd;
+}
+
+// Receive until a complete response is in the buffer. Returns false if the server closed the
+// connection.
+static bool ReceiveResponses(int fd, char *buf, size_t *size, size_t capacity)
+{
+    ssize_t n = recv(fd, buf + *size, capacity - *size, 0);
+    if (n <= 0) {
+        return false;
+    }
+    *size += (size_t)n;
+    return true;
+}
+
+static void *RunClient(void *arg)
+{
+    Client *client = arg;
+    char buf[4096];
+    size_t bufSize = 0;
+    double *sendTimes = malloc((size_t)linesPerClient * sizeof(double));
+    int sent = 0;
+
+    int fd = Connect();
+    client->connected = true;
+
+    while ((int)client->linesReceived < linesPerClient) {
+        // Keep the window full.
+        while (sent < linesPerClient && sent - (int)client->linesReceived < window) {
+            char line[32];
+            int length = snprintf(line, sizeof(line), "%d-%d\r\n", client->id, sent);
+            sendTimes[sent] = GetSeconds();
+            if (send(fd, line, (size_t)length, MSG_NOSIGNAL) != length) {
+                client->connected = false;
+                goto done;
+            }
+            ++sent;
+        }
+
+        if (!ReceiveResponses(fd, buf, &bufSize, sizeof(buf))) {
+            // The server closes connections beyond the maximum number of clients.
+            client->connected = client->linesReceived > 0;
+            goto done;
+        }
+
+        // Each response ends with "\r\n"; responses arrive in the order of the lines.
+        char *start = buf;
+        char *end;
+        while ((end = memchr(start, '\n', bufSize - (size_t)(start - buf))) != NULL) {
+            client->latencies[client->linesReceived] =
+                GetSeconds() - sendTimes[client->linesReceived];
+            ++client->linesReceived;
+            start = end + 1;
+        }
+        bufSize -= (size_t)(start - buf);
+        memmove(buf, start, bufSize);
+    }
+
+done:
+    close(fd);
+    free(sendTimes);
+    return NULL;
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void MeasureConnections(void)
+{
+    const int connections = 200;
+    char buf[64];
+
+    double start = GetSeconds();
+    for (int i = 0; i < connections; ++i) {
+        int fd = Connect();
+        send(fd, "hi\r\n", 4, MSG_NOSIGNAL);
+        size_t size = 0;
+        while (memchr(buf, '\n', size) == NULL && ReceiveResponses(fd, buf, &size, sizeof(buf))) {
+        }
+        close(fd);
+    }
+    double elapsed = GetSeconds() - start;
+
+    printf("Connections: %d in %.2f s, %.0f per second\n", connections, elapsed,
+           connections / elapsed);
+}
+
+static void MeasureLines(int clientCount)
+{
+    Client *clients = calloc((size_t)clientCount, sizeof(Client));
+    pthread_t *threads = calloc((size_t)clientCount, sizeof(pthread_t));
+
+    double start = GetSeconds();
+    for (int i = 0; i < clientCount; ++i) {
+        clients[i].id = i;
+        clients[i].latencies = malloc((size_t)linesPerClient * sizeof(double));
+        pthread_create(&threads[i], NULL, RunClient, &clients[i]);
+    }
+    for (int i = 0; i < clientCount; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = GetSeconds() - start;
+
+    size_t totalLines = 0;
+    int served = 0;
+    for (int i = 0; i < clientCount; ++i) {
+        totalLines += clients[i].linesReceived;
+        served += clients[i].connected ? 1 : 0;
+    }
+
+    double *latencies = malloc((totalLines > 0 ? totalLines : 1) * sizeof(double));
+    size_t count = 0;
+    for (int i = 0; i < clientCount; ++i) {
+        memcpy(latencies + count, clients[i].latencies,
+               clients[i].linesReceived * sizeof(double));
+        count += clients[i].linesReceived;
+        free(clients[i].latencies);
+    }
+    qsort(latencies, count, sizeof(double), CompareDoubles);
+
+    printf("Clients: %d served, %d refused\n", served, clientCount - served);
+    printf("Lines: %zu in %.2f s, %.0f per second\n", totalLines, elapsed, totalLines / elapsed);
+    if (count > 0) {
+        printf("Latency: median %.1f us, p99 %.1f us\n", latencies[count / 2] * 1e6,
+               latencies[(count * 99) / 100] * 1e6);
+    }
+
+    free(latencies);
+    free(threads);
+    free(clients);
+
+    if (served == 0 || totalLines != (size_t)served * (size_t)linesPerClient) {
+        printf("ERROR: not every line was answered\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int clientCount = ECHO_SERVER_MAX_CLIENTS;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:w:")) != -1) {
+        switch (opt) {
+        case 'c':
+            clientCount = atoi(optarg);
+            break;
+        case 'n':
+            linesPerClient = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-c clients] [-n lines per client] [-w window] [address port]\n",
+                   argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    serverAddr.sin_family = AF_INET;
+    EventLoop *eventLoop = NULL;
+    EchoServer_ServerState *serverState = NULL;
+    pthread_t serverThread;
+
+    if (optind + 2 <= argc) {
+        serverAddr.sin_addr.s_addr = inet_addr(argv[optind]);
+        serverAddr.sin_port = htons((uint16_t)atoi(argv[optind + 1]));
+    } else {
+        ExitCode exitCode = ExitCode_Success;
+        eventLoop = EventLoop_Create();
+        serverState = EchoServer_Start(eventLoop, htonl(INADDR_LOOPBACK), 0, 16, ServerStopped,
+                                       &exitCode);
+        if (serverState == NULL) {
+            printf("ERROR: could not start server (%d)\n", exitCode);
+            return EXIT_FAILURE;
+        }
+
+        socklen_t addrLen = sizeof(serverAddr);
+        getsockname(serverState->listenFd, (struct sockaddr *)&serverAddr, &addrLen);
+        pthread_create(&serverThread, NULL, RunServer, eventLoop);
+        printf("Server: in process, port %u\n", ntohs(serverAddr.sin_port));
+    }
+
+    MeasureConnections();
+    MeasureLines(clientCount);
+
+    if (serverState != NULL) {
+        atomic_store(&stopServer, true);
+        pthread_join(serverThread, NULL);
+        EchoServer_ShutDown(serverState);
+        EventLoop_Close(eventLoop);
+    }
+    return EXIT_SUCCESS;
+}
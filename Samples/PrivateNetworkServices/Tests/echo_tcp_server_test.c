@@ -0,0 +1,368 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Tests for echo_tcp_server.c, which run on a Linux PC. The server listens on the loopback
+// interface and is driven by the epoll event loop in eventloop_epoll.c, and the test's clients
+// run in the same thread, between runs of the event loop.
+//
+// echo_tcp_server.c is included rather than linked, so its calls to send can be replaced with
+// Test_Send, which can refuse data with EAGAIN or accept only part of it, as a client which reads
+// slowly would make the OS do.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+static ssize_t Test_Send(int fd, const void *buf, size_t len, int flags);
+
+#define send Test_Send
+#include "echo_tcp_server.c"
+#undef send
+
+// If true, Test_Send fails with EAGAIN. Otherwise, if randomSendLimits is true, it sends a
+// random number of bytes, and sometimes fails with EAGAIN.
+static bool sendBlocked = false;
+static bool randomSendLimits = false;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+static ssize_t Test_Send(int fd, const void *buf, size_t len, int flags)
+{
+    if (sendBlocked || (randomSendLimits && rand() % 4 == 0)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (randomSendLimits && len > 1) {
+        len = 1 + (size_t)rand() % len;
+    }
+    return send(fd, buf, len, flags);
+}
+
+static void ShutdownCallback(EchoServer_StopReason reason)
+{
+    Fail("ShutdownCallback", "server stopped", reason);
+}
+
+static EventLoop *eventLoop = NULL;
+static EchoServer_ServerState *serverState = NULL;
+static uint16_t serverPort = 0;
+
+static void StartTestServer(void)
+{
+    ExitCode exitCode = ExitCode_Success;
+    eventLoop = EventLoop_Create();
+    serverState = EchoServer_Start(eventLoop, htonl(INADDR_LOOPBACK), 0, 8, ShutdownCallback,
+                                   &exitCode);
+    if (serverState == NULL) {
+        printf("FAIL: could not start server (%d)\n", exitCode);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    getsockname(serverState->listenFd, (struct sockaddr *)&addr, &addrLen);
+    serverPort = ntohs(addr.sin_port);
+}
+
+static void StopTestServer(void)
+{
+    EchoServer_ShutDown(serverState);
+    EventLoop_Close(eventLoop);
+    serverState = NULL;
+    eventLoop = NULL;
+}
+
+// Process events until none arrive for a short time.
+static void RunUntilIdle(void)
+{
+    while (EventLoop_Run(eventLoop, 50, false) == EventLoop_Run_Finished) {
+    }
+}
+
+// Process events for a number of runs of the event loop. While Test_Send refuses data which the
+// socket could accept, the server is never idle, because it is told again that it can send.
+static void RunFor(int runs)
+{
+    for (int i = 0; i < runs; ++i) {
+        EventLoop_Run(eventLoop, 1, false);
+    }
+}
+
+// Connect a non-blocking client, and let the server accept it.
+static int Connect(void)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(serverPort),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        printf("FAIL: could not connect: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    RunUntilIdle();
+    return fd;
+}
+
+static EchoServer_Connection *FindConnection(void)
+{
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS; ++i) {
+        if (serverState->connections[i].clientFd != -1) {
+            return &serverState->connections[i];
+        }
+    }
+    return NULL;
+}
+
+// Read everything which has arrived on a non-blocking client. Returns the number of bytes read,
+// or -1 if the server closed the connection.
+static ssize_t ReadAvailable(int fd, char *buf, size_t size)
+{
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = recv(fd, buf + total, size - total, 0);
+        if (n > 0) {
+            total += (size_t)n;
+        } else if (n == 0) {
+            return total > 0 ? (ssize_t)total : -1;
+        } else {
+            break;
+        }
+    }
+    return (ssize_t)total;
+}
+
+// A client sends many empty lines while the server cannot send. The receive ring fills up, and
+// the server waits only for output. When it can send again, it must process the rest of the
+// ring, including the lines which were received after its last chance to process them.
+static void TestBlockedOutputWithFullRing(void)
+{
+    const char *test = "TestBlockedOutputWithFullRing";
+    const size_t lines = 400;
+    static const char response[] = "Received \"\"\r\n";
+    char input[400];
+    static char output[400 * (sizeof(response) - 1) + 1];
+
+    StartTestServer();
+    int fd = Connect();
+    EchoServer_Connection *connection = FindConnection();
+
+    sendBlocked = true;
+    memset(input, '\r', lines);
+    if (send(fd, input, lines, 0) != (ssize_t)lines) {
+        Fail(test, "could not send input", errno);
+    }
+    RunFor(100);
+    if (connection->rxCount != ECHO_SERVER_RX_RING_SIZE ||
+        connection->clientEvents != EventLoop_Output) {
+        Fail(test, "server did not back up as expected", (long)connection->rxCount);
+    }
+
+    sendBlocked = false;
+    size_t received = 0;
+    for (int attempt = 0; attempt < 100 && received < sizeof(output) - 1; ++attempt) {
+        EventLoop_Run(eventLoop, 10, false);
+        ssize_t n = ReadAvailable(fd, output + received, sizeof(output) - 1 - received);
+        if (n < 0) {
+            break;
+        }
+        received += (size_t)n;
+    }
+
+    if (received != lines * (sizeof(response) - 1)) {
+        Fail(test, "server stalled before answering every line",
+             (long)(received / (sizeof(response) - 1)));
+    } else {
+        for (size_t i = 0; i < lines; ++i) {
+            if (memcmp(output + i * (sizeof(response) - 1), response, sizeof(response) - 1) != 0) {
+                Fail(test, "wrong response", (long)i);
+                break;
+            }
+        }
+    }
+    if (connection->rxCount != 0 || connection->clientEvents != EventLoop_Input) {
+        Fail(test, "server not waiting for input", (long)connection->clientEvents);
+    }
+
+    close(fd);
+    StopTestServer();
+}
+
+// The maximum number of clients pipeline lines in random sizes of write, while the server's
+// sends are randomly refused or cut short. Every client must receive a response to each of its
+// lines, in order.
+static void TestPipelinedClients(void)
+{
+    const char *test = "TestPipelinedClients";
+    enum { Clients = ECHO_SERVER_MAX_CLIENTS, Lines = 2000 };
+    static char input[Clients][Lines * 16];
+    static char expected[Clients][Lines * 28];
+    static char output[Clients][Lines * 28];
+    size_t inputSize[Clients], expectedSize[Clients], sent[Clients] = {0}, received[Clients] = {0};
+    int fds[Clients];
+
+    StartTestServer();
+    srand(1);
+    randomSendLimits = true;
+
+    for (int c = 0; c < Clients; ++c) {
+        fds[c] = Connect();
+        inputSize[c] = 0;
+        expectedSize[c] = 0;
+        for (int i = 0; i < Lines; ++i) {
+            char line[ECHO_SERVER_MAX_LINE_LENGTH + 1];
+            snprintf(line, sizeof(line), "c%d-line-%d", c, i);
+            inputSize[c] += (size_t)sprintf(input[c] + inputSize[c], "%s\r\n", line);
+            expectedSize[c] +=
+                (size_t)sprintf(expected[c] + expectedSize[c], "Received \"%s\"\r\n", line);
+        }
+    }
+
+    // Stop if no client makes progress for many runs of the event loop, as the server has
+    // stalled.
+    bool done = false;
+    for (int idleRounds = 0; idleRounds < 1000 && !done;) {
+        done = true;
+        bool progress = false;
+        for (int c = 0; c < Clients; ++c) {
+            if (sent[c] < inputSize[c]) {
+                size_t size = 1 + (size_t)rand() % 700;
+                if (size > inputSize[c] - sent[c]) {
+                    size = inputSize[c] - sent[c];
+                }
+                ssize_t n = send(fds[c], input[c] + sent[c], size, 0);
+                if (n > 0) {
+                    sent[c] += (size_t)n;
+                    progress = true;
+                }
+            }
+
+            // Read only on some rounds, so the server sometimes finds its clients slow.
+            if (rand() % 3 == 0) {
+                ssize_t n = ReadAvailable(fds[c], output[c] + received[c],
+                                          sizeof(output[c]) - received[c]);
+                if (n > 0) {
+                    received[c] += (size_t)n;
+                    progress = true;
+                }
+            }
+            done = done && received[c] == expectedSize[c];
+        }
+
+        idleRounds = progress ? 0 : idleRounds + 1;
+        EventLoop_Run(eventLoop, progress ? 0 : 1, false);
+    }
+
+    for (int c = 0; c < Clients; ++c) {
+        if (received[c] != expectedSize[c] || memcmp(output[c], expected[c], received[c]) != 0) {
+            Fail(test, "wrong responses", c);
+        }
+        close(fds[c]);
+    }
+
+    randomSendLimits = false;
+    RunUntilIdle();
+    if (FindConnection() != NULL) {
+        Fail(test, "server did not close connections", 0);
+    }
+    StopTestServer();
+}
+
+// A line which is too long is discarded in pieces of ECHO_SERVER_MAX_LINE_LENGTH characters, and
+// characters which are not printable are discarded.
+static void TestLongLine(void)
+{
+    const char *test = "TestLongLine";
+    static const char input[] = "abcdefghijklmnopq\r\n\tx\r\n";
+    static const char expected[] = "Received \"pq\"\r\nReceived \"x\"\r\n";
+    char output[64];
+
+    StartTestServer();
+    int fd = Connect();
+    send(fd, input, sizeof(input) - 1, 0);
+    RunUntilIdle();
+    ssize_t n = ReadAvailable(fd, output, sizeof(output));
+    if (n != sizeof(expected) - 1 || memcmp(output, expected, (size_t)n) != 0) {
+        Fail(test, "wrong response", (long)n);
+    }
+
+    close(fd);
+    StopTestServer();
+}
+
+// A client which connects when the maximum number of clients are connected is disconnected,
+// and the other clients are not affected. Once a client disconnects, another can connect.
+static void TestTooManyClients(void)
+{
+    const char *test = "TestTooManyClients";
+    int fds[ECHO_SERVER_MAX_CLIENTS + 1];
+    char output[64];
+
+    StartTestServer();
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS + 1; ++i) {
+        fds[i] = Connect();
+    }
+
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS + 1; ++i) {
+        send(fds[i], "hi\r\n", 4, 0);
+        RunUntilIdle();
+        ssize_t n = ReadAvailable(fds[i], output, sizeof(output));
+        bool closed = n == -1 || recv(fds[i], output, 1, 0) == 0 || errno != EAGAIN;
+        if (i < ECHO_SERVER_MAX_CLIENTS ? n != sizeof("Received \"hi\"\r\n") - 1 : !closed) {
+            Fail(test, "wrong response", (long)i);
+        }
+    }
+
+    close(fds[0]);
+    RunUntilIdle();
+    int fd = Connect();
+    send(fd, "hi\r\n", 4, 0);
+    RunUntilIdle();
+    if (ReadAvailable(fd, output, sizeof(output)) != sizeof("Received \"hi\"\r\n") - 1) {
+        Fail(test, "could not connect after another client disconnected", 0);
+    }
+
+    close(fd);
+    for (size_t i = 1; i < ECHO_SERVER_MAX_CLIENTS + 1; ++i) {
+        close(fds[i]);
+    }
+    StopTestServer();
+}
+
+int main(void)
+{
+    // A client which the server has closed must not stop the test when it sends.
+    signal(SIGPIPE, SIG_IGN);
+
+    TestBlockedOutputWithFullRing();
+    TestPipelinedClients();
+    TestLongLine();
+    TestTooManyClients();
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
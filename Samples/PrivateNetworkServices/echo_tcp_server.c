@@ -1,7 +1,7 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
-#define _GNU_SOURCE // required for asprintf
+#define _GNU_SOURCE // required for accept4
 #include <stdbool.h>
 #include <ctype.h>
 #include <string.h>
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stddef.h>
+#include <unistd.h>
 
 #include <sys/socket.h>
 
@@ -16,13 +17,20 @@
 
 #include "echo_tcp_server.h"
 
+// Longest response which QueueResponse can write, excluding the NUL terminator.
+#define MAX_RESPONSE_LENGTH (sizeof("Received \"\"\r\n") - 1 + ECHO_SERVER_MAX_LINE_LENGTH)
+
 // Support functions.
 static void HandleListenEvent(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
-static void LaunchRead(EchoServer_ServerState *serverState);
+static EchoServer_Connection *FindFreeConnection(EchoServer_ServerState *serverState);
 static void HandleClientEvent(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
-static void HandleClientReadEvent(EchoServer_ServerState *serverState);
-static void LaunchWrite(EchoServer_ServerState *serverState);
-static void HandleClientWriteEvent(EchoServer_ServerState *serverState);
+static void ServiceConnection(EchoServer_Connection *connection);
+static void ProcessReceivedData(EchoServer_Connection *connection);
+static void AppendToLine(EchoServer_Connection *connection, const uint8_t *data, size_t size);
+static bool QueueResponse(EchoServer_Connection *connection);
+static bool FlushTxPayload(EchoServer_Connection *connection);
+static void UpdateClientEvents(EchoServer_Connection *connection);
+static void CloseConnection(EchoServer_Connection *connection);
 static int OpenIpV4Socket(in_addr_t ipAddr, uint16_t port, int sockType, ExitCode *callerExitCode);
 static void ReportError(const char *desc);
 static void StopServer(EchoServer_ServerState *serverState, EchoServer_StopReason reason);
@@ -43,9 +51,11 @@ EchoServer_ServerState *EchoServer_Start(EventLoop *eventLoopInstance, in_addr_t
     serverState->eventLoop = eventLoopInstance;
     serverState->listenFd = -1;
     serverState->listenEventReg = NULL;
-    serverState->clientFd = -1;
-    serverState->clientEventReg = NULL;
-    serverState->txPayload = NULL;
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS; ++i) {
+        serverState->connections[i].serverState = serverState;
+        serverState->connections[i].clientFd = -1;
+        serverState->connections[i].clientEventReg = NULL;
+    }
     serverState->shutdownCallback = shutdownCallback;
 
     int sockType = SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK;
@@ -70,7 +80,7 @@ EchoServer_ServerState *EchoServer_Start(EventLoop *eventLoopInstance, in_addr_t
         goto fail;
     }
 
-    Log_Debug("INFO: TCP server: Listening for client connection (fd %d).\n",
+    Log_Debug("INFO: TCP server: Listening for client connections (fd %d).\n",
               serverState->listenFd);
 
     return serverState;
@@ -96,212 +106,340 @@ void EchoServer_ShutDown(EchoServer_ServerState *serverState)
         return;
     }
 
-    EventLoop_UnregisterIo(serverState->eventLoop, serverState->clientEventReg);
-    CloseFdAndPrintError(serverState->clientFd, "clientFd");
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS; ++i) {
+        CloseConnection(&serverState->connections[i]);
+    }
 
     EventLoop_UnregisterIo(serverState->eventLoop, serverState->listenEventReg);
     CloseFdAndPrintError(serverState->listenFd, "listenFd");
 
-    free(serverState->txPayload);
-
     free(serverState);
 }
 
 static void HandleListenEvent(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
     EchoServer_ServerState *serverState = (EchoServer_ServerState *)context;
-    int localFd = -1;
 
-    do {
+    // Accept every pending connection, so clients which connect at the same time do not have to
+    // wait for another event.
+    while (true) {
         // Create a new accepted socket to connect to the client.
         // The newly-accepted sockets should be opened in non-blocking mode.
         struct sockaddr in_addr;
         socklen_t sockLen = sizeof(in_addr);
-        localFd = accept4(serverState->listenFd, &in_addr, &sockLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        int localFd =
+            accept4(serverState->listenFd, &in_addr, &sockLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (localFd == -1) {
+            // If no more connections are pending then wait for the next EventLoop_Input.
+            // A connection which was aborted before it was accepted is not a server error.
+            if (errno == EAGAIN || errno == ECONNABORTED) {
+                break;
+            }
+
+            // Another error occurred so stop the server.
             ReportError("accept");
+            StopServer(serverState, EchoServer_StopReason_Error);
             break;
         }
 
         Log_Debug("INFO: TCP server: Accepted client connection (fd %d).\n", localFd);
 
-        // If already have a client, then close the newly-accepted socket.
-        if (serverState->clientFd >= 0) {
+        // If already have the maximum number of clients, then close the newly-accepted socket.
+        EchoServer_Connection *connection = FindFreeConnection(serverState);
+        if (connection == NULL) {
             Log_Debug(
-                "INFO: TCP server: Closing incoming client connection: only one client supported "
-                "at a time.\n");
-            break;
+                "INFO: TCP server: Closing incoming client connection: only %d clients supported "
+                "at a time.\n",
+                ECHO_SERVER_MAX_CLIENTS);
+            CloseFdAndPrintError(localFd, "localClientFd");
+            continue;
         }
 
-        serverState->clientEventReg = EventLoop_RegisterIo(serverState->eventLoop, localFd, 0x0,
-                                                           HandleClientEvent, serverState);
-        if (serverState->clientEventReg == NULL) {
+        connection->clientEventReg = EventLoop_RegisterIo(
+            serverState->eventLoop, localFd, EventLoop_Input, HandleClientEvent, connection);
+        if (connection->clientEventReg == NULL) {
             ReportError("register client event");
-            break;
+            CloseFdAndPrintError(localFd, "localClientFd");
+            continue;
         }
 
-        // Socket opened successfully, so transfer ownership to EchoServer_ServerState object.
-        serverState->clientFd = localFd;
-        localFd = -1;
-
-        LaunchRead(serverState);
-    } while (0);
-
-    CloseFdAndPrintError(localFd, "localClientFd");
+        // Socket opened successfully, so transfer ownership to the connection.
+        connection->clientFd = localFd;
+        connection->clientEvents = EventLoop_Input;
+        connection->rxReadIndex = 0;
+        connection->rxCount = 0;
+        connection->inLineSize = 0;
+        connection->txPayloadSize = 0;
+        connection->txBytesSent = 0;
+    }
 }
 
-static void LaunchRead(EchoServer_ServerState *serverState)
+static EchoServer_Connection *FindFreeConnection(EchoServer_ServerState *serverState)
 {
-    serverState->inLineSize = 0;
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS; ++i) {
+        if (serverState->connections[i].clientFd == -1) {
+            return &serverState->connections[i];
+        }
+    }
 
-    EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg, EventLoop_Input);
+    return NULL;
 }
 
 static void HandleClientEvent(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
-    EchoServer_ServerState *serverState = context;
-
-    if (events & EventLoop_Input) {
-        HandleClientReadEvent(serverState);
-    }
-
-    if (events & EventLoop_Output) {
-        HandleClientWriteEvent(serverState);
-    }
+    // Input and output are handled together, because sending responses makes room to process
+    // more input, and processing input produces more responses.
+    ServiceConnection((EchoServer_Connection *)context);
 }
 
-static void HandleClientReadEvent(EchoServer_ServerState *serverState)
+/// <summary>
+///     <para>
+///         Processes buffered input, sends any responses, and reads more input, until no
+///         more input is immediately available or the responses cannot be sent yet.
+///     </para>
+///     <param name="connection">The connection to service.</param>
+/// </summary>
+static void ServiceConnection(EchoServer_Connection *connection)
 {
-    EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg, EventLoop_None);
-
-    // Continue until no immediately available input or until an error occurs.
-    size_t maxChars = sizeof(serverState->input) - 1;
-
     while (true) {
-        // Read a single byte from the client and add it to the buffered line.
-        uint8_t b;
-        ssize_t bytesReadOneSysCall = recv(serverState->clientFd, &b, 1, /* flags */ 0);
-
-        // If successfully read a single byte then process it.
-        if (bytesReadOneSysCall == 1) {
-            // If received newline then print received line to debug log.
-            if (b == '\r') {
-                serverState->input[serverState->inLineSize] = '\0';
-                Log_Debug("INFO: TCP server: Received \"%s\"\n", serverState->input);
-                LaunchWrite(serverState);
-                break;
-            }
+        ProcessReceivedData(connection);
 
-            // If new character is not printable then discard.
-            else if (!isprint(b)) {
-                // Special case '\n' to avoid printing a message for every line of input.
-                if (b != '\n') {
-                    Log_Debug("INFO: TCP server: Discarding unprintable character 0x%02x\n", b);
-                }
-            }
+        if (!FlushTxPayload(connection)) {
+            return;
+        }
 
-            // If new character would leave no space for NUL terminator then reset buffer.
-            else if (serverState->inLineSize == maxChars) {
-                Log_Debug("INFO: TCP server: Input data overflow. Discarding %zu characters.\n",
-                          maxChars);
-                serverState->input[0] = b;
-                serverState->inLineSize = 1;
-            }
+        // ProcessReceivedData only leaves data in the ring when there is no space for another
+        // response. If the flush has sent every response then process the rest of the ring now,
+        // because no further event may arrive for it.
+        if (connection->rxCount > 0 && connection->txBytesSent == connection->txPayloadSize) {
+            continue;
+        }
 
-            // Else append character to buffer.
-            else {
-                serverState->input[serverState->inLineSize] = b;
-                ++serverState->inLineSize;
-            }
+        // If the ring is still full then the responses are backed up, so wait for
+        // EventLoop_Output before reading more input.
+        if (connection->rxCount == ECHO_SERVER_RX_RING_SIZE) {
+            break;
         }
 
-        // If client has shut down cleanly then terminate.
+        // Read as much as will fit into the contiguous free space in the ring.
+        size_t writeIndex =
+            (connection->rxReadIndex + connection->rxCount) % ECHO_SERVER_RX_RING_SIZE;
+        size_t freeToEnd = ECHO_SERVER_RX_RING_SIZE - writeIndex;
+        size_t freeSpace = ECHO_SERVER_RX_RING_SIZE - connection->rxCount;
+        size_t maxRead = (freeToEnd < freeSpace) ? freeToEnd : freeSpace;
+        ssize_t bytesReadOneSysCall =
+            recv(connection->clientFd, &connection->rxRing[writeIndex], maxRead, /* flags */ 0);
+
+        // If successfully read data then process it.
+        if (bytesReadOneSysCall > 0) {
+            connection->rxCount += (size_t)bytesReadOneSysCall;
+        }
+
+        // If client has shut down cleanly then close the connection.
         else if (bytesReadOneSysCall == 0) {
-            Log_Debug("INFO: TCP server: Client has closed connection, so terminating server.\n");
-            StopServer(serverState, EchoServer_StopReason_ClientClosed);
-            break;
+            Log_Debug("INFO: TCP server: Client has closed connection (fd %d).\n",
+                      connection->clientFd);
+            CloseConnection(connection);
+            return;
         }
 
         // If receive buffer is empty then wait for EventLoop_Input event.
-        else if (bytesReadOneSysCall == -1 && errno == EAGAIN) {
-            EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg,
-                                     EventLoop_Input);
+        else if (errno == EAGAIN) {
             break;
         }
 
-        // Another error occured so abort the program.
+        // Another error occured so close the connection.
         else {
             ReportError("recv");
-            StopServer(serverState, EchoServer_StopReason_Error);
-            break;
+            CloseConnection(connection);
+            return;
         }
     }
+
+    UpdateClientEvents(connection);
 }
 
-static void LaunchWrite(EchoServer_ServerState *serverState)
+/// <summary>
+///     <para>
+///         Splits the data in the receive ring into lines, and queues a response for each
+///         complete line. Stops early if there is not enough space for another response.
+///     </para>
+///     <param name="connection">The connection whose data should be processed.</param>
+/// </summary>
+static void ProcessReceivedData(EchoServer_Connection *connection)
 {
-    // Allocate a client response on the heap.
-    char *str;
-    int result = asprintf(&str, "Received \"%s\"\r\n", serverState->input);
-    if (result == -1) {
-        ReportError("asprintf");
-        StopServer(serverState, EchoServer_StopReason_Error);
-        return;
+    while (connection->rxCount > 0) {
+        // Search the contiguous data before the end of the ring for the end of the line.
+        // memchr scans several bytes at a time.
+        size_t dataToEnd = ECHO_SERVER_RX_RING_SIZE - connection->rxReadIndex;
+        size_t chunkSize = (connection->rxCount < dataToEnd) ? connection->rxCount : dataToEnd;
+        const uint8_t *chunk = &connection->rxRing[connection->rxReadIndex];
+        const uint8_t *lineEnd = memchr(chunk, '\r', chunkSize);
+
+        size_t consumed = (lineEnd != NULL) ? (size_t)(lineEnd - chunk) : chunkSize;
+        AppendToLine(connection, chunk, consumed);
+
+        // If received newline then print received line to debug log and queue the response.
+        // If there is no space for the response then leave the newline in the ring.
+        bool stalled = false;
+        if (lineEnd != NULL) {
+            if (QueueResponse(connection)) {
+                ++consumed;
+            } else {
+                stalled = true;
+            }
+        }
+
+        connection->rxReadIndex = (connection->rxReadIndex + consumed) % ECHO_SERVER_RX_RING_SIZE;
+        connection->rxCount -= consumed;
+
+        if (stalled) {
+            break;
+        }
     }
+}
 
-    // Start to send the response.
-    serverState->txPayloadSize = (size_t)result;
-    serverState->txPayload = (uint8_t *)str;
-    serverState->txBytesSent = 0;
-    HandleClientWriteEvent(serverState);
+/// <summary>
+///     <para>Appends received characters, which do not include a newline, to the current
+///     line.</para>
+///     <param name="connection">The connection which received the characters.</param>
+///     <param name="data">Received characters.</param>
+///     <param name="size">Number of received characters.</param>
+/// </summary>
+static void AppendToLine(EchoServer_Connection *connection, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t b = data[i];
+
+        // If new character is not printable then discard.
+        if (!isprint(b)) {
+            // Special case '\n' to avoid printing a message for every line of input.
+            if (b != '\n') {
+                Log_Debug("INFO: TCP server: Discarding unprintable character 0x%02x\n", b);
+            }
+        }
+
+        // If new character would leave no space for NUL terminator then reset buffer.
+        else if (connection->inLineSize == ECHO_SERVER_MAX_LINE_LENGTH) {
+            Log_Debug("INFO: TCP server: Input data overflow. Discarding %d characters.\n",
+                      ECHO_SERVER_MAX_LINE_LENGTH);
+            connection->input[0] = (char)b;
+            connection->inLineSize = 1;
+        }
+
+        // Else append character to buffer.
+        else {
+            connection->input[connection->inLineSize] = (char)b;
+            ++connection->inLineSize;
+        }
+    }
 }
 
 /// <summary>
 ///     <para>
-///         Called to launch a new write operation, or to continue an existing
-///         write operation when the client socket receives a write event.
+///         Writes the response to the current line into the connection's transmit buffer,
+///         and starts a new line.
 ///     </para>
-///     <param name="serverState">
-///         The server whose client should be sent the message.
-///     </param>
+///     <param name="connection">The connection which received the line.</param>
+///     <returns>true if the response was queued; false if there was not enough space.</returns>
 /// </summary>
-static void HandleClientWriteEvent(EchoServer_ServerState *serverState)
+static bool QueueResponse(EchoServer_Connection *connection)
 {
-    EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg, EventLoop_None);
+    // Move any unsent data to the start of the buffer to make room for the response.
+    if (ECHO_SERVER_TX_BUFFER_SIZE - connection->txPayloadSize < MAX_RESPONSE_LENGTH + 1) {
+        size_t unsentBytes = connection->txPayloadSize - connection->txBytesSent;
+        memmove(connection->txPayload, &connection->txPayload[connection->txBytesSent],
+                unsentBytes);
+        connection->txPayloadSize = unsentBytes;
+        connection->txBytesSent = 0;
+
+        if (ECHO_SERVER_TX_BUFFER_SIZE - connection->txPayloadSize < MAX_RESPONSE_LENGTH + 1) {
+            return false;
+        }
+    }
 
-    // Continue until have written entire response, error occurs, or OS TX buffer is full.
-    while (serverState->txBytesSent < serverState->txPayloadSize) {
-        size_t remainingBytes = serverState->txPayloadSize - serverState->txBytesSent;
-        const uint8_t *data = &serverState->txPayload[serverState->txBytesSent];
-        ssize_t bytesSentOneSysCall =
-            send(serverState->clientFd, data, remainingBytes, /* flags */ 0);
+    connection->input[connection->inLineSize] = '\0';
+    connection->inLineSize = 0;
+    Log_Debug("INFO: TCP server: Received \"%s\" (fd %d)\n", connection->input,
+              connection->clientFd);
+
+    int result = snprintf(&connection->txPayload[connection->txPayloadSize],
+                          ECHO_SERVER_TX_BUFFER_SIZE - connection->txPayloadSize,
+                          "Received \"%s\"\r\n", connection->input);
+    connection->txPayloadSize += (size_t)result;
+    return true;
+}
+
+/// <summary>
+///     <para>
+///         Sends as much of the connection's transmit buffer as the OS will accept.
+///     </para>
+///     <param name="connection">The connection whose client should be sent the responses.</param>
+///     <returns>true if the connection is still open; false if it was closed.</returns>
+/// </summary>
+static bool FlushTxPayload(EchoServer_Connection *connection)
+{
+    // Continue until have written entire payload, error occurs, or OS TX buffer is full.
+    while (connection->txBytesSent < connection->txPayloadSize) {
+        size_t remainingBytes = connection->txPayloadSize - connection->txBytesSent;
+        const char *data = &connection->txPayload[connection->txBytesSent];
+        ssize_t bytesSentOneSysCall = send(connection->clientFd, data, remainingBytes,
+                                           /* flags */ 0);
 
         // If successfully sent data then stay in loop and try to send more data.
         if (bytesSentOneSysCall > 0) {
-            serverState->txBytesSent += (size_t)bytesSentOneSysCall;
+            connection->txBytesSent += (size_t)bytesSentOneSysCall;
         }
 
         // If OS TX buffer is full then wait for next EventLoop_Output.
         else if (bytesSentOneSysCall < 0 && errno == EAGAIN) {
-            EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg,
-                                     EventLoop_Output);
-            return;
+            return true;
         }
 
-        // Another error occurred so terminate the program.
+        // Another error occurred so close the connection.
         else {
             ReportError("send");
-            StopServer(serverState, EchoServer_StopReason_Error);
-            return;
+            CloseConnection(connection);
+            return false;
         }
     }
 
-    // If reached here then successfully sent entire payload so clean up and read next line from
-    // client.
-    free(serverState->txPayload);
-    serverState->txPayload = NULL;
+    // If reached here then successfully sent entire payload, so reuse the whole buffer.
+    connection->txPayloadSize = 0;
+    connection->txBytesSent = 0;
+    return true;
+}
+
+/// <summary>
+///     <para>
+///         Waits for input if there is space in the receive ring, and for output if there are
+///         responses which have not been sent.
+///     </para>
+///     <param name="connection">The connection whose events should be updated.</param>
+/// </summary>
+static void UpdateClientEvents(EchoServer_Connection *connection)
+{
+    EventLoop_IoEvents events = EventLoop_None;
+    if (connection->rxCount < ECHO_SERVER_RX_RING_SIZE) {
+        events |= EventLoop_Input;
+    }
+    if (connection->txBytesSent < connection->txPayloadSize) {
+        events |= EventLoop_Output;
+    }
+
+    if (events != connection->clientEvents) {
+        EventLoop_ModifyIoEvents(connection->serverState->eventLoop, connection->clientEventReg,
+                                 events);
+        connection->clientEvents = events;
+    }
+}
 
-    LaunchRead(serverState);
+static void CloseConnection(EchoServer_Connection *connection)
+{
+    EventLoop_UnregisterIo(connection->serverState->eventLoop, connection->clientEventReg);
+    connection->clientEventReg = NULL;
+    CloseFdAndPrintError(connection->clientFd, "clientFd");
+    connection->clientFd = -1;
 }
 
 static int OpenIpV4Socket(in_addr_t ipAddr, uint16_t port, int sockType, ExitCode *callerExitCode)
@@ -359,9 +497,8 @@ static void ReportError(const char *desc)
 
 static void StopServer(EchoServer_ServerState *serverState, EchoServer_StopReason reason)
 {
-    if (serverState->clientEventReg != NULL) {
-        EventLoop_ModifyIoEvents(serverState->eventLoop, serverState->clientEventReg,
-                                 EventLoop_None);
+    for (size_t i = 0; i < ECHO_SERVER_MAX_CLIENTS; ++i) {
+        CloseConnection(&serverState->connections[i]);
     }
 
     if (serverState->listenEventReg != NULL) {
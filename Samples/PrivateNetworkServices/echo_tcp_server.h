@@ -8,53 +8,83 @@
 #include "eventloop_timer_utilities.h"
 #include "exitcode_privnetserv.h"
 
+/// <summary>Maximum number of clients which can be connected at the same time.</summary>
+#define ECHO_SERVER_MAX_CLIENTS 4
+/// <summary>Maximum number of characters in a line, excluding the NUL terminator.</summary>
+#define ECHO_SERVER_MAX_LINE_LENGTH 15
+/// <summary>Size of each connection's receive ring buffer in bytes.</summary>
+#define ECHO_SERVER_RX_RING_SIZE 256
+/// <summary>Size of each connection's transmit buffer in bytes.</summary>
+#define ECHO_SERVER_TX_BUFFER_SIZE 512
+
 /// <summary>Reason why the TCP server stopped.</summary>
 typedef enum {
-    /// <summary>The echo server stopped because the client closed the connection.</summary>
-    EchoServer_StopReason_ClientClosed,
     /// <summary>The echo server stopped because an error occurred.</summary>
     EchoServer_StopReason_Error
 } EchoServer_StopReason;
 
+typedef struct EchoServer_ServerState EchoServer_ServerState;
+
 /// <summary>
-/// Bundles together state about an active echo server.
-/// This should be allocated with <see cref="EchoServer_Start" /> and freed with
-/// <see cref="EchoServer_ShutDown" />. The client should not directly modify member variables.
+/// State of one client connection. All of the buffers are allocated with the server, so
+/// handling a connection does not allocate any heap memory.
 /// </summary>
 typedef struct {
-    /// <summary>Used to respond asynchronously to incoming connections.</summary>
-    EventLoop *eventLoop;
-    /// <summary>Socket which listens for incoming connections.</summary>
-    int listenFd;
-    /// <summary>Invoked when a new connection is received.</summary>
-    EventRegistration *listenEventReg;
-    /// <summary>Accept socket. Only one client socket is supported at a time.</summary>
+    /// <summary>Server which accepted this connection.</summary>
+    EchoServer_ServerState *serverState;
+    /// <summary>Accept socket, or -1 if this connection is not in use.</summary>
     int clientFd;
     /// <summary>
     ///     Invoked when server receives data from or sends data to the client.
     /// </summary>
     EventRegistration *clientEventReg;
-    /// <summary>Number of characters received from client.</summary>
+    /// <summary>Events which are currently enabled for clientEventReg.</summary>
+    EventLoop_IoEvents clientEvents;
+    /// <summary>Data received from client which has not been processed yet.</summary>
+    uint8_t rxRing[ECHO_SERVER_RX_RING_SIZE];
+    /// <summary>Index of the first unprocessed byte in rxRing.</summary>
+    size_t rxReadIndex;
+    /// <summary>Number of unprocessed bytes in rxRing.</summary>
+    size_t rxCount;
+    /// <summary>Number of characters in the current line.</summary>
     size_t inLineSize;
-    /// <summary>Data received from client.</summary>
-    char input[16];
-    /// <summary>Payload to write to client.</summary>
-    uint8_t *txPayload;
-    /// <summary>Number of bytes to write to client.</summary>
+    /// <summary>Current line received from client.</summary>
+    char input[ECHO_SERVER_MAX_LINE_LENGTH + 1];
+    /// <summary>Responses to write to client.</summary>
+    char txPayload[ECHO_SERVER_TX_BUFFER_SIZE];
+    /// <summary>Number of bytes in txPayload.</summary>
     size_t txPayloadSize;
-    /// <summary>Number of characters from paylod which have been written to client so
+    /// <summary>Number of bytes from txPayload which have been written to client so
     /// far.</summary>
     size_t txBytesSent;
+} EchoServer_Connection;
+
+/// <summary>
+/// Bundles together state about an active echo server.
+/// This should be allocated with <see cref="EchoServer_Start" /> and freed with
+/// <see cref="EchoServer_ShutDown" />. The client should not directly modify member variables.
+/// </summary>
+struct EchoServer_ServerState {
+    /// <summary>Used to respond asynchronously to incoming connections.</summary>
+    EventLoop *eventLoop;
+    /// <summary>Socket which listens for incoming connections.</summary>
+    int listenFd;
+    /// <summary>Invoked when a new connection is received.</summary>
+    EventRegistration *listenEventReg;
+    /// <summary>Client connections. Up to ECHO_SERVER_MAX_CLIENTS are supported at a
+    /// time.</summary>
+    EchoServer_Connection connections[ECHO_SERVER_MAX_CLIENTS];
     /// <summary>
     ///     <para>Callback to invoke when the server stops processing connections.</para>
     ///     <para>
     ///         When this callback is invoked, the owner should clean up the server with
-    ///         <see cref="EchoServer_ShutDown" />.
+    ///         <see cref="EchoServer_ShutDown" />. A client closing its connection does not
+    ///         stop the server.
     ///     </para>
     ///     <param name="reason">Why the server stopped.</param>
     /// </summary>
     void (*shutdownCallback)(EchoServer_StopReason reason);
-} EchoServer_ServerState;
+};
 
 /// <summary>
 ///     <para>Open a non-blocking TCP listening socket on the supplied IP address and port.</para>
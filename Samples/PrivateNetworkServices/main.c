@@ -86,10 +86,6 @@ static void ServerStoppedHandler(EchoServer_StopReason reason)
 {
     const char *reasonText;
     switch (reason) {
-    case EchoServer_StopReason_ClientClosed:
-        reasonText = "client closed the connection.";
-        break;
-
     case EchoServer_StopReason_Error:
         reasonText = "an error occurred. See previous log output for more information.";
         break;
@@ -0,0 +1,20 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/gpio.h when the sample is built on a PC. The test program
+// defines these functions to simulate the inputs.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int GPIO_Id;
+
+typedef uint8_t GPIO_Value_Type;
+enum {
+    GPIO_Value_Low = 0,
+    GPIO_Value_High = 1
+};
+
+int GPIO_OpenAsInput(GPIO_Id gpioId);
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue);
@@ -0,0 +1,211 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for input_service.c, which runs on a Linux PC with the timer wheel in
+// eventloop_timer_utilities.c and the epoll event loop in eventloop_epoll.c. The AzureIoT samples
+// have an identical copy of input_service.c, so this test stands for both.
+//
+// GPIO_GetValue is simulated from the time since the test started. Button A is pressed briefly,
+// glitches for less than the debounce time, and is then held for a long press; its contacts
+// bounce for 8 ms at each edge. Button B, which reads high while pressed, is never pressed. The
+// test runs the event loop for 5 seconds, as the samples do, and checks that:
+//   - each press, release and long press is reported once, and the glitch is not reported;
+//   - each event is reported soon enough after the edge which caused it;
+//   - no event is reported for button B.
+// It reports the event loop wakeups and GPIO reads. The 1 ms button timer which the samples used
+// before would have woken 5000 times.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+#include <applibs/log.h>
+
+#include "input_service.h"
+
+#define BUTTON_A 12
+#define BUTTON_B 13
+#define RUN_MS 5000
+#define BOUNCE_MS 8
+// Edges are read within an idle poll, and debounced with reads at the active rate.
+#define MAX_EVENT_DELAY_MS \
+    (INPUT_SERVICE_IDLE_POLL_MS + INPUT_SERVICE_DEBOUNCE_MS + 2 * INPUT_SERVICE_ACTIVE_POLL_MS + 20)
+
+typedef struct {
+    int64_t startMs;
+    int64_t endMs;
+} PressInterval;
+
+typedef struct {
+    InputService_Event event;
+    // Time of the edge which causes the event.
+    int64_t edgeMs;
+    int64_t reportedMs;
+} ExpectedEvent;
+
+// Button A is pressed at these times. The glitch is shorter than the debounce time.
+static const PressInterval presses[] = {{1000, 1300}, {1600, 1610}, {2000, 3500}};
+
+static ExpectedEvent expectedEvents[] = {
+    {InputService_Event_Pressed, 1000},
+    {InputService_Event_Released, 1300},
+    {InputService_Event_Pressed, 2000},
+    {InputService_Event_LongPress, 2000 + INPUT_SERVICE_LONG_PRESS_MS},
+    {InputService_Event_Released, 3500}};
+
+static const size_t expectedEventCount = sizeof(expectedEvents) / sizeof(expectedEvents[0]);
+
+static int64_t startMs = 0;
+static int buttonAFd = -1;
+static int buttonBFd = -1;
+static size_t eventCount = 0;
+static unsigned long gpioReads = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = vprintf(fmt, args);
+    va_end(args);
+    return result;
+}
+
+static int64_t GetElapsedMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 - startMs;
+}
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+    // Any file descriptor will do, as the service only passes it to GPIO_GetValue and close.
+    int fd = dup(STDIN_FILENO);
+    if (gpioId == BUTTON_A) {
+        buttonAFd = fd;
+    } else if (gpioId == BUTTON_B) {
+        buttonBFd = fd;
+    }
+    return fd;
+}
+
+// Button A reads low while pressed, and toggles every third of a millisecond while it bounces.
+static bool IsButtonAPressed(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsedMs = GetElapsedMs();
+
+    for (size_t i = 0; i < sizeof(presses) / sizeof(presses[0]); ++i) {
+        if ((elapsedMs >= presses[i].startMs && elapsedMs < presses[i].startMs + BOUNCE_MS) ||
+            (elapsedMs >= presses[i].endMs && elapsedMs < presses[i].endMs + BOUNCE_MS)) {
+            return (now.tv_nsec / 333333) % 2 == 0;
+        }
+        if (elapsedMs >= presses[i].startMs && elapsedMs < presses[i].endMs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue)
+{
+    ++gpioReads;
+    if (gpioFd == buttonAFd) {
+        *outValue = IsButtonAPressed() ? GPIO_Value_Low : GPIO_Value_High;
+    } else {
+        *outValue = GPIO_Value_Low;
+    }
+    return 0;
+}
+
+static void ButtonAHandler(InputService_Event event, void *context)
+{
+    if (eventCount == expectedEventCount || expectedEvents[eventCount].event != event) {
+        Fail("ButtonAHandler", "unexpected event", (long)eventCount);
+        return;
+    }
+    expectedEvents[eventCount].reportedMs = GetElapsedMs();
+    ++eventCount;
+}
+
+static void ButtonBHandler(InputService_Event event, void *context)
+{
+    Fail("ButtonBHandler", "button B was never pressed", event);
+}
+
+static void FailureHandler(void)
+{
+    Fail("FailureHandler", "inputs could not be read", 0);
+}
+
+int main(void)
+{
+    EventLoop *eventLoop = EventLoop_Create();
+    if (eventLoop == NULL || InputService_Init(eventLoop, FailureHandler) != 0 ||
+        InputService_AddInput(BUTTON_A, GPIO_Value_Low, ButtonAHandler, NULL) != 0 ||
+        InputService_AddInput(BUTTON_B, GPIO_Value_High, ButtonBHandler, NULL) != 0) {
+        printf("ERROR: Could not initialize the input service.\n");
+        return EXIT_FAILURE;
+    }
+
+    startMs = GetElapsedMs();
+    unsigned long wakeups = 0;
+    while (GetElapsedMs() < RUN_MS) {
+        if (EventLoop_Run(eventLoop, 100, true) == EventLoop_Run_Finished) {
+            ++wakeups;
+        }
+    }
+
+    printf("%-12s %8s %12s %10s\n", "event", "edge ms", "reported ms", "delay ms");
+    static const char *eventNames[] = {"pressed", "released", "long press"};
+    for (size_t i = 0; i < eventCount; ++i) {
+        const ExpectedEvent *expected = &expectedEvents[i];
+        int64_t delay = expected->reportedMs - expected->edgeMs;
+        printf("%-12s %8lld %12lld %10lld\n", eventNames[expected->event],
+               (long long)expected->edgeMs, (long long)expected->reportedMs, (long long)delay);
+        if (delay < INPUT_SERVICE_DEBOUNCE_MS && expected->event != InputService_Event_LongPress) {
+            Fail("main", "event was not debounced", (long)i);
+        }
+        if (delay < 0 || delay > MAX_EVENT_DELAY_MS) {
+            Fail("main", "event was reported late", (long)i);
+        }
+    }
+    printf("%d ms with %zu events: %lu wakeups, %lu GPIO reads\n", RUN_MS, eventCount, wakeups,
+           gpioReads);
+
+    if (eventCount != expectedEventCount) {
+        Fail("main", "wrong number of events", (long)eventCount);
+    }
+    if (wakeups > RUN_MS / INPUT_SERVICE_IDLE_POLL_MS * 2) {
+        Fail("main", "too many wakeups", (long)wakeups);
+    }
+
+    InputService_Cleanup();
+    EventLoop_Close(eventLoop);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
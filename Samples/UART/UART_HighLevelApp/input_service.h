@@ -0,0 +1,83 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+
+// The input service owns the GPIO inputs of an application, such as its buttons, and reads all
+// of them from a single timer. Each input is debounced: a change is only reported once the input
+// has held its new value for INPUT_SERVICE_DEBOUNCE_MS.
+//
+// While every input is steady, the inputs are read every INPUT_SERVICE_IDLE_POLL_MS. As soon as
+// an input changes, they are read every INPUT_SERVICE_ACTIVE_POLL_MS until the change has been
+// debounced, and then the service returns to the idle rate.
+
+/// <summary>Maximum number of inputs which the service can own.</summary>
+#define INPUT_SERVICE_MAX_INPUTS 4
+
+/// <summary>Interval at which the inputs are read while they are steady.</summary>
+#define INPUT_SERVICE_IDLE_POLL_MS 50
+
+/// <summary>Interval at which the inputs are read while an input is changing.</summary>
+#define INPUT_SERVICE_ACTIVE_POLL_MS 5
+
+/// <summary>Time for which an input must hold a new value before the change is reported.</summary>
+#define INPUT_SERVICE_DEBOUNCE_MS 20
+
+/// <summary>Time for which an input must be held before a long press is reported.</summary>
+#define INPUT_SERVICE_LONG_PRESS_MS 1000
+
+/// <summary>Event which the input service reports for an input.</summary>
+typedef enum {
+    /// <summary>The input has been pressed.</summary>
+    InputService_Event_Pressed,
+    /// <summary>The input has been released.</summary>
+    InputService_Event_Released,
+    /// <summary>
+    /// The input has been held for INPUT_SERVICE_LONG_PRESS_MS. This is reported once per press,
+    /// between the press and the release.
+    /// </summary>
+    InputService_Event_LongPress
+} InputService_Event;
+
+/// <summary>
+/// Callback which is invoked when an event happens on an input.
+/// </summary>
+/// <param name="event">The event.</param>
+/// <param name="context">
+/// The context which was passed to <see cref="InputService_AddInput" />.
+/// </param>
+typedef void (*InputService_EventHandler)(InputService_Event event, void *context);
+
+/// <summary>
+/// Callback which is invoked when the inputs cannot be read. The error has been logged.
+/// </summary>
+typedef void (*InputService_FailureHandler)(void);
+
+/// <summary>
+/// Initialize the input service. Inputs are added with <see cref="InputService_AddInput" />.
+/// </summary>
+/// <param name="el">Event loop on which the inputs are read and events are reported.</param>
+/// <param name="failureHandler">Function called when the inputs cannot be read.</param>
+/// <returns>0 on success; -1 on failure.</returns>
+int InputService_Init(EventLoop *el, InputService_FailureHandler failureHandler);
+
+/// <summary>
+/// Open a GPIO as an input, and report its events.
+/// </summary>
+/// <param name="gpioId">The GPIO to open.</param>
+/// <param name="pressedValue">The value of the GPIO while the input is pressed.</param>
+/// <param name="handler">Function called when an event happens on the input.</param>
+/// <param name="context">Passed to the handler.</param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more information.</returns>
+int InputService_AddInput(GPIO_Id gpioId, GPIO_Value_Type pressedValue,
+                          InputService_EventHandler handler, void *context);
+
+/// <summary>
+/// Stop reading the inputs, and close them.
+/// </summary>
+void InputService_Cleanup(void);
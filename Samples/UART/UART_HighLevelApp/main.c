@@ -11,6 +11,9 @@
 // - GPIO (digital input for button)
 // - log (displays messages in the Device Output window during debugging)
 // - eventloop (system invokes handlers for timer events)
+//
+// The button is read by the input service, which debounces it and reads it at a low rate until
+// it starts to change.
 
 #include <errno.h>
 #include <signal.h>
@@ -41,6 +44,7 @@
 #include <hw/sample_appliance.h>
 
 #include "eventloop_timer_utilities.h"
+#include "input_service.h"
 
 /// <summary>
 /// Exit codes for this application. These are used for the
@@ -64,21 +68,17 @@ typedef enum {
 
 // File descriptors - initialized to invalid value
 static int uartFd = -1;
-static int gpioButtonFd = -1;
 
 EventLoop *eventLoop = NULL;
 EventRegistration *uartEventReg = NULL;
-EventLoopTimer *buttonPollTimer = NULL;
-
-// State variables
-static GPIO_Value_Type buttonState = GPIO_Value_High;
 
 // Termination state
 static volatile sig_atomic_t exitCode = ExitCode_Success;
 
 static void TerminationHandler(int signalNumber);
 static void SendUartMessage(int uartFd, const char *dataToSend);
-static void ButtonTimerEventHandler(EventLoopTimer *timer);
+static void ButtonEventHandler(InputService_Event event, void *context);
+static void InputFailureHandler(void);
 static void UartEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
 static ExitCode InitPeripheralsAndHandlers(void);
 static void CloseFdAndPrintError(int fd, const char *fdName);
@@ -123,32 +123,21 @@ static void SendUartMessage(int uartFd, const char *dataToSend)
 }
 
 /// <summary>
-///     Handle button timer event: if the button is pressed, send data over the UART.
+///     Handle button event: if the button has been pressed, send data over the UART.
 /// </summary>
-static void ButtonTimerEventHandler(EventLoopTimer *timer)
+static void ButtonEventHandler(InputService_Event event, void *context)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
-        return;
-    }
-
-    // Check for a button press
-    GPIO_Value_Type newButtonState;
-    int result = GPIO_GetValue(gpioButtonFd, &newButtonState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        exitCode = ExitCode_ButtonTimer_GetValue;
-        return;
+    if (event == InputService_Event_Pressed) {
+        SendUartMessage(uartFd, "Hello world!\n");
     }
+}
 
-    // If the button has just been pressed, send data over the UART
-    // The button has GPIO_Value_Low when pressed and GPIO_Value_High when released
-    if (newButtonState != buttonState) {
-        if (newButtonState == GPIO_Value_Low) {
-            SendUartMessage(uartFd, "Hello world!\n");
-        }
-        buttonState = newButtonState;
-    }
+/// <summary>
+///     Handle a failure to read the button.
+/// </summary>
+static void InputFailureHandler(void)
+{
+    exitCode = ExitCode_ButtonTimer_GetValue;
 }
 
 /// <summary>
@@ -212,19 +201,15 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_RegisterIo;
     }
 
-    // Open SAMPLE_BUTTON_1 GPIO as input, and set up a timer to poll it
+    // Start the input service, and open SAMPLE_BUTTON_1 GPIO as an input to it.
+    // The button has GPIO_Value_Low when pressed and GPIO_Value_High when released.
+    if (InputService_Init(eventLoop, InputFailureHandler) != 0) {
+        return ExitCode_Init_ButtonPollTimer;
+    }
     Log_Debug("Opening SAMPLE_BUTTON_1 as input.\n");
-    gpioButtonFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
-    if (gpioButtonFd == -1) {
-        Log_Debug("ERROR: Could not open button GPIO: %s (%d).\n", strerror(errno), errno);
+    if (InputService_AddInput(SAMPLE_BUTTON_1, GPIO_Value_Low, ButtonEventHandler, NULL) != 0) {
         return ExitCode_Init_OpenButton;
     }
-    struct timespec buttonPressCheckPeriod1Ms = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, ButtonTimerEventHandler,
-                                                   &buttonPressCheckPeriod1Ms);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
-    }
 
     return ExitCode_Success;
 }
@@ -249,12 +234,11 @@ static void CloseFdAndPrintError(int fd, const char *fdName)
 /// </summary>
 static void ClosePeripheralsAndHandlers(void)
 {
-    DisposeEventLoopTimer(buttonPollTimer);
+    InputService_Cleanup();
     EventLoop_UnregisterIo(eventLoop, uartEventReg);
     EventLoop_Close(eventLoop);
 
     Log_Debug("Closing file descriptors.\n");
-    CloseFdAndPrintError(gpioButtonFd, "GpioButton");
     CloseFdAndPrintError(uartFd, "Uart");
 }
 
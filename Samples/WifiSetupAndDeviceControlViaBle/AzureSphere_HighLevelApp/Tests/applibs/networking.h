@@ -0,0 +1,20 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/networking.h when the sample is built on a PC. The test
+// program defines Networking_GetInterfaceConnectionStatus.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t Networking_InterfaceConnectionStatus;
+enum {
+    Networking_InterfaceConnectionStatus_InterfaceUp = 1 << 0,
+    Networking_InterfaceConnectionStatus_ConnectedToNetwork = 1 << 1,
+    Networking_InterfaceConnectionStatus_IpAvailable = 1 << 2,
+    Networking_InterfaceConnectionStatus_ConnectedToInternet = 1 << 3
+};
+
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus);
@@ -0,0 +1,8 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/uart.h when the sample is built on a PC. The message
+// protocol only reads and writes the UART file descriptor, so the test passes it one end of a
+// socket pair, and nothing from this header is needed.
+
+#pragma once
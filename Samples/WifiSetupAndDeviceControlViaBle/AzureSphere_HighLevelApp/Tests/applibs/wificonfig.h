@@ -0,0 +1,46 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Stand-in for the Azure Sphere applibs/wificonfig.h when the sample is built on a PC. The test
+// program defines these functions to simulate the scan and the stored networks.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WIFICONFIG_SSID_MAX_LENGTH 32
+#define WIFICONFIG_BSSID_BUFFER_SIZE 6
+
+typedef uint8_t WifiConfig_Security_Type;
+enum {
+    WifiConfig_Security_Unknown = 0,
+    WifiConfig_Security_Open = 1,
+    WifiConfig_Security_Wpa2_Psk = 2
+};
+
+typedef struct {
+    uint8_t ssid[WIFICONFIG_SSID_MAX_LENGTH];
+    uint8_t bssid[WIFICONFIG_BSSID_BUFFER_SIZE];
+    uint8_t ssidLength;
+    WifiConfig_Security_Type security;
+    int8_t signalRssi;
+    uint32_t frequencyMHz;
+} WifiConfig_ScannedNetwork;
+
+typedef WifiConfig_ScannedNetwork WifiConfig_ConnectedNetwork;
+
+int WifiConfig_AddNetwork(void);
+int WifiConfig_SetSSID(int networkId, const uint8_t *ssid, size_t ssidLength);
+int WifiConfig_SetSecurityType(int networkId, WifiConfig_Security_Type securityType);
+int WifiConfig_SetPSK(int networkId, const char *psk, size_t pskLength);
+int WifiConfig_SetTargetedScanEnabled(int networkId, bool enabled);
+int WifiConfig_SetNetworkEnabled(int networkId, bool enabled);
+int WifiConfig_PersistConfig(void);
+int WifiConfig_ForgetNetworkById(int networkId);
+int WifiConfig_GetCurrentNetwork(WifiConfig_ConnectedNetwork *connectedNetwork);
+ssize_t WifiConfig_TriggerScanAndGetScannedNetworkCount(void);
+ssize_t WifiConfig_GetScannedNetworks(WifiConfig_ScannedNetwork *scannedNetworkArray,
+                                      size_t scannedNetworkArrayCount);
@@ -0,0 +1,455 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Test for the Wi-Fi scan results in wificonfig_message_protocol.c, which runs on a Linux PC with
+// message_protocol.c and epoll_timerfd_utilities.c. One end of a socket pair stands in for the
+// UART, and a simulated nRF52 peer on the other end sends the "Wi-Fi Scan Needed" event, answers
+// each request with a success response and records the scan results which it receives.
+//
+// WifiConfig_GetScannedNetworks returns a simulated scan. The test checks that:
+//   - a scan with 20 access points, each also found on a second channel with a different signal,
+//     is sent as 20 results with the strongest signal of each;
+//   - a scan with more than 20 access points is cut to the first 20, and a later network for one
+//     of them still raises its signal;
+//   - a scan which finds no networks sends only the summary;
+//   - every request fits in a BLE GATT MTU.
+// It reports the round trips which each scan takes: one for the summary, and one for each
+// request which carries results. Sending one result per request took 21 round trips for 20
+// access points.
+//
+// Build and run with CMake from this directory:
+//
+//     cmake -S . -B build && cmake --build build && ctest --test-dir build
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <applibs/log.h>
+#include <applibs/networking.h>
+#include <applibs/wificonfig.h>
+
+#include "epoll_timerfd_utilities.h"
+#include "message_protocol.h"
+#include "message_protocol_private.h"
+#include "wificonfig_message_protocol.h"
+#include "wificonfig_message_protocol_defs.h"
+
+#define MAX_AP_COUNT 20
+#define MAX_SCANNED_NETWORKS 64
+// The max MTU size of BLE GATT, which the nRF52 forwards requests through.
+#define MAX_MESSAGE_SIZE 247
+#define PEER_BUFFER_SIZE 1024
+
+typedef struct {
+    // Requests which the peer has answered; each is one round trip.
+    unsigned requests;
+    bool summaryReceived;
+    uint8_t totalNetworkCount;
+    size_t resultCount;
+    WifiConfigureMessageProtocol_WifiScanResultRequestStruct results[MAX_AP_COUNT];
+} PeerScan;
+
+static int epollFd = -1;
+static int peerFd = -1;
+static uint8_t peerBuffer[PEER_BUFFER_SIZE];
+static size_t peerBufferLength = 0;
+static PeerScan peerScan;
+static bool deadlinePassed = false;
+
+static WifiConfig_ScannedNetwork scannedNetworks[MAX_SCANNED_NETWORKS];
+static size_t scannedNetworkCount = 0;
+
+static int failures = 0;
+
+static void Fail(const char *test, const char *message, long detail)
+{
+    printf("FAIL: %s: %s (%ld)\n", test, message, detail);
+    ++failures;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+ssize_t WifiConfig_TriggerScanAndGetScannedNetworkCount(void)
+{
+    return (ssize_t)scannedNetworkCount;
+}
+
+ssize_t WifiConfig_GetScannedNetworks(WifiConfig_ScannedNetwork *scannedNetworkArray,
+                                      size_t scannedNetworkArrayCount)
+{
+    size_t count = (scannedNetworkArrayCount < scannedNetworkCount) ? scannedNetworkArrayCount
+                                                                    : scannedNetworkCount;
+    memcpy(scannedNetworkArray, scannedNetworks, count * sizeof(scannedNetworks[0]));
+    return (ssize_t)count;
+}
+
+// The test does not store networks or connect to one.
+int WifiConfig_AddNetwork(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_SetSSID(int networkId, const uint8_t *ssid, size_t ssidLength)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_SetSecurityType(int networkId, WifiConfig_Security_Type securityType)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_SetPSK(int networkId, const char *psk, size_t pskLength)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_SetTargetedScanEnabled(int networkId, bool enabled)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_SetNetworkEnabled(int networkId, bool enabled)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_PersistConfig(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_ForgetNetworkById(int networkId)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int WifiConfig_GetCurrentNetwork(WifiConfig_ConnectedNetwork *connectedNetwork)
+{
+    errno = ENOTCONN;
+    return -1;
+}
+
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static void AddScannedNetwork(const char *ssid, WifiConfig_Security_Type security, int8_t rssi)
+{
+    WifiConfig_ScannedNetwork *network = &scannedNetworks[scannedNetworkCount++];
+    memset(network, 0, sizeof(*network));
+    network->ssidLength = (uint8_t)strlen(ssid);
+    memcpy(network->ssid, ssid, network->ssidLength);
+    network->security = security;
+    network->signalRssi = rssi;
+}
+
+static void PeerWrite(const void *message, size_t length)
+{
+    if (write(peerFd, message, length) != (ssize_t)length) {
+        Fail("PeerWrite", "could not write to the UART", errno);
+    }
+}
+
+static void PeerSendEvent(MessageProtocol_EventId eventId)
+{
+    MessageProtocol_EventMessage event;
+    memset(&event, 0, sizeof(event));
+    memcpy(event.messageHeaderWithType.messageHeader.preamble, MessageProtocol_MessagePreamble,
+           sizeof(MessageProtocol_MessagePreamble));
+    event.messageHeaderWithType.messageHeader.length =
+        sizeof(event) - sizeof(MessageProtocol_MessageHeader);
+    event.messageHeaderWithType.type = MessageProtocol_EventMessageType;
+    event.eventInfo.categoryId = MessageProtocol_WifiConfigCategoryId;
+    event.eventInfo.eventId = eventId;
+    PeerWrite(&event, sizeof(event));
+}
+
+static void PeerStoreResult(size_t index,
+                            const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *result)
+{
+    if (index != peerScan.resultCount || index >= MAX_AP_COUNT) {
+        Fail("PeerStoreResult", "result out of order", (long)index);
+        return;
+    }
+    peerScan.results[peerScan.resultCount++] = *result;
+}
+
+// Records the scan results in a request, as the companion app does.
+static void PeerHandleRequest(const MessageProtocol_RequestMessage *request, size_t dataSize)
+{
+    ++peerScan.requests;
+    if (request->requestHeader.categoryId != MessageProtocol_WifiConfigCategoryId) {
+        Fail("PeerHandleRequest", "unexpected category", request->requestHeader.categoryId);
+        return;
+    }
+
+    MessageProtocol_RequestId requestId = request->requestHeader.requestId;
+    if (requestId == WifiConfigureMessageProtocol_SetWifiScanResultsSummaryRequestId) {
+        const WifiConfigureMessageProtocol_WifiScanResultsSummaryRequestStruct *summary =
+            (const void *)request->data;
+        peerScan.summaryReceived = true;
+        peerScan.totalNetworkCount = summary->totalNetworkCount;
+    } else if (requestId == WifiConfigureMessageProtocol_SetWifiScanResultsBatchRequestId) {
+        const WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct *batch =
+            (const void *)request->data;
+        size_t expectedSize =
+            offsetof(WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct, networks) +
+            batch->networkCount * sizeof(batch->networks[0]);
+        if (batch->networkCount == 0 ||
+            batch->networkCount > WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH ||
+            dataSize != expectedSize) {
+            Fail("PeerHandleRequest", "malformed batch", (long)dataSize);
+            return;
+        }
+        for (size_t i = 0; i < batch->networkCount; ++i) {
+            PeerStoreResult(batch->firstIndex + i, &batch->networks[i]);
+        }
+    } else if (requestId == WifiConfigureMessageProtocol_SetNextWiFiScanResultRequestId) {
+        PeerStoreResult(peerScan.resultCount, (const void *)request->data);
+    } else {
+        Fail("PeerHandleRequest", "unexpected request", requestId);
+    }
+}
+
+static void PeerRespond(const MessageProtocol_RequestMessage *request)
+{
+    MessageProtocol_ResponseHeader response;
+    memset(&response, 0, sizeof(response));
+    memcpy(response.messageHeaderWithType.messageHeader.preamble, MessageProtocol_MessagePreamble,
+           sizeof(MessageProtocol_MessagePreamble));
+    response.messageHeaderWithType.messageHeader.length =
+        sizeof(response) - sizeof(MessageProtocol_MessageHeader);
+    response.messageHeaderWithType.type = MessageProtocol_ResponseMessageType;
+    response.categoryId = request->requestHeader.categoryId;
+    response.requestId = request->requestHeader.requestId;
+    response.sequenceNumber = request->requestHeader.sequenceNumber;
+    PeerWrite(&response, sizeof(response));
+}
+
+// Reads the requests which the application has sent, and answers each complete one.
+static void PeerProcessRequests(void)
+{
+    ssize_t bytesRead;
+    while ((bytesRead = read(peerFd, peerBuffer + peerBufferLength,
+                             sizeof(peerBuffer) - peerBufferLength)) > 0) {
+        peerBufferLength += (size_t)bytesRead;
+    }
+
+    while (peerBufferLength >= sizeof(MessageProtocol_RequestHeader)) {
+        static MessageProtocol_RequestMessage request;
+        memcpy(&request, peerBuffer, sizeof(MessageProtocol_RequestHeader));
+        size_t messageSize = request.requestHeader.messageHeaderWithType.messageHeader.length +
+                             sizeof(MessageProtocol_MessageHeader);
+        if (memcmp(peerBuffer, MessageProtocol_MessagePreamble,
+                   sizeof(MessageProtocol_MessagePreamble)) != 0 ||
+            request.requestHeader.messageHeaderWithType.type !=
+                MessageProtocol_RequestMessageType ||
+            messageSize > MAX_MESSAGE_SIZE) {
+            Fail("PeerProcessRequests", "malformed request", (long)messageSize);
+            peerBufferLength = 0;
+            return;
+        }
+        if (peerBufferLength < messageSize) {
+            return;
+        }
+
+        memcpy(&request, peerBuffer, messageSize);
+        peerBufferLength -= messageSize;
+        memmove(peerBuffer, peerBuffer + messageSize, peerBufferLength);
+        PeerHandleRequest(&request, messageSize - sizeof(MessageProtocol_RequestHeader));
+        PeerRespond(&request);
+    }
+}
+
+static void DeadlineHandler(EventData *eventData)
+{
+    ConsumeTimerFdEvent(eventData->fd);
+    deadlinePassed = true;
+}
+
+static EventData deadlineEventData = {.eventHandler = &DeadlineHandler};
+
+// Asks for a scan, and runs the application and the peer until the peer has every result.
+// Returns the round trips which the scan took.
+static unsigned RunScan(const char *test)
+{
+    memset(&peerScan, 0, sizeof(peerScan));
+    deadlinePassed = false;
+    const struct timespec deadline = {2, 0};
+    SetTimerFdToSingleExpiry(deadlineEventData.fd, &deadline);
+
+    PeerSendEvent(WifiConfigureMessageProtocol_WifiScanNeededEventId);
+    while (!deadlinePassed && !(peerScan.summaryReceived &&
+                                peerScan.resultCount == peerScan.totalNetworkCount &&
+                                MessageProtocol_IsIdle())) {
+        if (WaitForEventAndCallHandler(epollFd) != 0) {
+            Fail(test, "could not wait for events", errno);
+            break;
+        }
+        PeerProcessRequests();
+    }
+
+    if (deadlinePassed) {
+        Fail(test, "scan did not complete", (long)peerScan.resultCount);
+    }
+    printf("%-40s %8zu %8u %12u\n", test, scannedNetworkCount, peerScan.totalNetworkCount,
+           peerScan.requests);
+    return peerScan.requests;
+}
+
+static const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *FindResult(
+    const char *ssid, WifiConfig_Security_Type security)
+{
+    for (size_t i = 0; i < peerScan.resultCount; ++i) {
+        const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *result =
+            &peerScan.results[i];
+        if (result->ssidLength == strlen(ssid) && memcmp(result->ssid, ssid, strlen(ssid)) == 0 &&
+            result->securityType == security) {
+            return result;
+        }
+    }
+    return NULL;
+}
+
+// Each access point is found twice, with its stronger signal first for half of them. One SSID is
+// used with both security types, which are separate access points.
+static void TestDuplicateNetworks(void)
+{
+    static const char *test = "TestDuplicateNetworks";
+    char ssid[WIFICONFIG_SSID_MAX_LENGTH];
+    scannedNetworkCount = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < MAX_AP_COUNT; ++i) {
+            snprintf(ssid, sizeof(ssid), "network-%02d", i % (MAX_AP_COUNT - 1));
+            WifiConfig_Security_Type security =
+                (i == MAX_AP_COUNT - 1) ? WifiConfig_Security_Open : WifiConfig_Security_Wpa2_Psk;
+            int8_t rssi = (int8_t)(-40 - i - ((i % 2 == pass) ? 0 : 20));
+            AddScannedNetwork(ssid, security, rssi);
+        }
+    }
+
+    unsigned roundTrips = RunScan(test);
+    if (peerScan.totalNetworkCount != MAX_AP_COUNT || peerScan.resultCount != MAX_AP_COUNT) {
+        Fail(test, "wrong number of access points", (long)peerScan.resultCount);
+    }
+    for (int i = 0; i < MAX_AP_COUNT; ++i) {
+        snprintf(ssid, sizeof(ssid), "network-%02d", i % (MAX_AP_COUNT - 1));
+        WifiConfig_Security_Type security =
+            (i == MAX_AP_COUNT - 1) ? WifiConfig_Security_Open : WifiConfig_Security_Wpa2_Psk;
+        const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *result =
+            FindResult(ssid, security);
+        if (result == NULL || result->signalRssi != -40 - i) {
+            Fail(test, "access point missing or not at its strongest signal", i);
+        }
+    }
+    unsigned maxRoundTrips =
+        1 + (MAX_AP_COUNT + WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH - 1) /
+                WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH;
+    if (roundTrips > maxRoundTrips) {
+        Fail(test, "too many round trips", (long)roundTrips);
+    }
+}
+
+// Only the first access points found are sent, but networks for them are still collapsed.
+static void TestTooManyNetworks(void)
+{
+    static const char *test = "TestTooManyNetworks";
+    const int accessPointCount = MAX_AP_COUNT + 5;
+    char ssid[WIFICONFIG_SSID_MAX_LENGTH];
+    scannedNetworkCount = 0;
+    for (int i = 0; i < accessPointCount; ++i) {
+        snprintf(ssid, sizeof(ssid), "network-%02d", i);
+        AddScannedNetwork(ssid, WifiConfig_Security_Wpa2_Psk, -80);
+    }
+    AddScannedNetwork("network-00", WifiConfig_Security_Wpa2_Psk, -30);
+
+    RunScan(test);
+    if (peerScan.totalNetworkCount != MAX_AP_COUNT || peerScan.resultCount != MAX_AP_COUNT) {
+        Fail(test, "wrong number of access points", (long)peerScan.resultCount);
+    }
+    for (int i = 0; i < accessPointCount; ++i) {
+        snprintf(ssid, sizeof(ssid), "network-%02d", i);
+        bool found = (FindResult(ssid, WifiConfig_Security_Wpa2_Psk) != NULL);
+        if (found != (i < MAX_AP_COUNT)) {
+            Fail(test, "wrong access points sent", i);
+        }
+    }
+    const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *first =
+        FindResult("network-00", WifiConfig_Security_Wpa2_Psk);
+    if (first == NULL || first->signalRssi != -30) {
+        Fail(test, "later network was not collapsed", 0);
+    }
+}
+
+static void TestNoNetworks(void)
+{
+    static const char *test = "TestNoNetworks";
+    scannedNetworkCount = 0;
+    unsigned roundTrips = RunScan(test);
+    if (roundTrips != 1 || peerScan.totalNetworkCount != 0) {
+        Fail(test, "only the summary should be sent", (long)roundTrips);
+    }
+}
+
+int main(void)
+{
+    int fds[2];
+    epollFd = CreateEpollFd();
+    if (epollFd == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 ||
+        fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0) {
+        printf("ERROR: Could not create the UART: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    peerFd = fds[1];
+
+    const struct timespec disabled = {0, 0};
+    if (MessageProtocol_Init(epollFd, fds[0]) != ExitCode_Success ||
+        CreateTimerFdAndAddToEpoll(epollFd, &disabled, &deadlineEventData, EPOLLIN) == -1) {
+        printf("ERROR: Could not initialize the message protocol.\n");
+        return EXIT_FAILURE;
+    }
+    WifiConfigMessageProtocol_Init();
+
+    printf("%-40s %8s %8s %12s\n", "scan", "networks", "sent", "round trips");
+    TestDuplicateNetworks();
+    TestTooManyNetworks();
+    TestNoNetworks();
+
+    WifiConfigMessageProtocol_Cleanup();
+    MessageProtocol_Cleanup();
+    CloseFdAndPrintError(deadlineEventData.fd, "Deadline");
+    close(fds[0]);
+    close(fds[1]);
+    close(epollFd);
+
+    if (failures != 0) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All tests passed\n");
+    return EXIT_SUCCESS;
+}
@@ -343,6 +343,11 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return localExitCode;
     }
 
+    // The nRF52 forwards Wi-Fi and device control requests over BLE to the companion app, which
+    // expects each request in its own notification and answers them strictly in turn, and the
+    // nRF52 assembles one UART message at a time. Send one request at a time.
+    MessageProtocol_SetWindowSize(1);
+
     BleControlMessageProtocol_Init(BleStateChangeHandler, epollFd);
     WifiConfigMessageProtocol_Init();
     DeviceControlMessageProtocol_Init(SetDeviceControlLedStatusHandler,
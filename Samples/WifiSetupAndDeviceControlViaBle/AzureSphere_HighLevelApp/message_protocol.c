@@ -22,14 +22,17 @@
 // File descriptors - initialized to invalid value.
 static int epollFdRef = -1;
 static int messageUartFd = -1;
-static int sendRequestMessageTimerFd = -1;
 
 // Buffer for data received via UART and index at which to write future data.
 static uint8_t receiveBuffer[UART_RECEIVED_BUFFER_SIZE];
 static uint16_t receiveBufferPos = 0;
 
-// Buffer for data to be writtern via UART.
-static uint8_t sendBuffer[UART_SEND_BUFFER_SIZE];
+// Buffer in which to assemble a request message.
+static uint8_t _Alignas(MessageProtocol_RequestMessage) requestBuffer[UART_SEND_BUFFER_SIZE];
+
+// Buffer for data to be written via UART. Each request message is appended to it, so a request
+// can be sent while an earlier one is still being written.
+static uint8_t sendBuffer[UART_SEND_BUFFER_SIZE * MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
 
 // Total amount of data in sendBuffer.
 static size_t sendBufferDataLength = 0;
@@ -37,19 +40,27 @@ static size_t sendBufferDataLength = 0;
 // Amount of data so far written to the UART.
 static size_t sendBufferDataSent = 0;
 
-// Message protocol states.
-typedef enum {
-    MessageProtocolState_Idle,
-    MessageProtocolState_RequestOutstanding
-} MessageProtocolState;
-
-// Current state of the message protocol.
-static MessageProtocolState protocolState;
-
 // True if the EPOLLOUT event is registered for the UART fd; false if not.
 static bool uartFdEpolloutEnabled = false;
 
-static MessageProtocol_ResponseHandlerType currentResponseHandler;
+// A request which has been sent, and whose response has not been received yet. Responses are
+// matched to requests by sequence number, so they can arrive in any order.
+typedef struct {
+    bool inUse;
+    uint16_t sequenceNumber;
+    MessageProtocol_CategoryId categoryId;
+    MessageProtocol_RequestId requestId;
+    MessageProtocol_ResponseHandlerType responseHandler;
+    // Times out this request.
+    int timeoutTimerFd;
+    EventData timeoutEventData;
+} OutstandingRequest;
+
+static OutstandingRequest outstandingRequests[MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS];
+static size_t outstandingRequestCount = 0;
+
+// Maximum number of requests which can be outstanding at once.
+static size_t windowSize = MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS;
 
 // Request sequence number
 static uint16_t currentSequenceNumber = 0;
@@ -70,6 +81,31 @@ struct IdleHandlerNode {
 };
 static struct IdleHandlerNode *idleHandlerList;
 
+static OutstandingRequest *FindOutstandingRequest(uint16_t sequenceNumber)
+{
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (outstandingRequests[i].inUse &&
+            outstandingRequests[i].sequenceNumber == sequenceNumber) {
+            return &outstandingRequests[i];
+        }
+    }
+    return NULL;
+}
+
+static MessageProtocol_ResponseHandlerType CompleteOutstandingRequest(OutstandingRequest *request)
+{
+    // The slot is released before the response handler is called, so the handler can send
+    // another request.
+    struct timespec disabled = {0, 0};
+    SetTimerFdToPeriod(request->timeoutTimerFd, &disabled);
+    request->inUse = false;
+    --outstandingRequestCount;
+
+    MessageProtocol_ResponseHandlerType handler = request->responseHandler;
+    request->responseHandler = NULL;
+    return handler;
+}
+
 static void RemoveFirstCompleteMessage(void)
 {
     MessageProtocol_MessageHeader *messageHeader = (MessageProtocol_MessageHeader *)receiveBuffer;
@@ -130,9 +166,9 @@ static MessageProtocol_EventInfo *GetEventInfo(uint8_t *message, uint16_t messag
 
 static void CallIdleHandlers(void)
 {
-    // Call all registered idle handlers as long as protocol state is still idle.
+    // Call all registered idle handlers as long as no request has been sent by one of them.
     struct IdleHandlerNode *current = idleHandlerList;
-    while (current != NULL && protocolState == MessageProtocolState_Idle) {
+    while (current != NULL && outstandingRequestCount == 0) {
         current->handler();
         current = current->nextNode;
     }
@@ -172,22 +208,15 @@ static void CallResponseHandler(void)
         return;
     }
 
-    if (currentSequenceNumber != responseMessage->responseHeader.sequenceNumber) {
+    OutstandingRequest *request =
+        FindOutstandingRequest(responseMessage->responseHeader.sequenceNumber);
+    if (request == NULL) {
         Log_Debug("ERROR: Received a response with invalid sequence number: %x.\n",
                   responseMessage->responseHeader.sequenceNumber);
         return;
     }
 
-    if (protocolState != MessageProtocolState_RequestOutstanding) {
-        Log_Debug("ERROR: Received a response when not expecting one\n");
-        return;
-    }
-    protocolState = MessageProtocolState_Idle;
-    struct timespec disabled = {0, 0};
-    SetTimerFdToPeriod(sendRequestMessageTimerFd, &disabled);
-
-    MessageProtocol_ResponseHandlerType handler = currentResponseHandler;
-    currentResponseHandler = NULL;
+    MessageProtocol_ResponseHandlerType handler = CompleteOutstandingRequest(request);
 
     if (handler != NULL) {
         size_t dataLength =
@@ -198,7 +227,9 @@ static void CallResponseHandler(void)
                 responseMessage->responseHeader.responseResult, false);
     }
 
-    CallIdleHandlers();
+    if (outstandingRequestCount == 0) {
+        CallIdleHandlers();
+    }
 }
 
 static void HandleReceivedMessage(EventData *eventData)
@@ -235,28 +266,37 @@ static void HandleReceivedMessage(EventData *eventData)
 
 static void RequestTimeoutEventHandler(EventData *eventData)
 {
-    if (ConsumeTimerFdEvent(sendRequestMessageTimerFd) != 0) {
+    if (ConsumeTimerFdEvent(eventData->fd) != 0) {
+        return;
+    }
+
+    OutstandingRequest *request = NULL;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (&outstandingRequests[i].timeoutEventData == eventData && outstandingRequests[i].inUse) {
+            request = &outstandingRequests[i];
+            break;
+        }
+    }
+    if (request == NULL) {
         return;
     }
 
-    // Timed out waiting for response message: change back to Idle state and call the response
-    // handler to inform it that the request has timed out.
-    protocolState = MessageProtocolState_Idle;
-    MessageProtocol_ResponseHandlerType handler = currentResponseHandler;
-    currentResponseHandler = NULL;
+    // Timed out waiting for response message: release the request and call the response
+    // handler to inform it that the request has timed out. Other requests are unaffected.
+    MessageProtocol_CategoryId categoryId = request->categoryId;
+    MessageProtocol_RequestId requestId = request->requestId;
+    MessageProtocol_ResponseHandlerType handler = CompleteOutstandingRequest(request);
     if (handler != NULL) {
-        MessageProtocol_RequestMessage *requestMessage =
-            (MessageProtocol_RequestMessage *)sendBuffer;
-        handler(requestMessage->requestHeader.categoryId, requestMessage->requestHeader.requestId,
-                NULL, 0, 0, true);
+        handler(categoryId, requestId, NULL, 0, 0, true);
     }
 
-    // We are idle now, so call the idle handlers.
-    CallIdleHandlers();
+    // If we are idle now, call the idle handlers.
+    if (outstandingRequestCount == 0) {
+        CallIdleHandlers();
+    }
 }
 
 static void SendUartMessage(EventData *eventData);
-static EventData requestTimeoutEventData = {.eventHandler = &RequestTimeoutEventHandler};
 static EventData uartReceivedEventData = {.eventHandler = &HandleReceivedMessage};
 static EventData uartSendEventData = {.eventHandler = &SendUartMessage};
 
@@ -296,16 +336,23 @@ ExitCode MessageProtocol_Init(int epollFd, int uartFd)
         return ExitCode_MsgProtoInit_UartHandler;
     }
 
-    // Set up request timeout timer, for later use.
+    // Set up a timeout timer for each request slot, for later use.
     struct timespec disabled = {0, 0};
-    sendRequestMessageTimerFd =
-        CreateTimerFdAndAddToEpoll(epollFd, &disabled, &requestTimeoutEventData, EPOLLIN);
-    if (sendRequestMessageTimerFd == -1) {
-        return ExitCode_MsgProtoInit_Timer;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        outstandingRequests[i] = (OutstandingRequest){
+            .inUse = false,
+            .timeoutTimerFd = -1,
+            .timeoutEventData = {.eventHandler = &RequestTimeoutEventHandler}};
+        outstandingRequests[i].timeoutTimerFd = CreateTimerFdAndAddToEpoll(
+            epollFd, &disabled, &outstandingRequests[i].timeoutEventData, EPOLLIN);
+        if (outstandingRequests[i].timeoutTimerFd == -1) {
+            return ExitCode_MsgProtoInit_Timer;
+        }
     }
 
-    protocolState = MessageProtocolState_Idle;
-    currentResponseHandler = NULL;
+    outstandingRequestCount = 0;
+    sendBufferDataLength = 0;
+    sendBufferDataSent = 0;
     eventHandlerList = NULL;
     idleHandlerList = NULL;
     return ExitCode_Success;
@@ -313,7 +360,14 @@ ExitCode MessageProtocol_Init(int epollFd, int uartFd)
 
 void MessageProtocol_Cleanup(void)
 {
-    CloseFdAndPrintError(sendRequestMessageTimerFd, "SendRequestMessageTimer");
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (outstandingRequests[i].timeoutTimerFd != -1) {
+            CloseFdAndPrintError(outstandingRequests[i].timeoutTimerFd, "RequestTimeoutTimer");
+        }
+        outstandingRequests[i] = (OutstandingRequest){.inUse = false, .timeoutTimerFd = -1};
+    }
+    outstandingRequestCount = 0;
+
     // Free all event handlers in the list.
     struct EventHandlerNode *currentEventHandler = NULL;
     while (eventHandlerList != NULL) {
@@ -357,13 +411,22 @@ void MessageProtocol_SendRequest(MessageProtocol_CategoryId categoryId,
                                  size_t bodyLength,
                                  MessageProtocol_ResponseHandlerType responseHandler)
 {
-    if (protocolState != MessageProtocolState_Idle) {
+    if (outstandingRequestCount >= windowSize) {
         Log_Debug("INFO: Protocol busy, can't send request: %x, %x.\n", categoryId, requestId);
         return;
     }
 
+    OutstandingRequest *request = NULL;
+    for (size_t i = 0; i < MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS; ++i) {
+        if (!outstandingRequests[i].inUse) {
+            request = &outstandingRequests[i];
+            break;
+        }
+    }
+
     // Set request message data in-place.
-    MessageProtocol_RequestMessage *requestMessage = (MessageProtocol_RequestMessage *)sendBuffer;
+    MessageProtocol_RequestMessage *requestMessage =
+        (MessageProtocol_RequestMessage *)requestBuffer;
     memcpy(requestMessage->requestHeader.messageHeaderWithType.messageHeader.preamble,
            MessageProtocol_MessagePreamble, sizeof(MessageProtocol_MessagePreamble));
     requestMessage->requestHeader.messageHeaderWithType.messageHeader.length =
@@ -386,19 +449,48 @@ void MessageProtocol_SendRequest(MessageProtocol_CategoryId categoryId,
     }
     memcpy(requestMessage->data, body, bodyLength);
 
-    currentResponseHandler = responseHandler;
-    sendBufferDataLength = messageLength;
-    sendBufferDataSent = 0;
+    // Once all the data in the send buffer has been written, start again at its beginning.
+    if (sendBufferDataSent == sendBufferDataLength) {
+        sendBufferDataLength = 0;
+        sendBufferDataSent = 0;
+    }
+    if (messageLength > sizeof(sendBuffer) - sendBufferDataLength) {
+        Log_Debug("ERROR: UART send buffer is full, can't send request: %x, %x.\n", categoryId,
+                  requestId);
+        return;
+    }
+    memcpy(sendBuffer + sendBufferDataLength, requestBuffer, messageLength);
+    sendBufferDataLength += messageLength;
+
+    request->inUse = true;
+    request->sequenceNumber = requestMessage->requestHeader.sequenceNumber;
+    request->categoryId = categoryId;
+    request->requestId = requestId;
+    request->responseHandler = responseHandler;
+    ++outstandingRequestCount;
 
     // Start timer for response to this request.
     const struct timespec sendRequestMessageCheckPeriod = {REQUEST_TIMEOUT, 0};
-    SetTimerFdToSingleExpiry(sendRequestMessageTimerFd, &sendRequestMessageCheckPeriod);
-    protocolState = MessageProtocolState_RequestOutstanding;
+    SetTimerFdToSingleExpiry(request->timeoutTimerFd, &sendRequestMessageCheckPeriod);
 
-    SendUartMessage(NULL);
+    // If an earlier message is still waiting for the UART, the EPOLLOUT handler sends this one
+    // after it.
+    if (!uartFdEpolloutEnabled) {
+        SendUartMessage(NULL);
+    }
+}
+
+void MessageProtocol_SetWindowSize(size_t size)
+{
+    if (size == 0 || size > MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS) {
+        Log_Debug("ERROR: Invalid window size %zu; it must be between 1 and %u.\n", size,
+                  MESSAGE_PROTOCOL_MAX_OUTSTANDING_REQUESTS);
+        return;
+    }
+    windowSize = size;
 }
 
 bool MessageProtocol_IsIdle(void)
 {
-    return (protocolState == MessageProtocolState_Idle);
+    return (outstandingRequestCount == 0);
 }
\ No newline at end of file
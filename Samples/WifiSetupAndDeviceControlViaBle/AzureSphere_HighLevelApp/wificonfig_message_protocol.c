@@ -6,6 +6,7 @@
 #include "wificonfig_message_protocol.h"
 #include "wificonfig_message_protocol_defs.h"
 #include "message_protocol.h"
+#include "message_protocol_private.h"
 #include "applibs_versions.h"
 #include <applibs/wificonfig.h>
 #include <applibs/networking.h>
@@ -24,6 +25,18 @@ static WifiConfigureMessageProtocol_WifiScanResultRequestStruct
     foundAPs[MAX_AP_COUNT_FOUND_BY_SCAN];
 static uint8_t foundAccessPointsCount = 0;
 static uint8_t currentAccessPointIndex = 0;
+
+// Hash table which maps the SSID and security type of a found access point to its index in
+// foundAPs, so scanned networks can be collapsed in a single pass. Each entry holds the index
+// plus one, or 0 if it is empty. The table is kept under half full, so probe sequences are short.
+#define FOUND_AP_TABLE_SIZE 64u
+static uint8_t foundAPTable[FOUND_AP_TABLE_SIZE];
+
+_Static_assert(sizeof(WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct) <=
+                   MAX_REQUEST_DATA_SIZE,
+               "A batch of scan results does not fit in a request message.");
+_Static_assert(MAX_AP_COUNT_FOUND_BY_SCAN * 2 <= FOUND_AP_TABLE_SIZE,
+               "The found access point table is too small.");
 static const char wifiInterface[] = "wlan0";
 
 // Wi-Fi response handlers
@@ -91,8 +104,8 @@ static void GetNewWifiDetailsResponseHandler(MessageProtocol_CategoryId category
         case WifiConfig_Security_Wpa2_Psk:
             configResult = WifiConfig_SetSecurityType(networkId, WifiConfig_Security_Wpa2_Psk);
             if (configResult != -1) {
-                configResult =
-                    WifiConfig_SetPSK(networkId, newWifiDetails->psk, newWifiDetails->pskLength);
+                configResult = WifiConfig_SetPSK(networkId, (const char *)newWifiDetails->psk,
+                                                 newWifiDetails->pskLength);
             }
             break;
 
@@ -138,7 +151,7 @@ static void GetNewWifiDetailsResponseHandler(MessageProtocol_CategoryId category
                                 &SetWifiOperationResultResponseHandler);
 }
 
-static void SendSetNextWiFiScanResultRequest(void);
+static void SendSetWifiScanResultsBatchRequest(void);
 
 static void SetWifiScanResultsSummaryResponseHandler(MessageProtocol_CategoryId categoryId,
                                                      MessageProtocol_RequestId requestId,
@@ -161,7 +174,7 @@ static void SetWifiScanResultsSummaryResponseHandler(MessageProtocol_CategoryId
     Log_Debug("INFO: \"Set Wi-Fi Scan Results Summary\" succeeded.\n");
 
     if (foundAccessPointsCount > 0) {
-        SendSetNextWiFiScanResultRequest();
+        SendSetWifiScanResultsBatchRequest();
     }
 }
 
@@ -183,14 +196,14 @@ static void SetWifiStatusResponseHandler(MessageProtocol_CategoryId categoryId,
     Log_Debug("INFO: \"Set Wi-Fi Status\" succeeded.\n");
 }
 
-static void SetNextWifiScanResultResponseHandler(MessageProtocol_CategoryId categoryId,
-                                                 MessageProtocol_RequestId requestId,
-                                                 const uint8_t *data, size_t dataSize,
-                                                 MessageProtocol_ResponseResult result,
-                                                 bool timedOut)
+static void SetWifiScanResultsBatchResponseHandler(MessageProtocol_CategoryId categoryId,
+                                                   MessageProtocol_RequestId requestId,
+                                                   const uint8_t *data, size_t dataSize,
+                                                   MessageProtocol_ResponseResult result,
+                                                   bool timedOut)
 {
     if (timedOut) {
-        Log_Debug("ERROR: Timed out waiting for \"Set Next Wi-Fi Scan Result\" response.\n");
+        Log_Debug("ERROR: Timed out waiting for \"Set Wi-Fi Scan Results Batch\" response.\n");
         foundAccessPointsCount = 0;
         currentAccessPointIndex = 0;
         return;
@@ -198,12 +211,12 @@ static void SetNextWifiScanResultResponseHandler(MessageProtocol_CategoryId cate
 
     // This response contains no data, so check its result to see whether the request was successful
     if (result != 0) {
-        Log_Debug("ERROR: \"Set Next Wi-Fi Scan Result\" failed with error code: %d.\n", result);
+        Log_Debug("ERROR: \"Set Wi-Fi Scan Results Batch\" failed with error code: %d.\n", result);
         return;
     }
-    Log_Debug("INFO: \"Set Next Wi-Fi Scan Result\" succeeded.\n");
+    Log_Debug("INFO: \"Set Wi-Fi Scan Results Batch\" succeeded.\n");
     if (foundAccessPointsCount > 0 && currentAccessPointIndex < foundAccessPointsCount) {
-        SendSetNextWiFiScanResultRequest();
+        SendSetWifiScanResultsBatchRequest();
     }
 }
 
@@ -284,6 +297,17 @@ static void WifiStatusNeededEventHandler(MessageProtocol_CategoryId categoryId,
     }
 }
 
+static uint32_t HashAccessPoint(const WifiConfig_ScannedNetwork *network)
+{
+    // FNV-1a over the security type and the SSID.
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ network->security) * 16777619u;
+    for (size_t i = 0; i < network->ssidLength; ++i) {
+        hash = (hash ^ network->ssid[i]) * 16777619u;
+    }
+    return hash;
+}
+
 static bool IsSameAccessPoint(
     const WifiConfigureMessageProtocol_WifiScanResultRequestStruct *target,
     const WifiConfig_ScannedNetwork *source)
@@ -306,27 +330,38 @@ static void SetScannedNetwork(WifiConfigureMessageProtocol_WifiScanResultRequest
 static uint8_t CollapseNetworks(const WifiConfig_ScannedNetwork *target, size_t count)
 {
     uint8_t scannedNetworksCount = 0;
+    bool truncated = false;
+    memset(foundAPTable, 0, sizeof(foundAPTable));
+
     for (size_t i = 0; i < count; ++i) {
-        bool found = false;
-        for (size_t j = 0; j < scannedNetworksCount; ++j) {
-            if (IsSameAccessPoint(foundAPs + j, target + i)) {
-                if (foundAPs[j].signalRssi < target[i].signalRssi) {
-                    foundAPs[j].signalRssi = target[i].signalRssi;
-                }
-                found = true;
-                break;
-            }
+        // Find the access point's entry in the table, or the empty entry where it belongs.
+        size_t slot = HashAccessPoint(target + i) % FOUND_AP_TABLE_SIZE;
+        while (foundAPTable[slot] != 0 &&
+               !IsSameAccessPoint(foundAPs + foundAPTable[slot] - 1, target + i)) {
+            slot = (slot + 1) % FOUND_AP_TABLE_SIZE;
         }
-        if (!found) {
-            if (scannedNetworksCount >= MAX_AP_COUNT_FOUND_BY_SCAN) {
-                Log_Debug("INFO: Returning only the first %d networks found by scan.\n",
-                          MAX_AP_COUNT_FOUND_BY_SCAN);
-                break;
+
+        if (foundAPTable[slot] != 0) {
+            // Keep the strongest signal of all the networks for this access point.
+            WifiConfigureMessageProtocol_WifiScanResultRequestStruct *found =
+                foundAPs + foundAPTable[slot] - 1;
+            if (found->signalRssi < target[i].signalRssi) {
+                found->signalRssi = target[i].signalRssi;
             }
+        } else if (scannedNetworksCount >= MAX_AP_COUNT_FOUND_BY_SCAN) {
+            // Networks for access points which have been found are still collapsed.
+            truncated = true;
+        } else {
             SetScannedNetwork(foundAPs + scannedNetworksCount, target + i);
             ++scannedNetworksCount;
+            foundAPTable[slot] = scannedNetworksCount;
         }
     }
+
+    if (truncated) {
+        Log_Debug("INFO: Returning only the first %d networks found by scan.\n",
+                  MAX_AP_COUNT_FOUND_BY_SCAN);
+    }
     return scannedNetworksCount;
 }
 
@@ -377,18 +412,30 @@ static void SendSetWifiScanResultsSummaryRequestNeeded(void)
                                 &SetWifiScanResultsSummaryResponseHandler);
 }
 
-static void SendSetNextWiFiScanResultRequest(void)
+static void SendSetWifiScanResultsBatchRequest(void)
 {
     if (currentAccessPointIndex < foundAccessPointsCount) {
-        Log_Debug("INFO: Sending request: \"Set Next Wi-Fi Scan Result\" (%d).\n",
-                  currentAccessPointIndex);
+        // Send as many of the remaining access points as fit in one request.
+        WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct batch;
+        memset(&batch, 0, sizeof(batch));
+        batch.firstIndex = currentAccessPointIndex;
+        batch.networkCount = (uint8_t)(foundAccessPointsCount - currentAccessPointIndex);
+        if (batch.networkCount > WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH) {
+            batch.networkCount = WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH;
+        }
+        memcpy(batch.networks, &foundAPs[currentAccessPointIndex],
+               batch.networkCount * sizeof(batch.networks[0]));
+
+        Log_Debug("INFO: Sending request: \"Set Wi-Fi Scan Results Batch\" (%d-%d).\n",
+                  currentAccessPointIndex, currentAccessPointIndex + batch.networkCount - 1);
         MessageProtocol_SendRequest(
             MessageProtocol_WifiConfigCategoryId,
-            WifiConfigureMessageProtocol_SetNextWiFiScanResultRequestId,
-            (const uint8_t *)&foundAPs[currentAccessPointIndex],
-            sizeof(WifiConfigureMessageProtocol_WifiScanResultRequestStruct),
-            &SetNextWifiScanResultResponseHandler);
-        ++currentAccessPointIndex;
+            WifiConfigureMessageProtocol_SetWifiScanResultsBatchRequestId,
+            (const uint8_t *)&batch,
+            offsetof(WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct, networks) +
+                batch.networkCount * sizeof(batch.networks[0]),
+            &SetWifiScanResultsBatchResponseHandler);
+        currentAccessPointIndex = (uint8_t)(currentAccessPointIndex + batch.networkCount);
     } else {
         Log_Debug("ERROR: Invalid index (%d) for scanned network result.\n",
                   currentAccessPointIndex);
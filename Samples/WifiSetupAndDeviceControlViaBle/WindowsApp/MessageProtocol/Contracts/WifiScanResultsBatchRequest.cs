@@ -0,0 +1,44 @@
+﻿// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+namespace Microsoft.Azure.Sphere.Samples.WifiSetupAndDeviceControlViaBle.MessageProtocol.Contracts
+{
+    using System;
+
+    public sealed class WifiScanResultsBatchRequest : RequestBase
+    {
+        private const int HeaderLength = 4;
+        private const int NetworkLength = 36;
+
+        internal WifiScanResultsBatchRequest(WifiRequestId wifiRequestType, uint sequenceId, byte[] payload)
+            : base(CategoryIdType.WifiControl, (ushort)wifiRequestType, sequenceId, payload, payload?.Length ?? HeaderLength)
+        {
+            /* Data format:
+             * 
+             * - 00 [  1 ] Index of the first network in this batch
+             * - 01 [  1 ] Number of networks in this batch
+             * - 02 [  2 ] Reserved
+             * - 04 [ 36 ] Network, in the format of the "Set Next Wi-Fi Scan Result" request,
+             *             repeated for each network in this batch
+             */
+
+            if (payload.Length < HeaderLength || payload.Length != HeaderLength + payload[1] * NetworkLength)
+            {
+                throw new ArgumentOutOfRangeException(nameof(payload), $"Payload of {payload.Length} bytes does not match its network count.");
+            }
+
+            FirstIndex = payload[0];
+            Networks = new WifiScanResultRequest[payload[1]];
+
+            for (uint i = 0; i < Networks.Length; i++)
+            {
+                byte[] network = ByteArrayHelper.ReadBytes(payload, HeaderLength + i * NetworkLength, NetworkLength);
+                Networks[i] = new WifiScanResultRequest(wifiRequestType, sequenceId, network);
+            }
+        }
+
+        public byte FirstIndex { get; }
+
+        public WifiScanResultRequest[] Networks { get; }
+    }
+}
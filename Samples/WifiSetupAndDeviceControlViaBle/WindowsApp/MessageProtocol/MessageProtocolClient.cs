@@ -206,19 +206,36 @@ namespace Microsoft.Azure.Sphere.Samples.WifiSetupAndDeviceControlViaBle.Message
 
         private async void WifiScanResultRequest_NotificationReceived(object sender, NotifyEventArgs e)
         {
-            if (MessageProtocolFactory.ReadRequestMessagePayload(e.Data) is WifiScanResultRequest wifiScanResultRequest)
+            RequestBase request = MessageProtocolFactory.ReadRequestMessagePayload(e.Data);
+            WifiScanResultRequest[] networks;
+
+            if (request is WifiScanResultRequest wifiScanResultRequest)
+            {
+                networks = new[] { wifiScanResultRequest };
+            }
+            else if (request is WifiScanResultsBatchRequest wifiScanResultsBatchRequest)
             {
-                Debug.WriteLine($"Received Wi-Fi config message protocol request: '{wifiScanResultRequest.RequestType}'");
+                // The device sends several networks in each request to save round trips.
+                networks = wifiScanResultsBatchRequest.Networks;
+            }
+            else
+            {
+                return;
+            }
 
+            Debug.WriteLine($"Received Wi-Fi config message protocol request: '{request.RequestType}'");
+
+            foreach (WifiScanResultRequest network in networks)
+            {
                 actualWifiNetworkCount++;
-                WifiNetworkScanReceived?.Invoke(this, new WifiScanRequestEventArgs(wifiScanResultRequest, actualWifiNetworkCount, expectedWifiNetworkCount));
+                WifiNetworkScanReceived?.Invoke(this, new WifiScanRequestEventArgs(network, actualWifiNetworkCount, expectedWifiNetworkCount));
+            }
 
-                await SendResponseAsync(currentService, wifiScanResultRequest, 0x00);
+            await SendResponseAsync(currentService, request, 0x00);
 
-                if (actualWifiNetworkCount == expectedWifiNetworkCount)
-                {
-                    bluetoothLeHelper.NotificationReceived -= WifiScanResultRequest_NotificationReceived;
-                }
+            if (actualWifiNetworkCount >= expectedWifiNetworkCount)
+            {
+                bluetoothLeHelper.NotificationReceived -= WifiScanResultRequest_NotificationReceived;
             }
         }
 
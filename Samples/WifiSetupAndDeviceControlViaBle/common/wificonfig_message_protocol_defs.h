@@ -23,6 +23,10 @@ static const MessageProtocol_RequestId
 static const MessageProtocol_RequestId WifiConfigureMessageProtocol_SetNextWiFiScanResultRequestId =
     0x0005;
 
+/// <summary>Request ID for a Set Wi-Fi Scan Results Batch request message.</summary>
+static const MessageProtocol_RequestId
+    WifiConfigureMessageProtocol_SetWifiScanResultsBatchRequestId = 0x0006;
+
 /// <summary>Event ID for a New Wi-Fi Details Available event message.</summary>
 static const MessageProtocol_EventId WifiConfigureMessageProtocol_NewWiFiDetailsAvailableEventId =
     0x0001;
@@ -154,3 +158,28 @@ typedef struct {
     /// <summary>The SSID for this network, as a fixed-length array of bytes.</summary>
     uint8_t ssid[32];
 } WifiConfigureMessageProtocol_WifiScanResultRequestStruct;
+
+/// <summary>
+///     Maximum number of networks in a
+///     <see cref="WifiConfigureMessageProtocol_SetWifiScanResultsBatchRequestId"/> request
+///     message. This many results and the batch header fit in a request message body.
+/// </summary>
+#define WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH 6
+
+/// <summary>
+///     Data structure for the body of a
+///     <see cref="WifiConfigureMessageProtocol_SetWifiScanResultsBatchRequestId"/> request
+///     message. This structure describes consecutive networks as found during a network scan.
+///     Only the first networkCount networks are sent.
+/// </summary>
+typedef struct {
+    /// <summary>Index in the scan results of the first network in this batch.</summary>
+    uint8_t firstIndex;
+    /// <summary>Number of networks in this batch.</summary>
+    uint8_t networkCount;
+    /// <summary>Reserved; must all be 0.</summary>
+    uint8_t reserved[2];
+    /// <summary>The networks.</summary>
+    WifiConfigureMessageProtocol_WifiScanResultRequestStruct
+        networks[WIFICONFIG_MAX_SCAN_RESULTS_PER_BATCH];
+} WifiConfigureMessageProtocol_WifiScanResultsBatchRequestStruct;